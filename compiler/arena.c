@@ -0,0 +1,61 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "arena.h"
+#include "mem.h"
+
+#define ARENA_BLOCK_SIZE (64 * 1024)
+
+struct ArenaBlock {
+    ArenaBlock *next;
+    size_t used;
+    size_t cap;
+    char data[];
+};
+
+void *arena_alloc(Arena *a, size_t size) {
+    size = (size + 7) & ~(size_t)7;   // keep pointers aligned
+
+    ArenaBlock *b = a->head;
+    if (!b || b->used + size > b->cap) {
+        size_t cap = size > ARENA_BLOCK_SIZE ? size : ARENA_BLOCK_SIZE;
+        b = xmalloc(sizeof(ArenaBlock) + cap);
+        b->used = 0;
+        b->cap = cap;
+        b->next = a->head;
+        a->head = b;
+    }
+
+    void *p = b->data + b->used;
+    b->used += size;
+    a->total += size;
+    memset(p, 0, size);
+    return p;
+}
+
+char *arena_strndup(Arena *a, const char *s, size_t len) {
+    char *p = arena_alloc(a, len + 1);
+    memcpy(p, s, len);
+    p[len] = '\0';
+    return p;
+}
+
+void *arena_grow(Arena *a, void *items, size_t item_size, int *cap) {
+    int new_cap = *cap ? *cap * 2 : 16;
+    void *p = arena_alloc(a, (size_t)new_cap * item_size);
+    if (items) memcpy(p, items, (size_t)*cap * item_size);
+    *cap = new_cap;
+    return p;
+}
+
+void arena_free(Arena *a) {
+    ArenaBlock *b = a->head;
+    while (b) {
+        ArenaBlock *next = b->next;
+        xfree(b);
+        b = next;
+    }
+    a->head = NULL;
+    a->total = 0;
+}
@@ -0,0 +1,24 @@
+#ifndef ARENA_H
+#define ARENA_H
+
+#include <stddef.h>
+
+// Bump allocator: many small allocations, one free at the end.
+typedef struct ArenaBlock ArenaBlock;
+
+typedef struct {
+    ArenaBlock *head;
+    size_t total;       // bytes handed out so far
+} Arena;
+
+void *arena_alloc(Arena *a, size_t size);
+char *arena_strndup(Arena *a, const char *s, size_t len);
+void arena_free(Arena *a);
+
+// Grow an array living in the arena: doubles *cap and copies the items over.
+// The old copy stays behind, so the waste is bounded by the final size.
+void *arena_grow(Arena *a, void *items, size_t item_size, int *cap);
+
+#define ARENA_NEW(a, type) ((type *)arena_alloc((a), sizeof(type)))
+
+#endif // ARENA_H
@@ -0,0 +1,98 @@
+#ifndef AST_H
+#define AST_H
+
+// Program tree built by the parser. Nodes live in the parser's arenas.
+// Codegen fills in the resolved labels before any code is written.
+
+typedef enum {
+    EXPR_NUMBER,    // 42, -3
+    EXPR_REG,       // w0, x3 (used as-is)
+    EXPR_VAR,       // num variable
+    EXPR_STRING,    // "text" (print only)
+    EXPR_MEM,       // [sp, #4] (setr/setm only, kept as written)
+    EXPR_BINARY     // a <op> b
+} ExprKind;
+
+typedef enum {
+    OP_ADD,
+    OP_SUB,
+    OP_MUL,
+    OP_DIV
+} BinOp;
+
+typedef enum {
+    CMP_LT,
+    CMP_GT,
+    CMP_EQ,
+    CMP_NE,
+    CMP_LE,
+    CMP_GE
+} CmpOp;
+
+typedef struct Expr Expr;
+struct Expr {
+    ExprKind kind;
+    const char *name;   // interned: number spelling, register, variable, string body
+    long value;         // EXPR_NUMBER, EXPR_STRING: length once escapes are resolved (set by codegen)
+    BinOp op;           // EXPR_BINARY
+    Expr *lhs;
+    Expr *rhs;
+    const char *text;   // EXPR_MEM: slice of the source
+    int len;
+    Expr *next;         // argument / parameter lists
+
+    const char *label;  // set by codegen: data label of a variable or string
+};
+
+typedef enum {
+    STMT_NUM,       // num dest = value
+    STMT_ASSIGN,    // dest = value (dest is a variable or register)
+    STMT_LOOP,      // loop value { body }
+    STMT_IF,        // if lhs cmp rhs { body } else { else_body }
+    STMT_PRINT,     // print(value)
+    STMT_CALL,      // bl callee(args)
+    STMT_EXIT,      // exit(...)
+    STMT_SETR,      // setr dest, value
+    STMT_SETM,      // setm dest, value
+    STMT_RAW        // anything else is passed through as assembly
+} StmtKind;
+
+typedef struct Stmt Stmt;
+struct Stmt {
+    StmtKind kind;
+    int line;
+    Stmt *next;
+
+    Expr *dest;
+    Expr *value;
+
+    CmpOp cmp;
+    Expr *lhs;
+    Expr *rhs;
+
+    Stmt *body;
+    Stmt *else_body;
+
+    const char *callee;
+    Expr *args;
+
+    const char *text;   // STMT_RAW: slice of the source
+    int len;
+
+    int seq;            // set by codegen: STMT_LOOP / STMT_IF label number
+};
+
+typedef struct Func Func;
+struct Func {
+    const char *name;
+    int line;
+    Expr *params;       // EXPR_VAR list
+    Stmt *body;
+    Func *next;
+};
+
+typedef struct {
+    Func *funcs;        // in source order
+} Program;
+
+#endif // AST_H
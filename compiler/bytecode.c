@@ -0,0 +1,391 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdbool.h>
+#include <sys/mman.h>
+
+#include "bytecode.h"
+#include "codegen.h"
+#include "errors.h"
+#include "lexer.h"
+#include "mem.h"
+
+// 64-bit key -> slot or code offset, open addressing; keys are interned
+// pointers (variables, functions, strings) or constant values
+typedef struct {
+    uint64_t *keys;
+    uint32_t *vals;     // value + 1, 0 for an empty entry
+    size_t cap, count;
+} Map;
+
+// a call to a function that may come later in the source
+typedef struct {
+    size_t at;          // code word holding the target
+    const char *callee;
+    int line;
+} Call;
+
+typedef struct {
+    Bytecode *bc;
+    bool hot_spots;
+    Map vars, consts, funcs, strings;
+    Call *calls;
+    int ncalls, call_cap;
+} Compiler;
+
+/* ---- maps ---- */
+
+static size_t map_hash(uint64_t key, size_t cap) {
+    return (size_t)((key * 0x9E3779B97F4A7C15ull) >> 32) & (cap - 1);
+}
+
+static uint32_t *map_find(Map *m, uint64_t key) {
+    if ((m->count + 1) * 2 > m->cap) {
+        Map old = *m;
+        m->cap = m->cap ? m->cap * 2 : 256;
+        m->keys = xcalloc(m->cap, sizeof(uint64_t));
+        m->vals = xcalloc(m->cap, sizeof(uint32_t));
+        for (size_t i = 0; i < old.cap; i++) {
+            if (!old.vals[i]) continue;
+            size_t h = map_hash(old.keys[i], m->cap);
+            while (m->vals[h]) h = (h + 1) & (m->cap - 1);
+            m->keys[h] = old.keys[i];
+            m->vals[h] = old.vals[i];
+        }
+        xfree(old.keys);
+        xfree(old.vals);
+    }
+    size_t h = map_hash(key, m->cap);
+    while (m->vals[h] && m->keys[h] != key) h = (h + 1) & (m->cap - 1);
+    m->keys[h] = key;
+    return &m->vals[h];
+}
+
+static void map_free(Map *m) {
+    xfree(m->keys);
+    xfree(m->vals);
+}
+
+/* ---- slots ---- */
+
+static uint32_t new_slot(Compiler *c, uint64_t init) {
+    Bytecode *bc = c->bc;
+    if (bc->nslots == bc->slot_cap) {
+        bc->slot_cap = bc->slot_cap ? bc->slot_cap * 2 : 256;
+        bc->init = xrealloc(bc->init, bc->slot_cap * sizeof(uint64_t));
+    }
+    bc->init[bc->nslots] = init;
+    return bc->nslots++;
+}
+
+// w3 and x3 are both slot 3
+static uint32_t reg_slot(const char *name, int line) {
+    char *end;
+    long n = strtol(name + 1, &end, 10);
+    if (*end || n < 0 || n >= BC_REGS)
+        error_fatal("Error: unknown register (line %d): %s\n", line, name);
+    return (uint32_t)n;
+}
+
+static uint32_t var_slot(Compiler *c, const char *label) {
+    uint32_t *v = map_find(&c->vars, (uint64_t)(uintptr_t)label);
+    if (!*v) {
+        c->vars.count++;
+        *v = new_slot(c, 0) + 1;
+
+        Bytecode *bc = c->bc;
+        if (bc->nvars == bc->var_cap) {
+            bc->var_cap = bc->var_cap ? bc->var_cap * 2 : 64;
+            bc->vars = xrealloc(bc->vars, bc->var_cap * sizeof(BcVar));
+        }
+        bc->vars[bc->nvars++] = (BcVar){ *v - 1, label };
+    }
+    return *v - 1;
+}
+
+static uint32_t const_slot(Compiler *c, long value) {
+    uint32_t *v = map_find(&c->consts, (uint64_t)value);
+    if (!*v) {
+        c->consts.count++;
+        *v = new_slot(c, (uint64_t)value) + 1;
+    }
+    return *v - 1;
+}
+
+// slot holding a number, register or variable
+static uint32_t operand(Compiler *c, const Expr *e, int line) {
+    switch (e->kind) {
+        case EXPR_NUMBER: return const_slot(c, e->value);
+        case EXPR_REG: return reg_slot(e->name, line);
+        case EXPR_VAR: return var_slot(c, e->label);
+        default:
+            error_fatal("Error: memory operands only work in native code (line %d)\n", line);
+    }
+    return 0;
+}
+
+/* ---- code ---- */
+
+static size_t put(Compiler *c, uint32_t word) {
+    Bytecode *bc = c->bc;
+    if (bc->len == bc->cap) {
+        bc->cap = bc->cap ? bc->cap * 2 : 4096;
+        bc->code = xrealloc(bc->code, bc->cap * sizeof(uint32_t));
+    }
+    bc->code[bc->len] = word;
+    return bc->len++;
+}
+
+static void op2(Compiler *c, BcOp op, uint32_t a, uint32_t b) {
+    put(c, op);
+    put(c, a);
+    put(c, b);
+}
+
+static void op3(Compiler *c, BcOp op, uint32_t a, uint32_t b, uint32_t d) {
+    put(c, op);
+    put(c, a);
+    put(c, b);
+    put(c, d);
+}
+
+static uint32_t here(const Compiler *c) {
+    return (uint32_t)c->bc->len;
+}
+
+static void patch(Compiler *c, size_t at, uint32_t target) {
+    c->bc->code[at] = target;
+}
+
+static BcOp math_op(BinOp op) {
+    switch (op) {
+        case OP_ADD: return BC_ADD;
+        case OP_SUB: return BC_SUB;
+        case OP_MUL: return BC_MUL;
+        case OP_DIV: return BC_DIV;
+    }
+    return BC_ADD;
+}
+
+// jump taken when the if condition is false
+static BcOp false_jump(CmpOp cmp) {
+    switch (cmp) {
+        case CMP_LT: return BC_JGE;
+        case CMP_GT: return BC_JLE;
+        case CMP_EQ: return BC_JNE;
+        case CMP_NE: return BC_JEQ;
+        case CMP_LE: return BC_JGT;
+        case CMP_GE: return BC_JLT;
+    }
+    return BC_JMP;
+}
+
+// dest = value; a 32-bit result, except x registers copied from an x
+// register or set to a number keep all 64 bits, as on the native targets
+static void assign(Compiler *c, uint32_t dest, bool wide, const Expr *value, int line) {
+    if (value->kind == EXPR_BINARY) {
+        op3(c, math_op(value->op), dest, operand(c, value->lhs, line), operand(c, value->rhs, line));
+        return;
+    }
+    bool wide_src = value->kind == EXPR_NUMBER || (value->kind == EXPR_REG && value->name[0] == 'x');
+    op2(c, wide && wide_src ? BC_MOV64 : BC_MOV, dest, operand(c, value, line));
+}
+
+static uint32_t dest_slot(Compiler *c, const Expr *dest, int line) {
+    return dest->kind == EXPR_REG ? reg_slot(dest->name, line) : var_slot(c, dest->label);
+}
+
+static bool is_wide(const Expr *dest) {
+    return dest->kind == EXPR_REG && dest->name[0] == 'x';
+}
+
+// print's string with the assembler's escapes resolved, once per literal
+static uint32_t string_index(Compiler *c, const char *text) {
+    uint32_t *v = map_find(&c->strings, (uint64_t)(uintptr_t)text);
+    if (*v) return *v - 1;
+    c->strings.count++;
+
+    Bytecode *bc = c->bc;
+    if (bc->nstr == bc->str_cap) {
+        bc->str_cap = bc->str_cap ? bc->str_cap * 2 : 64;
+        bc->str_off = xrealloc(bc->str_off, bc->str_cap * sizeof(uint32_t));
+        bc->str_len = xrealloc(bc->str_len, bc->str_cap * sizeof(uint32_t));
+    }
+    size_t start = bc->strings.len;
+    for (const char *p = text; *p;)
+        emit_char(&bc->strings, codegen_string_byte(&p));
+    bc->str_off[bc->nstr] = (uint32_t)start;
+    bc->str_len[bc->nstr] = (uint32_t)(bc->strings.len - start);
+    *v = (uint32_t)bc->nstr + 1;
+    return (uint32_t)bc->nstr++;
+}
+
+// a BC_HOT for the native code's label, when tiering
+static void hot_spot(Compiler *c, const char *label) {
+    if (!c->hot_spots) return;
+    Bytecode *bc = c->bc;
+    if (bc->nspots == bc->spot_cap) {
+        bc->spot_cap = bc->spot_cap ? bc->spot_cap * 2 : 64;
+        bc->spots = xrealloc(bc->spots, bc->spot_cap * sizeof(BcHotSpot));
+    }
+    bc->spots[bc->nspots] = (BcHotSpot){ label };
+    put(c, BC_HOT);
+    put(c, (uint32_t)bc->nspots++);
+}
+
+static void compile_block(Compiler *c, const Stmt *s);
+
+// prefix followed by a number, interned like codegen's labels
+static const char *seq_label(const char *prefix, int n) {
+    char label[32];
+    int len = (int)strlen(prefix);
+    memcpy(label, prefix, (size_t)len);
+    len += emit_format_int(label + len, n);
+    return intern(label, len);
+}
+
+static void compile_loop(Compiler *c, const Stmt *s) {
+    // the hidden counter, _loop_counter_N as in native code
+    uint32_t counter = var_slot(c, seq_label("_loop_counter_", s->seq));
+    assign(c, counter, false, s->value, s->line);
+
+    op2(c, BC_LOOP, counter, 0);
+    size_t exit = here(c) - 1;
+    uint32_t body = here(c);
+    hot_spot(c, seq_label("_loop_", s->seq));
+    compile_block(c, s->body);
+    op2(c, BC_NEXT, counter, body);
+    patch(c, exit, here(c));
+}
+
+static void compile_if(Compiler *c, const Stmt *s) {
+    op3(c, false_jump(s->cmp), operand(c, s->lhs, s->line), operand(c, s->rhs, s->line), 0);
+    size_t to_else = here(c) - 1;
+    compile_block(c, s->body);
+    if (s->else_body) {
+        put(c, BC_JMP);
+        size_t to_end = put(c, 0);
+        patch(c, to_else, here(c));
+        compile_block(c, s->else_body);
+        patch(c, to_end, here(c));
+    } else {
+        patch(c, to_else, here(c));
+    }
+}
+
+// "bl func(a, b)": arguments to w0, w1... then a jump, nothing returns
+static void compile_call(Compiler *c, const Stmt *s) {
+    uint32_t reg = 0;
+    for (const Expr *a = s->args; a; a = a->next, reg++) {
+        if (reg == BC_REGS) error_func_args(s->line, s->callee);
+        op2(c, BC_MOV, reg, operand(c, a, s->line));
+    }
+    put(c, BC_JMP);
+    if (c->ncalls == c->call_cap) {
+        c->call_cap = c->call_cap ? c->call_cap * 2 : 64;
+        c->calls = xrealloc(c->calls, c->call_cap * sizeof(Call));
+    }
+    c->calls[c->ncalls++] = (Call){ put(c, 0), s->callee, s->line };
+}
+
+static void compile_stmt(Compiler *c, const Stmt *s) {
+    switch (s->kind) {
+        case STMT_NUM:
+        case STMT_ASSIGN:
+        case STMT_SETR:
+        case STMT_SETM:
+            if (s->dest->kind == EXPR_MEM || s->value->kind == EXPR_MEM)
+                error_fatal("Error: memory operands only work in native code (line %d)\n", s->line);
+            assign(c, dest_slot(c, s->dest, s->line), is_wide(s->dest), s->value, s->line);
+            break;
+
+        case STMT_LOOP:
+            compile_loop(c, s);
+            break;
+
+        case STMT_IF:
+            compile_if(c, s);
+            break;
+
+        case STMT_PRINT:
+            if (s->value->kind == EXPR_STRING) {
+                put(c, BC_PRINTS);
+                put(c, string_index(c, s->value->name));
+            } else {
+                put(c, BC_PRINTN);
+                put(c, operand(c, s->value, s->line));
+            }
+            break;
+
+        case STMT_CALL:
+            compile_call(c, s);
+            break;
+
+        case STMT_EXIT:
+            put(c, BC_EXIT);
+            break;
+
+        case STMT_RAW:
+            error_fatal("Error: assembly only works in native code (line %d): %.*s\n", s->line, s->len, s->text);
+    }
+}
+
+static void compile_block(Compiler *c, const Stmt *s) {
+    for (; s; s = s->next)
+        compile_stmt(c, s);
+}
+
+void bytecode_compile(const Program *prog, Bytecode *bc, bool hot_spots) {
+    memset(bc, 0, sizeof(*bc));
+    Compiler c = { .bc = bc, .hot_spots = hot_spots };
+    for (int i = 0; i < BC_REGS; i++) new_slot(&c, 0);
+
+    for (const Func *f = prog->funcs; f; f = f->next) {
+        uint32_t *entry = map_find(&c.funcs, (uint64_t)(uintptr_t)f->name);
+        if (*entry) error_fatal("Error: function defined twice (line %d): %s\n", f->line, f->name);
+        c.funcs.count++;
+        *entry = here(&c) + 1;
+        hot_spot(&c, f->name);
+
+        // incoming arguments into the parameters, also on fall-through
+        uint32_t reg = 0;
+        for (const Expr *p = f->params; p; p = p->next, reg++) {
+            if (reg == BC_REGS) error_func_args(f->line, f->name);
+            op2(&c, BC_MOV, var_slot(&c, p->label), reg);
+        }
+        compile_block(&c, f->body);
+    }
+    put(&c, BC_EXIT);
+
+    for (int i = 0; i < c.ncalls; i++) {
+        uint32_t *entry = map_find(&c.funcs, (uint64_t)(uintptr_t)c.calls[i].callee);
+        if (!*entry)
+            error_fatal("Error: call to undefined function (line %d): %s\n", c.calls[i].line, c.calls[i].callee);
+        patch(&c, c.calls[i].at, *entry - 1);
+    }
+    uint32_t *main_entry = map_find(&c.funcs, (uint64_t)(uintptr_t)intern("_main", 5));
+    if (!*main_entry) error_fatal("Error: no _main function\n");
+    bc->entry = *main_entry - 1;
+
+    map_free(&c.vars);
+    map_free(&c.consts);
+    map_free(&c.funcs);
+    map_free(&c.strings);
+    xfree(c.calls);
+}
+
+void bytecode_free(Bytecode *bc) {
+    if (bc->map) {
+        munmap(bc->map, bc->map_len);
+        memset(bc, 0, sizeof(*bc));
+        return;
+    }
+    xfree(bc->code);
+    xfree(bc->init);
+    xfree(bc->str_off);
+    xfree(bc->str_len);
+    xfree(bc->spots);
+    xfree(bc->vars);
+    emit_free(&bc->strings);
+    memset(bc, 0, sizeof(*bc));
+}
@@ -0,0 +1,91 @@
+#ifndef BYTECODE_H
+#define BYTECODE_H
+
+#include <stdint.h>
+#include <stddef.h>
+#include <stdbool.h>
+
+#include "ast.h"
+#include "emit.h"
+
+// Register-based bytecode for `compiler run`. Every operand is a slot in
+// one flat register file: w0..w30 / x0..x30 first, then the variables,
+// then the constants the code uses, so no instruction has an immediate
+// form. Code is a stream of 32-bit words, an opcode and then its
+// operands; jump targets are word offsets into the code.
+//
+// The layout follows the native code exactly: functions in source order,
+// falling through into the next one, calls that jump and never return,
+// and the exit after the last function.
+
+#define BC_REGS 31      // slots 0..30, wN and xN share one
+
+typedef enum {
+    BC_MOV,     // d s      d = low 32 bits of s
+    BC_MOV64,   // d s      d = s, for x registers
+    BC_ADD,     // d a b    32-bit, wrapping
+    BC_SUB,
+    BC_MUL,
+    BC_DIV,     // d a b    with sdiv's rules: x / 0 is 0, INT_MIN / -1 is INT_MIN
+    BC_JMP,     // t
+    BC_JEQ,     // a b t    jump when a cmp b, signed 32-bit
+    BC_JNE,
+    BC_JLT,
+    BC_JGT,
+    BC_JLE,
+    BC_JGE,
+    BC_LOOP,    // c t      jump to t when the counter c is 0
+    BC_NEXT,    // c t      c -= 1, jump to t unless it reached 0
+    BC_PRINTS,  // i        string i
+    BC_PRINTN,  // s        s as an unsigned 32-bit decimal
+    BC_EXIT,
+    BC_HOT,     // h        passing hot spot h, with hot spots only
+    BC_OP_COUNT
+} BcOp;
+
+// A place the tiered interpreter can hand over to native code from: a
+// function's entry or the top of a loop body, where the native code keeps
+// nothing in machine registers. label is the native code's name for it,
+// the function or _loop_N.
+typedef struct {
+    const char *label;
+} BcHotSpot;
+
+// a variable's slot and its data label in native code; loop counters are
+// variables too, _loop_counter_N
+typedef struct {
+    uint32_t slot;
+    const char *label;
+} BcVar;
+
+typedef struct {
+    uint32_t *code;
+    size_t len, cap;
+    uint32_t entry;         // _main
+
+    uint64_t *init;         // the register file at the start: constants
+    uint32_t nslots;        // filled in, everything else 0
+    uint32_t slot_cap;
+
+    Emitter strings;        // print's strings with the escapes resolved,
+    uint32_t *str_off;      // string i is str_len[i] bytes at str_off[i]
+    uint32_t *str_len;
+    int nstr, str_cap;
+
+    BcHotSpot *spots;       // with hot spots: BC_HOT's h indexes these
+    int nspots, spot_cap;
+    BcVar *vars;            // every variable, for carrying the state over
+    int nvars, var_cap;
+
+    void *map;              // set when code, init and the strings point into
+    size_t map_len;         // a mapped .nbc file rather than the heap
+} Bytecode;
+
+// Lower a program after codegen_resolve. What only native code can do,
+// raw assembly lines and memory operands, is reported as an error.
+// hot_spots adds a BC_HOT at every function entry and loop body for
+// tiering up; plain interpretation leaves them out.
+void bytecode_compile(const Program *prog, Bytecode *bc, bool hot_spots);
+void bytecode_free(Bytecode *bc);
+
+#endif // BYTECODE_H
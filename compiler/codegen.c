@@ -0,0 +1,404 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdbool.h>
+
+#include "codegen.h"
+#include "emit.h"
+#include "errors.h"
+#include "lexer.h"
+#include "mem.h"
+#include "pool.h"
+#include "symtab.h"
+
+// globals hold plain num vars and params, each function gets a nested
+// scope for its scoped vars (func_var_x) and hidden loop counters
+static Arena sym_arena;
+static Scope *globals = NULL;
+static Scope *scope = NULL;
+static Symbol *sym_first = NULL;
+static Symbol **sym_tail = &sym_first;
+static char *scoped_prefix = NULL;
+static size_t scoped_prefix_len = 0;
+
+typedef struct {
+    const char *label;
+    const char *text;
+} StringLiteral;
+
+static StringLiteral *str_literals = NULL;
+static int str_count = 0;
+static int str_cap = 0;
+
+// Add a string literal with a specified label, returns the stored label
+static const char *add_string_literal_with_label(const char *text, const char *label) {
+    if (str_count == str_cap)
+        str_literals = arena_grow(&sym_arena, str_literals, sizeof(StringLiteral), &str_cap);
+    str_literals[str_count].label = arena_strndup(&sym_arena, label, strlen(label));
+    str_literals[str_count].text = text;
+    return str_literals[str_count++].label;
+}
+
+// prefix followed by a number, e.g. "_loop_3"
+static void make_label(char *buf, const char *prefix, int n) {
+    size_t len = strlen(prefix);
+    memcpy(buf, prefix, len);
+    emit_format_int(buf + len, n);
+}
+
+// Add a string literal with an auto-generated label
+static void add_string_literal(const char *text) {
+    char label[32];
+    make_label(label, "str_", str_count);
+    add_string_literal_with_label(text, label);
+}
+
+// Emit all string literals to output file
+static void emit_all_string_literals(Emitter *out, const Target *t) {
+    if (str_count == 0) return;
+    if (t->isa->string) {
+        for (int i = 0; i < str_count; i++)
+            t->isa->string(out, str_literals[i].label, str_literals[i].text);
+        return;
+    }
+    emit_text(out, t->format->data);
+    for (int i = 0; i < str_count; i++) {
+        emit_label(out, str_literals[i].label);
+        emit_text(out, "    .asciz \"");
+        emit_text(out, str_literals[i].text);
+        emit_text(out, "\"\n");
+    }
+}
+
+static bool has_word(const Isa *isa, const Symbol *sym) {
+    return !isa->in_register || !isa->in_register(sym->label);
+}
+
+static void emit_all_variables(Emitter *out, const Target *t) {
+    if (!sym_first) return;
+    if (t->isa->variable) {
+        for (Symbol *sym = sym_first; sym; sym = sym->next)
+            if (has_word(t->isa, sym)) t->isa->variable(out, sym->label);
+        return;
+    }
+    emit_text(out, t->format->data);
+    if (t->isa->var_block) {
+        // 128 bytes, a cache line on Apple cores and two elsewhere
+        emit_text(out, ".p2align 7\n");
+        emit_label(out, t->isa->var_block);
+    }
+    for (Symbol *sym = sym_first; sym; sym = sym->next) {
+        if (!has_word(t->isa, sym)) continue;
+        emit_text(out, t->isa->align_word);
+        emit_text(out, sym->label);
+        emit_text(out, t->isa->word);
+    }
+}
+
+static const char *get_var_label(const char *name) {
+    Symbol *sym = scope_find(scope, name);
+    return sym ? sym->label : NULL;
+}
+
+static const char *define_var(Scope *target, const char *name) {
+    Symbol *sym = scope_add(&sym_arena, target, name);
+    *sym_tail = sym;
+    sym_tail = &sym->next;
+    return sym->label;
+}
+
+static const char *assign_var(const char *name) {
+    if (!name) return NULL;
+
+    // already exists?
+    Symbol *sym = scope_find(scope, name);
+    if (sym) return sym->label;
+
+    // the transpiler turns "scoped num x" into func_var_x, those stay in the function scope
+    bool scoped = scope != globals && strncmp(name, scoped_prefix, scoped_prefix_len) == 0;
+    return define_var(scoped ? scope : globals, name);
+}
+
+static int loop_seq = 0;
+static int if_label_seq = 0;
+
+// length of a string literal once its escapes are resolved
+static size_t literal_len(const char *s) {
+    size_t n = 0;
+    for (; *s; s++, n++)
+        if (*s == '\\' && s[1]) s++;
+    return n;
+}
+
+char codegen_string_byte(const char **p) {
+    char ch = *(*p)++;
+    if (ch != '\\' || !**p) return ch;
+    ch = *(*p)++;
+    switch (ch) {
+        case 'n': return '\n';
+        case 't': return '\t';
+        case 'r': return '\r';
+        case 'b': return '\b';
+        case 'f': return '\f';
+        case '0': return '\0';
+    }
+    return ch;
+}
+
+static const char *var_label(const Expr *e, int line_num) {
+    const char *label = get_var_label(e->name);
+    if (!label) error_undef(line_num, e->name);
+    return label;
+}
+
+/* ---- resolve ----
+   One pass in source order that does everything order-dependent: defining
+   and looking up variables, numbering loops, ifs and strings, and all the
+   error checks. What it finds is stored in the tree, so the backends only
+   read it and each function can be written on its own thread. */
+
+// a number, register or variable
+static void resolve_operand(Expr *e, int line_num) {
+    switch (e->kind) {
+        case EXPR_NUMBER:
+        case EXPR_REG:
+            break;
+        case EXPR_VAR:
+            e->label = var_label(e, line_num);
+            break;
+        default:
+            error_syntax(line_num, "Expected a number, register or variable");
+    }
+}
+
+static void resolve_expr(Expr *e, int line_num) {
+    if (e->kind == EXPR_REG) return;
+    if (e->kind != EXPR_BINARY) {
+        resolve_operand(e, line_num);
+        return;
+    }
+    resolve_operand(e->lhs, line_num);
+    resolve_operand(e->rhs, line_num);
+}
+
+// returns the number of statements, used to share functions out evenly
+static long resolve_block(Stmt *s);
+
+static long resolve_stmt(Stmt *s) {
+    char label[32];
+
+    switch (s->kind) {
+        case STMT_NUM:
+            // assign var first, so "num x = x" refers to itself
+            assign_var(s->dest->name);
+            resolve_expr(s->value, s->line);
+            s->dest->label = var_label(s->dest, s->line);
+            break;
+
+        case STMT_ASSIGN:
+            // dest is a register or a declared variable in RAM
+            if (s->dest->kind != EXPR_REG) s->dest->label = var_label(s->dest, s->line);
+            resolve_expr(s->value, s->line);
+            break;
+
+        case STMT_LOOP:
+            // hidden counter variable, local to the function
+            s->seq = loop_seq++;
+            make_label(label, "_loop_counter_", s->seq);
+            define_var(scope, intern(label, strlen(label)));
+            resolve_expr(s->value, s->line);
+            return 1 + resolve_block(s->body);
+
+        case STMT_IF:
+            resolve_operand(s->lhs, s->line);
+            resolve_operand(s->rhs, s->line);
+            s->seq = if_label_seq++;
+            return 1 + resolve_block(s->body) + resolve_block(s->else_body);
+
+        case STMT_PRINT:
+            if (s->value->kind != EXPR_STRING) {
+                resolve_operand(s->value, s->line);
+            } else if (strcmp(s->value->name, "\\n") == 0) {
+                s->value->label = "str_newline";
+                s->value->value = 1;
+            } else {
+                // stored now, emitted after all the code
+                make_label(label, "str_", str_count);
+                s->value->label = add_string_literal_with_label(s->value->name, label);
+                s->value->value = (long)literal_len(s->value->name);
+            }
+            break;
+
+        case STMT_CALL:
+            for (Expr *a = s->args; a; a = a->next)
+                resolve_operand(a, s->line);
+            break;
+
+        case STMT_SETR:
+            if (s->value->kind != EXPR_MEM) resolve_operand(s->value, s->line);
+            break;
+
+        case STMT_SETM:
+            if (s->dest->kind == EXPR_VAR) {
+                s->dest->label = get_var_label(s->dest->name);
+                if (!s->dest->label)
+                    error_fatal("Error: setm destination must be memory (line %d): %s\n",
+                                s->line, s->dest->name);
+            }
+            resolve_operand(s->value, s->line);
+            break;
+
+        case STMT_EXIT:
+        case STMT_RAW:
+            break;
+    }
+    return 1;
+}
+
+static long resolve_block(Stmt *s) {
+    long n = 0;
+    for (; s; s = s->next)
+        n += resolve_stmt(s);
+    return n;
+}
+
+static long resolve_func(Func *f) {
+    scope = scope_push(&sym_arena, globals);
+    scoped_prefix_len = strlen(f->name) + 5;
+    scoped_prefix = arena_alloc(&sym_arena, scoped_prefix_len + 1);
+    memcpy(scoped_prefix, f->name, scoped_prefix_len - 5);
+    memcpy(scoped_prefix + scoped_prefix_len - 5, "_var_", 6);
+
+    for (Expr *p = f->params; p; p = p->next)
+        p->label = assign_var(p->name);
+
+    long n = resolve_block(f->body);
+
+    scope = globals;
+    return n;
+}
+
+
+/* ---- parallel emit ---- */
+
+// a run of consecutive functions, written by one worker into its own buffer
+typedef struct {
+    const Isa *isa;
+    const Func *first;
+    int count;
+    Emitter buf;
+} FuncGroup;
+
+static void emit_group(void *ctx, int task, int worker) {
+    (void)worker;
+    FuncGroup *g = &((FuncGroup *)ctx)[task];
+    const Func *f = g->first;
+    for (int i = 0; i < g->count; i++, f = f->next)
+        g->isa->func(&g->buf, f);
+}
+
+// resolve everything in order, weight[i] gets how big function i is
+static long resolve_program(Program *prog, long *weight) {
+    // numbered from 0 every time, the same program gets the same labels
+    loop_seq = if_label_seq = 0;
+    globals = scope = scope_push(&sym_arena, NULL);
+    add_string_literal("%d"); // this will be used for printing numbers
+
+    long total = 0;
+    int i = 0;
+    for (Func *f = prog->funcs; f; f = f->next, i++) {
+        long w = 1 + resolve_func(f);
+        if (weight) weight[i] = w;
+        total += w;
+    }
+    return total;
+}
+
+const Symbol *codegen_variables(void) {
+    return sym_first;
+}
+
+void codegen_resolve(Program *prog) {
+    resolve_program(prog, NULL);
+}
+
+void codegen_release(void) {
+    arena_free(&sym_arena);
+    globals = scope = NULL;
+    sym_first = NULL;
+    sym_tail = &sym_first;
+    str_literals = NULL;
+    str_count = str_cap = 0;
+}
+
+void codegen_program(Emitter *out, Program *prog, int jobs, const Target *t) {
+    const Isa *isa = t->isa;
+
+    // resolve everything in order, noting how big each function is
+    int nfuncs = 0;
+    for (Func *f = prog->funcs; f; f = f->next) nfuncs++;
+    long *weight = xmalloc((nfuncs + 1) * sizeof(long));
+    long total = resolve_program(prog, weight);
+
+    isa->start(out, t, prog);
+    if (isa->declare_first) {
+        emit_all_variables(out, t);
+        emit_all_string_literals(out, t);
+    }
+
+    if (jobs <= 1) {
+        for (const Func *f = prog->funcs; f; f = f->next)
+            isa->func(out, f);
+    } else {
+        // group neighbouring functions into a few tasks per worker
+        long target_weight = total / ((long)jobs * 4);
+        FuncGroup *groups = xcalloc(nfuncs + 1, sizeof(FuncGroup));
+        int ngroups = 0;
+        long sum = 0;
+        int i = 0;
+        for (const Func *f = prog->funcs; f; f = f->next, i++) {
+            if (sum == 0) {
+                groups[ngroups].isa = isa;
+                groups[ngroups++].first = f;
+            }
+            groups[ngroups - 1].count++;
+            sum += weight[i];
+            if (sum >= target_weight) sum = 0;
+        }
+
+        pool_run(jobs, ngroups, emit_group, groups);
+
+        // stitch the pieces together in source order
+        size_t code_len = 0;
+        for (int g = 0; g < ngroups; g++) code_len += groups[g].buf.len;
+        emit_reserve(out, code_len);
+        for (int g = 0; g < ngroups; g++) {
+            emit_textn(out, groups[g].buf.data, groups[g].buf.len);
+            emit_free(&groups[g].buf);
+        }
+        xfree(groups);
+    }
+    xfree(weight);
+
+    isa->end(out);
+    emit_text(out, t->format->stack_note);
+
+    if (!isa->declare_first) {
+        emit_all_variables(out, t);
+        emit_all_string_literals(out, t);
+    }
+
+    codegen_release();
+}
+
+bool codegen_ir(Emitter *out, Program *prog, const Target *t, const char *pipeline,
+                IrPassHook hook, void *ctx) {
+    resolve_program(prog, NULL);
+    IrProgram ir;
+    ir_build(prog, &ir);
+    bool ok = ir_run_pipeline(&ir, pipeline, hook, ctx);
+    if (ok) t->isa->lower(out, &ir);
+    ir_free(&ir);
+    codegen_release();
+    return ok;
+}
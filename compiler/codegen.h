@@ -0,0 +1,39 @@
+#ifndef CODEGEN_H
+#define CODEGEN_H
+
+#include "ast.h"
+#include "emit.h"
+#include "target.h"
+#include "ir.h"
+#include "symtab.h"
+
+// Walk the program tree and append assembly for t to out. Names are
+// resolved in one pass in source order, then the target's backend writes
+// functions on up to jobs threads and they are joined back up in order.
+void codegen_program(Emitter *out, Program *prog, int jobs, const Target *t);
+
+// For targets whose Isa lowers from the IR: resolve, build the IR, run
+// the passes in pipeline (see ir_run_pipeline, hook sees each result)
+// and lower what is left. false, with nothing written, when pipeline
+// names a pass there is not.
+bool codegen_ir(Emitter *out, Program *prog, const Target *t, const char *pipeline,
+                IrPassHook hook, void *ctx);
+
+// Only the resolve pass, for backends that do not write assembly (the
+// bytecode compiler): fills in the tree as above. Variable labels are
+// interned names, so one pointer per variable. String labels and the
+// symbol tables stay valid until codegen_release().
+void codegen_resolve(Program *prog);
+void codegen_release(void);
+
+// Variables in the order they are laid out in memory, from
+// codegen_resolve until codegen_release. With an Isa's var_block the
+// first sits at the block's start and each next one 4 bytes on.
+const Symbol *codegen_variables(void);
+
+// next byte of a string literal's text, advancing *p past it; escapes
+// resolve the way lengths are counted, a backslash and the character
+// after it are one byte (\n, \t, \r, \b, \f, \0, anything else as itself)
+char codegen_string_byte(const char **p);
+
+#endif // CODEGEN_H
@@ -0,0 +1,1079 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <ctype.h>
+
+#include "codegen_arm64.h"
+#include "codegen.h"
+#include "encode_arm64.h"
+#include "peephole_arm64.h"
+#include "mem.h"
+
+bool arm64_peephole = true;
+
+// picked by start on the main thread, then only read by the workers
+static const Target *target = NULL;
+static const RegisterFile *regs = NULL;
+static uint32_t named_regs = 0;     // bit n: the program uses wn / xn itself
+static int base_num = -1;           // register holding VAR_BLOCK's address, -1 for none
+static char base_reg[4];            // "x28"
+
+// prefix followed by a number, e.g. "_loop_3"
+static void make_label(char *buf, const char *prefix, int n) {
+    size_t len = strlen(prefix);
+    memcpy(buf, prefix, len);
+    emit_format_int(buf + len, n);
+}
+
+static const char *math_op(BinOp op) {
+    switch (op) {
+        case OP_ADD: return "add";
+        case OP_SUB: return "sub";
+        case OP_MUL: return "mul";
+        case OP_DIV: return "sdiv";
+    }
+    return NULL;
+}
+
+// branch taken when the if condition is false
+static const char *false_branch(CmpOp cmp) {
+    switch (cmp) {
+        case CMP_LT: return "b.ge";
+        case CMP_GT: return "b.le";
+        case CMP_EQ: return "b.ne";
+        case CMP_NE: return "b.eq";
+        case CMP_LE: return "b.gt";
+        case CMP_GE: return "b.lt";
+    }
+    return NULL;
+}
+
+// "    adrp reg, label@PAGE"
+static void emit_adrp(Emitter *out, const char *reg, const char *label) {
+    emit_op(out, "adrp");
+    emit_text(out, reg);
+    emit_textn(out, ", ", 2);
+    emit_text(out, target->format->page_prefix);
+    emit_text(out, label);
+    emit_text(out, target->format->page_suffix);
+    emit_char(out, '\n');
+}
+
+// "label@PAGEOFF", or ":lo12:label" on ELF
+static void emit_lo12(Emitter *out, const char *label) {
+    emit_text(out, target->format->lo12_prefix);
+    emit_text(out, label);
+    emit_text(out, target->format->lo12_suffix);
+}
+
+// "    op reg, [x9, label@PAGEOFF]" after an adrp into x9
+static void emit_pageoff(Emitter *out, const char *op, const char *reg, const char *label) {
+    emit_op(out, op);
+    emit_text(out, reg);
+    emit_text(out, ", [");
+    emit_text(out, regs->addr);
+    emit_textn(out, ", ", 2);
+    emit_lo12(out, label);
+    emit_text(out, "]\n");
+}
+
+/* ---- the variable block ----
+   Every variable is a word in one block, VAR_BLOCK, which codegen lays
+   out in definition order. A register the program does not name is
+   pinned to its address at _main, so a variable is one "ldr w0, [x28,
+   #off]" away instead of an adrp and an ldr, and those used together
+   share cache lines. Only offsets up to 16380 fit the instruction; a
+   variable beyond that, or every variable when the program names all of
+   x19..x28, is still reached through its own page in x9. A loop counter
+   no function leaves in memory has no word at all. */
+
+#define VAR_BLOCK "nv.vars"         // no nevo name has a dot in it
+#define VAR_REACH 4096              // words [xN, #off] can address
+
+typedef struct {
+    const char *label;
+    int slot;
+} VarSlot;
+
+static VarSlot *var_slots = NULL;   // open addressing on the label's text
+static int var_slots_cap = 0;
+
+// loop seq -> the counter is left in memory by its function, set at
+// start from the frames and kept past end, when codegen lays out the
+// variables
+static bool *counter_in_memory = NULL;
+static int nloops = 0;
+
+#define COUNTER_PREFIX "_loop_counter_"
+
+static bool counter_in_register(const char *label) {
+    size_t n = sizeof(COUNTER_PREFIX) - 1;
+    if (strncmp(label, COUNTER_PREFIX, n) != 0) return false;
+    long seq = strtol(label + n, NULL, 10);
+    return seq < nloops && !counter_in_memory[seq];
+}
+
+static size_t text_slot(const char *s, int cap) {
+    uint32_t h = 2166136261u;
+    for (; *s; s++) h = (h ^ (unsigned char)*s) * 16777619u;
+    return (size_t)h & (size_t)(cap - 1);
+}
+
+static void var_slots_build(void) {
+    int count = 0;
+    for (const Symbol *sym = codegen_variables(); sym && count < VAR_REACH; sym = sym->next)
+        count += !counter_in_register(sym->label);
+    var_slots_cap = 16;
+    while (var_slots_cap < 2 * count) var_slots_cap *= 2;
+    var_slots = xcalloc((size_t)var_slots_cap, sizeof(VarSlot));
+    int n = 0;
+    for (const Symbol *sym = codegen_variables(); sym && n < count; sym = sym->next) {
+        if (counter_in_register(sym->label)) continue;
+        size_t i = text_slot(sym->label, var_slots_cap);
+        while (var_slots[i].label) i = (i + 1) & (size_t)(var_slots_cap - 1);
+        var_slots[i] = (VarSlot){ sym->label, n++ };
+    }
+}
+
+// word offset of a variable in the block, -1 when it is reached by page
+static int var_slot(const char *label) {
+    if (base_num < 0) return -1;
+    for (size_t i = text_slot(label, var_slots_cap); var_slots[i].label; i = (i + 1) & (size_t)(var_slots_cap - 1))
+        if (strcmp(var_slots[i].label, label) == 0) return var_slots[i].slot;
+    return -1;
+}
+
+// "    op reg, [x28, #off]", or "    op reg, [x9, label@PAGEOFF]" after
+// an adrp of its page
+static void emit_var(Emitter *out, const char *op, const char *reg, const char *label) {
+    int slot = var_slot(label);
+    if (slot < 0) {
+        emit_adrp(out, regs->addr, label);
+        emit_pageoff(out, op, reg, label);
+        return;
+    }
+    emit_op(out, op);
+    emit_text(out, reg);
+    emit_textn(out, ", [", 3);
+    emit_text(out, base_reg);
+    emit_textn(out, ", ", 2);
+    emit_imm(out, slot * 4L);
+    emit_text(out, "]\n");
+}
+
+// "#0x2000004"
+static void emit_hex(Emitter *out, unsigned long v) {
+    char hex[16];
+    int n = sizeof(hex);
+    do {
+        hex[--n] = "0123456789abcdef"[v & 15];
+        v >>= 4;
+    } while (v);
+    emit_text(out, "#0x");
+    emit_textn(out, hex + n, sizeof(hex) - n);
+}
+
+// syscall number into place: "mov x8, #64", or a movz/movk pair when it
+// does not fit a mov. A pair rather than "ldr x16, =0x2000004" keeps
+// literal pools out of the text, they have to sit within 1MB of the load.
+static void emit_sysnum(Emitter *out, const char *indent, long nr) {
+    const char *reg = target->abi->sys_reg;
+    emit_text(out, indent);
+    if (nr >= 0 && nr <= 0xffff) {
+        emit_text(out, "mov ");
+        emit_text(out, reg);
+        emit_textn(out, ", ", 2);
+        emit_imm(out, nr);
+        return;
+    }
+
+    emit_text(out, "movz ");
+    emit_text(out, reg);
+    emit_textn(out, ", ", 2);
+    emit_hex(out, ((unsigned long)nr >> 16) & 0xffff);
+    emit_text(out, ", lsl #16\n");
+    emit_text(out, indent);
+    emit_text(out, "movk ");
+    emit_text(out, reg);
+    emit_textn(out, ", ", 2);
+    emit_hex(out, (unsigned long)nr & 0xffff);
+}
+
+// the line that follows is the program's own, the peephole pass keeps
+// its hands off it
+static void emit_opaque(Emitter *out) {
+    if (arm64_peephole) emit_char(out, PEEPHOLE_OPAQUE);
+}
+
+static void emit_mov_imm(Emitter *out, const char *reg, long v) {
+    emit_op(out, "mov");
+    emit_text(out, reg);
+    emit_textn(out, ", ", 2);
+    emit_imm(out, v);
+    emit_char(out, '\n');
+}
+
+/* ---- register allocation ----
+   A variable a function uses more than once gets a register of its own
+   for the whole function. It is loaded at the entry when the function
+   may read it before setting it, and stored back before control leaves
+   (a call, or the fall through into the next function), since the code
+   there reads it from memory. Calls never come back, so nothing is saved
+   around them. A loop's hidden counter is never read outside the loop
+   and lives only in its register. When there are more variables than
+   registers the least used stay in memory, weighing each use 8x per
+   enclosing loop.
+
+   The registers are x19..x28 and x10..x15, minus the variable block's
+   base and any the program names itself, in nevo code, as call
+   arguments or in raw assembly lines. A function with raw assembly or
+   memory operands keeps its variables in memory, since either could
+   read or write one behind our back. Its loop counters, which nothing
+   can name, still get registers, but only from x19..x28: those survive
+   anything the raw code calls. */
+
+#define ALLOC_MAX 16
+
+static const int alloc_pool[ALLOC_MAX] = { 19, 20, 21, 22, 23, 24, 25, 26, 27, 28, 10, 11, 12, 13, 14, 15 };
+
+typedef struct {
+    const void *key;        // the variable's label (interned), or the
+    const char *label;      // loop for a counter, which has no label
+    long weight;
+    bool written;
+    bool counter;
+    int slot;               // index of its register, -1 in memory
+} VarUse;
+
+// the variables of the function being written
+typedef struct {
+    VarUse *vars;
+    int count, cap;
+    int *table;             // open addressing on key, index + 1
+    int table_cap;
+    bool in_memory;         // raw assembly or memory operands seen
+
+    int nalloc;
+    char reg[ALLOC_MAX][4]; // "w19"
+    const char *label[ALLOC_MAX];
+    uint32_t exposed;       // bit per register: loaded at the entry
+    uint32_t stored;        // stored back before leaving
+} Frame;
+
+static size_t key_slot(const void *key, int cap) {
+    uint64_t h = (uint64_t)(uintptr_t)key * 0x9e3779b97f4a7c15ull;
+    return (size_t)(h >> 32) & (size_t)(cap - 1);
+}
+
+static VarUse *frame_find(const Frame *fr, const void *key) {
+    if (!fr->table_cap) return NULL;
+    for (size_t i = key_slot(key, fr->table_cap);; i = (i + 1) & (size_t)(fr->table_cap - 1)) {
+        int v = fr->table[i];
+        if (!v) return NULL;
+        if (fr->vars[v - 1].key == key) return &fr->vars[v - 1];
+    }
+}
+
+static VarUse *frame_add(Frame *fr, const void *key, const char *label) {
+    VarUse *v = frame_find(fr, key);
+    if (v) return v;
+
+    if (2 * (fr->count + 1) > fr->table_cap) {
+        int cap = fr->table_cap ? fr->table_cap * 2 : 16;
+        int *table = xcalloc((size_t)cap, sizeof(int));
+        for (int i = 0; i < fr->count; i++) {
+            size_t j = key_slot(fr->vars[i].key, cap);
+            while (table[j]) j = (j + 1) & (size_t)(cap - 1);
+            table[j] = i + 1;
+        }
+        xfree(fr->table);
+        fr->table = table;
+        fr->table_cap = cap;
+    }
+    if (fr->count == fr->cap) {
+        fr->cap = fr->cap ? fr->cap * 2 : 16;
+        fr->vars = xrealloc(fr->vars, (size_t)fr->cap * sizeof(VarUse));
+    }
+
+    size_t j = key_slot(key, fr->table_cap);
+    while (fr->table[j]) j = (j + 1) & (size_t)(fr->table_cap - 1);
+    fr->table[j] = fr->count + 1;
+    v = &fr->vars[fr->count++];
+    *v = (VarUse){ key, label, 0, false, false, -1 };
+    return v;
+}
+
+// the register a variable (its label) or loop counter (the loop) lives
+// in, NULL when it is in memory
+static const char *var_reg(const Frame *fr, const void *key) {
+    const VarUse *v = frame_find(fr, key);
+    return v && v->slot >= 0 ? fr->reg[v->slot] : NULL;
+}
+
+static void note_operand(Frame *fr, const Expr *e, long weight) {
+    if (e->kind == EXPR_VAR) frame_add(fr, e->label, e->label)->weight += weight;
+    else if (e->kind == EXPR_MEM) fr->in_memory = true;
+}
+
+static void note_expr(Frame *fr, const Expr *e, long weight) {
+    if (e->kind != EXPR_BINARY) {
+        note_operand(fr, e, weight);
+        return;
+    }
+    note_operand(fr, e->lhs, weight);
+    note_operand(fr, e->rhs, weight);
+}
+
+static void note_write(Frame *fr, const Expr *dest, long weight) {
+    if (dest->kind == EXPR_MEM) {
+        fr->in_memory = true;
+    } else if (dest->kind == EXPR_VAR) {
+        VarUse *v = frame_add(fr, dest->label, dest->label);
+        v->weight += weight;
+        v->written = true;
+    }
+}
+
+// every variable the block touches, weight per use
+static void note_block(Frame *fr, const Stmt *s, long weight) {
+    for (; s; s = s->next) {
+        switch (s->kind) {
+            case STMT_NUM:
+            case STMT_ASSIGN:
+            case STMT_SETR:
+            case STMT_SETM:
+                note_expr(fr, s->value, weight);
+                note_write(fr, s->dest, weight);
+                break;
+            case STMT_LOOP: {
+                long inner = weight < (1L << 40) ? weight * 8 : weight;
+                note_expr(fr, s->value, weight);
+                VarUse *c = frame_add(fr, s, NULL);
+                c->counter = true;
+                c->weight += weight + 2 * inner;
+                note_block(fr, s->body, inner);
+                break;
+            }
+            case STMT_IF:
+                note_operand(fr, s->lhs, weight);
+                note_operand(fr, s->rhs, weight);
+                note_block(fr, s->body, weight);
+                note_block(fr, s->else_body, weight);
+                break;
+            case STMT_PRINT:
+                if (s->value->kind != EXPR_STRING) note_operand(fr, s->value, weight);
+                break;
+            case STMT_CALL:
+                for (const Expr *a = s->args; a; a = a->next)
+                    note_operand(fr, a, weight);
+                break;
+            case STMT_RAW:
+                fr->in_memory = true;
+                break;
+            case STMT_EXIT:
+                break;
+        }
+    }
+}
+
+static uint32_t var_bit(const Frame *fr, const void *key) {
+    const VarUse *v = frame_find(fr, key);
+    return v && v->slot >= 0 ? 1u << v->slot : 0;
+}
+
+static void expose_operand(Frame *fr, const Expr *e, uint32_t defined) {
+    if (e->kind == EXPR_VAR) fr->exposed |= var_bit(fr, e->label) & ~defined;
+}
+
+static void expose_expr(Frame *fr, const Expr *e, uint32_t defined) {
+    if (e->kind != EXPR_BINARY) {
+        expose_operand(fr, e, defined);
+        return;
+    }
+    expose_operand(fr, e->lhs, defined);
+    expose_operand(fr, e->rhs, defined);
+}
+
+// Which registers the function can read, or store back, before it has
+// set them: those are loaded at the entry. defined holds the ones set on
+// every path to here, returns the same after the block.
+static uint32_t expose_block(Frame *fr, const Stmt *s, uint32_t defined) {
+    for (; s; s = s->next) {
+        switch (s->kind) {
+            case STMT_NUM:
+            case STMT_ASSIGN:
+            case STMT_SETR:
+            case STMT_SETM:
+                expose_expr(fr, s->value, defined);
+                if (s->dest->kind == EXPR_VAR) defined |= var_bit(fr, s->dest->label);
+                break;
+            case STMT_LOOP:
+                expose_expr(fr, s->value, defined);
+                expose_block(fr, s->body, defined | var_bit(fr, s));
+                break;
+            case STMT_IF:
+                expose_operand(fr, s->lhs, defined);
+                expose_operand(fr, s->rhs, defined);
+                expose_block(fr, s->body, defined);
+                expose_block(fr, s->else_body, defined);
+                break;
+            case STMT_PRINT:
+                if (s->value->kind != EXPR_STRING) expose_operand(fr, s->value, defined);
+                break;
+            case STMT_CALL:
+                for (const Expr *a = s->args; a; a = a->next)
+                    expose_operand(fr, a, defined);
+                fr->exposed |= fr->stored & ~defined;
+                break;
+            case STMT_RAW:
+            case STMT_EXIT:
+                break;
+        }
+    }
+    return defined;
+}
+
+// heaviest first, then in order of first use
+static int by_weight(const void *a, const void *b) {
+    const VarUse *x = *(const VarUse *const *)a, *y = *(const VarUse *const *)b;
+    if (x->weight != y->weight) return x->weight < y->weight ? 1 : -1;
+    return x < y ? -1 : x > y;
+}
+
+static void frame_build(Frame *fr, const Func *f) {
+    memset(fr, 0, sizeof(*fr));
+    for (const Expr *p = f->params; p; p = p->next) {
+        VarUse *v = frame_add(fr, p->label, p->label);
+        v->weight++;
+        v->written = true;
+    }
+    note_block(fr, f->body, 1);
+    if (fr->count == 0) return;
+
+    char free_regs[ALLOC_MAX];
+    int nfree = 0;
+    for (int i = 0; i < ALLOC_MAX; i++)
+        if (!(named_regs & (1u << alloc_pool[i])) && alloc_pool[i] != base_num
+            && (!fr->in_memory || alloc_pool[i] >= 19))
+            free_regs[nfree++] = (char)alloc_pool[i];
+
+    VarUse **order = xmalloc((size_t)fr->count * sizeof(VarUse *));
+    for (int i = 0; i < fr->count; i++) order[i] = &fr->vars[i];
+    qsort(order, (size_t)fr->count, sizeof(VarUse *), by_weight);
+    for (int i = 0; i < fr->count && fr->nalloc < nfree && order[i]->weight >= 2; i++) {
+        VarUse *v = order[i];
+        if (fr->in_memory && !v->counter) continue;
+        int n = fr->nalloc++;
+        v->slot = n;
+        fr->reg[n][0] = 'w';
+        emit_format_int(fr->reg[n] + 1, free_regs[n]);
+        fr->label[n] = v->label;
+        if (v->written && !v->counter) fr->stored |= 1u << n;
+    }
+    xfree(order);
+
+    uint32_t defined = 0;
+    for (const Expr *p = f->params; p; p = p->next) defined |= var_bit(fr, p->label);
+    defined = expose_block(fr, f->body, defined);
+    fr->exposed |= fr->stored & ~defined;
+}
+
+static void frame_free(Frame *fr) {
+    xfree(fr->vars);
+    xfree(fr->table);
+}
+
+/* ---- frames of the program ----
+   Which counters some function leaves in memory decides the variable
+   block's layout, and that is fixed before the first function is
+   written. So every frame is built once at start, on the main thread,
+   and the workers only look theirs up. */
+
+typedef struct {
+    const Func *func;
+    Frame frame;
+} FuncFrame;
+
+static FuncFrame *frames = NULL;    // open addressing on the Func
+static int frames_cap = 0;
+
+static int count_loops(const Stmt *s) {
+    int n = 0;
+    for (; s; s = s->next)
+        n += (s->kind == STMT_LOOP) + count_loops(s->body) + count_loops(s->else_body);
+    return n;
+}
+
+static void frames_build(const Program *prog) {
+    int nfuncs = 0;
+    nloops = 0;
+    for (const Func *f = prog->funcs; f; f = f->next) {
+        nfuncs++;
+        nloops += count_loops(f->body);
+    }
+    counter_in_memory = xcalloc((size_t)nloops + 1, sizeof(bool));
+    frames_cap = 16;
+    while (frames_cap < 2 * nfuncs) frames_cap *= 2;
+    frames = xcalloc((size_t)frames_cap, sizeof(FuncFrame));
+
+    for (const Func *f = prog->funcs; f; f = f->next) {
+        size_t i = key_slot(f, frames_cap);
+        while (frames[i].func) i = (i + 1) & (size_t)(frames_cap - 1);
+        frames[i].func = f;
+        Frame *fr = &frames[i].frame;
+        frame_build(fr, f);
+        for (int v = 0; v < fr->count; v++)
+            if (fr->vars[v].counter && fr->vars[v].slot < 0)
+                counter_in_memory[((const Stmt *)fr->vars[v].key)->seq] = true;
+    }
+}
+
+static const Frame *frame_of(const Func *f) {
+    size_t i = key_slot(f, frames_cap);
+    while (frames[i].func != f) i = (i + 1) & (size_t)(frames_cap - 1);
+    return &frames[i].frame;
+}
+
+static void frames_free(void) {
+    for (int i = 0; i < frames_cap; i++)
+        if (frames[i].func) frame_free(&frames[i].frame);
+    xfree(frames);
+    frames = NULL;
+    frames_cap = 0;
+}
+
+/* ---- variables and operands ---- */
+
+// "mov dest, src" of a 32-bit value; an x register on either side is
+// written as its w half, the mov zero-extends
+static void emit_mov32(Emitter *out, const char *dest, const char *src) {
+    char d[4], s[4];
+    if (dest[0] == 'x' && strlen(dest) < sizeof(d)) {
+        strcpy(d, dest);
+        d[0] = 'w';
+        dest = d;
+    }
+    if (src[0] == 'x' && strlen(src) < sizeof(s)) {
+        strcpy(s, src);
+        s[0] = 'w';
+        src = s;
+    }
+    if (strcmp(dest, src) != 0) emit_ins(out, "mov", dest, src, NULL);
+}
+
+static void store_var(Emitter *out, const Frame *fr, const char *label, const char *reg) {
+    const char *r = var_reg(fr, label);
+    if (r) {
+        emit_mov32(out, r, reg);
+        return;
+    }
+    emit_var(out, "str", reg, label);
+}
+
+static void load_var(Emitter *out, const char *label, const char *reg) {
+    emit_var(out, "ldr", reg, label);
+}
+
+// the variables in registers that the function sets, back to memory
+// before control leaves it
+static void store_back(Emitter *out, const Frame *fr) {
+    for (int i = 0; i < fr->nalloc; i++) {
+        if (!(fr->stored & (1u << i))) continue;
+        emit_var(out, "str", fr->reg[i], fr->label[i]);
+    }
+}
+
+// load a number, register or variable into reg
+static void load_operand(Emitter *out, const Frame *fr, const Expr *e, const char *reg) {
+    const char *r;
+    switch (e->kind) {
+        case EXPR_NUMBER:
+            emit_mov_imm(out, reg, e->value);
+            break;
+        case EXPR_REG:
+            emit_ins(out, "mov", reg, e->name, NULL);
+            break;
+        default:
+            r = var_reg(fr, e->label);
+            if (r) emit_mov32(out, reg, r);
+            else load_var(out, e->label, reg);
+    }
+}
+
+// the register holding an operand: a variable's own, or reg loaded
+static const char *operand_reg(Emitter *out, const Frame *fr, const Expr *e, const char *reg) {
+    if (e->kind == EXPR_VAR) {
+        const char *r = var_reg(fr, e->label);
+        if (r) return r;
+    }
+    load_operand(out, fr, e, reg);
+    return reg;
+}
+
+// evaluate an expression into dest, returns the register holding the
+// result (a register or variable on its own is left where it is)
+static const char *emit_expr(Emitter *out, const Frame *fr, const Expr *e, const char *dest) {
+    if (e->kind == EXPR_REG) return e->name;
+    if (e->kind != EXPR_BINARY) return operand_reg(out, fr, e, dest);
+    const char *a = operand_reg(out, fr, e->lhs, regs->acc);
+    const char *b = operand_reg(out, fr, e->rhs, regs->tmp);
+    emit_ins(out, math_op(e->op), dest, a, b);
+    return dest;
+}
+
+/* ---- statements ---- */
+
+static void emit_block(Emitter *out, const Frame *fr, const Stmt *s);
+
+// "bl func(a, b, c)"
+static void emit_call(Emitter *out, const Frame *fr, const Stmt *s) {
+    store_back(out, fr);
+
+    // move params into w0,w1,w2...
+    int reg = 0;
+    for (const Expr *a = s->args; a; a = a->next) {
+        char r[16];
+        make_label(r, regs->arg_prefix, reg++);
+        load_operand(out, fr, a, r);
+    }
+
+    // finally call function
+    emit_ins(out, "bl", s->callee, NULL, NULL);
+}
+
+// "loop <expr> { ... }": tested once up front, then at the bottom, where
+// subs sets the flags b.ne needs
+static void emit_loop(Emitter *out, const Frame *fr, const Stmt *s) {
+    char label_start[32], label_end[32], counter_var[32];
+
+    // unique labels, numbered by resolve
+    make_label(label_start, "_loop_", s->seq);
+    make_label(label_end, "_loop_end_", s->seq);
+    make_label(counter_var, COUNTER_PREFIX, s->seq);
+
+    const char *counter = var_reg(fr, s);
+    if (counter) {
+        emit_mov32(out, counter, emit_expr(out, fr, s->value, counter));
+        emit_ins(out, "cbz", counter, label_end, NULL);
+        emit_label(out, label_start);
+        emit_block(out, fr, s->body);
+        emit_ins(out, "subs", counter, counter, "#1");
+        emit_ins(out, "b.ne", label_start, NULL, NULL);
+        emit_label(out, label_end);
+        return;
+    }
+
+    // evaluate expression and store initial counter
+    emit_mov32(out, regs->acc, emit_expr(out, fr, s->value, regs->acc));
+    store_var(out, fr, counter_var, regs->acc);
+
+    // zero times → skip the loop
+    emit_ins(out, "cbz", regs->acc, label_end, NULL);
+
+    // loop start label
+    emit_label(out, label_start);
+
+    emit_block(out, fr, s->body);
+
+    // decrement counter, the store leaves the flags alone
+    load_var(out, counter_var, regs->acc);
+    emit_ins(out, "subs", regs->acc, regs->acc, "#1");
+    store_var(out, fr, counter_var, regs->acc);
+
+    // jump back while it is not zero
+    emit_ins(out, "b.ne", label_start, NULL, NULL);
+
+    // exit label
+    emit_label(out, label_end);
+}
+
+// "if a <op> b { ... } else { ... }"
+static void emit_if(Emitter *out, const Frame *fr, const Stmt *s) {
+    char label_else[32], label_end[32];
+
+    // val1 -> w0, val2 -> w1, unless they are in registers already
+    const char *a = operand_reg(out, fr, s->lhs, regs->acc);
+    const char *b = operand_reg(out, fr, s->rhs, regs->tmp);
+
+    emit_ins(out, "cmp", a, b, NULL);
+
+    // unique labels, numbered by resolve
+    make_label(label_else, "if_else_", s->seq);
+    make_label(label_end, "if_end_", s->seq);
+
+    // branch based on operator
+    emit_ins(out, false_branch(s->cmp), label_else, NULL, NULL);
+
+    emit_block(out, fr, s->body);
+
+    if (s->else_body) {
+        // branch to skip else block
+        emit_ins(out, "b", label_end, NULL, NULL);
+
+        // else label
+        emit_label(out, label_else);
+        emit_block(out, fr, s->else_body);
+        emit_label(out, label_end);
+    } else {
+        emit_label(out, label_else);
+    }
+}
+
+// "print(...)"
+static void emit_print(Emitter *out, const Frame *fr, const Stmt *s) {
+    const Expr *arg = s->value;
+
+    // string literal
+    if (arg->kind == EXPR_STRING) {
+        const char *label = arg->label;
+
+        // emit write syscall
+        emit_text(out, "    // print string literal\n");
+        emit_sysnum(out, "    ", target->abi->sys_write);
+        emit_char(out, '\n');
+        emit_ins(out, "mov", "x0", "1", NULL);
+        emit_adrp(out, "x1", label);
+        emit_op(out, "add");
+        emit_text(out, "x1, x1, ");
+        emit_lo12(out, label);
+        emit_char(out, '\n');
+        emit_op(out, "mov");
+        emit_text(out, "x2, ");
+        emit_int(out, arg->value);
+        emit_char(out, '\n');
+        emit_ins(out, "svc", "0", NULL, NULL);
+        return;
+    }
+
+    // numeric value
+    emit_text(out, "    // print variable ");
+    emit_text(out, arg->name);
+    emit_text(out, " (convert to string)\n");
+
+    // load value into w0, the routine below works on w0..w9
+    load_operand(out, fr, arg, "w0");
+
+    // stack buffer
+    emit_text(out,
+        "    sub sp, sp, #32\n"
+        "    mov x1, sp\n"
+        "    mov w2, #0\n"
+        "    mov w4, #10\n"
+    );
+
+    // convert number -> ASCII (reverse)
+    emit_text(out,
+        "1: udiv w3, w0, w4\n"
+        "   msub w5, w3, w4, w0\n"
+        "   add w5, w5, #'0'\n"
+        "   strb w5, [x1, w2, uxtw]\n"
+        "   add w2, w2, #1\n"
+        "   mov w0, w3\n"
+        "   cbnz w0, 1b\n"
+    );
+
+    // reverse buffer
+    emit_text(out,
+        "   mov w6, #0\n"
+        "   mov w7, w2\n"
+        "   sub w7, w7, #1\n"
+        "3: ldrb w8, [x1, w6, uxtw]\n"
+        "   ldrb w9, [x1, w7, uxtw]\n"
+        "   strb w8, [x1, w7, uxtw]\n"
+        "   strb w9, [x1, w6, uxtw]\n"
+        "   add w6, w6, #1\n"
+        "   sub w7, w7, #1\n"
+        "   cmp w6, w7\n"
+        "   blt 3b\n"
+    );
+
+    // write syscall
+    emit_sysnum(out, "   ", target->abi->sys_write);
+    emit_text(out,
+        "\n"
+        "   mov x0, #1\n"
+        "   svc 0\n"
+    );
+
+    // restore stack
+    emit_text(out, "    add sp, sp, #32\n");
+}
+
+// "setr reg, src"
+static void emit_setr(Emitter *out, const Frame *fr, const Stmt *s) {
+    if (s->value->kind == EXPR_MEM) {
+        // memory operand form preserved as-is
+        emit_opaque(out);
+        emit_op(out, "ldr");
+        emit_text(out, s->dest->name);
+        emit_textn(out, ", ", 2);
+        emit_textn(out, s->value->text, s->value->len);
+        emit_char(out, '\n');
+    } else {
+        // number, register, or a variable in RAM loaded into the register
+        load_operand(out, fr, s->value, s->dest->name);
+    }
+}
+
+// "setm dest, src"
+static void emit_setm(Emitter *out, const Frame *fr, const Stmt *s) {
+    // straight into a variable's register
+    const char *r = s->dest->kind == EXPR_VAR ? var_reg(fr, s->dest->label) : NULL;
+    if (r) {
+        load_operand(out, fr, s->value, r);
+        return;
+    }
+
+    /* ---- load RHS into w0 ---- */
+    load_operand(out, fr, s->value, regs->acc);
+
+    /* ---- store w0 into LHS ---- */
+    if (s->dest->kind == EXPR_MEM) {
+        // e.g. [sp, #4]
+        emit_opaque(out);
+        emit_op(out, "str");
+        emit_text(out, regs->acc);
+        emit_textn(out, ", ", 2);
+        emit_textn(out, s->dest->text, s->dest->len);
+        emit_char(out, '\n');
+    } else {
+        store_var(out, fr, s->dest->label, regs->acc);
+    }
+}
+
+static void emit_stmt(Emitter *out, const Frame *fr, const Stmt *s) {
+    const char *reg;
+
+    switch (s->kind) {
+        case STMT_NUM:
+        case STMT_ASSIGN:
+            // dest is a register or a declared variable, in RAM or in
+            // a register of its own, which the result goes straight to
+            if (s->dest->kind != EXPR_REG) {
+                const char *r = var_reg(fr, s->dest->label);
+                reg = emit_expr(out, fr, s->value, r ? r : regs->acc);
+                store_var(out, fr, s->dest->label, reg);
+                break;
+            }
+            reg = emit_expr(out, fr, s->value, regs->acc);
+            if (strcmp(reg, s->dest->name) == 0) break;
+            if (s->value->kind == EXPR_VAR && reg != regs->acc)
+                emit_mov32(out, s->dest->name, reg);
+            else
+                emit_ins(out, "mov", s->dest->name, reg, NULL);
+            break;
+
+        case STMT_LOOP:
+            emit_loop(out, fr, s);
+            break;
+
+        case STMT_IF:
+            emit_if(out, fr, s);
+            break;
+
+        case STMT_PRINT:
+            emit_print(out, fr, s);
+            break;
+
+        case STMT_CALL:
+            emit_call(out, fr, s);
+            break;
+
+        case STMT_EXIT:
+            emit_sysnum(out, "   ", target->abi->sys_exit);
+            emit_text(out,
+                    "\n"
+                    "   mov x0, 0\n"
+                    "   svc 0\n"
+            );
+            break;
+
+        case STMT_SETR:
+            emit_setr(out, fr, s);
+            break;
+
+        case STMT_SETM:
+            emit_setm(out, fr, s);
+            break;
+
+        case STMT_RAW:
+            // fallback: emit raw (indented)
+            emit_opaque(out);
+            emit_textn(out, "    ", 4);
+            emit_textn(out, s->text, s->len);
+            emit_char(out, '\n');
+            break;
+    }
+}
+
+static void emit_block(Emitter *out, const Frame *fr, const Stmt *s) {
+    for (; s; s = s->next)
+        emit_stmt(out, fr, s);
+}
+
+// "name(p1, p2) { ... }"
+static void emit_func_text(Emitter *out, const Func *f) {
+    const Frame *fr = frame_of(f);
+
+    emit_text(out, ".global ");
+    emit_text(out, f->name);
+    emit_char(out, '\n');
+    emit_label(out, f->name);
+
+    // where every run starts, the block's address for good
+    if (base_num >= 0 && strcmp(f->name, "_main") == 0) {
+        emit_adrp(out, base_reg, VAR_BLOCK);
+        emit_op(out, "add");
+        emit_text(out, base_reg);
+        emit_textn(out, ", ", 2);
+        emit_text(out, base_reg);
+        emit_textn(out, ", ", 2);
+        emit_lo12(out, VAR_BLOCK);
+        emit_char(out, '\n');
+    }
+
+    for (int i = 0; i < fr->nalloc; i++)
+        if (fr->exposed & (1u << i)) load_var(out, fr->label[i], fr->reg[i]);
+
+    int reg = 0;
+    for (const Expr *p = f->params; p; p = p->next) {
+        char r[16];
+        make_label(r, regs->arg_prefix, reg++);
+
+        // store incoming argument register into that variable
+        emit_text(out, "    // param ");
+        emit_text(out, p->name);
+        emit_char(out, '\n');
+        store_var(out, fr, p->label, r);
+    }
+
+    emit_block(out, fr, f->body);
+
+    // falling through into the next function
+    const Stmt *last = f->body;
+    while (last && last->next) last = last->next;
+    if (!last || (last->kind != STMT_CALL && last->kind != STMT_EXIT)) store_back(out, fr);
+}
+
+// Statement by statement, then cleaned up by the peephole pass. What
+// comes after the function, its callees and the one it falls into, reads
+// only the registers the program names and the block's base: variables
+// are in memory again by then and w0/w1/x9 are scratch.
+static void emit_func(Emitter *out, const Func *f) {
+    if (!arm64_peephole) {
+        emit_func_text(out, f);
+        return;
+    }
+    Emitter text = {0};
+    emit_func_text(&text, f);
+    peephole_arm64(text.data, text.len, named_regs | (base_num >= 0 ? 1u << base_num : 0), out);
+    emit_free(&text);
+}
+
+/* ---- program ---- */
+
+// w/x and a register number, not part of a longer name
+static uint32_t regs_in_text(const char *p, int len) {
+    uint32_t mask = 0;
+    for (int i = 0; i < len; i++) {
+        if ((p[i] != 'w' && p[i] != 'x') || (i > 0 && (isalnum((unsigned char)p[i - 1]) || p[i - 1] == '_')))
+            continue;
+        int j = i + 1, n = 0;
+        while (j < len && isdigit((unsigned char)p[j]) && j - i <= 2) n = n * 10 + (p[j++] - '0');
+        if (j == i + 1 || (j < len && (isalnum((unsigned char)p[j]) || p[j] == '_'))) continue;
+        if (n <= 30) mask |= 1u << n;
+    }
+    return mask;
+}
+
+static uint32_t regs_in_expr(const Expr *e) {
+    if (!e) return 0;
+    switch (e->kind) {
+        case EXPR_REG: return regs_in_text(e->name, (int)strlen(e->name));
+        case EXPR_MEM: return regs_in_text(e->text, e->len);
+        case EXPR_BINARY: return regs_in_expr(e->lhs) | regs_in_expr(e->rhs);
+        default: return 0;
+    }
+}
+
+// arguments in w0.. count too, for the calls and the parameters
+static uint32_t arg_regs(const Expr *list) {
+    int n = 0;
+    for (; list; list = list->next) n++;
+    return n >= 31 ? 0x7fffffffu : (1u << n) - 1;
+}
+
+static uint32_t regs_in_block(const Stmt *s) {
+    uint32_t mask = 0;
+    for (; s; s = s->next) {
+        mask |= regs_in_expr(s->dest) | regs_in_expr(s->value) | regs_in_expr(s->lhs) | regs_in_expr(s->rhs);
+        mask |= regs_in_block(s->body) | regs_in_block(s->else_body);
+        if (s->kind == STMT_CALL) mask |= arg_regs(s->args);
+        if (s->kind == STMT_RAW) mask |= regs_in_text(s->text, s->len);
+    }
+    return mask;
+}
+
+static void arm64_start(Emitter *out, const Target *t, const Program *prog) {
+    target = t;
+    regs = t->regs;
+    named_regs = 0;
+    for (const Func *f = prog->funcs; f; f = f->next)
+        named_regs |= arg_regs(f->params) | regs_in_block(f->body);
+
+    // the highest of x19..x28 left, it leaves the allocator one fewer
+    base_num = -1;
+    for (int r = 28; r >= 19 && codegen_variables(); r--)
+        if (!(named_regs & (1u << r))) {
+            base_num = r;
+            break;
+        }
+    xfree(counter_in_memory);
+    frames_build(prog);
+    if (base_num >= 0) {
+        base_reg[0] = 'x';
+        emit_format_int(base_reg + 1, base_num);
+        var_slots_build();
+    }
+
+    emit_text(out, t->format->text);
+    emit_text(out, t->format->data);
+    emit_text(out, "str_newline: .asciz \"\\n\"\n");
+    emit_text(out, t->format->text);
+    if (prog->funcs) emit_text(out, t->format->text);
+
+    // no crt to call _main for us
+    if (t->abi->entry) {
+        emit_text(out, ".global ");
+        emit_text(out, t->abi->entry);
+        emit_char(out, '\n');
+        emit_label(out, t->abi->entry);
+        emit_ins(out, "b", "_main", NULL, NULL);
+    }
+}
+
+static void arm64_end(Emitter *out) {
+    emit_sysnum(out, "    ", target->abi->sys_exit);
+    emit_text(out, "   // exit syscall\n");
+    emit_text(out, "    mov x0, 0\n");
+    emit_text(out, "    svc 0\n");
+
+    xfree(var_slots);
+    var_slots = NULL;
+    var_slots_cap = 0;
+    frames_free();
+}
+
+const Isa isa_arm64 = {
+    .name = "arm64",
+    .align_word = ".align 2\n",
+    .word = ": .word 0\n",
+    .var_block = VAR_BLOCK,
+    .in_register = counter_in_register,
+    .start = arm64_start,
+    .func = emit_func,
+    .end = arm64_end,
+    .assemble = arm64_assemble,
+};
@@ -0,0 +1,13 @@
+#ifndef CODEGEN_ARM64_H
+#define CODEGEN_ARM64_H
+
+#include "target.h"
+
+// arm64 instruction selection, for Mach-O and ELF alike: the relocation
+// syntax and syscall numbers come from the target.
+extern const Isa isa_arm64;
+
+// run peephole_arm64 over each function, on unless -fno-peephole
+extern bool arm64_peephole;
+
+#endif // CODEGEN_ARM64_H
@@ -0,0 +1,427 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdbool.h>
+#include <stdint.h>
+
+#include "codegen_c.h"
+#include "codegen.h"
+#include "errors.h"
+#include "mem.h"
+
+#define REG_COUNT 31    // w0..w30 / x0..x30, r[] in the output
+
+// runtime and the top of main, "%d" and the other strings follow
+static const char prologue[] =
+    "// generated by the nevo compiler\n"
+    "#include <stdint.h>\n"
+    "#include <stdio.h>\n"
+    "\n"
+    "static inline void nevo_write(const char *s, size_t n) {\n"
+    "    fwrite(s, 1, n, stdout);\n"
+    "}\n"
+    "\n"
+    "static inline void nevo_print_u32(uint32_t v) {\n"
+    "    char buf[10];\n"
+    "    int n = 10;\n"
+    "    do {\n"
+    "        buf[--n] = (char)('0' + v % 10);\n"
+    "        v /= 10;\n"
+    "    } while (v);\n"
+    "    fwrite(buf + n, 1, (size_t)(10 - n), stdout);\n"
+    "}\n"
+    "\n"
+    "// arm64 sdiv: x / 0 is 0, INT_MIN / -1 is INT_MIN\n"
+    "static inline uint32_t nevo_div(uint32_t a, uint32_t b) {\n"
+    "    if (b == 0) return 0;\n"
+    "    if (b == 0xffffffffu) return 0u - a;\n"
+    "    return (uint32_t)((int32_t)a / (int32_t)b);\n"
+    "}\n"
+    "\n"
+    "int main(void) {\n"
+    "    uint64_t r[31] = {0};\n"
+    "    static const char str_newline[] = \"\\n\";\n"
+    "    (void)r;\n"
+    "    (void)str_newline;\n";
+
+static void indent(Emitter *out, int depth) {
+    for (int i = 0; i < depth; i++) emit_textn(out, "    ", 4);
+}
+
+static void emit_unsigned(Emitter *out, uint64_t v) {
+    char buf[21];
+    int n = 21;
+    do {
+        buf[--n] = (char)('0' + v % 10);
+        v /= 10;
+    } while (v);
+    emit_textn(out, buf + n, (size_t)(21 - n));
+}
+
+// slot of a nevo register, w3 and x3 share slot 3
+static int reg_slot(const char *name, int line_num) {
+    char *end;
+    long n = strtol(name + 1, &end, 10);
+    if (*end || n < 0 || n >= REG_COUNT)
+        error_fatal("Error: unknown register (line %d): %s\n", line_num, name);
+    return (int)n;
+}
+
+static void emit_var(Emitter *out, const char *label) {
+    emit_textn(out, "nv_", 3);
+    emit_text(out, label);
+}
+
+static void emit_reg(Emitter *out, const Expr *e, int line_num) {
+    emit_textn(out, "r[", 2);
+    emit_int(out, reg_slot(e->name, line_num));
+    emit_char(out, ']');
+}
+
+// a number, register or variable as a uint32_t
+static void emit_operand(Emitter *out, const Expr *e, int line_num) {
+    switch (e->kind) {
+        case EXPR_NUMBER:
+            emit_unsigned(out, (uint32_t)e->value);
+            emit_char(out, 'u');
+            break;
+        case EXPR_REG:
+            emit_text(out, "(uint32_t)");
+            emit_reg(out, e, line_num);
+            break;
+        case EXPR_VAR:
+            emit_var(out, e->label);
+            break;
+        default:
+            error_fatal("Error: memory operands only work in native code (line %d)\n", line_num);
+    }
+}
+
+// 32-bit wrapping arithmetic, which unsigned C arithmetic already is
+static void emit_expr(Emitter *out, const Expr *e, int line_num) {
+    if (e->kind != EXPR_BINARY) {
+        emit_operand(out, e, line_num);
+        return;
+    }
+    if (e->op == OP_DIV) {
+        emit_text(out, "nevo_div(");
+        emit_operand(out, e->lhs, line_num);
+        emit_textn(out, ", ", 2);
+        emit_operand(out, e->rhs, line_num);
+        emit_char(out, ')');
+        return;
+    }
+    static const char *const ops[] = { " + ", " - ", " * " };
+    emit_operand(out, e->lhs, line_num);
+    emit_text(out, ops[e->op]);
+    emit_operand(out, e->rhs, line_num);
+}
+
+// dest = value; x registers copied from an x register or set to a number
+// keep 64 bits, everything else is a zero-extended 32-bit result
+static void emit_assign(Emitter *out, const Expr *dest, const Expr *value, int line_num, int depth) {
+    if (dest->kind == EXPR_MEM || value->kind == EXPR_MEM)
+        error_fatal("Error: memory operands only work in native code (line %d)\n", line_num);
+
+    indent(out, depth);
+    if (dest->kind != EXPR_REG) {
+        emit_var(out, dest->label);
+        emit_text(out, " = ");
+        emit_expr(out, value, line_num);
+        emit_text(out, ";\n");
+        return;
+    }
+
+    emit_reg(out, dest, line_num);
+    emit_text(out, " = ");
+    bool wide = dest->name[0] == 'x';
+    if (wide && value->kind == EXPR_REG && value->name[0] == 'x') {
+        emit_reg(out, value, line_num);
+    } else if (wide && value->kind == EXPR_NUMBER) {
+        emit_unsigned(out, (uint64_t)value->value);
+        emit_text(out, "ull");
+    } else {
+        emit_expr(out, value, line_num);
+    }
+    emit_text(out, ";\n");
+}
+
+static void emit_block(Emitter *out, const Stmt *s, int depth);
+
+static const char *cmp_op(CmpOp cmp) {
+    switch (cmp) {
+        case CMP_LT: return " < ";
+        case CMP_GT: return " > ";
+        case CMP_EQ: return " == ";
+        case CMP_NE: return " != ";
+        case CMP_LE: return " <= ";
+        case CMP_GE: return " >= ";
+    }
+    return NULL;
+}
+
+// "if a <op> b { ... } else { ... }", a signed 32-bit compare
+static void emit_if(Emitter *out, const Stmt *s, int depth) {
+    indent(out, depth);
+    emit_text(out, "if ((int32_t)");
+    emit_operand(out, s->lhs, s->line);
+    emit_text(out, cmp_op(s->cmp));
+    emit_text(out, "(int32_t)");
+    emit_operand(out, s->rhs, s->line);
+    emit_text(out, ") {\n");
+    emit_block(out, s->body, depth + 1);
+    indent(out, depth);
+    if (s->else_body) {
+        emit_text(out, "} else {\n");
+        emit_block(out, s->else_body, depth + 1);
+        indent(out, depth);
+    }
+    emit_text(out, "}\n");
+}
+
+// "loop <expr> { ... }", the hidden counter counts down to 0
+static void emit_loop(Emitter *out, const Stmt *s, int depth) {
+    char counter[32] = "_loop_counter_";
+    emit_format_int(counter + strlen(counter), s->seq);
+
+    indent(out, depth);
+    emit_text(out, "for (");
+    emit_var(out, counter);
+    emit_text(out, " = ");
+    emit_expr(out, s->value, s->line);
+    emit_text(out, "; ");
+    emit_var(out, counter);
+    emit_text(out, " != 0; ");
+    emit_var(out, counter);
+    emit_text(out, "--) {\n");
+    emit_block(out, s->body, depth + 1);
+    indent(out, depth);
+    emit_text(out, "}\n");
+}
+
+// "bl func(a, b)": arguments to w0, w1... and a jump, nothing comes back
+static void emit_call(Emitter *out, const Stmt *s, int depth) {
+    int slot = 0;
+    for (const Expr *a = s->args; a; a = a->next, slot++) {
+        if (slot == REG_COUNT) error_func_args(s->line, s->callee);
+        indent(out, depth);
+        emit_textn(out, "r[", 2);
+        emit_int(out, slot);
+        emit_text(out, "] = ");
+        emit_operand(out, a, s->line);
+        emit_text(out, ";\n");
+    }
+    indent(out, depth);
+    emit_text(out, "goto ");
+    emit_text(out, s->callee);
+    emit_text(out, ";\n");
+}
+
+static void emit_stmt(Emitter *out, const Stmt *s, int depth) {
+    switch (s->kind) {
+        case STMT_NUM:
+        case STMT_ASSIGN:
+        case STMT_SETR:
+        case STMT_SETM:
+            emit_assign(out, s->dest, s->value, s->line, depth);
+            break;
+
+        case STMT_LOOP:
+            emit_loop(out, s, depth);
+            break;
+
+        case STMT_IF:
+            emit_if(out, s, depth);
+            break;
+
+        case STMT_PRINT:
+            indent(out, depth);
+            if (s->value->kind == EXPR_STRING) {
+                emit_text(out, "nevo_write(");
+                emit_text(out, s->value->label);
+                emit_textn(out, ", ", 2);
+                emit_int(out, s->value->value);
+                emit_text(out, ");\n");
+            } else {
+                emit_text(out, "nevo_print_u32(");
+                emit_operand(out, s->value, s->line);
+                emit_text(out, ");\n");
+            }
+            break;
+
+        case STMT_CALL:
+            emit_call(out, s, depth);
+            break;
+
+        case STMT_EXIT:
+            indent(out, depth);
+            emit_text(out, "return 0;\n");
+            break;
+
+        case STMT_RAW:
+            error_fatal("Error: assembly only works in native code (line %d): %.*s\n", s->line, s->len, s->text);
+    }
+}
+
+static void emit_block(Emitter *out, const Stmt *s, int depth) {
+    for (; s; s = s->next)
+        emit_stmt(out, s, depth);
+}
+
+/* ---- labels ----
+   A function is a label in main, but one nothing jumps to would be an
+   unused label, so only _main and the functions some call names get
+   one; the rest are only ever fallen into. The set is built by start on
+   the main thread and only read by the workers. A goto to a label that
+   is not there, or a label twice, would not compile, so start also
+   makes the checks the bytecode and the IR make: no function defined
+   twice, a _main, and nothing called that is not defined. */
+
+typedef struct {
+    const char **names;     // open addressing on the name's text
+    size_t cap;
+} NameSet;
+
+static NameSet called;
+
+static void set_init(NameSet *set, size_t count) {
+    set->cap = 16;
+    while (set->cap < 2 * count) set->cap *= 2;
+    set->names = xcalloc(set->cap, sizeof(const char *));
+}
+
+static void set_free(NameSet *set) {
+    xfree(set->names);
+    set->names = NULL;
+    set->cap = 0;
+}
+
+static size_t name_slot(const NameSet *set, const char *s) {
+    uint32_t h = 2166136261u;
+    for (; *s; s++) h = (h ^ (unsigned char)*s) * 16777619u;
+    return (size_t)h & (set->cap - 1);
+}
+
+static bool set_has(const NameSet *set, const char *name) {
+    for (size_t i = name_slot(set, name); set->names[i]; i = (i + 1) & (set->cap - 1))
+        if (strcmp(set->names[i], name) == 0) return true;
+    return false;
+}
+
+// false when name was in already
+static bool set_add(NameSet *set, const char *name) {
+    size_t i = name_slot(set, name);
+    for (; set->names[i]; i = (i + 1) & (set->cap - 1))
+        if (strcmp(set->names[i], name) == 0) return false;
+    set->names[i] = name;
+    return true;
+}
+
+static size_t count_calls(const Stmt *s) {
+    size_t n = 0;
+    for (; s; s = s->next)
+        n += (s->kind == STMT_CALL) + count_calls(s->body) + count_calls(s->else_body);
+    return n;
+}
+
+static void note_calls(const Stmt *s, const NameSet *defined) {
+    for (; s; s = s->next) {
+        if (s->kind == STMT_CALL) {
+            if (!set_has(defined, s->callee))
+                error_fatal("Error: call to undefined function (line %d): %s\n", s->line, s->callee);
+            set_add(&called, s->callee);
+        }
+        note_calls(s->body, defined);
+        note_calls(s->else_body, defined);
+    }
+}
+
+static void c_start(Emitter *out, const Target *t, const Program *prog) {
+    (void)t;
+    size_t funcs = 0, calls = 1;
+    for (const Func *f = prog->funcs; f; f = f->next) {
+        funcs++;
+        calls += count_calls(f->body);
+    }
+
+    NameSet defined;
+    set_init(&defined, funcs);
+    for (const Func *f = prog->funcs; f; f = f->next)
+        if (!set_add(&defined, f->name))
+            error_fatal("Error: function defined twice (line %d): %s\n", f->line, f->name);
+    if (prog->funcs && !set_has(&defined, "_main")) error_fatal("Error: no _main function\n");
+
+    set_init(&called, calls);
+    set_add(&called, "_main");
+    for (const Func *f = prog->funcs; f; f = f->next) note_calls(f->body, &defined);
+    set_free(&defined);
+
+    emit_text(out, prologue);
+    if (prog->funcs) emit_text(out, "    goto _main;\n");
+}
+
+static void c_func(Emitter *out, const Func *f) {
+    if (set_has(&called, f->name)) {
+        emit_text(out, f->name);
+        emit_text(out, ":\n");
+    }
+
+    int slot = 0;
+    for (const Expr *p = f->params; p; p = p->next, slot++) {
+        if (slot == REG_COUNT) error_func_args(f->line, f->name);
+        indent(out, 1);
+        emit_var(out, p->label);
+        emit_text(out, " = (uint32_t)r[");
+        emit_int(out, slot);
+        emit_text(out, "];\n");
+    }
+    emit_block(out, f->body, 1);
+}
+
+static void c_end(Emitter *out) {
+    emit_text(out, "    return 0;\n}\n");
+    set_free(&called);
+}
+
+// locals of main, static: the goto to _main jumps past them, and they
+// have to be 0 wherever they are first read. The (void) keeps unused
+// ones quiet
+static void c_variable(Emitter *out, const char *label) {
+    emit_text(out, "    static uint32_t ");
+    emit_var(out, label);
+    emit_text(out, " = 0;\n    (void)");
+    emit_var(out, label);
+    emit_text(out, ";\n");
+}
+
+// escapes resolved, then written back out the C way: printable
+// characters as they are, the rest as octal
+static void c_string(Emitter *out, const char *label, const char *text) {
+    emit_text(out, "    static const char ");
+    emit_text(out, label);
+    emit_text(out, "[] = \"");
+    for (const char *p = text; *p;) {
+        unsigned char c = (unsigned char)codegen_string_byte(&p);
+        if (c >= ' ' && c <= '~' && c != '"' && c != '\\' && c != '?') {
+            emit_char(out, (char)c);
+        } else {
+            char esc[5] = { '\\', (char)('0' + (c >> 6)), (char)('0' + ((c >> 3) & 7)), (char)('0' + (c & 7)), 0 };
+            emit_textn(out, esc, 4);
+        }
+    }
+    emit_text(out, "\";\n    (void)");
+    emit_text(out, label);
+    emit_text(out, ";\n");
+}
+
+const Isa isa_c = {
+    .name = "c",
+    .align_word = "",
+    .word = "",
+    .start = c_start,
+    .func = c_func,
+    .end = c_end,
+    .variable = c_variable,
+    .string = c_string,
+    .declare_first = true,
+};
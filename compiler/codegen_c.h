@@ -0,0 +1,15 @@
+#ifndef CODEGEN_C_H
+#define CODEGEN_C_H
+
+#include "target.h"
+
+// --emit=c: the program as one portable C99 main() for the host's C
+// compiler to optimize. Functions are labels in it, falling through into
+// the next one, and bl is a goto, the same as in the assembly; variables
+// are locals of main, so the compiler can keep them in registers.
+//
+// The output compiles cleanly with -std=c99 -Wall -Wextra. Raw assembly
+// lines and memory operands have no C equivalent and are errors.
+extern const Isa isa_c;
+
+#endif // CODEGEN_C_H
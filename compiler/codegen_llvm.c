@@ -0,0 +1,269 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdbool.h>
+#include <stdint.h>
+
+#include "codegen_llvm.h"
+#include "codegen.h"
+#include "ir.h"
+#include "mem.h"
+
+// runtime, defined ahead of main: printing through the C library's
+// buffered stdout, and arm64's sdiv (x / 0 is 0, INT_MIN / -1 is INT_MIN).
+// nevo_write is not internal because LLVM 14's argument promotion crashes
+// on internal functions with opaque pointer arguments.
+static const char runtime[] =
+    "; generated by the nevo compiler\n"
+    "\n"
+    "declare i32 @putchar(i32)\n"
+    "declare i32 @printf(ptr, ...)\n"
+    "\n"
+    "@nevo.u32 = private unnamed_addr constant [3 x i8] c\"%u\\00\"\n"
+    "\n"
+    "define void @nevo_write(ptr %s, i64 %n) {\n"
+    "entry:\n"
+    "  %empty = icmp eq i64 %n, 0\n"
+    "  br i1 %empty, label %done, label %next\n"
+    "next:\n"
+    "  %i = phi i64 [ 0, %entry ], [ %i.next, %next ]\n"
+    "  %p = getelementptr inbounds i8, ptr %s, i64 %i\n"
+    "  %c = load i8, ptr %p\n"
+    "  %w = zext i8 %c to i32\n"
+    "  %r = call i32 @putchar(i32 %w)\n"
+    "  %i.next = add i64 %i, 1\n"
+    "  %more = icmp ult i64 %i.next, %n\n"
+    "  br i1 %more, label %next, label %done\n"
+    "done:\n"
+    "  ret void\n"
+    "}\n"
+    "\n"
+    "define internal void @nevo_print_u32(i32 %v) {\n"
+    "  %r = call i32 (ptr, ...) @printf(ptr @nevo.u32, i32 %v)\n"
+    "  ret void\n"
+    "}\n"
+    "\n"
+    "define internal i32 @nevo_div(i32 %a, i32 %b) {\n"
+    "entry:\n"
+    "  %zero = icmp eq i32 %b, 0\n"
+    "  br i1 %zero, label %done, label %nonzero\n"
+    "nonzero:\n"
+    "  %minus1 = icmp eq i32 %b, -1\n"
+    "  br i1 %minus1, label %negate, label %divide\n"
+    "negate:\n"
+    "  %n = sub i32 0, %a\n"
+    "  br label %done\n"
+    "divide:\n"
+    "  %q = sdiv i32 %a, %b\n"
+    "  br label %done\n"
+    "done:\n"
+    "  %r = phi i32 [ 0, %entry ], [ %n, %negate ], [ %q, %divide ]\n"
+    "  ret i32 %r\n"
+    "}\n"
+    "\n";
+
+// escapes resolved, then written back out LLVM's way: printable
+// characters as they are, the rest as two hex digits
+static void llvm_string(Emitter *out, const char *label, const char *text) {
+    int len = 0;
+    for (const char *p = text; *p; len++) codegen_string_byte(&p);
+
+    emit_char(out, '@');
+    emit_text(out, label);
+    emit_text(out, " = private unnamed_addr constant [");
+    emit_int(out, len + 1);
+    emit_text(out, " x i8] c\"");
+    for (const char *p = text; *p;) {
+        unsigned char c = (unsigned char)codegen_string_byte(&p);
+        if (c >= ' ' && c <= '~' && c != '"' && c != '\\') {
+            emit_char(out, (char)c);
+        } else {
+            char esc[3] = { '\\', "0123456789ABCDEF"[c >> 4], "0123456789ABCDEF"[c & 15] };
+            emit_textn(out, esc, 3);
+        }
+    }
+    emit_text(out, "\\00\"\n");
+}
+
+// %v.N, or a constant written in place; the dot keeps values apart
+// from blocks, which are named after nevo functions
+static void emit_value(Emitter *out, const IrProgram *ir, int v) {
+    const IrInst *in = &ir->insts[v];
+    if (in->op != IR_CONST) {
+        emit_text(out, "%v.");
+        emit_int(out, v);
+    } else if (in->type == IR_I1) {
+        emit_text(out, in->imm ? "true" : "false");
+    } else if (in->type == IR_I64) {
+        char buf[21];
+        emit_textn(out, buf, emit_format_int(buf, in->imm));
+    } else {
+        emit_int(out, (int)in->imm);
+    }
+}
+
+static void emit_block_ref(Emitter *out, const IrProgram *ir, int block) {
+    emit_text(out, "label %");
+    emit_text(out, ir->blocks[block].name);
+}
+
+// variables are @nv_label, registers @nevo.rN
+static void emit_cell(Emitter *out, const IrCell *c) {
+    if (c->label) {
+        emit_text(out, "@nv_");
+        emit_text(out, c->label);
+    } else {
+        emit_text(out, "@nevo.r");
+        emit_int(out, c->reg);
+    }
+}
+
+static const char *const type_names[] = { "void", "i1", "i32", "i64" };
+
+static const char *icmp(CmpOp cmp) {
+    switch (cmp) {
+        case CMP_LT: return "icmp slt i32 ";
+        case CMP_GT: return "icmp sgt i32 ";
+        case CMP_EQ: return "icmp eq i32 ";
+        case CMP_NE: return "icmp ne i32 ";
+        case CMP_LE: return "icmp sle i32 ";
+        case CMP_GE: return "icmp sge i32 ";
+    }
+    return NULL;
+}
+
+static void emit_inst(Emitter *out, const IrProgram *ir, int id) {
+    const IrInst *in = &ir->insts[id];
+    if (in->op == IR_CONST) return;
+
+    emit_textn(out, "  ", 2);
+    if (in->type != IR_VOID && in->op != IR_PHI) {
+        emit_value(out, ir, id);
+        emit_text(out, " = ");
+    }
+    switch (in->op) {
+        case IR_LOAD:
+            emit_text(out, "load ");
+            emit_text(out, type_names[in->type]);
+            emit_text(out, ", ptr ");
+            emit_cell(out, &ir->cells[in->cell]);
+            break;
+        case IR_STORE:
+            emit_text(out, "store ");
+            emit_text(out, type_names[ir->cells[in->cell].type]);
+            emit_char(out, ' ');
+            emit_value(out, ir, in->a);
+            emit_text(out, ", ptr ");
+            emit_cell(out, &ir->cells[in->cell]);
+            break;
+        case IR_ADD:
+        case IR_SUB:
+        case IR_MUL:
+        case IR_CMP: {
+            // 32-bit wrapping arithmetic, which LLVM's add/sub/mul already are
+            static const char *const ops[] = { [IR_ADD] = "add i32 ", [IR_SUB] = "sub i32 ",
+                                               [IR_MUL] = "mul i32 " };
+            emit_text(out, in->op == IR_CMP ? icmp(in->cmp) : ops[in->op]);
+            emit_value(out, ir, in->a);
+            emit_textn(out, ", ", 2);
+            emit_value(out, ir, in->b);
+            break;
+        }
+        case IR_DIV:
+            emit_text(out, "call i32 @nevo_div(i32 ");
+            emit_value(out, ir, in->a);
+            emit_text(out, ", i32 ");
+            emit_value(out, ir, in->b);
+            emit_char(out, ')');
+            break;
+        case IR_ZEXT:
+        case IR_TRUNC:
+            emit_text(out, in->op == IR_ZEXT ? "zext i32 " : "trunc i64 ");
+            emit_value(out, ir, in->a);
+            emit_text(out, in->op == IR_ZEXT ? " to i64" : " to i32");
+            break;
+        case IR_PHI: {
+            const IrBlock *b = &ir->blocks[in->block];
+            emit_value(out, ir, id);
+            emit_text(out, " = phi ");
+            emit_text(out, type_names[in->type]);
+            for (int k = 0; k < b->npreds; k++) {
+                emit_text(out, k ? ", [ " : " [ ");
+                emit_value(out, ir, in->phi[k]);
+                emit_text(out, ", %");
+                emit_text(out, ir->blocks[b->preds[k]].name);
+                emit_text(out, " ]");
+            }
+            break;
+        }
+        case IR_PRINTN:
+            emit_text(out, "call void @nevo_print_u32(i32 ");
+            emit_value(out, ir, in->a);
+            emit_char(out, ')');
+            break;
+        case IR_PRINTS:
+            emit_text(out, "call void @nevo_write(ptr @");
+            emit_text(out, ir->strings[in->str].label);
+            emit_text(out, ", i64 ");
+            emit_int(out, ir->strings[in->str].len);
+            emit_char(out, ')');
+            break;
+        case IR_BR:
+            emit_text(out, "br ");
+            emit_block_ref(out, ir, in->succ[0]);
+            break;
+        case IR_CONDBR:
+            emit_text(out, "br i1 ");
+            emit_value(out, ir, in->a);
+            emit_textn(out, ", ", 2);
+            emit_block_ref(out, ir, in->succ[0]);
+            emit_textn(out, ", ", 2);
+            emit_block_ref(out, ir, in->succ[1]);
+            break;
+        case IR_EXIT:
+            emit_text(out, "ret i32 0");
+            break;
+        case IR_CONST:
+        case IR_OP_COUNT:
+            break;
+    }
+    emit_char(out, '\n');
+}
+
+// the runtime, strings, then whatever cells the passes left in memory as
+// internal globals, zero like the assembly's, and main: the IR's blocks
+// in order, .start first
+static void llvm_lower(Emitter *out, const IrProgram *ir) {
+    emit_text(out, runtime);
+    for (int i = 0; i < ir->nstrings; i++)
+        llvm_string(out, ir->strings[i].label, ir->strings[i].text);
+
+    bool *used = xcalloc((size_t)ir->ncells + 1, sizeof(bool));
+    for (int i = 0; i < ir->ninsts; i++)
+        if (ir->insts[i].block >= 0 && (ir->insts[i].op == IR_LOAD || ir->insts[i].op == IR_STORE))
+            used[ir->insts[i].cell] = true;
+    for (int c = 0; c < ir->ncells; c++) {
+        if (!used[c]) continue;
+        emit_cell(out, &ir->cells[c]);
+        emit_text(out, ir->cells[c].type == IR_I64 ? " = internal global i64 0\n" : " = internal global i32 0\n");
+    }
+    xfree(used);
+
+    emit_text(out, "\ndefine i32 @main() {\n");
+    for (int bi = 0; bi < ir->nblocks; bi++) {
+        const IrBlock *b = &ir->blocks[bi];
+        if (b->ninsts == 0) continue;
+        emit_text(out, b->name);
+        emit_text(out, ":\n");
+        for (int k = 0; k < b->ninsts; k++)
+            emit_inst(out, ir, b->insts[k]);
+    }
+    emit_text(out, "}\n");
+}
+
+const Isa isa_llvm = {
+    .name = "llvm",
+    .align_word = "",
+    .word = "",
+    .lower = llvm_lower,
+};
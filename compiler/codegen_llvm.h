@@ -0,0 +1,19 @@
+#ifndef CODEGEN_LLVM_H
+#define CODEGEN_LLVM_H
+
+#include "target.h"
+
+// --emit=llvm: the program as textual LLVM IR for `opt -O3` and `llc`,
+// lowered from the IR (ir.h) once its passes have run. Like the assembly
+// it is one function, main, whose nevo functions are basic blocks
+// falling through into the next, and bl is a br. After mem2reg the
+// variables and registers are SSA values; with fewer passes what is left
+// of them are internal globals. Print goes through a small runtime on
+// the C library's putchar/printf.
+//
+// Pointers are opaque (`ptr`), the default since LLVM 15; LLVM 14 tools
+// need -opaque-pointers. Raw assembly lines and memory operands are
+// errors, as in --emit=c.
+extern const Isa isa_llvm;
+
+#endif // CODEGEN_LLVM_H
@@ -0,0 +1,740 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <ctype.h>
+
+#include "codegen_x86_64.h"
+#include "errors.h"
+
+// picked by start on the main thread, then only read by the workers
+static const Target *target = NULL;
+static const RegisterFile *regs = NULL;
+
+// in-process code (the JIT) keeps this much of its stack for [sp, #n]
+// operands; with the return address the stack stays 16-byte aligned
+#define HOST_FRAME "264"
+
+// prefix followed by a number, e.g. "_loop_3"
+static void make_label(char *buf, const char *prefix, int n) {
+    size_t len = strlen(prefix);
+    memcpy(buf, prefix, len);
+    emit_format_int(buf + len, n);
+}
+
+// slot of a nevo register, w3 and x3 share slot 3
+static int reg_slot(const char *name, int line_num) {
+    char *end;
+    long n = strtol(name + 1, &end, 10);
+    if (*end || n < 0 || n >= regs->count)
+        error_fatal("Error: unknown register (line %d): %s\n", line_num, name);
+    return (int)n;
+}
+
+static void emit_slot(Emitter *out, int slot) {
+    emit_text(out, regs->storage);
+    if (slot) {
+        emit_char(out, '+');
+        emit_int(out, slot * 8);
+    }
+    emit_text(out, "(%rip)");
+}
+
+// a number, register or variable as an operand: "$5", ".Lnevo_regs+8(%rip)", "x(%rip)"
+static void emit_operand(Emitter *out, const Expr *e, int line_num) {
+    switch (e->kind) {
+        case EXPR_NUMBER:
+            emit_char(out, '$');
+            emit_int(out, e->value);
+            break;
+        case EXPR_REG:
+            emit_slot(out, reg_slot(e->name, line_num));
+            break;
+        default:
+            emit_text(out, e->label);
+            emit_text(out, "(%rip)");
+    }
+}
+
+// "    op src, reg"
+static void emit_from(Emitter *out, const char *op, const Expr *src, const char *reg, int line_num) {
+    emit_op(out, op);
+    emit_operand(out, src, line_num);
+    emit_textn(out, ", ", 2);
+    emit_text(out, reg);
+    emit_char(out, '\n');
+}
+
+// "    op reg, dst"
+static void emit_to(Emitter *out, const char *op, const char *reg, const Expr *dst, int line_num) {
+    emit_op(out, op);
+    emit_text(out, reg);
+    emit_textn(out, ", ", 2);
+    emit_operand(out, dst, line_num);
+    emit_char(out, '\n');
+}
+
+static void load_eax(Emitter *out, const Expr *e, int line_num) {
+    if (e->kind == EXPR_NUMBER && e->value == 0)
+        emit_ins(out, "xorl", "%eax", "%eax", NULL);
+    else
+        emit_from(out, "movl", e, "%eax", line_num);
+}
+
+// 32-bit wrapping arithmetic with sdiv's rules: x / 0 is 0, INT_MIN / -1 is INT_MIN
+static int32_t fold(BinOp op, long a, long b) {
+    uint32_t x = (uint32_t)a, y = (uint32_t)b;
+    switch (op) {
+        case OP_ADD: return (int32_t)(x + y);
+        case OP_SUB: return (int32_t)(x - y);
+        case OP_MUL: return (int32_t)(x * y);
+        case OP_DIV:
+            if (y == 0) return 0;
+            if ((int32_t)y == -1) return (int32_t)(0u - x);
+            return (int32_t)x / (int32_t)y;
+    }
+    return 0;
+}
+
+// eax = lhs * rhs, by a constant goes through lea where it can
+static void emit_mul(Emitter *out, const Expr *lhs, const Expr *rhs, int line_num) {
+    if (lhs->kind == EXPR_NUMBER) {
+        const Expr *t = lhs;
+        lhs = rhs;
+        rhs = t;
+    }
+    if (rhs->kind != EXPR_NUMBER) {
+        load_eax(out, lhs, line_num);
+        emit_from(out, "imull", rhs, "%eax", line_num);
+        return;
+    }
+
+    const char *lea = NULL;
+    switch (rhs->value) {
+        case 0:
+            emit_ins(out, "xorl", "%eax", "%eax", NULL);
+            return;
+        case 1:
+            load_eax(out, lhs, line_num);
+            return;
+        case 2: lea = "(%rax,%rax)"; break;
+        case 3: lea = "(%rax,%rax,2)"; break;
+        case 4: lea = "0(,%rax,4)"; break;
+        case 5: lea = "(%rax,%rax,4)"; break;
+        case 8: lea = "0(,%rax,8)"; break;
+        case 9: lea = "(%rax,%rax,8)"; break;
+    }
+    if (lea) {
+        load_eax(out, lhs, line_num);
+        emit_ins(out, "leal", lea, "%eax", NULL);
+        return;
+    }
+
+    // three-operand imul reads the other side straight from memory
+    emit_op(out, "imull");
+    emit_operand(out, rhs, line_num);
+    emit_textn(out, ", ", 2);
+    emit_operand(out, lhs, line_num);
+    emit_text(out, ", %eax\n");
+}
+
+// eax = lhs / rhs, matching arm64 sdiv instead of trapping like idiv
+static void emit_div(Emitter *out, const Expr *lhs, const Expr *rhs, int line_num) {
+    if (rhs->kind == EXPR_NUMBER) {
+        int32_t d = (int32_t)rhs->value;
+        if (d == 0) {
+            emit_ins(out, "xorl", "%eax", "%eax", NULL);
+            return;
+        }
+        load_eax(out, lhs, line_num);
+        if (d == -1) {
+            emit_ins(out, "negl", "%eax", NULL, NULL);
+        } else if (d != 1) {
+            emit_from(out, "movl", rhs, "%ecx", line_num);
+            emit_ins(out, "cltd", NULL, NULL, NULL);
+            emit_ins(out, "idivl", "%ecx", NULL, NULL);
+        }
+        return;
+    }
+
+    // a divisor of 0 or -1 is swapped for 1, then cmov picks 0 or -lhs
+    load_eax(out, lhs, line_num);
+    emit_from(out, "movl", rhs, "%ecx", line_num);
+    emit_ins(out, "leal", "1(%rcx)", "%edx", NULL);
+    emit_ins(out, "movl", "$1", "%r8d", NULL);
+    emit_ins(out, "cmpl", "$1", "%edx", NULL);
+    emit_ins(out, "cmovbe", "%r8d", "%ecx", NULL);
+    emit_ins(out, "cltd", NULL, NULL, NULL);
+    emit_ins(out, "idivl", "%ecx", NULL, NULL);
+    emit_ins(out, "movl", "%eax", "%r9d", NULL);
+    emit_ins(out, "negl", "%r9d", NULL, NULL);
+    emit_ins(out, "xorl", "%r8d", "%r8d", NULL);
+    emit_op(out, "cmpl");
+    emit_text(out, "$-1, ");
+    emit_operand(out, rhs, line_num);
+    emit_char(out, '\n');
+    emit_ins(out, "cmove", "%r9d", "%eax", NULL);
+    emit_op(out, "cmpl");
+    emit_text(out, "$0, ");
+    emit_operand(out, rhs, line_num);
+    emit_char(out, '\n');
+    emit_ins(out, "cmove", "%r8d", "%eax", NULL);
+}
+
+// evaluate an expression into eax
+static void emit_expr(Emitter *out, const Expr *e, int line_num) {
+    if (e->kind != EXPR_BINARY) {
+        load_eax(out, e, line_num);
+        return;
+    }
+    if (e->lhs->kind == EXPR_NUMBER && e->rhs->kind == EXPR_NUMBER) {
+        int32_t v = fold(e->op, e->lhs->value, e->rhs->value);
+        if (v == 0) {
+            emit_ins(out, "xorl", "%eax", "%eax", NULL);
+        } else {
+            emit_op(out, "movl");
+            emit_char(out, '$');
+            emit_int(out, v);
+            emit_text(out, ", %eax\n");
+        }
+        return;
+    }
+
+    switch (e->op) {
+        case OP_ADD:
+        case OP_SUB:
+            load_eax(out, e->lhs, line_num);
+            emit_from(out, e->op == OP_ADD ? "addl" : "subl", e->rhs, "%eax", line_num);
+            break;
+        case OP_MUL:
+            emit_mul(out, e->lhs, e->rhs, line_num);
+            break;
+        case OP_DIV:
+            emit_div(out, e->lhs, e->rhs, line_num);
+            break;
+    }
+}
+
+static bool same_var(const Expr *a, const Expr *b) {
+    return a->kind == EXPR_VAR && b->kind == EXPR_VAR && a->label == b->label;
+}
+
+// reg = value, w writes clear the top half as they do on arm64
+static void set_reg(Emitter *out, const Expr *reg, const Expr *value, int line_num) {
+    if (reg->name[0] == 'x' && value->kind == EXPR_REG && value->name[0] == 'x') {
+        emit_from(out, "movq", value, "%rax", line_num);
+    } else if (reg->name[0] == 'x' && value->kind == EXPR_NUMBER) {
+        bool imm32 = value->value >= INT32_MIN && value->value <= INT32_MAX;
+        emit_from(out, imm32 ? "movq" : "movabsq", value, "%rax", line_num);
+    } else {
+        emit_expr(out, value, line_num);
+    }
+    emit_to(out, "movq", "%rax", reg, line_num);
+}
+
+// "dest = value" for num and plain assignments
+static void emit_assign(Emitter *out, const Expr *dest, const Expr *value, int line_num) {
+    if (dest->kind == EXPR_REG) {
+        set_reg(out, dest, value, line_num);
+        return;
+    }
+
+    // immediates go straight to memory
+    if (value->kind == EXPR_NUMBER) {
+        emit_op(out, "movl");
+        emit_operand(out, value, line_num);
+        emit_textn(out, ", ", 2);
+        emit_operand(out, dest, line_num);
+        emit_char(out, '\n');
+        return;
+    }
+
+    // x = x + y and x = x - y update x in place
+    if (value->kind == EXPR_BINARY && (value->op == OP_ADD || value->op == OP_SUB)) {
+        const Expr *other = NULL;
+        if (same_var(value->lhs, dest)) other = value->rhs;
+        else if (value->op == OP_ADD && same_var(value->rhs, dest)) other = value->lhs;
+        if (other) {
+            const char *op = value->op == OP_ADD ? "addl" : "subl";
+            if (other->kind == EXPR_NUMBER) {
+                emit_op(out, op);
+                emit_operand(out, other, line_num);
+                emit_textn(out, ", ", 2);
+                emit_operand(out, dest, line_num);
+                emit_char(out, '\n');
+            } else {
+                load_eax(out, other, line_num);
+                emit_to(out, op, "%eax", dest, line_num);
+            }
+            return;
+        }
+    }
+
+    emit_expr(out, value, line_num);
+    emit_to(out, "movl", "%eax", dest, line_num);
+}
+
+// "    movl $60, %eax", the caller ends the line
+static void emit_sysnum(Emitter *out, long nr) {
+    emit_op(out, "movl");
+    emit_char(out, '$');
+    emit_int(out, nr);
+    emit_textn(out, ", ", 2);
+    emit_text(out, target->abi->sys_reg);
+}
+
+/* ---- memory operands ----
+   setr/setm take arm64 addressing as written, "[base]" or "[base, #imm]".
+   sp maps to %rsp, an xN base is read from the register file into %rcx. */
+
+typedef struct {
+    long offset;
+    int slot;       // -1 for sp
+} MemRef;
+
+static MemRef parse_mem(const Expr *m, int line_num) {
+    const char *p = m->text + 1, *end = m->text + m->len - 1;
+    MemRef ref = { 0, -1 };
+
+    while (p < end && *p == ' ') p++;
+    const char *base = p;
+    while (p < end && isalnum((unsigned char)*p)) p++;
+    size_t base_len = (size_t)(p - base);
+    while (p < end && *p == ' ') p++;
+
+    bool ok = true;
+    if (p < end && *p == ',') {
+        p++;
+        while (p < end && *p == ' ') p++;
+        if (p < end && *p == '#') p++;
+        char *num_end;
+        ref.offset = strtol(p, &num_end, 0);
+        ok = num_end != p;
+        p = num_end;
+        while (p < end && *p == ' ') p++;
+    }
+    ok = ok && p == end && *end == ']';
+
+    if (ok && base_len == 2 && memcmp(base, "sp", 2) == 0) {
+        ref.slot = -1;
+    } else if (ok && base_len >= 2 && base[0] == 'x' && isdigit((unsigned char)base[1])) {
+        char *num_end;
+        ref.slot = (int)strtol(base + 1, &num_end, 10);
+        ok = num_end == base + base_len && ref.slot < regs->count;
+    } else {
+        ok = false;
+    }
+
+    if (!ok)
+        error_fatal("Error: unsupported memory operand for x86-64 (line %d): %.*s\n",
+                    line_num, m->len, m->text);
+    return ref;
+}
+
+// load the base register if the operand needs one
+static void mem_base(Emitter *out, const MemRef *ref) {
+    if (ref->slot < 0) return;
+    emit_op(out, "movq");
+    emit_slot(out, ref->slot);
+    emit_text(out, ", %rcx\n");
+}
+
+// "8(%rsp)"
+static void emit_mem(Emitter *out, const MemRef *ref) {
+    if (ref->offset) emit_int(out, ref->offset);
+    emit_text(out, ref->slot < 0 ? "(%rsp)" : "(%rcx)");
+}
+
+/* ---- statements ---- */
+
+static void emit_block(Emitter *out, const Stmt *s);
+
+// condition code that holds when the if condition is true
+static const char *cond_code(CmpOp cmp) {
+    switch (cmp) {
+        case CMP_LT: return "l";
+        case CMP_GT: return "g";
+        case CMP_EQ: return "e";
+        case CMP_NE: return "ne";
+        case CMP_LE: return "le";
+        case CMP_GE: return "ge";
+    }
+    return NULL;
+}
+
+// jump taken when the if condition is false
+static const char *false_jump(CmpOp cmp) {
+    switch (cmp) {
+        case CMP_LT: return "jge";
+        case CMP_GT: return "jle";
+        case CMP_EQ: return "jne";
+        case CMP_NE: return "je";
+        case CMP_LE: return "jg";
+        case CMP_GE: return "jl";
+    }
+    return NULL;
+}
+
+// flags for lhs - rhs, only clobbers ecx
+static void emit_cmp(Emitter *out, const Stmt *s) {
+    if (s->lhs->kind == EXPR_NUMBER) {
+        emit_from(out, "movl", s->lhs, "%ecx", s->line);
+        emit_from(out, "cmpl", s->rhs, "%ecx", s->line);
+    } else if (s->rhs->kind == EXPR_NUMBER) {
+        emit_op(out, "cmpl");
+        emit_operand(out, s->rhs, s->line);
+        emit_textn(out, ", ", 2);
+        emit_operand(out, s->lhs, s->line);
+        emit_char(out, '\n');
+    } else {
+        emit_from(out, "movl", s->rhs, "%ecx", s->line);
+        emit_to(out, "cmpl", "%ecx", s->lhs, s->line);
+    }
+}
+
+// a lone "x = value" with nothing that can trap, cheap enough to always run
+static bool is_select_arm(const Stmt *s) {
+    return s && !s->next && (s->kind == STMT_NUM || s->kind == STMT_ASSIGN) &&
+           s->dest->kind == EXPR_VAR &&
+           !(s->value->kind == EXPR_BINARY && s->value->op == OP_DIV);
+}
+
+// "if a <op> b { ... } else { ... }"
+static void emit_if(Emitter *out, const Stmt *s) {
+    const Stmt *then = s->body, *other = s->else_body;
+
+    // both sides store to the same variable: compute both and pick with cmov
+    if (is_select_arm(then) && (!other || (is_select_arm(other) && same_var(other->dest, then->dest)))) {
+        if (other) {
+            emit_expr(out, other->value, other->line);
+            emit_ins(out, "movl", "%eax", "%edx", NULL);
+        } else {
+            emit_from(out, "movl", then->dest, "%edx", s->line);
+        }
+        emit_expr(out, then->value, then->line);
+        emit_cmp(out, s);
+        char cmov[8] = "cmov";
+        strcat(cmov, cond_code(s->cmp));
+        emit_ins(out, cmov, "%eax", "%edx", NULL);
+        emit_to(out, "movl", "%edx", then->dest, s->line);
+        return;
+    }
+
+    char label_else[32], label_end[32];
+    make_label(label_else, "if_else_", s->seq);
+    make_label(label_end, "if_end_", s->seq);
+
+    emit_cmp(out, s);
+    emit_ins(out, false_jump(s->cmp), label_else, NULL, NULL);
+    emit_block(out, then);
+
+    if (other) {
+        emit_ins(out, "jmp", label_end, NULL, NULL);
+        emit_label(out, label_else);
+        emit_block(out, other);
+        emit_label(out, label_end);
+    } else {
+        emit_label(out, label_else);
+    }
+}
+
+// "loop <expr> { ... }", tested at the bottom with the counter kept in memory
+static void emit_loop(Emitter *out, const Stmt *s) {
+    char label_start[32], label_end[32], counter_var[32];
+    make_label(label_start, "_loop_", s->seq);
+    make_label(label_end, "_loop_end_", s->seq);
+    make_label(counter_var, "_loop_counter_", s->seq);
+
+    if (s->value->kind == EXPR_NUMBER) {
+        emit_op(out, "movl");
+        emit_operand(out, s->value, s->line);
+        emit_textn(out, ", ", 2);
+        emit_text(out, counter_var);
+        emit_text(out, "(%rip)\n");
+        if ((uint32_t)s->value->value == 0) emit_ins(out, "jmp", label_end, NULL, NULL);
+    } else {
+        emit_expr(out, s->value, s->line);
+        emit_op(out, "movl");
+        emit_text(out, "%eax, ");
+        emit_text(out, counter_var);
+        emit_text(out, "(%rip)\n");
+        emit_ins(out, "testl", "%eax", "%eax", NULL);
+        emit_ins(out, "je", label_end, NULL, NULL);
+    }
+
+    emit_label(out, label_start);
+    emit_block(out, s->body);
+
+    emit_op(out, "decl");
+    emit_text(out, counter_var);
+    emit_text(out, "(%rip)\n");
+    emit_ins(out, "jne", label_start, NULL, NULL);
+    emit_label(out, label_end);
+}
+
+// "print(...)"
+static void emit_print(Emitter *out, const Stmt *s) {
+    const Expr *arg = s->value;
+
+    if (arg->kind == EXPR_STRING) {
+        emit_text(out, "    # print string literal\n");
+        if (!target->abi->in_process) {
+            emit_sysnum(out, target->abi->sys_write);
+            emit_char(out, '\n');
+        }
+        emit_ins(out, "movl", "$1", "%edi", NULL);
+        emit_op(out, "leaq");
+        emit_text(out, arg->label);
+        emit_text(out, "(%rip), %rsi\n");
+        emit_op(out, "movl");
+        emit_char(out, '$');
+        emit_int(out, arg->value);
+        emit_text(out, ", %edx\n");
+        // nevo_rt_write(fd, buf, len) takes the same registers as the syscall
+        if (target->abi->in_process)
+            emit_ins(out, "call", "nevo_rt_write", NULL, NULL);
+        else
+            emit_ins(out, "syscall", NULL, NULL, NULL);
+        return;
+    }
+
+    emit_text(out, "    # print variable ");
+    emit_text(out, arg->name);
+    emit_char(out, '\n');
+    load_eax(out, arg, s->line);
+    emit_ins(out, "call", ".Lnevo_print_u32", NULL, NULL);
+}
+
+// "bl func(a, b, c)": arguments go to w0, w1, w2... and control never comes back
+static void emit_call(Emitter *out, const Stmt *s) {
+    int slot = 0;
+    for (const Expr *a = s->args; a; a = a->next, slot++) {
+        if (slot == regs->count) error_func_args(s->line, s->callee);
+        load_eax(out, a, s->line);
+        emit_op(out, "movq");
+        emit_text(out, "%rax, ");
+        emit_slot(out, slot);
+        emit_char(out, '\n');
+    }
+    emit_ins(out, "jmp", s->callee, NULL, NULL);
+}
+
+// "setr reg, src"
+static void emit_setr(Emitter *out, const Stmt *s) {
+    if (s->value->kind != EXPR_MEM) {
+        set_reg(out, s->dest, s->value, s->line);
+        return;
+    }
+    MemRef ref = parse_mem(s->value, s->line);
+    bool wide = s->dest->name[0] == 'x';
+    mem_base(out, &ref);
+    emit_op(out, wide ? "movq" : "movl");
+    emit_mem(out, &ref);
+    emit_text(out, wide ? ", %rax\n" : ", %eax\n");
+    emit_to(out, "movq", "%rax", s->dest, s->line);
+}
+
+// "setm dest, src", 32-bit store like str w0
+static void emit_setm(Emitter *out, const Stmt *s) {
+    if (s->dest->kind != EXPR_MEM) {
+        emit_assign(out, s->dest, s->value, s->line);
+        return;
+    }
+    MemRef ref = parse_mem(s->dest, s->line);
+    load_eax(out, s->value, s->line);
+    mem_base(out, &ref);
+    emit_op(out, "movl");
+    emit_text(out, "%eax, ");
+    emit_mem(out, &ref);
+    emit_char(out, '\n');
+}
+
+static void emit_stmt(Emitter *out, const Stmt *s) {
+    switch (s->kind) {
+        case STMT_NUM:
+        case STMT_ASSIGN:
+            emit_assign(out, s->dest, s->value, s->line);
+            break;
+
+        case STMT_LOOP:
+            emit_loop(out, s);
+            break;
+
+        case STMT_IF:
+            emit_if(out, s);
+            break;
+
+        case STMT_PRINT:
+            emit_print(out, s);
+            break;
+
+        case STMT_CALL:
+            emit_call(out, s);
+            break;
+
+        case STMT_EXIT:
+            if (target->abi->in_process) {
+                emit_ins(out, "jmp", ".Lnevo_exit", NULL, NULL);
+                break;
+            }
+            emit_sysnum(out, target->abi->sys_exit);
+            emit_text(out,
+                    "\n"
+                    "    xorl %edi, %edi\n"
+                    "    syscall\n"
+            );
+            break;
+
+        case STMT_SETR:
+            emit_setr(out, s);
+            break;
+
+        case STMT_SETM:
+            emit_setm(out, s);
+            break;
+
+        case STMT_RAW:
+            // passed through, so it has to be x86 assembly already
+            emit_textn(out, "    ", 4);
+            emit_textn(out, s->text, s->len);
+            emit_char(out, '\n');
+            break;
+    }
+}
+
+static void emit_block(Emitter *out, const Stmt *s) {
+    for (; s; s = s->next)
+        emit_stmt(out, s);
+}
+
+static void x86_64_start(Emitter *out, const Target *t, const Program *prog) {
+    (void)prog;
+    target = t;
+    regs = t->regs;
+
+    emit_text(out, t->format->text);
+    emit_text(out, t->format->data);
+    emit_text(out, "str_newline: .asciz \"\\n\"\n");
+    emit_text(out, t->format->text);
+
+    // no crt to call _main for us
+    if (t->abi->entry) {
+        emit_text(out, ".global ");
+        emit_text(out, t->abi->entry);
+        emit_char(out, '\n');
+        emit_label(out, t->abi->entry);
+        if (t->abi->in_process) {
+            // called from C: note where the stack was for the exit
+            emit_ins(out, "subq", "$" HOST_FRAME, "%rsp", NULL);
+            emit_ins(out, "movq", "%rsp", ".Lnevo_host_sp(%rip)", NULL);
+        }
+        emit_ins(out, "jmp", "_main", NULL, NULL);
+
+        // the tiered interpreter's way in: the state is already in memory
+        // and %rdi is the function or loop to go on from; the push and
+        // ret jump there, the encoder has no indirect jmp
+        if (t->abi->in_process) {
+            emit_text(out, ".global nevo_jit_resume\n");
+            emit_label(out, "nevo_jit_resume");
+            emit_ins(out, "subq", "$" HOST_FRAME, "%rsp", NULL);
+            emit_ins(out, "movq", "%rsp", ".Lnevo_host_sp(%rip)", NULL);
+            emit_ins(out, "pushq", "%rdi", NULL, NULL);
+            emit_ins(out, "ret", NULL, NULL, NULL);
+        }
+    }
+}
+
+static void x86_64_func(Emitter *out, const Func *f) {
+    emit_text(out, ".global ");
+    emit_text(out, f->name);
+    emit_char(out, '\n');
+    emit_label(out, f->name);
+
+    int slot = 0;
+    for (const Expr *p = f->params; p; p = p->next, slot++) {
+        if (slot == regs->count) error_func_args(f->line, f->name);
+
+        // copy the incoming argument out of the register file
+        emit_text(out, "    # param ");
+        emit_text(out, p->name);
+        emit_char(out, '\n');
+        emit_op(out, "movl");
+        emit_slot(out, slot);
+        emit_text(out, ", %eax\n");
+        emit_to(out, "movl", "%eax", p, f->line);
+    }
+
+    emit_block(out, f->body);
+}
+
+// in-process: exit and print go to the host, the exit returns to it
+static void x86_64_end_in_process(Emitter *out) {
+    emit_text(out,
+        ".Lnevo_exit:\n"
+        "    call nevo_rt_exit\n"
+        "    movq .Lnevo_host_sp(%rip), %rsp\n"
+        "    addq $" HOST_FRAME ", %rsp\n"
+        "    ret\n"
+        ".Lnevo_print_u32:\n"
+        "    movl %eax, %edi\n"
+        "    jmp nevo_rt_print_u32\n"
+        ".bss\n.p2align 3\n"
+        ".Lnevo_host_sp: .zero 8\n"
+    );
+    emit_text(out, regs->storage);
+    emit_text(out, ": .zero ");
+    emit_int(out, regs->count * 8);
+    emit_char(out, '\n');
+}
+
+static void x86_64_end(Emitter *out) {
+    if (target->abi->in_process) {
+        x86_64_end_in_process(out);
+        return;
+    }
+    emit_sysnum(out, target->abi->sys_exit);
+    emit_text(out, "   # exit syscall\n");
+    emit_text(out, "    xorl %edi, %edi\n");
+    emit_text(out, "    syscall\n");
+
+    // print eax as unsigned decimal, digits built backwards in the red zone
+    emit_text(out,
+        ".Lnevo_print_u32:\n"
+        "    leaq -1(%rsp), %rsi\n"
+        "    movl $10, %ecx\n"
+        "1:  xorl %edx, %edx\n"
+        "    divl %ecx\n"
+        "    addl $48, %edx\n"
+        "    movb %dl, (%rsi)\n"
+        "    decq %rsi\n"
+        "    testl %eax, %eax\n"
+        "    jnz 1b\n"
+        "    leaq -1(%rsp), %rdx\n"
+        "    subq %rsi, %rdx\n"
+        "    incq %rsi\n"
+    );
+    emit_sysnum(out, target->abi->sys_write);
+    emit_text(out,
+        "\n"
+        "    movl $1, %edi\n"
+        "    syscall\n"
+        "    ret\n"
+    );
+
+    // the register file
+    emit_text(out, ".bss\n.p2align 3\n");
+    emit_text(out, regs->storage);
+    emit_text(out, ": .zero ");
+    emit_int(out, regs->count * 8);
+    emit_char(out, '\n');
+}
+
+const Isa isa_x86_64 = {
+    .name = "x86_64",
+    .align_word = ".p2align 2\n",
+    .word = ": .long 0\n",
+    .start = x86_64_start,
+    .func = x86_64_func,
+    .end = x86_64_end,
+};
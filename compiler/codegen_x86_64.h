@@ -0,0 +1,14 @@
+#ifndef CODEGEN_X86_64_H
+#define CODEGEN_X86_64_H
+
+#include "target.h"
+
+// x86-64 instruction selection, AT&T syntax for the GNU assembler. Works
+// on the tree after codegen's resolve pass, the same as the arm64 one.
+//
+// Nevo's w0..w30 / x0..x30 have no x86 equivalent, so they live in a
+// register file in memory (see the target's RegisterFile), one 8-byte
+// slot each with wN the low half.
+extern const Isa isa_x86_64;
+
+#endif // CODEGEN_X86_64_H
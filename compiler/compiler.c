@@ -2,946 +2,409 @@
 #include <stdlib.h>
 #include <string.h>
 #include <stdbool.h>
-#include <ctype.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/wait.h>
 
 // Custom includes
 #include "errors.h"
-
-#define MAX_LINE 512
-#define MAX_VARS 256
-#define FIRST_VAR_REG 1
-
-typedef struct {
-    char label_else[64];
-    char label_end[64];
-    bool has_else;
-} IfLabel;
-
-static IfLabel if_stack[256];
-static int if_counter = 0;
-
-typedef struct {
-    char label_start[64];
-    char label_end[64];
-    char counter_var[64];
-} LoopLabel;
-
-static LoopLabel loop_stack[256];
-static int loop_depth = 0;
-static int loop_seq = 0;
-
-
-typedef struct {
-    char name[64];
-    char label[64];   // e.g. "ram"
-} Var;
-
-static Var vars[MAX_VARS];
-static int var_count = 0;
-
-typedef struct {
-    char label[64];
-    char *text;
-} StringLiteral;
-
-static StringLiteral str_literals[256];
-static int str_count = 0;
-
-// Add a string literal with an auto-generated label
-void add_string_literal(const char *text) {
-    char label[64];
-    snprintf(label, sizeof(label), "str_%d", str_count);
-    strncpy(str_literals[str_count].label, label, sizeof(str_literals[str_count].label)-1);
-    str_literals[str_count].text = strdup(text);
-    str_count++;
+#include "source.h"
+#include "transpiler.h"
+#include "lexer.h"
+#include "parser.h"
+#include "codegen.h"
+#include "codegen_arm64.h"
+#include "ir.h"
+#include "bytecode.h"
+#include "interp.h"
+#include "nbc.h"
+#include "jit.h"
+#include "target.h"
+#include "object.h"
+#include "mem.h"
+#include "pool.h"
+#include "timing.h"
+
+static void usage(const char *prog) {
+    fprintf(stderr, "Usage: %s [--time-report[=json]] [--target=T | --emit=c|llvm|ir] [--passes=LIST] [--print-after-all] [-j N] [-S] [-fno-integrated-as] [-fno-peephole] <input.n> <output>\n", prog);
+    fprintf(stderr, "       %s run [--jit | --tiered[=N]] [--no-cache] [-j N] <input.n>\n", prog);
+    fprintf(stderr, "  --target=T %s (default)", targets[0].name);
+    for (int i = 1; i < target_count; i++) fprintf(stderr, ", %s", targets[i].name);
+    fprintf(stderr, "\n");
+    fprintf(stderr, "  --emit=c   C source for the host's C compiler instead of assembly\n");
+    fprintf(stderr, "  --emit=llvm\n");
+    fprintf(stderr, "             LLVM IR for opt and llc instead of assembly\n");
+    fprintf(stderr, "  --emit=ir  the compiler's own IR as text, after the passes\n");
+    fprintf(stderr, "  --passes=LIST\n");
+    fprintf(stderr, "             IR passes for llvm and ir, comma-separated or none (default %s):\n", IR_DEFAULT_PIPELINE);
+    for (int i = 0; i < ir_pass_count; i++)
+        fprintf(stderr, "               %-9s %s\n", ir_passes[i].name, ir_passes[i].help);
+    fprintf(stderr, "  --print-after-all\n");
+    fprintf(stderr, "             the IR to stderr after each pass\n");
+    fprintf(stderr, "  -j N       parse and generate code on N threads (default: all cores)\n");
+    fprintf(stderr, "  -S         assembly text, whatever the output is called\n");
+    fprintf(stderr, "  -fno-integrated-as\n");
+    fprintf(stderr, "             assemble with $CC rather than the built-in encoder\n");
+    fprintf(stderr, "  -fno-peephole\n");
+    fprintf(stderr, "             arm64 code as written statement by statement, not cleaned up\n");
+    fprintf(stderr, "  output.s   assembly only\n");
+    fprintf(stderr, "  output.o   object file\n");
+    fprintf(stderr, "  other      object linked into an executable with $CC\n");
+    fprintf(stderr, "  run        interpret the program as bytecode, kept in input.nbc for next time\n");
+    fprintf(stderr, "  --no-cache neither read nor write input.nbc\n");
+    fprintf(stderr, "  --jit      run it as x86-64 machine code built in memory instead\n");
+    fprintf(stderr, "  --tiered   interpret, then switch to the JIT's code at the first function\n");
+    fprintf(stderr, "             or loop reached N times (default %d)\n", JIT_TIER_THRESHOLD);
 }
 
-// Emit all string literals to output file
-void emit_all_string_literals(FILE *fout) {
-    if (str_count == 0) return;
-    fprintf(fout, ".data\n");
-    for (int i = 0; i < str_count; i++) {
-        fprintf(fout, "%s:\n", str_literals[i].label);
-        fprintf(fout, "    .asciz \"%s\"\n", str_literals[i].text);
-    }
-}
-
-void emit_all_variables(FILE *fout) {
-    if (var_count == 0) return;
-    fprintf(fout, ".data\n");
-    for (int i = 0; i < var_count; i++) {
-        fprintf(fout, ".align 2\n");
-        fprintf(fout, "%s: .word 0\n", vars[i].label);
-    }
+static bool ends_with(const char *s, const char *suffix) {
+    size_t n = strlen(s), m = strlen(suffix);
+    return n >= m && strcmp(s + n - m, suffix) == 0;
 }
 
-// Add a string literal with a specified label
-void add_string_literal_with_label(const char *text, const char *label) {
-    if (str_count >= 256) {
-        fprintf(stderr, "Too many string literals\n");
-        exit(1);
+// run the system compiler driver for assembling and linking ($CC, or cc)
+static bool run_cc(Phase phase, const char *in, const char *out, bool compile_only, const Target *target) {
+    const char *cc = getenv("CC");
+    if (!cc || !*cc) cc = "cc";
+
+    const char *argv[16];
+    int n = 0;
+    argv[n++] = cc;
+    if (compile_only) {
+        argv[n++] = "-c";
+    } else {
+        for (const char *const *f = target->abi->link_flags; *f && n < 11; f++)
+            argv[n++] = *f;
     }
-    strncpy(str_literals[str_count].label, label, sizeof(str_literals[str_count].label)-1);
-    str_literals[str_count].label[sizeof(str_literals[str_count].label)-1] = '\0';
-    str_literals[str_count].text = strdup(text);
-    str_count++;
-}
-
-
-// Trim leading and trailing whitespace (in place), return pointer to trimmed start.
-char *trim(char *s) {
-    if (!s) return s;
-    while (*s && (*s == ' ' || *s == '\t' || *s == '\r' || *s == '\n')) s++;
-    char *end = s + strlen(s) - 1;
-    while (end >= s && (*end == ' ' || *end == '\t' || *end == '\r' || *end == '\n')) { *end = '\0'; end--; }
-    return s;
-}
-
-// find first top-level separator ',' or '=' not inside brackets []
-char *find_top_level_sep(char *s) {
-    int depth = 0;
-    for (char *p = s; *p; ++p) {
-        if (*p == '[') depth++;
-        else if (*p == ']') { if (depth>0) depth--; }
-        else if (depth == 0 && (*p == '=' || *p == ',')) return p;
+    argv[n++] = in;
+    argv[n++] = "-o";
+    argv[n++] = out;
+    argv[n] = NULL;
+
+    double start = timing_now();
+    pid_t pid = fork();
+    if (pid < 0) return false;
+    if (pid == 0) {
+        execvp(cc, (char *const *)argv);
+        fprintf(stderr, "Could not run %s\n", cc);
+        _exit(127);
     }
-    return NULL;
-}
-
-char *get_var_label(const char *name) {
-    for (int i = 0; i < var_count; i++)
-        if (strcmp(vars[i].name, name) == 0)
-            return vars[i].label;
-    return NULL;
-}
-
-char *assign_var(const char *name) {
-    if (!name) return NULL;
-
-    // already exists?
-    for (int i = 0; i < var_count; i++) {
-        if (strcmp(vars[i].name, name) == 0)
-            return vars[i].label;
-    }
-
-    if (var_count >= 256) {
-        fprintf(stderr, "Too many variables\n");
-        exit(1);
-    }
-
-    snprintf(vars[var_count].name, sizeof(vars[var_count].name), "%s", name);
-    snprintf(vars[var_count].label, sizeof(vars[var_count].label), "%s", name);
 
-    var_count++;
-    return vars[var_count - 1].label;
+    int status;
+    struct rusage ru;
+    if (wait4(pid, &status, 0, &ru) < 0) return false;
+    timing_add_child(phase, timing_now() - start, &ru);
+    return WIFEXITED(status) && WEXITSTATUS(status) == 0;
 }
 
-
-bool is_number(const char *s) {
-    if (!s || !*s) return false;
-    const char *p = s;
-    if (*p == '+' || *p == '-') p++;
-    bool has = false;
-    while (*p) {
-        if (!isdigit((unsigned char)*p)) return false;
-        has = true;
-        p++;
-    }
-    return has;
+// the integrated assembler, straight from the text in memory to the
+// object file's bytes; false when the target has none or the text has
+// something it cannot encode
+static bool encode_object(const Emitter *text, const Target *target, Emitter *bytes) {
+    if (!target->isa->assemble) return false;
+    ObjFile obj = {0};
+    bool ok = target->isa->assemble(text->data, text->len, &obj);
+    if (ok) target->format->write_object(&obj, bytes);
+    obj_free(&obj);
+    return ok;
 }
 
-bool is_register(const char *s) {
-    if (!s) return false;
-    if ((s[0] == 'w' || s[0] == 'x') && isdigit((unsigned char)s[1])) return true;
-    return false;
+// a fresh file under /tmp for intermediate output, suffix like ".s"
+static int temp_file(char *path, size_t size, const char *suffix) {
+    snprintf(path, size, "/tmp/nevo-XXXXXX%s", suffix);
+    return mkstemps(path, (int)strlen(suffix));
 }
 
-int is_var(const char *s) {
-    if (!s || !*s) return 0;
-    if (is_number(s)) return 0;
-    if (is_register(s)) return 0;
-    if (s[0] == '[') return 0;
-    return get_var_label(s) != NULL;
-}
-
-int main(int argc, char **argv) {
-    if (argc != 3) {
-        fprintf(stderr, "Usage: %s <input.n> <output.s>\n", argv[0]);
-        return 1;
+// "compiler run": straight from source to the bytecode interpreter, the
+// JIT with --jit, or one then the other with --tiered; no assembler,
+// linker or files in between
+static int run_main(int argc, char **argv) {
+    int jobs = pool_default_jobs();
+    bool jit = false, cache = true;
+    long tier_threshold = 0;
+    int arg = 2;
+    for (; arg < argc && argv[arg][0] == '-' && argv[arg][1]; arg++) {
+        if (strcmp(argv[arg], "--jit") == 0) {
+            jit = true;
+        } else if (strcmp(argv[arg], "--no-cache") == 0) {
+            cache = false;
+        } else if (strncmp(argv[arg], "--tiered", 8) == 0 && (!argv[arg][8] || argv[arg][8] == '=')) {
+            tier_threshold = argv[arg][8] ? atol(argv[arg] + 9) : JIT_TIER_THRESHOLD;
+            if (tier_threshold < 1) {
+                usage(argv[0]);
+                return 1;
+            }
+        } else if (strncmp(argv[arg], "-j", 2) == 0) {
+            const char *n = argv[arg][2] ? argv[arg] + 2 : (arg + 1 < argc ? argv[++arg] : "");
+            jobs = atoi(n);
+            if (jobs < 1) {
+                usage(argv[0]);
+                return 1;
+            }
+        } else {
+            usage(argv[0]);
+            return 1;
+        }
     }
-
-    char cmd[512];
-
-    // Run transpiler first
-    snprintf(cmd, sizeof(cmd),
-             "./transpiler \"%s\" out.n",
-             argv[1]);
-
-    if (system(cmd) != 0) {
-        fprintf(stderr, "Transpiler failed\n");
+    if (argc - arg != 1) {
+        usage(argv[0]);
         return 1;
     }
 
-    // Now open transpiled file
-    FILE *fin = fopen("out.n", "r");
-    FILE *fout = fopen(argv[2], "w");
-
-    if (!fin || !fout) {
+    SourceFile in;
+    if (!load_source(argv[arg], &in)) {
         fprintf(stderr, "Could not open files\n");
         return 1;
     }
 
-    add_string_literal("%d"); // this will be used for printing numbers
-
-    fprintf(fout, ".text\n");
-    fprintf(fout, ".data\nstr_newline: .asciz \"\\n\"\n.text\n");
-
-    char rawline[MAX_LINE];
-    bool text_written = false;
-    int line_num = 0;
-
-    while (fgets(rawline, sizeof(rawline), fin)) {
-        line_num++;
-        // strip newline
-        rawline[strcspn(rawline, "\n")] = '\0';
-        char *line = trim(rawline);
-        if (!line || *line == '\0') continue;
-
-
-
-        // FUNCTION DETECTION WITH PARAMETERS
-        size_t len = strlen(line);
-        if (len >= 3 && line[len-1] == '{' && strchr(line, '(') && strchr(line, ')')) {
-
-            char func[128] = {0};
-            char param_str[128] = {0};
-
-            // extract function name + params inside ()
-            // ex: "add(c, d)" -> func="add", param_str="c, d"
-            sscanf(line, "%127[^ (](%127[^)])", func, param_str);
-
-            trim(func);
-            trim(param_str);
-
-            if (!text_written) { 
-                fprintf(fout, ".text\n");
-                text_written = true;
-            }
-
-            fprintf(fout, ".global %s\n%s:\n", func, func);
-
-            // split parameters by comma
-            char *p = strtok(param_str, ",");
-            int reg = 0;
-
-            while (p) {
-                char *name = trim(p);                // variable name
-                char *vlabel = assign_var(name);     // get label for variable storage
-
-                // store incoming argument register into that variable
-                fprintf(fout, "    // param %s\n", name);
-                fprintf(fout, "    adrp x9, %s@PAGE\n", vlabel);
-                fprintf(fout, "    str w%d, [x9, %s@PAGEOFF]\n", reg, vlabel);
-
-                reg++;
-                p = strtok(NULL, ",");
-            }
-
-            continue;
-        }
-
-        if (strcmp(line, "}") == 0) {
-            if (loop_depth > 0) {
-                LoopLabel *L = &loop_stack[loop_depth - 1];
-
-                // decrement counter
-                fprintf(fout, "    adrp x9, %s@PAGE\n", L->counter_var);
-                fprintf(fout, "    ldr w0, [x9, %s@PAGEOFF]\n", L->counter_var);
-                fprintf(fout, "    sub w0, w0, #1\n");
-                fprintf(fout, "    str w0, [x9, %s@PAGEOFF]\n", L->counter_var);
-
-                // jump back
-                fprintf(fout, "    b %s\n", L->label_start);
-
-                // exit label
-                fprintf(fout, "%s:\n", L->label_end);
-
-                loop_depth--;
-                continue;
-            }
-            if (if_counter > 0) {
-                IfLabel *curr = &if_stack[if_counter - 1];
-
-                if (curr->has_else) {
-                    fprintf(fout, "%s:\n", curr->label_end);
-                } else {
-                    fprintf(fout, "%s:\n", curr->label_else);
-                }
-
-                if_counter--;
-
-            }
-            continue;
-        }
-
-        // FUNCTION CALL WITH PARAMETERS:  func(a,b,c)
-        if (strstr(line, "bl ") && strchr(line,'(') && strchr(line,')')) {
-
-            char fname[64], params[128];
-            sscanf(line, "bl %63[^ (](%127[^)])", fname, params);
-
-            trim(fname);
-            trim(params);
-
-            // split params and move them into w0,w1,w2...
-            char *p = strtok(params,",");
-            int reg = 0;
-
-            while (p) {
-                char *arg = trim(p);
-                char *vlabel = get_var_label(arg);
-
-                // load argument variable into correct register
-                fprintf(fout, "    adrp x9, %s@PAGE\n", vlabel);
-                fprintf(fout, "    ldr w%d, [x9, %s@PAGEOFF]\n", reg, vlabel);
-
-                reg++;
-                p = strtok(NULL,",");
-            }
-
-            // finally call function
-            fprintf(fout, "    bl %s\n", fname);
-            continue;
-        }
-
-        if (strncmp(line, "loop ", 5) == 0) {
-            char expr[256];
-
-            // strip "loop " and optional "{"
-            strcpy(expr, line + 5);
-            char *brace = strchr(expr, '{');
-            if (brace) *brace = '\0';
-            trim(expr);
-
-            LoopLabel *L = &loop_stack[loop_depth++];
-
-            // create unique labels
-            snprintf(L->label_start, sizeof(L->label_start), "_loop_%d", loop_seq);
-            snprintf(L->label_end, sizeof(L->label_end), "_loop_end_%d", loop_seq);
-
-            // create hidden counter variable
-            snprintf(L->counter_var, sizeof(L->counter_var), "_loop_counter_%d", loop_seq);
-            assign_var(L->counter_var);
-
-            loop_seq++;
-
-            /* ---- evaluate expression into w0 ---- */
-
-            char a[128], b[128];
-            char op;
-
-            if (sscanf(expr, "%127s %c %127s", a, &op, b) == 3) {
-                const char *asmop = NULL;
-                if (op == '+') asmop = "add";
-                else if (op == '-') asmop = "sub";
-                else if (op == '*') asmop = "mul";
-                else if (op == '/') asmop = "sdiv";
-                else error_syntax(line_num, "Invalid operator in loop");
-
-                // load a → w0
-                if (is_number(a)) {
-                    fprintf(fout, "    mov w0, #%s\n", a);
-                } else {
-                    char *al = get_var_label(a);
-                    if (!al) error_undef(line_num, a);
-                    fprintf(fout, "    adrp x9, %s@PAGE\n", al);
-                    fprintf(fout, "    ldr w0, [x9, %s@PAGEOFF]\n", al);
-                }
-
-                // load b → w1
-                if (is_number(b)) {
-                    fprintf(fout, "    mov w1, #%s\n", b);
-                } else {
-                    char *bl = get_var_label(b);
-                    if (!bl) error_undef(line_num, b);
-                    fprintf(fout, "    adrp x9, %s@PAGE\n", bl);
-                    fprintf(fout, "    ldr w1, [x9, %s@PAGEOFF]\n", bl);
-                }
-
-                fprintf(fout, "    %s w0, w0, w1\n", asmop);
-            } else {
-                // simple value
-                if (is_number(expr)) {
-                    fprintf(fout, "    mov w0, #%s\n", expr);
-                } else {
-                    char *el = get_var_label(expr);
-                    if (!el) error_undef(line_num, expr);
-                    fprintf(fout, "    adrp x9, %s@PAGE\n", el);
-                    fprintf(fout, "    ldr w0, [x9, %s@PAGEOFF]\n", el);
-                }
-            }
-
-            // store initial counter
-            fprintf(fout, "    adrp x9, %s@PAGE\n", L->counter_var);
-            fprintf(fout, "    str w0, [x9, %s@PAGEOFF]\n", L->counter_var);
-
-            // loop start label
-            fprintf(fout, "%s:\n", L->label_start);
-
-            // if counter == 0 → exit loop
-            fprintf(fout, "    adrp x9, %s@PAGE\n", L->counter_var);
-            fprintf(fout, "    ldr w0, [x9, %s@PAGEOFF]\n", L->counter_var);
-            fprintf(fout, "    cbz w0, %s\n", L->label_end);
-
-            continue;
-        }
-
-        if (strncmp(line, "exit(", 5) == 0 && line[strlen(line)-1] == ')') {
-            fprintf(fout,
-                    "   ldr x16, =0x2000001\n"
-                    "   mov x0, 0\n"
-                    "   svc 0\n"
-            );
-            continue;
-        }
-
-        // ---- print(...) statement
-        if (strncmp(line, "print(", 6) == 0 && line[strlen(line)-1] == ')') {
-            char buf[MAX_LINE];
-            size_t len = strlen(line);
-            if (len < 7) {
-                error_syntax(line_num, "too few arguments in print call");
-                continue;
-            }
-            strncpy(buf, line + 6, len - 7); // extract inside parentheses
-            buf[len - 7] = '\0';
-            char *arg = trim(buf);
-            char *comma = strchr(arg, ',');
-            if (comma) error_syntax(line_num, "Too many arguments in print()");
-
-            const char *label = NULL;
-            size_t print_len = 0;
-
-            // string literal
-            if (arg[0] == '"' && arg[strlen(arg)-1] == '"') {
-                arg[strlen(arg)-1] = '\0';
-                char *strval = arg + 1;
-
-                if (strcmp(strval, "\n") == 0) {
-                    label = "str_newline";
-                    print_len = 1;
-                } else {
-                    // generate a unique label
-                    static int str_counter = 0;
-                    char tmp_label[64];
-                    snprintf(tmp_label, sizeof(tmp_label), "str_%d", str_count);
-                    label = tmp_label;
-
-                    // store in str_literals array; will emit later at top
-                    add_string_literal_with_label(strval, label);
-                    print_len = strlen(strval);
-                }
-
-                // emit write syscall
-                fprintf(fout, "    // print string literal\n");
-                fprintf(fout, "    ldr x16, =0x2000004\n");
-                fprintf(fout, "    mov x0, 1\n");
-                fprintf(fout, "    adrp x1, %s@PAGE\n", label);
-                fprintf(fout, "    add x1, x1, %s@PAGEOFF\n", label);
-                fprintf(fout, "    mov x2, %zu\n", print_len);
-                fprintf(fout, "    svc 0\n");
-
-            } else { 
-                // numeric variable
-                char *vlabel = get_var_label(arg);
-                if (!vlabel) error_undef(line_num, arg);
-
-                fprintf(fout, "    // print variable %s (convert to string)\n", arg);
-
-                // load variable into w0
-                fprintf(fout, "    adrp x9, %s@PAGE\n", vlabel);
-                fprintf(fout, "    ldr w0, [x9, %s@PAGEOFF]\n", vlabel);
-
-                // stack buffer
-                fprintf(fout, "    sub sp, sp, #32\n");
-                fprintf(fout, "    mov x1, sp\n");
-                fprintf(fout, "    mov w2, #0\n");
-                fprintf(fout, "    mov w4, #10\n");
-
-                // convert number -> ASCII (reverse)
-                fprintf(fout,
-                    "1: udiv w3, w0, w4\n"
-                    "   msub w5, w3, w4, w0\n"
-                    "   add w5, w5, #'0'\n"
-                    "   strb w5, [x1, w2, uxtw]\n"
-                    "   add w2, w2, #1\n"
-                    "   mov w0, w3\n"
-                    "   cbnz w0, 1b\n"
-                );
-
-                // reverse buffer
-                fprintf(fout,
-                    "   mov w6, #0\n"
-                    "   mov w7, w2\n"
-                    "   sub w7, w7, #1\n"
-                    "3: ldrb w8, [x1, w6, uxtw]\n"
-                    "   ldrb w9, [x1, w7, uxtw]\n"
-                    "   strb w8, [x1, w7, uxtw]\n"
-                    "   strb w9, [x1, w6, uxtw]\n"
-                    "   add w6, w6, #1\n"
-                    "   sub w7, w7, #1\n"
-                    "   cmp w6, w7\n"
-                    "   blt 3b\n"
-                );
-
-                // write syscall
-                fprintf(fout,
-                    "   ldr x16, =0x2000004\n"
-                    "   mov x0, #1\n"
-                    "   svc 0\n"
-                );
-
-                // restore stack
-                fprintf(fout, "    add sp, sp, #32\n");
-            }
-
-            continue;
-        }
-
-        if (strncmp(line, "if ", 3) == 0) {
-            char *brace = strchr(line, '{');
-            if (brace) *brace = '\0';
-            trim(line);
-            char cond[128];
-            sscanf(line + 3, "%127[^{]", cond); // get everything up to '{'
-            trim(cond);
-
-            char val1[64], val2[64], op[3];
-            if (sscanf(cond, "%63s %2s %63s", val1, op, val2) != 3) {
-                error_syntax(line_num, "Malformed if condition");
-            }
-
-            // load val1 -> w0
-            if (is_number(val1)) {
-                fprintf(fout, "    mov w0, #%s\n", val1);
-            } else {
-                char *l = get_var_label(val1);
-                if (!l) error_undef(line_num, val1);
-                fprintf(fout, "    adrp x9, %s@PAGE\n", l);
-                fprintf(fout, "    ldr w0, [x9, %s@PAGEOFF]\n", l);
-            }
-
-            // load val2 -> w1
-            if (is_number(val2)) {
-                fprintf(fout, "    mov w1, #%s\n", val2);
-            } else {
-                char *l = get_var_label(val2);
-                if (!l) error_undef(line_num, val2);
-                fprintf(fout, "    adrp x9, %s@PAGE\n", l);
-                fprintf(fout, "    ldr w1, [x9, %s@PAGEOFF]\n", l);
-            }
-
-            fprintf(fout, "    cmp w0, w1\n");
-
-            // generate unique labels
-            int curr_if = if_counter;
-            static int if_label_seq = 0;
-
-            snprintf(if_stack[curr_if].label_else, sizeof(if_stack[curr_if].label_else),
-                    "if_else_%d", if_label_seq);
-            snprintf(if_stack[curr_if].label_end, sizeof(if_stack[curr_if].label_end),
-                    "if_end_%d", if_label_seq);
-            if_label_seq++;
-
-
-            // branch based on operator
-            if (strcmp(op, "<") == 0) fprintf(fout, "    b.ge %s\n", if_stack[curr_if].label_else);
-            else if (strcmp(op, ">") == 0) fprintf(fout, "    b.le %s\n", if_stack[curr_if].label_else);
-            else if (strcmp(op, "==") == 0) fprintf(fout, "    b.ne %s\n", if_stack[curr_if].label_else);
-            else if (strcmp(op, "!=") == 0) fprintf(fout, "    b.eq %s\n", if_stack[curr_if].label_else);
-            else if (strcmp(op, "=!") == 0) fprintf(fout, "    b.eq %s\n", if_stack[curr_if].label_else);
-            else if (strcmp(op, "<=") == 0) fprintf(fout, "    b.gt %s\n", if_stack[curr_if].label_else);
-            else if (strcmp(op, "=<") == 0) fprintf(fout, "    b.gt %s\n", if_stack[curr_if].label_else);
-            else if (strcmp(op, ">=") == 0) fprintf(fout, "    b.lt %s\n", if_stack[curr_if].label_else);
-            else if (strcmp(op, "=>") == 0) fprintf(fout, "    b.lt %s\n", if_stack[curr_if].label_else);
-            else error_syntax(line_num, "Unsupported operator in if");
-
-            // now increment counter
-            if_counter++;
-
-
-            continue;
+    // the interpreter's bytecode comes from file.nbc when the source has
+    // not changed since it was written; the JIT needs the parsed program
+    Bytecode bc;
+    int status;
+    char *cache_path = NULL;
+    uint64_t hash = 0;
+    if (cache && !jit && !tier_threshold && strcmp(argv[arg], "-") != 0) {
+        cache_path = nbc_path(argv[arg]);
+        hash = nbc_hash(in.data, in.len);
+        if (nbc_load(cache_path, hash, &bc)) {
+            xfree(cache_path);
+            free_source(&in);
+            status = interp_run(&bc, NULL);
+            bytecode_free(&bc);
+            return status;
         }
+    }
 
-        // check for '} else {' first
-        if (strstr(line, "} else {")) {
-            if (if_counter == 0) error_syntax(line_num, "Unexpected else without matching if");
-
-            IfLabel *curr = &if_stack[if_counter - 1];
-            curr->has_else = true;
-
-            // branch to skip else block
-            fprintf(fout, "    b %s\n", curr->label_end);
-
-            // else label
-            fprintf(fout, "%s:\n", curr->label_else);
-
-            continue;
-        }
+    const char *src = in.data;
+    size_t src_len = in.len;
+    Emitter transpiled = {0};
+    if (transpile_needed(in.data, in.len)) {
+        transpile_buffer(in.data, in.len, &transpiled);
+        src = transpiled.data;
+        src_len = transpiled.len;
+    }
 
-        // check for 'else' alone (possibly with '{')
-        char *ltrim = trim(line);
-        if (strncmp(ltrim, "else", 4) == 0) {
-            if (if_counter == 0) error_syntax(line_num, "Unexpected else without matching if");
+    Arena *arenas = xcalloc(jobs, sizeof(Arena));
+    Program *prog = parse_source(src, src_len, jobs, arenas);
 
-            // remove trailing '{' if present
-            char *brace = strchr(ltrim, '{');
-            if (brace) *brace = '\0';
-            trim(ltrim);
+    if (jit || tier_threshold) {
+        status = jit ? jit_run(prog, jobs) : jit_run_tiered(prog, jobs, tier_threshold);
+        for (int i = 0; i < jobs; i++) arena_free(&arenas[i]);
+        xfree(arenas);
+        emit_free(&transpiled);
+        free_source(&in);
+        return status;
+    }
 
-            IfLabel *curr = &if_stack[if_counter - 1];
-            curr->has_else = true;
+    codegen_resolve(prog);
+    bytecode_compile(prog, &bc, false);
+    codegen_release();
 
-            // branch to skip else block
-            fprintf(fout, "    b %s\n", curr->label_end);
+    // before running, which may never end; no cache is no error
+    if (cache_path) {
+        nbc_save(&bc, hash, cache_path);
+        xfree(cache_path);
+    }
 
-            // else label
-            fprintf(fout, "%s:\n", curr->label_else);
+    for (int i = 0; i < jobs; i++) arena_free(&arenas[i]);
+    xfree(arenas);
+    emit_free(&transpiled);
+    free_source(&in);
 
-            continue;
-        }
+    status = interp_run(&bc, NULL);
+    bytecode_free(&bc);
+    return status;
+}
 
+// --print-after-all
+static void print_ir(void *ctx, const char *pass, const IrProgram *ir) {
+    (void)ctx;
+    Emitter text = {0};
+    emit_text(&text, "; *** IR after ");
+    emit_text(&text, pass);
+    emit_text(&text, " ***\n");
+    ir_dump(&text, ir);
+    emit_write(&text, 2);
+    emit_free(&text);
+}
 
-        // ---- typed declaration: num <var> = <expr>
-                // ---- typed declaration: num <var> = <expr>
-        if (strncmp(line, "num ", 4) == 0) {
-            char *rest = trim(line + 4);
-            // split on top-level '='
-            char *sep = find_top_level_sep(rest);
-            if (!sep || *sep != '=') {
-                error_syntax(line_num, "Unsupported decleration syntax in num type decleration");
+int main(int argc, char **argv) {
+    if (argc > 1 && strcmp(argv[1], "run") == 0) return run_main(argc, argv);
+
+    bool report = false, report_json = false;
+    bool emit_asm = false, integrated_as = true, print_after_all = false;
+    const char *pipeline = IR_DEFAULT_PIPELINE;
+    int jobs = pool_default_jobs();
+    const Target *target = target_default();
+    int arg = 1;
+    for (; arg < argc && argv[arg][0] == '-' && argv[arg][1]; arg++) {
+        if (strcmp(argv[arg], "--time-report") == 0) {
+            report = true;
+        } else if (strcmp(argv[arg], "--time-report=json") == 0) {
+            report = report_json = true;
+        } else if (strcmp(argv[arg], "-S") == 0) {
+            emit_asm = true;
+        } else if (strcmp(argv[arg], "-fno-integrated-as") == 0) {
+            integrated_as = false;
+        } else if (strcmp(argv[arg], "-fno-peephole") == 0) {
+            arm64_peephole = false;
+        } else if (strcmp(argv[arg], "--emit=c") == 0 || strcmp(argv[arg], "--emit=llvm") == 0) {
+            // source text like -S, the C compiler or LLVM does the rest
+            target = argv[arg][7] == 'c' ? &target_c : &target_llvm;
+            emit_asm = true;
+        } else if (strcmp(argv[arg], "--emit=ir") == 0) {
+            target = &target_ir;
+            emit_asm = true;
+        } else if (strncmp(argv[arg], "--passes=", 9) == 0) {
+            // checked here, before any temp file exists to clean up
+            pipeline = argv[arg] + 9;
+            if (!ir_pipeline_valid(pipeline)) {
+                fprintf(stderr, "Unknown pass in --passes=%s\n", pipeline);
+                usage(argv[0]);
                 return 1;
             }
-            *sep = '\0';
-            char lhsbuf[128], rhsbuf[256];
-            strncpy(lhsbuf, rest, sizeof(lhsbuf)-1); lhsbuf[sizeof(lhsbuf)-1] = '\0';
-            strncpy(rhsbuf, sep+1, sizeof(rhsbuf)-1); rhsbuf[sizeof(rhsbuf)-1] = '\0';
-            char *varname = trim(lhsbuf);
-            char *rhs = trim(rhsbuf);
-            // check redefinition
-            // if (get_var_label(varname) != NULL) error_redef(line_num, varname);
-            // assign var (returns a memory label like "var_3")
-            char *vlabel = assign_var(varname);
-
-            // check if rhs is math: a <op> b
-            char a[128], b[128];
-            char op;
-            if (sscanf(rhs, "%127s %c %127s", a, &op, b) == 3) {
-                const char *asmop = NULL;
-                switch (op) {
-                    case '+': asmop = "add"; break;
-                    case '-': asmop = "sub"; break;
-                    case '*': asmop = "mul"; break;
-                    case '/': asmop = "sdiv"; break;
-                }
-                if (!asmop) { error_syntax(line_num, "Unsupported operator in function call"); return 1; }
-
-                // load operand a into w0
-                if (is_number(a)) {
-                    fprintf(fout, "    mov w0, #%s\n", a);
-                } else if (is_register(a)) {
-                    fprintf(fout, "    mov w0, %s\n", a);
-                } else {
-                    char *alabel = get_var_label(a);
-                    if (!alabel) error_undef(line_num, a);
-                    fprintf(fout, "    adrp x9, %s@PAGE\n", alabel);
-                    fprintf(fout, "    ldr  w0, [x9, %s@PAGEOFF]\n", alabel);
-                }
-
-                // load operand b into w1
-                if (is_number(b)) {
-                    fprintf(fout, "    mov w1, #%s\n", b);
-                } else if (is_register(b)) {
-                    fprintf(fout, "    mov w1, %s\n", b);
-                } else {
-                    char *blabel = get_var_label(b);
-                    if (!blabel) error_undef(line_num, b);
-                    fprintf(fout, "    adrp x9, %s@PAGE\n", blabel);
-                    fprintf(fout, "    ldr  w1, [x9, %s@PAGEOFF]\n", blabel);
-                }
-
-                // compute into w2 and store into variable memory
-                fprintf(fout, "    %s w2, w0, w1\n", asmop);
-                fprintf(fout, "    adrp x9, %s@PAGE\n", vlabel);
-                fprintf(fout, "    str  w2, [x9, %s@PAGEOFF]\n", vlabel);
-            } else {
-                // simple assign: num x = <literal/register/var>
-                // simple assign: num x = <literal/register/var>
-                if (is_number(rhs)) {
-
-                    fprintf(fout, "    mov w0, #%s\n", rhs);
-                    fprintf(fout, "    adrp x9, %s@PAGE\n", vlabel);
-                    fprintf(fout, "    str  w0, [x9, %s@PAGEOFF]\n", vlabel);
-
-                } else if (is_register(rhs)) {
-
-                    fprintf(fout, "    adrp x9, %s@PAGE\n", vlabel);
-                    fprintf(fout, "    str  %s, [x9, %s@PAGEOFF]\n", rhs, vlabel);
-
-                } else {
-
-                    // variable RHS: load then store
-                    char *rlabel = get_var_label(rhs);
-                    if (!rlabel) error_undef(line_num, rhs);
-
-                    fprintf(fout, "    adrp x9, %s@PAGE\n", rlabel);
-                    fprintf(fout, "    ldr  w0, [x9, %s@PAGEOFF]\n", rlabel);
-
-                    fprintf(fout, "    adrp x9, %s@PAGE\n", vlabel);
-                    fprintf(fout, "    str  w0, [x9, %s@PAGEOFF]\n", vlabel);
-                }
-            }
-            continue;
-        }
-
-        // ---- setr / setm (supports both '=' and ',') robust parsing
-        if (strncmp(line, "setr", 4) == 0 || strncmp(line, "setm", 4) == 0) {
-            bool is_setr = (strncmp(line, "setr", 4) == 0);
-            char *rest = trim(line + 4);
-            char *sep = find_top_level_sep(rest);
-            if (!sep) { error_syntax(line_num, "Expected ',' or '=' in setr/setm function call"); continue; }
-            char sepch = *sep;
-            *sep = '\0';
-            char lhsbuf[MAX_LINE], rhsbuf[MAX_LINE];
-            strncpy(lhsbuf, rest, sizeof(lhsbuf)-1); lhsbuf[sizeof(lhsbuf)-1]='\0';
-            strncpy(rhsbuf, sep+1, sizeof(rhsbuf)-1); rhsbuf[sizeof(rhsbuf)-1]='\0';
-            char *lhs = trim(lhsbuf);
-            char *rhs = trim(rhsbuf);
-
-            // count commas in the rest of the statement
-            int comma_count = 0;
-            for (char *p = rest; *p; ++p) {
-                if (*p == ',') comma_count++;
-            }
-
-            if (comma_count > 1) {
-                error_syntax(line_num, "Too many arguments in setr/setm function call");
+        } else if (strcmp(argv[arg], "--print-after-all") == 0) {
+            print_after_all = true;
+        } else if (strncmp(argv[arg], "--target=", 9) == 0) {
+            target = target_find(argv[arg] + 9);
+            if (!target) {
+                fprintf(stderr, "Unknown target: %s\n", argv[arg] + 9);
+                usage(argv[0]);
+                return 1;
             }
-
-            if (is_setr) {
-                // setr dest = src  OR setr dest, src
-                // dest is expected to be a register (e.g. w0) - keep that behavior
-                if (!is_register(lhs)) {
-                    // user attempted to set a non-register with setr: allow register-like usage for lhs by treating it as memory target?
-                    // Here we treat lhs as a register name if it looks like one; otherwise error.
-                    fprintf(stderr, "Error: setr destination must be a register (line %d): %s\n", line_num, lhs);
-                    return 1;
-                }
-
-                if (rhs[0] == '[') {
-                    // memory operand form preserved as-is
-                    fprintf(fout, "    ldr %s, %s\n", lhs, rhs);
-                } else if (is_number(rhs)) {
-                    fprintf(fout, "    mov %s, #%s\n", lhs, rhs);
-                } else if (is_register(rhs)) {
-                    fprintf(fout, "    mov %s, %s\n", lhs, rhs);
-                } else {
-                    // rhs can now be a variable in RAM: load it into the register
-                    char *rlabel = get_var_label(rhs);
-                    if (!rlabel) error_undef(line_num, rhs);
-                    fprintf(fout, "    adrp x9, %s@PAGE\n", rlabel);
-                    fprintf(fout, "    ldr  %s, [x9, %s@PAGEOFF]\n", lhs, rlabel);
-                }
-            } else {
-                // setm MEM, SRC
-                int lhs_is_mem = (lhs[0] == '[');
-                int lhs_is_var = is_var(lhs);
-
-                if (!lhs_is_mem && !lhs_is_var) {
-                    fprintf(stderr,
-                        "Error: setm destination must be memory (line %d): %s\n",
-                        line_num, lhs);
-                    return 1;
-                }
-
-                /* ---- load RHS into w0 if needed ---- */
-
-                if (is_number(rhs)) {
-
-                    fprintf(fout, "    mov w0, #%s\n", rhs);
-
-                } else if (is_register(rhs)) {
-
-                    fprintf(fout, "    mov w0, %s\n", rhs);
-
-                } else if (is_var(rhs)) {
-
-                    char *rlabel = get_var_label(rhs);
-                    fprintf(fout, "    adrp x9, %s@PAGE\n", rlabel);
-                    fprintf(fout, "    ldr  w0, [x9, %s@PAGEOFF]\n", rlabel);
-
-                } else {
-                    error_undef(line_num, rhs);
-                }
-
-                /* ---- store w0 into LHS ---- */
-
-                if (lhs_is_mem) {
-
-                    // e.g. [sp, #4]
-                    fprintf(fout, "    str w0, %s\n", lhs);
-
-                } else {
-                    // lhs is a variable
-                    char *llabel = get_var_label(lhs);
-                    fprintf(fout, "    adrp x9, %s@PAGE\n", llabel);
-                    fprintf(fout, "    str  w0, [x9, %s@PAGEOFF]\n", llabel);
-                }
-
+        } else if (strncmp(argv[arg], "-j", 2) == 0) {
+            const char *n = argv[arg][2] ? argv[arg] + 2 : (arg + 1 < argc ? argv[++arg] : "");
+            jobs = atoi(n);
+            if (jobs < 1) {
+                usage(argv[0]);
+                return 1;
             }
-            continue;
+        } else {
+            usage(argv[0]);
+            return 1;
         }
+    }
+    if (argc - arg != 2) {
+        usage(argv[0]);
+        return 1;
+    }
+    const char *input = argv[arg];
+    const char *output = argv[arg + 1];
 
-        // ---- math: dest = a <op> b  (dest can be a register or a declared variable (memory))
-        {
-            char dest[128], a[128], b[128];
-            char oper;
-            if (sscanf(line, "%127s = %127s %c %127s", dest, a, &oper, b) == 4) {
-                const char *asmop = NULL;
-                switch (oper) {
-                    case '+': asmop = "add"; break;
-                    case '-': asmop = "sub"; break;
-                    case '*': asmop = "mul"; break;
-                    case '/': asmop = "sdiv"; break;
-                }
-                if (!asmop) { fprintf(stderr, "Unsupported operator (line %d)\n", line_num); return 1; }
-
-                bool dest_is_reg = is_register(dest);
-                char *dest_label = NULL;
-                if (!dest_is_reg) {
-                    dest_label = get_var_label(dest);
-                    if (!dest_label) error_undef(line_num, dest);
-                }
-
-                // load a -> w0
-                if (is_number(a)) {
-                    fprintf(fout, "    mov w0, #%s\n", a);
-                } else if (is_register(a)) {
-                    fprintf(fout, "    mov w0, %s\n", a);
-                } else {
-                    char *alabel = get_var_label(a);
-                    if (!alabel) error_undef(line_num, a);
-                    fprintf(fout, "    adrp x9, %s@PAGE\n", alabel);
-                    fprintf(fout, "    ldr  w0, [x9, %s@PAGEOFF]\n", alabel);
-                }
-
-                // load b -> w1
-                if (is_number(b)) {
-                    fprintf(fout, "    mov w1, #%s\n", b);
-                } else if (is_register(b)) {
-                    fprintf(fout, "    mov w1, %s\n", b);
-                } else {
-                    char *blabel = get_var_label(b);
-                    if (!blabel) error_undef(line_num, b);
-                    fprintf(fout, "    ldr w1, %s\n", blabel);
-                }
-
-                // compute -> w2
-                fprintf(fout, "    %s w2, w0, w1\n", asmop);
-
-                // store result to dest (register or memory)
-                if (dest_is_reg) {
-                    fprintf(fout, "    mov %s, w2\n", dest);
-                } else {
-
-                    fprintf(fout, "    adrp x9, %s@PAGE\n", dest_label);
-                    fprintf(fout, "    str w2, [x9, %s@PAGEOFF]\n", dest_label);
-                }
-                continue;
-            }
-        }
+    if (report) timing_start();
 
-        // ---- simple assignment: left = right  (left can be a register or a declared variable in RAM)
-        {
-            // ---- simple assignment: left = right (left can be reg or variable)
-            {
-                char left[128], right[256];
-                if (sscanf(line, "%127s = %255s", left, right) == 2) {
-
-                    bool left_is_reg = is_register(left);
-                    char *left_label = NULL;
-                    if (!left_is_reg) {
-                        left_label = get_var_label(left);
-                        if (!left_label) error_undef(line_num, left);
-                    }
-
-                    // Number
-                    if (is_number(right)) {
-                        fprintf(fout, "    mov w0, #%s\n", right);
-
-                        if (left_is_reg) {
-                            fprintf(fout, "    mov %s, w0\n", left);
-                        } else {
-                            fprintf(fout, "    adrp x9, %s@PAGE\n", left_label);
-                            fprintf(fout, "    str  w0, [x9, %s@PAGEOFF]\n", left_label);
-                        }
-                        continue;
-                    }
-
-                    // Register
-                    if (is_register(right)) {
-                        if (left_is_reg) {
-                            fprintf(fout, "    mov %s, %s\n", left, right);
-                        } else {
-                            fprintf(fout, "    adrp x9, %s@PAGE\n", left_label);
-                            fprintf(fout, "    str  %s, [x9, %s@PAGEOFF]\n", right, left_label);
-                        }
-                        continue;
-                    }
-
-                    // Variable in RAM
-                    char *rlabel = get_var_label(right);
-                    if (!rlabel) error_undef(line_num, right);
-
-                    // Load rlabel → w0
-                    fprintf(fout, "    adrp x9, %s@PAGE\n", rlabel);
-                    fprintf(fout, "    ldr  w0, [x9, %s@PAGEOFF]\n", rlabel);
-
-                    if (left_is_reg) {
-                        fprintf(fout, "    mov %s, w0\n", left);
-                    } else {
-                        fprintf(fout, "    adrp x9, %s@PAGE\n", left_label);
-                        fprintf(fout, "    str  w0, [x9, %s@PAGEOFF]\n", left_label);
-                    }
-
-                    continue;
-                }
-            }
+    SourceFile in;
+    if (!load_source(input, &in)) {
+        fprintf(stderr, "Could not open files\n");
+        return 1;
+    }
 
+    // Run transpiler first, straight into memory. Plain nevo needs no
+    // rewriting and is lexed right out of the mapped file.
+    const char *src = in.data;
+    size_t src_len = in.len;
+    Emitter transpiled = {0};
+    timing_begin(PHASE_TRANSPILE);
+    if (transpile_needed(in.data, in.len)) {
+        transpile_buffer(in.data, in.len, &transpiled);
+        src = transpiled.data;
+        src_len = transpiled.len;
+    }
+    timing_end(PHASE_TRANSPILE);
+
+    // -S or a .s output stops at the assembly text, anything else is
+    // assembled, and linked unless it is a .o
+    bool assemble = !emit_asm && !ends_with(output, ".s");
+    bool link = assemble && !ends_with(output, ".o");
+    char asm_path[64], obj_path[64];
+    const char *obj = output;
+    if (link) {
+        int fd = temp_file(obj_path, sizeof(obj_path), ".o");
+        if (fd < 0) {
+            fprintf(stderr, "Could not open files\n");
+            return 1;
         }
-        
-
-        // fallback: emit raw (indented)
-        if (strcmp(line, "{") == 0 || strcmp(line, "}") == 0)
-            continue; // skip literal braces
-
-
-        trim(line);
-        if (line[0] == '\0') continue;
+        close(fd);
+        obj = obj_path;
+    }
 
-        fprintf(fout, "    %s\n", line);
+    // Lex and parse in one pass over the source, building the tree.
+    // Functions are independent, so the source is split between them
+    // and each worker parses its share into its own arena.
+    Arena *arenas = xcalloc(jobs, sizeof(Arena));
+    timing_begin(PHASE_PARSE);
+    Program *prog = parse_source(src, src_len, jobs, arenas);
+    timing_end(PHASE_PARSE);
+
+    // assembly is built in memory and written out in one go
+    Emitter out = {0};
+    timing_begin(PHASE_CODEGEN);
+    if (!target->isa->lower) codegen_program(&out, prog, jobs, target);
+    else codegen_ir(&out, prog, target, pipeline, print_after_all ? print_ir : NULL, NULL);
+    timing_end(PHASE_CODEGEN);
+
+    // the integrated assembler encodes the text in memory; the system
+    // one reads it from a temp file
+    Emitter bytes = {0};
+    bool encoded = false;
+    if (assemble && integrated_as) {
+        timing_begin(PHASE_ASSEMBLE);
+        encoded = encode_object(&out, target, &bytes);
+        timing_end(PHASE_ASSEMBLE);
+    }
 
+    const char *path = encoded ? obj : output;
+    int fout;
+    if (assemble && !encoded) {
+        fout = temp_file(asm_path, sizeof(asm_path), ".s");
+        path = asm_path;
+    } else {
+        fout = open(path, O_WRONLY | O_CREAT | O_TRUNC, 0644);
+    }
+    if (fout < 0) {
+        fprintf(stderr, "Could not open files\n");
+        if (link) unlink(obj_path);
+        return 1;
     }
 
-    fprintf(fout, "    ldr x16, =0x2000001   // exit syscall\n");
-    fprintf(fout, "    mov x0, 0\n");
-    fprintf(fout, "    svc 0\n");
+    timing_begin(PHASE_EMIT);
+    int written = emit_write(encoded ? &bytes : &out, fout);
+    close(fout);
+    timing_end(PHASE_EMIT);
+    if (written != 0) {
+        fprintf(stderr, "Could not write %s\n", path);
+        if (path == asm_path) unlink(asm_path);
+        if (link) unlink(obj_path);
+        return 1;
+    }
 
-    emit_all_variables(fout);
-    emit_all_string_literals(fout);
+    emit_free(&bytes);
+    emit_free(&out);
+    for (int i = 0; i < jobs; i++) arena_free(&arenas[i]);
+    xfree(arenas);
+    emit_free(&transpiled);
+    free_source(&in);
+
+    bool ok = true;
+    if (assemble && !encoded) {
+        ok = run_cc(PHASE_ASSEMBLE, asm_path, obj, true, target);
+        unlink(asm_path);
+    }
+    if (ok && link) ok = run_cc(PHASE_LINK, obj, output, false, target);
+    if (link) unlink(obj_path);
+    if (!ok) {
+        fprintf(stderr, "Could not build %s\n", output);
+        return 1;
+    }
 
-    fclose(fin);
-    fclose(fout);
-    printf("Transpilation complete: %s -> %s\n", argv[1], argv[2]);
+    if (report_json) {
+        timing_report(stdout, input, true);
+        return 0;
+    }
+    printf("Transpilation complete: %s -> %s\n", input, output);
+    if (report) {
+        fflush(stdout);
+        timing_report(stderr, input, false);
+    }
     return 0;
-}
\ No newline at end of file
+}
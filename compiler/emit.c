@@ -0,0 +1,80 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <errno.h>
+#include <unistd.h>
+
+#include "emit.h"
+#include "mem.h"
+
+void emit_reserve(Emitter *e, size_t extra) {
+    if (e->len + extra <= e->cap) return;
+    size_t cap = e->cap ? e->cap : 64 * 1024;
+    while (cap < e->len + extra) cap *= 2;
+    e->data = xrealloc(e->data, cap);
+    e->cap = cap;
+}
+
+void emit_free(Emitter *e) {
+    xfree(e->data);
+    e->data = NULL;
+    e->len = e->cap = 0;
+}
+
+int emit_write(const Emitter *e, int fd) {
+    size_t done = 0;
+    while (done < e->len) {
+        ssize_t n = write(fd, e->data + done, e->len - done);
+        if (n < 0) {
+            if (errno == EINTR) continue;
+            return -1;
+        }
+        done += (size_t)n;
+    }
+    return 0;
+}
+
+int emit_format_int(char *buf, long v) {
+    char tmp[20];
+    unsigned long u = v < 0 ? 0UL - (unsigned long)v : (unsigned long)v;
+    int n = 0, len = 0;
+
+    do {
+        tmp[n++] = (char)('0' + u % 10);
+        u /= 10;
+    } while (u);
+
+    if (v < 0) buf[len++] = '-';
+    while (n) buf[len++] = tmp[--n];
+    buf[len] = '\0';
+    return len;
+}
+
+void emit_int(Emitter *e, long v) {
+    char buf[24];
+    emit_textn(e, buf, emit_format_int(buf, v));
+}
+
+void emit_ins(Emitter *e, const char *op, const char *a, const char *b, const char *c) {
+    emit_textn(e, "    ", 4);
+    emit_text(e, op);
+    if (a) { emit_char(e, ' '); emit_text(e, a); }
+    if (b) { emit_textn(e, ", ", 2); emit_text(e, b); }
+    if (c) { emit_textn(e, ", ", 2); emit_text(e, c); }
+    emit_char(e, '\n');
+}
+
+void emit_op(Emitter *e, const char *op) {
+    emit_textn(e, "    ", 4);
+    emit_text(e, op);
+    emit_char(e, ' ');
+}
+
+void emit_imm(Emitter *e, long v) {
+    emit_char(e, '#');
+    emit_int(e, v);
+}
+
+void emit_label(Emitter *e, const char *label) {
+    emit_text(e, label);
+    emit_textn(e, ":\n", 2);
+}
@@ -0,0 +1,53 @@
+#ifndef EMIT_H
+#define EMIT_H
+
+#include <stddef.h>
+#include <string.h>
+
+// Assembly output collects in one growable buffer and goes out with a
+// single write at the end. No printf on the hot path.
+typedef struct {
+    char *data;
+    size_t len;
+    size_t cap;
+} Emitter;
+
+void emit_reserve(Emitter *e, size_t extra);
+void emit_free(Emitter *e);
+
+// write the whole buffer to fd, returns 0 on success
+int emit_write(const Emitter *e, int fd);
+
+static inline void emit_textn(Emitter *e, const char *s, size_t n) {
+    if (e->len + n > e->cap) emit_reserve(e, n);
+    memcpy(e->data + e->len, s, n);
+    e->len += n;
+}
+
+static inline void emit_text(Emitter *e, const char *s) {
+    emit_textn(e, s, strlen(s));
+}
+
+static inline void emit_char(Emitter *e, char c) {
+    if (e->len + 1 > e->cap) emit_reserve(e, 1);
+    e->data[e->len++] = c;
+}
+
+// decimal integer, buf needs 21 bytes; returns the length written
+int emit_format_int(char *buf, long v);
+
+void emit_int(Emitter *e, long v);
+
+// "    mnemonic a, b, c\n", trailing NULL operands are left out
+void emit_ins(Emitter *e, const char *op, const char *a, const char *b, const char *c);
+
+// "    mnemonic " -- the caller writes the operands and the newline
+void emit_op(Emitter *e, const char *op);
+
+// "#v"
+void emit_imm(Emitter *e, long v);
+
+// "label:\n"
+void emit_label(Emitter *e, const char *label);
+
+#endif // EMIT_H
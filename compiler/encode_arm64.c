@@ -0,0 +1,735 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+#include <stdbool.h>
+#include <ctype.h>
+
+#include "encode_arm64.h"
+#include "mem.h"
+
+typedef struct {
+    const char *p;
+    int len;
+} Slice;
+
+typedef struct {
+    int num;        // 0..30, 31 for sp and the zero register
+    bool x;         // 64-bit
+    bool sp;
+    bool zr;
+} Reg;
+
+// branches to names are patched once the whole text has been read
+typedef enum {
+    FIX_B26,        // b
+    FIX_BL26,       // bl
+    FIX_IMM19,      // b.cond, cbz, cbnz
+} FixKind;
+
+typedef struct {
+    uint64_t offset;
+    FixKind kind;
+    int symbol;
+} Fixup;
+
+typedef struct {
+    ObjFile *obj;
+    int section;
+
+    int *table;         // label name -> symbol index + 1, open addressing
+    size_t table_cap;
+
+    Fixup *fixups;
+    int nfix, fix_cap;
+
+    int64_t numeric[10];    // text offset of the last "N:", -1 before one
+} Asm;
+
+#define NOP 0xd503201f
+
+/* ---- symbols ---- */
+
+static uint32_t hash(const char *s, int len) {
+    uint32_t h = 2166136261u;
+    for (int i = 0; i < len; i++) h = (h ^ (unsigned char)s[i]) * 16777619u;
+    return h;
+}
+
+static void table_grow(Asm *a) {
+    xfree(a->table);
+    a->table_cap = a->table_cap ? a->table_cap * 2 : 1024;
+    a->table = xcalloc(a->table_cap, sizeof(int));
+    size_t mask = a->table_cap - 1;
+    for (int i = 0; i < a->obj->nsyms; i++) {
+        const ObjSymbol *s = &a->obj->syms[i];
+        size_t h = hash(s->name, s->len) & mask;
+        while (a->table[h]) h = (h + 1) & mask;
+        a->table[h] = i + 1;
+    }
+}
+
+// index of the symbol for name, added undefined the first time
+static int symbol(Asm *a, Slice name) {
+    if ((size_t)(a->obj->nsyms + 1) * 2 > a->table_cap) table_grow(a);
+    size_t mask = a->table_cap - 1;
+    size_t h = hash(name.p, name.len) & mask;
+    while (a->table[h]) {
+        const ObjSymbol *s = &a->obj->syms[a->table[h] - 1];
+        if (s->len == name.len && memcmp(s->name, name.p, name.len) == 0) return a->table[h] - 1;
+        h = (h + 1) & mask;
+    }
+    int i = obj_add_symbol(a->obj, name.p, name.len);
+    a->table[h] = i + 1;
+    return i;
+}
+
+/* ---- operands ---- */
+
+static bool is_ident_char(char c) {
+    return isalnum((unsigned char)c) || c == '_' || c == '.' || c == '$';
+}
+
+static bool is_name(Slice s) {
+    if (s.len == 0 || isdigit((unsigned char)s.p[0])) return false;
+    for (int i = 0; i < s.len; i++)
+        if (!is_ident_char(s.p[i])) return false;
+    return true;
+}
+
+static bool is(Slice s, const char *word) {
+    return (size_t)s.len == strlen(word) && memcmp(s.p, word, s.len) == 0;
+}
+
+static const char *skip_space(const char *p, const char *end) {
+    while (p < end && isspace((unsigned char)*p)) p++;
+    return p;
+}
+
+static Slice trim(const char *p, const char *end) {
+    p = skip_space(p, end);
+    while (end > p && isspace((unsigned char)end[-1])) end--;
+    return (Slice){ p, (int)(end - p) };
+}
+
+// "a, [b, c], d" at the commas outside brackets, -1 for more than max
+static int split_operands(const char *p, const char *end, Slice *ops, int max) {
+    int n = 0, depth = 0;
+    const char *start = p;
+    if (skip_space(p, end) == end) return 0;
+    for (; p <= end; p++) {
+        if (p < end && *p == '[') depth++;
+        if (p < end && *p == ']') depth--;
+        if (p == end || (*p == ',' && depth == 0)) {
+            if (n == max) return -1;
+            ops[n++] = trim(start, p);
+            start = p + 1;
+        }
+    }
+    return n;
+}
+
+// "w3", "x30", "wzr", "sp"
+static bool parse_reg(Slice s, Reg *r) {
+    memset(r, 0, sizeof(*r));
+    if (is(s, "sp") || is(s, "wsp")) {
+        r->num = 31;
+        r->x = s.len == 2;
+        r->sp = true;
+        return true;
+    }
+    if (s.len < 2 || s.len > 3 || (s.p[0] != 'w' && s.p[0] != 'x')) return false;
+    r->x = s.p[0] == 'x';
+    if (s.len == 3 && s.p[1] == 'z' && s.p[2] == 'r') {
+        r->num = 31;
+        r->zr = true;
+        return true;
+    }
+    if (!isdigit((unsigned char)s.p[1]) || (s.len == 3 && (s.p[1] == '0' || !isdigit((unsigned char)s.p[2]))))
+        return false;
+    r->num = s.p[1] - '0';
+    if (s.len == 3) r->num = r->num * 10 + s.p[2] - '0';
+    return r->num <= 30;
+}
+
+// "#12", "#-1", "#0x200", "#'0'", the '#' optional
+static bool parse_imm(Slice s, int64_t *v) {
+    const char *p = s.p, *end = s.p + s.len;
+    if (p < end && *p == '#') p++;
+    bool neg = p < end && *p == '-';
+    if (neg) p++;
+    if (p == end) return false;
+
+    uint64_t u = 0;
+    if (*p == '\'') {
+        if (end - p < 2 || p[1] == '\\') return false;
+        u = (unsigned char)p[1];
+        p += 2;
+        if (p < end && *p == '\'') p++;
+    } else if (end - p > 2 && p[0] == '0' && (p[1] == 'x' || p[1] == 'X')) {
+        for (p += 2; p < end && isxdigit((unsigned char)*p); p++) {
+            if (u >> 60) return false;
+            u = u * 16 + (uint64_t)(isdigit((unsigned char)*p) ? *p - '0' : (tolower((unsigned char)*p) - 'a' + 10));
+        }
+    } else {
+        if (!isdigit((unsigned char)*p)) return false;
+        for (; p < end && isdigit((unsigned char)*p); p++) {
+            if (u > (UINT64_MAX - 9) / 10) return false;
+            u = u * 10 + (uint64_t)(*p - '0');
+        }
+    }
+    if (p != end) return false;
+    *v = neg ? -(int64_t)u : (int64_t)u;
+    return true;
+}
+
+static bool has_suffix(Slice s, const char *suffix, Slice *rest) {
+    int n = (int)strlen(suffix);
+    if (s.len <= n || memcmp(s.p + s.len - n, suffix, n) != 0) return false;
+    *rest = (Slice){ s.p, s.len - n };
+    return true;
+}
+
+// "label@PAGE", or a bare label on ELF
+static bool parse_page(Slice s, Slice *name) {
+    if (!has_suffix(s, "@PAGE", name)) *name = s;
+    return is_name(*name);
+}
+
+// "label@PAGEOFF", or ":lo12:label" on ELF
+static bool parse_lo12(Slice s, Slice *name) {
+    if (s.len > 6 && memcmp(s.p, ":lo12:", 6) == 0) {
+        *name = (Slice){ s.p + 6, s.len - 6 };
+        return is_name(*name);
+    }
+    return has_suffix(s, "@PAGEOFF", name) && is_name(*name);
+}
+
+static int cond_code(const char *c) {
+    static const char *const names[] = {
+        "eq", "ne", "hs", "lo", "mi", "pl", "vs", "vc",
+        "hi", "ls", "ge", "lt", "gt", "le", "al",
+    };
+    for (int i = 0; i < (int)(sizeof(names) / sizeof(names[0])); i++)
+        if (c[0] == names[i][0] && c[1] == names[i][1]) return i;
+    if (c[0] == 'c' && c[1] == 's') return 2;
+    if (c[0] == 'c' && c[1] == 'c') return 3;
+    return -1;
+}
+
+/* ---- output ---- */
+
+static void put_ins(Asm *a, uint32_t ins) {
+    char b[4] = { (char)ins, (char)(ins >> 8), (char)(ins >> 16), (char)(ins >> 24) };
+    emit_textn(&a->obj->sec[OBJ_TEXT], b, 4);
+}
+
+static uint64_t here(const Asm *a) {
+    return a->obj->sec[a->section].len;
+}
+
+static void reloc(Asm *a, RelocKind kind, Slice name) {
+    obj_add_reloc(a->obj, OBJ_TEXT, here(a), kind, symbol(a, name));
+}
+
+// fills in a branch displacement, false when out of range
+static bool patch_branch(uint32_t *ins, FixKind kind, int64_t delta) {
+    int64_t words = delta / 4;
+    if (kind == FIX_IMM19) {
+        if (words < -(1 << 18) || words >= (1 << 18)) return false;
+        *ins |= ((uint32_t)words & 0x7ffff) << 5;
+    } else {
+        if (words < -(1 << 25) || words >= (1 << 25)) return false;
+        *ins |= (uint32_t)words & 0x3ffffff;
+    }
+    return true;
+}
+
+// b/bl/b.cond/cbz to a label: "1b" resolves now, names at the end
+static bool branch(Asm *a, uint32_t ins, FixKind kind, Slice target) {
+    if (target.len == 2 && isdigit((unsigned char)target.p[0]) && target.p[1] == 'b') {
+        int64_t at = a->numeric[target.p[0] - '0'];
+        if (at < 0 || !patch_branch(&ins, kind, at - (int64_t)here(a))) return false;
+        put_ins(a, ins);
+        return true;
+    }
+    if (!is_name(target)) return false;
+    if (a->nfix == a->fix_cap) {
+        a->fix_cap = a->fix_cap ? a->fix_cap * 2 : 1024;
+        a->fixups = xrealloc(a->fixups, sizeof(Fixup) * a->fix_cap);
+    }
+    a->fixups[a->nfix++] = (Fixup){ here(a), kind, symbol(a, target) };
+    put_ins(a, ins);
+    return true;
+}
+
+/* ---- instructions ---- */
+
+static bool is_shifted_mask(uint64_t v) {
+    uint64_t m = v | (v - 1);
+    return v && ((m + 1) & m) == 0;
+}
+
+// N:immr:imms of a logical immediate (a repeating run of ones), as
+// LLVM's processLogicalImmediate works it out
+static bool logical_imm(uint64_t imm, int width, uint32_t *bits) {
+    uint64_t all = width == 64 ? ~0ULL : (1ULL << width) - 1;
+    imm &= all;
+    if (imm == 0 || imm == all) return false;
+
+    int size = width;
+    do {
+        size /= 2;
+        uint64_t mask = (1ULL << size) - 1;
+        if ((imm & mask) != ((imm >> size) & mask)) {
+            size *= 2;
+            break;
+        }
+    } while (size > 2);
+
+    uint64_t mask = ~0ULL >> (64 - size);
+    imm &= mask;
+    int rotate, ones;
+    if (is_shifted_mask(imm)) {
+        rotate = __builtin_ctzll(imm);
+        ones = __builtin_ctzll(~(imm >> rotate));
+    } else {
+        imm |= ~mask;
+        if (!is_shifted_mask(~imm)) return false;
+        int leading = __builtin_clzll(~imm);
+        rotate = 64 - leading;
+        ones = leading + __builtin_ctzll(~imm) - (64 - size);
+    }
+    uint32_t immr = (uint32_t)(size - rotate) & (uint32_t)(size - 1);
+    uint64_t nimms = (~(uint64_t)(size - 1) << 1) | (uint64_t)(ones - 1);
+    uint32_t n = (uint32_t)((nimms >> 6) & 1) ^ 1;
+    *bits = n << 22 | immr << 16 | (uint32_t)(nimms & 0x3f) << 10;
+    return true;
+}
+
+// "mov rd, #imm": movz, else movn, else orr with a logical immediate
+static bool mov_imm(Asm *a, Reg d, int64_t v) {
+    if (d.sp) return false;
+    int width = d.x ? 64 : 32;
+    if (!d.x && (v < INT32_MIN || v > (int64_t)UINT32_MAX)) return false;
+    uint64_t all = d.x ? ~0ULL : 0xffffffffULL;
+    uint64_t u = (uint64_t)v & all;
+    uint32_t sf = d.x ? 0x80000000 : 0;
+
+    for (int inverted = 0; inverted < 2; inverted++) {
+        uint64_t w = inverted ? ~u & all : u;
+        for (int hw = 0; hw < width / 16; hw++) {
+            if (w & ~(0xffffULL << (16 * hw))) continue;
+            uint32_t base = inverted ? 0x12800000 : 0x52800000;
+            put_ins(a, base | sf | (uint32_t)hw << 21 | (uint32_t)((w >> (16 * hw)) & 0xffff) << 5 | (uint32_t)d.num);
+            return true;
+        }
+    }
+
+    uint32_t bits;
+    if (!logical_imm(u, width, &bits)) return false;
+    put_ins(a, 0x320003e0 | sf | bits | (uint32_t)d.num);
+    return true;
+}
+
+// movz/movk/movn rd, #imm{, lsl #16}
+static bool mov_wide(Asm *a, uint32_t base, const Slice *ops, int n) {
+    Reg d;
+    int64_t v, shift = 0;
+    if (n < 2 || n > 3 || !parse_reg(ops[0], &d) || d.sp || !parse_imm(ops[1], &v)) return false;
+    if (n == 3) {
+        Slice s = ops[2];
+        if (s.len < 4 || memcmp(s.p, "lsl", 3) != 0) return false;
+        if (!parse_imm(trim(s.p + 3, s.p + s.len), &shift)) return false;
+    }
+    if (v < 0 || v > 0xffff || shift % 16 || shift < 0 || shift >= (d.x ? 64 : 32)) return false;
+    put_ins(a, base | (d.x ? 0x80000000 : 0) | (uint32_t)(shift / 16) << 21 | (uint32_t)v << 5 | (uint32_t)d.num);
+    return true;
+}
+
+static bool mov(Asm *a, const Slice *ops, int n) {
+    Reg d, s;
+    int64_t v;
+    if (n != 2 || !parse_reg(ops[0], &d)) return false;
+    if (parse_imm(ops[1], &v)) return mov_imm(a, d, v);
+    if (!parse_reg(ops[1], &s) || s.x != d.x) return false;
+    uint32_t sf = d.x ? 0x80000000 : 0;
+    if (d.sp || s.sp) {
+        // to or from sp it is "add rd, rn, #0"
+        if (d.zr || s.zr) return false;
+        put_ins(a, 0x11000000 | sf | (uint32_t)s.num << 5 | (uint32_t)d.num);
+    } else {
+        // "orr rd, zr, rm"
+        put_ins(a, 0x2a0003e0 | sf | (uint32_t)s.num << 16 | (uint32_t)d.num);
+    }
+    return true;
+}
+
+// add/sub/adds/subs, cmp as subs into the zero register
+static bool add_sub(Asm *a, bool sub, bool flags, Reg d, Reg n, Slice src) {
+    int64_t v;
+    Reg m;
+    Slice name;
+    uint32_t sf = d.x ? 0x80000000 : 0;
+    if (d.x != n.x) return false;
+
+    bool lo12 = !sub && !flags && parse_lo12(src, &name);
+    if (lo12 || parse_imm(src, &v)) {
+        // 31 is sp here, there is no zero register
+        if (n.zr || (d.zr && !flags) || (d.sp && flags)) return false;
+        if (lo12) {
+            reloc(a, RELOC_LO12_ADD, name);
+            v = 0;
+        }
+        if (v < 0) {
+            sub = !sub;
+            v = -v;
+        }
+        uint32_t shift = 0;
+        if (v > 0xfff) {
+            if ((v & 0xfff) || v > 0xfff000) return false;
+            shift = 1;
+            v >>= 12;
+        }
+        put_ins(a, 0x11000000 | sf | (sub ? 0x40000000 : 0) | (flags ? 0x20000000 : 0) |
+                   shift << 22 | (uint32_t)v << 10 | (uint32_t)n.num << 5 | (uint32_t)d.num);
+        return true;
+    }
+
+    // shifted register form, where 31 is the zero register and not sp
+    if (!parse_reg(src, &m) || m.x != d.x || m.sp || n.sp || d.sp) return false;
+    put_ins(a, 0x0b000000 | sf | (sub ? 0x40000000 : 0) | (flags ? 0x20000000 : 0) |
+               (uint32_t)m.num << 16 | (uint32_t)n.num << 5 | (uint32_t)d.num);
+    return true;
+}
+
+// register data processing: mul, sdiv, udiv, and madd/msub with a fourth
+static bool data_reg(Asm *a, uint32_t base, const Slice *ops, int n, int want) {
+    Reg r[4];
+    if (n != want) return false;
+    for (int i = 0; i < n; i++)
+        if (!parse_reg(ops[i], &r[i]) || r[i].sp || r[i].x != r[0].x) return false;
+    uint32_t ra = want == 4 ? (uint32_t)r[3].num : 0;
+    put_ins(a, base | (r[0].x ? 0x80000000 : 0) | (uint32_t)r[2].num << 16 | ra << 10 |
+               (uint32_t)r[1].num << 5 | (uint32_t)r[0].num);
+    return true;
+}
+
+// ldr/str/ldrb/strb; size is log2 of the access. The address is one of
+//   [xN]  [xN, #imm]  [xN, :lo12:label]  [xN, label@PAGEOFF]
+//   [xN, xM]  [xN, wM, uxtw]  [xN, wM, sxtw]
+static bool load_store(Asm *a, bool load, int size, const Slice *ops, int n) {
+    Reg t, base, idx;
+    Slice inner[3], name;
+    int64_t v = 0;
+    if (n != 2 || !parse_reg(ops[0], &t) || t.sp) return false;
+    if (size == 0 && t.x) return false;
+    if (size != 0) size = t.x ? 3 : 2;
+
+    Slice m = ops[1];
+    if (m.len < 2 || m.p[0] != '[' || m.p[m.len - 1] != ']') return false;
+    int k = split_operands(m.p + 1, m.p + m.len - 1, inner, 3);
+    if (k < 1 || !parse_reg(inner[0], &base) || !base.x || base.zr) return false;
+
+    static const uint32_t unsigned_op[4] = { 0x39000000, 0, 0xb9000000, 0xf9000000 };
+    static const uint32_t unscaled_op[4] = { 0x38000000, 0, 0xb8000000, 0xf8000000 };
+    static const uint32_t register_op[4] = { 0x38200800, 0, 0xb8200800, 0xf8200800 };
+    static const RelocKind lo12[4] = { RELOC_LO12_LDST8, 0, RELOC_LO12_LDST32, RELOC_LO12_LDST64 };
+    uint32_t rn_rt = (uint32_t)base.num << 5 | (uint32_t)t.num;
+    uint32_t l = load ? 0x00400000 : 0;
+
+    if (k >= 2 && parse_reg(inner[1], &idx)) {
+        uint32_t option;
+        if (k == 2 && idx.x) option = 3;                    // lsl #0
+        else if (k == 3 && !idx.x && is(inner[2], "uxtw")) option = 2;
+        else if (k == 3 && !idx.x && is(inner[2], "sxtw")) option = 6;
+        else return false;
+        if (idx.sp) return false;
+        put_ins(a, register_op[size] | l | (uint32_t)idx.num << 16 | option << 13 | rn_rt);
+        return true;
+    }
+    if (k > 2) return false;
+    if (k == 2 && parse_lo12(inner[1], &name)) {
+        reloc(a, lo12[size], name);
+        put_ins(a, unsigned_op[size] | l | rn_rt);
+        return true;
+    }
+    if (k == 2 && !parse_imm(inner[1], &v)) return false;
+
+    if (v >= 0 && (v & ((1 << size) - 1)) == 0 && (v >> size) <= 0xfff) {
+        put_ins(a, unsigned_op[size] | l | (uint32_t)(v >> size) << 10 | rn_rt);
+    } else if (v >= -256 && v <= 255) {
+        // ldur/stur for negative and unaligned offsets
+        put_ins(a, unscaled_op[size] | l | ((uint32_t)v & 0x1ff) << 12 | rn_rt);
+    } else {
+        return false;
+    }
+    return true;
+}
+
+static bool instruction(Asm *a, Slice op, const Slice *ops, int n) {
+    Reg d, r;
+    int64_t v;
+    Slice name;
+
+    if (is(op, "mov")) return mov(a, ops, n);
+    if (is(op, "movz")) return mov_wide(a, 0x52800000, ops, n);
+    if (is(op, "movk")) return mov_wide(a, 0x72800000, ops, n);
+    if (is(op, "movn")) return mov_wide(a, 0x12800000, ops, n);
+
+    bool sub = is(op, "sub") || is(op, "subs");
+    if (sub || is(op, "add") || is(op, "adds")) {
+        if (n != 3 || !parse_reg(ops[0], &d) || !parse_reg(ops[1], &r)) return false;
+        return add_sub(a, sub, op.len == 4, d, r, ops[2]);
+    }
+    if (is(op, "cmp")) {
+        if (n != 2 || !parse_reg(ops[0], &r)) return false;
+        d = (Reg){ 31, r.x, false, true };
+        return add_sub(a, true, true, d, r, ops[1]);
+    }
+    if (is(op, "mul")) return data_reg(a, 0x1b007c00, ops, n, 3);     // madd with the zero register
+    if (is(op, "madd")) return data_reg(a, 0x1b000000, ops, n, 4);
+    if (is(op, "msub")) return data_reg(a, 0x1b008000, ops, n, 4);
+    if (is(op, "sdiv")) return data_reg(a, 0x1ac00c00, ops, n, 3);
+    if (is(op, "udiv")) return data_reg(a, 0x1ac00800, ops, n, 3);
+
+    if (is(op, "ldr")) return load_store(a, true, 2, ops, n);
+    if (is(op, "str")) return load_store(a, false, 2, ops, n);
+    if (is(op, "ldrb")) return load_store(a, true, 0, ops, n);
+    if (is(op, "strb")) return load_store(a, false, 0, ops, n);
+
+    if (is(op, "adrp")) {
+        if (n != 2 || !parse_reg(ops[0], &d) || !d.x || d.sp || !parse_page(ops[1], &name)) return false;
+        reloc(a, RELOC_PAGE21, name);
+        put_ins(a, 0x90000000 | (uint32_t)d.num);
+        return true;
+    }
+
+    if (is(op, "b") || is(op, "bl")) {
+        if (n != 1) return false;
+        return branch(a, op.len == 1 ? 0x14000000 : 0x94000000, op.len == 1 ? FIX_B26 : FIX_BL26, ops[0]);
+    }
+    if (is(op, "cbz") || is(op, "cbnz")) {
+        if (n != 2 || !parse_reg(ops[0], &r) || r.sp) return false;
+        uint32_t base = op.len == 3 ? 0x34000000 : 0x35000000;
+        return branch(a, base | (r.x ? 0x80000000 : 0) | (uint32_t)r.num, FIX_IMM19, ops[1]);
+    }
+    // "b.ge", or the older "bge"
+    if (op.p[0] == 'b' && (op.len == 3 || (op.len == 4 && op.p[1] == '.'))) {
+        int cond = cond_code(op.p + op.len - 2);
+        if (cond < 0 || n != 1) return false;
+        return branch(a, 0x54000000 | (uint32_t)cond, FIX_IMM19, ops[0]);
+    }
+
+    if (is(op, "svc")) {
+        if (n != 1 || !parse_imm(ops[0], &v) || v < 0 || v > 0xffff) return false;
+        put_ins(a, 0xd4000001 | (uint32_t)v << 5);
+        return true;
+    }
+    if (is(op, "ret") && n == 0) {
+        put_ins(a, 0xd65f03c0);
+        return true;
+    }
+    if (is(op, "nop") && n == 0) {
+        put_ins(a, NOP);
+        return true;
+    }
+    return false;
+}
+
+/* ---- directives ---- */
+
+// the body of a quoted string with GNU as escapes, terminated
+static bool string(Asm *a, Slice s) {
+    Emitter *out = &a->obj->sec[a->section];
+    if (s.len < 2 || s.p[0] != '"' || s.p[s.len - 1] != '"') return false;
+    const char *p = s.p + 1, *end = s.p + s.len - 1;
+    while (p < end) {
+        char c = *p++;
+        if (c == '"') return false;
+        if (c == '\\') {
+            if (p == end) return false;
+            c = *p++;
+            switch (c) {
+                case 'n': c = '\n'; break;
+                case 't': c = '\t'; break;
+                case 'r': c = '\r'; break;
+                case 'b': c = '\b'; break;
+                case 'f': c = '\f'; break;
+                case 'x': {
+                    int v = 0;
+                    while (p < end && isxdigit((unsigned char)*p)) {
+                        v = v * 16 + (isdigit((unsigned char)*p) ? *p - '0' : tolower((unsigned char)*p) - 'a' + 10);
+                        p++;
+                    }
+                    c = (char)v;
+                    break;
+                }
+                default:
+                    if (c >= '0' && c <= '7') {
+                        int v = c - '0';
+                        for (int i = 0; i < 2 && p < end && *p >= '0' && *p <= '7'; i++) v = v * 8 + *p++ - '0';
+                        c = (char)v;
+                    }
+                    // anything else stands for itself: \" \\ \'
+            }
+        }
+        emit_char(out, c);
+    }
+    emit_char(out, '\0');
+    return true;
+}
+
+static void align(Asm *a, int log2) {
+    Emitter *out = &a->obj->sec[a->section];
+    size_t to = (out->len + ((size_t)1 << log2) - 1) & ~(((size_t)1 << log2) - 1);
+    if (a->section == OBJ_TEXT) {
+        while (out->len + 4 <= to) put_ins(a, NOP);
+    }
+    while (out->len < to) emit_char(out, 0);
+    if (log2 > a->obj->align[a->section]) a->obj->align[a->section] = log2;
+}
+
+static bool directive(Asm *a, Slice op, const char *p, const char *end) {
+    Slice arg = trim(p, end);
+    int64_t v;
+
+    if (is(op, ".text") || is(op, ".data")) {
+        if (arg.len) return false;
+        a->section = op.p[1] == 't' ? OBJ_TEXT : OBJ_DATA;
+        return true;
+    }
+    if (is(op, ".global") || is(op, ".globl")) {
+        if (!is_name(arg)) return false;
+        int i = symbol(a, arg);
+        a->obj->syms[i].global = true;
+        return true;
+    }
+    if (is(op, ".align") || is(op, ".p2align")) {
+        if (!parse_imm(arg, &v) || v < 0 || v > 12) return false;
+        align(a, (int)v);
+        return true;
+    }
+    if (is(op, ".word")) {
+        Slice vals[16];
+        int n = split_operands(p, end, vals, 16);
+        if (n < 1) return false;
+        for (int i = 0; i < n; i++) {
+            if (!parse_imm(vals[i], &v) || v < INT32_MIN || v > (int64_t)UINT32_MAX) return false;
+            char b[4] = { (char)v, (char)(v >> 8), (char)(v >> 16), (char)(v >> 24) };
+            emit_textn(&a->obj->sec[a->section], b, 4);
+        }
+        return true;
+    }
+    if (is(op, ".asciz")) return string(a, arg);
+    if (is(op, ".zero") || is(op, ".space")) {
+        if (!parse_imm(arg, &v) || v < 0 || v > (1 << 24)) return false;
+        for (int64_t i = 0; i < v; i++) emit_char(&a->obj->sec[a->section], 0);
+        return true;
+    }
+    if (is(op, ".section")) {
+        // only the ELF stack note, which has no contents
+        const char *comma = memchr(p, ',', (size_t)(end - p));
+        Slice name = trim(p, comma ? comma : end);
+        if (!is(name, ".note.GNU-stack")) return false;
+        a->obj->stack_note = true;
+        return true;
+    }
+    return false;
+}
+
+/* ---- lines ---- */
+
+// "name:" starts a symbol, "1:" a numeric label for "1b"
+static bool define_label(Asm *a, Slice name) {
+    if (isdigit((unsigned char)name.p[0])) {
+        if (name.len != 1 || a->section != OBJ_TEXT) return false;
+        a->numeric[name.p[0] - '0'] = (int64_t)here(a);
+        return true;
+    }
+    int i = symbol(a, name);
+    ObjSymbol *s = &a->obj->syms[i];
+    if (s->section >= 0) return false;
+    s->section = a->section;
+    s->offset = here(a);
+    return true;
+}
+
+// end of the line without its "//" comment
+static const char *strip_comment(const char *p, const char *end) {
+    bool quoted = false;
+    for (; p + 1 < end; p++) {
+        if (*p == '\\' && quoted) p++;
+        else if (*p == '"') quoted = !quoted;
+        else if (!quoted && p[0] == '/' && p[1] == '/') return p;
+    }
+    return end;
+}
+
+static bool assemble_line(Asm *a, const char *p, const char *end) {
+    end = strip_comment(p, end);
+    p = skip_space(p, end);
+
+    // any labels, then maybe an instruction or directive on the same line
+    for (;;) {
+        const char *q = p;
+        while (q < end && is_ident_char(*q)) q++;
+        if (q == p || q == end || *q != ':') break;
+        if (!define_label(a, (Slice){ p, (int)(q - p) })) return false;
+        p = skip_space(q + 1, end);
+    }
+    if (skip_space(p, end) == end) return true;
+
+    const char *q = p;
+    while (q < end && !isspace((unsigned char)*q)) q++;
+    Slice op = { p, (int)(q - p) };
+    if (op.p[0] == '.') return directive(a, op, q, end);
+
+    Slice ops[4];
+    int n = split_operands(q, end, ops, 4);
+    if (n < 0 || a->section != OBJ_TEXT || (here(a) & 3)) return false;
+    return instruction(a, op, ops, n);
+}
+
+// branches to names, now that every label is known: direct within the
+// text, left to the linker otherwise
+static bool resolve(Asm *a) {
+    Emitter *text = &a->obj->sec[OBJ_TEXT];
+    for (int i = 0; i < a->nfix; i++) {
+        const Fixup *f = &a->fixups[i];
+        const ObjSymbol *s = &a->obj->syms[f->symbol];
+        if (s->section != OBJ_TEXT) {
+            if (f->kind == FIX_IMM19) return false;
+            obj_add_reloc(a->obj, OBJ_TEXT, f->offset, f->kind == FIX_B26 ? RELOC_JUMP26 : RELOC_CALL26, f->symbol);
+            continue;
+        }
+        unsigned char *b = (unsigned char *)text->data + f->offset;
+        uint32_t ins = (uint32_t)b[0] | (uint32_t)b[1] << 8 | (uint32_t)b[2] << 16 | (uint32_t)b[3] << 24;
+        if (!patch_branch(&ins, f->kind, (int64_t)s->offset - (int64_t)f->offset)) return false;
+        b[0] = (unsigned char)ins;
+        b[1] = (unsigned char)(ins >> 8);
+        b[2] = (unsigned char)(ins >> 16);
+        b[3] = (unsigned char)(ins >> 24);
+    }
+    return true;
+}
+
+bool arm64_assemble(const char *text, size_t len, ObjFile *o) {
+    Asm a = { .obj = o, .section = OBJ_TEXT };
+    for (int i = 0; i < 10; i++) a.numeric[i] = -1;
+    o->align[OBJ_TEXT] = 2;
+
+    bool ok = true;
+    const char *p = text, *end = text + len;
+    while (ok && p < end) {
+        const char *eol = memchr(p, '\n', (size_t)(end - p));
+        if (!eol) eol = end;
+        ok = assemble_line(&a, p, eol);
+        p = eol + 1;
+    }
+    if (ok) ok = resolve(&a);
+
+    xfree(a.table);
+    xfree(a.fixups);
+    return ok;
+}
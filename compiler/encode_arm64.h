@@ -0,0 +1,18 @@
+#ifndef ENCODE_ARM64_H
+#define ENCODE_ARM64_H
+
+#include <stddef.h>
+#include <stdbool.h>
+
+#include "object.h"
+
+// The integrated assembler: encodes the arm64 backend's instruction
+// stream straight into an object, so building needs no assembler, only a
+// linker. It knows the instructions and directives codegen produces, in
+// either relocation syntax (label@PAGEOFF or :lo12:label).
+//
+// Returns false on anything else, e.g. an unusual raw line from the
+// source, and the caller hands the text to the system assembler instead.
+bool arm64_assemble(const char *text, size_t len, ObjFile *o);
+
+#endif // ENCODE_ARM64_H
@@ -0,0 +1,816 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+#include <stdbool.h>
+#include <ctype.h>
+
+#include "encode_x86_64.h"
+#include "mem.h"
+
+typedef struct {
+    const char *p;
+    int len;
+} Slice;
+
+#define RIP 16          // base register number for %rip-relative operands
+
+typedef enum {
+    OPND_REG,
+    OPND_IMM,
+    OPND_MEM,
+    OPND_LABEL,         // branch target: a name or "1b"
+} OperandKind;
+
+typedef struct {
+    OperandKind kind;
+    int reg;            // OPND_REG: 0..15
+    int size;           // OPND_REG: 8, 32 or 64
+    int64_t imm;        // OPND_IMM, or the displacement
+    int base, index;    // OPND_MEM: -1 for none, RIP
+    int scale;
+    Slice sym;          // OPND_MEM / OPND_LABEL: symbol, len 0 for none
+} Operand;
+
+// one instruction as it is put together, then written out in one go
+typedef struct {
+    uint8_t b[16];
+    int len;
+    int field;          // offset of the rel32/disp32 to a symbol, -1 for none
+    Slice sym;
+    int64_t addend;
+} Ins;
+
+// rel32 fields pointing at names, patched once the whole text is read
+typedef struct {
+    uint64_t offset;
+    int symbol;
+} Fixup;
+
+typedef struct {
+    ObjFile *obj;
+    int section;
+
+    int *table;         // label name -> symbol index + 1, open addressing
+    size_t table_cap;
+
+    Fixup *fixups;
+    int nfix, fix_cap;
+
+    int64_t numeric[10];    // text offset of the last "N:", -1 before one
+
+    char *err;              // why it failed, for the caller's error
+    size_t err_len;
+} Asm;
+
+// false with what went wrong and the name or text it is about in err
+static bool fail(Asm *a, const char *what, const char *p, int len) {
+    snprintf(a->err, a->err_len, "%s: %.*s", what, len, p);
+    return false;
+}
+
+/* ---- symbols ---- */
+
+static uint32_t hash(const char *s, int len) {
+    uint32_t h = 2166136261u;
+    for (int i = 0; i < len; i++) h = (h ^ (unsigned char)s[i]) * 16777619u;
+    return h;
+}
+
+static void table_grow(Asm *a) {
+    xfree(a->table);
+    a->table_cap = a->table_cap ? a->table_cap * 2 : 1024;
+    a->table = xcalloc(a->table_cap, sizeof(int));
+    size_t mask = a->table_cap - 1;
+    for (int i = 0; i < a->obj->nsyms; i++) {
+        const ObjSymbol *s = &a->obj->syms[i];
+        size_t h = hash(s->name, s->len) & mask;
+        while (a->table[h]) h = (h + 1) & mask;
+        a->table[h] = i + 1;
+    }
+}
+
+// index of the symbol for name, added undefined the first time
+static int symbol(Asm *a, Slice name) {
+    if ((size_t)(a->obj->nsyms + 1) * 2 > a->table_cap) table_grow(a);
+    size_t mask = a->table_cap - 1;
+    size_t h = hash(name.p, name.len) & mask;
+    while (a->table[h]) {
+        const ObjSymbol *s = &a->obj->syms[a->table[h] - 1];
+        if (s->len == name.len && memcmp(s->name, name.p, name.len) == 0) return a->table[h] - 1;
+        h = (h + 1) & mask;
+    }
+    int i = obj_add_symbol(a->obj, name.p, name.len);
+    a->table[h] = i + 1;
+    return i;
+}
+
+/* ---- operands ---- */
+
+static bool is_ident_char(char c) {
+    return isalnum((unsigned char)c) || c == '_' || c == '.' || c == '$';
+}
+
+static bool is_name(Slice s) {
+    if (s.len == 0 || isdigit((unsigned char)s.p[0]) || s.p[0] == '$') return false;
+    for (int i = 0; i < s.len; i++)
+        if (!is_ident_char(s.p[i])) return false;
+    return true;
+}
+
+static bool is(Slice s, const char *word) {
+    return (size_t)s.len == strlen(word) && memcmp(s.p, word, s.len) == 0;
+}
+
+static const char *skip_space(const char *p, const char *end) {
+    while (p < end && isspace((unsigned char)*p)) p++;
+    return p;
+}
+
+static Slice trim(const char *p, const char *end) {
+    p = skip_space(p, end);
+    while (end > p && isspace((unsigned char)end[-1])) end--;
+    return (Slice){ p, (int)(end - p) };
+}
+
+// "a, 8(b,c,4), d" at the commas outside parentheses, -1 for more than max
+static int split_operands(const char *p, const char *end, Slice *ops, int max) {
+    int n = 0, depth = 0;
+    const char *start = p;
+    if (skip_space(p, end) == end) return 0;
+    for (; p <= end; p++) {
+        if (p < end && *p == '(') depth++;
+        if (p < end && *p == ')') depth--;
+        if (p == end || (*p == ',' && depth == 0)) {
+            if (n == max) return -1;
+            ops[n++] = trim(start, p);
+            start = p + 1;
+        }
+    }
+    return n;
+}
+
+// "12", "-1", "0x200", "'0'"
+static bool parse_number(Slice s, int64_t *v) {
+    const char *p = s.p, *end = s.p + s.len;
+    bool neg = p < end && *p == '-';
+    if (neg) p++;
+    if (p == end) return false;
+
+    uint64_t u = 0;
+    if (*p == '\'') {
+        if (end - p < 2 || p[1] == '\\') return false;
+        u = (unsigned char)p[1];
+        p += 2;
+        if (p < end && *p == '\'') p++;
+    } else if (end - p > 2 && p[0] == '0' && (p[1] == 'x' || p[1] == 'X')) {
+        for (p += 2; p < end && isxdigit((unsigned char)*p); p++) {
+            if (u >> 60) return false;
+            u = u * 16 + (uint64_t)(isdigit((unsigned char)*p) ? *p - '0' : (tolower((unsigned char)*p) - 'a' + 10));
+        }
+    } else {
+        if (!isdigit((unsigned char)*p)) return false;
+        for (; p < end && isdigit((unsigned char)*p); p++) {
+            if (u > (UINT64_MAX - 9) / 10) return false;
+            u = u * 10 + (uint64_t)(*p - '0');
+        }
+    }
+    if (p != end) return false;
+    *v = neg ? -(int64_t)u : (int64_t)u;
+    return true;
+}
+
+// "%eax", "%r8d", "%rsp", "%dl", "%rip" (as RIP); of the byte registers
+// only the four that need no REX prefix
+static bool parse_reg(Slice s, Operand *o) {
+    static const char *const r64[] = {
+        "rax", "rcx", "rdx", "rbx", "rsp", "rbp", "rsi", "rdi",
+    };
+    static const char *const r32[] = {
+        "eax", "ecx", "edx", "ebx", "esp", "ebp", "esi", "edi",
+    };
+    static const char *const r8[] = { "al", "cl", "dl", "bl" };
+    if (s.len < 3 || s.p[0] != '%') return false;
+    Slice name = { s.p + 1, s.len - 1 };
+    o->kind = OPND_REG;
+
+    if (is(name, "rip")) {
+        o->reg = RIP;
+        o->size = 64;
+        return true;
+    }
+    for (int i = 0; i < 8; i++) {
+        if (is(name, r64[i])) { o->reg = i; o->size = 64; return true; }
+        if (is(name, r32[i])) { o->reg = i; o->size = 32; return true; }
+        if (i < 4 && is(name, r8[i])) { o->reg = i; o->size = 8; return true; }
+    }
+
+    // r8..r15 with an optional d or b
+    if (name.p[0] != 'r' || !isdigit((unsigned char)name.p[1])) return false;
+    int n = 0, i = 1;
+    while (i < name.len && isdigit((unsigned char)name.p[i])) n = n * 10 + name.p[i++] - '0';
+    if (n < 8 || n > 15) return false;
+    o->reg = n;
+    if (i == name.len) o->size = 64;
+    else if (i + 1 == name.len && name.p[i] == 'd') o->size = 32;
+    else if (i + 1 == name.len && name.p[i] == 'b') o->size = 8;
+    else return false;
+    return true;
+}
+
+// "disp(base,index,scale)" where disp is a number, a name, or name+number
+static bool parse_mem(Slice s, Operand *o) {
+    const char *open = memchr(s.p, '(', (size_t)s.len);
+    o->kind = OPND_MEM;
+    o->base = o->index = -1;
+    o->scale = 1;
+    o->imm = 0;
+    o->sym = (Slice){ NULL, 0 };
+
+    // the displacement
+    Slice disp = trim(s.p, open ? open : s.p + s.len);
+    if (disp.len) {
+        int split = 0;
+        while (split < disp.len && (split == 0 || (disp.p[split] != '+' && disp.p[split] != '-'))) split++;
+        Slice head = { disp.p, split };
+        if (is_name(head)) {
+            o->sym = head;
+            if (split < disp.len) {
+                Slice tail = { disp.p + split + (disp.p[split] == '+'), disp.len - split - (disp.p[split] == '+') };
+                if (!parse_number(tail, &o->imm)) return false;
+            }
+        } else if (!parse_number(disp, &o->imm)) {
+            return false;
+        }
+    }
+    if (!open) return false;
+
+    // "(base)", "(base,index)", "(base,index,scale)", "(,index,scale)"
+    const char *close = s.p + s.len - 1;
+    if (*close != ')') return false;
+    Slice parts[3];
+    int n = split_operands(open + 1, close, parts, 3);
+    if (n < 1) return false;
+    Operand r;
+    if (parts[0].len) {
+        if (!parse_reg(parts[0], &r) || r.size != 64) return false;
+        o->base = r.reg;
+    }
+    if (n >= 2) {
+        if (!parse_reg(parts[1], &r) || r.size != 64 || r.reg == RIP || r.reg == 4) return false;
+        o->index = r.reg;
+    }
+    if (n == 3) {
+        int64_t sc;
+        if (!parse_number(parts[2], &sc) || (sc != 1 && sc != 2 && sc != 4 && sc != 8)) return false;
+        o->scale = (int)sc;
+    }
+    if (o->base < 0 && o->index < 0) return false;
+    if (o->base == RIP && o->index >= 0) return false;
+    // a symbol only makes sense relative to %rip here
+    return !o->sym.len || o->base == RIP;
+}
+
+static bool parse_operand(Slice s, Operand *o) {
+    memset(o, 0, sizeof(*o));
+    if (s.len == 0) return false;
+    if (s.p[0] == '$') {
+        o->kind = OPND_IMM;
+        return parse_number((Slice){ s.p + 1, s.len - 1 }, &o->imm);
+    }
+    if (s.p[0] == '%') return parse_reg(s, o) && o->reg != RIP;
+    if (memchr(s.p, '(', (size_t)s.len)) return parse_mem(s, o);
+    if (s.len == 2 && isdigit((unsigned char)s.p[0]) && (s.p[1] == 'b' || s.p[1] == 'f')) {
+        o->kind = OPND_LABEL;
+        o->sym = s;
+        return true;
+    }
+    if (!is_name(s)) return false;
+    o->kind = OPND_LABEL;
+    o->sym = s;
+    return true;
+}
+
+static bool fits8(int64_t v) {
+    return v >= -128 && v <= 127;
+}
+
+// an immediate for a size-bit operation: 32-bit ones take any 32-bit
+// pattern, 64-bit ones a sign-extended 32-bit value
+static bool imm_ok(int64_t v, int size) {
+    if (size == 8) return v >= -128 && v <= 255;
+    if (size == 32) return v >= INT32_MIN && v <= (int64_t)UINT32_MAX;
+    return v >= INT32_MIN && v <= INT32_MAX;
+}
+
+static int cond_code(Slice c) {
+    static const char *const names[][3] = {
+        { "o" }, { "no" }, { "b", "c", "nae" }, { "ae", "nb", "nc" },
+        { "e", "z" }, { "ne", "nz" }, { "be", "na" }, { "a", "nbe" },
+        { "s" }, { "ns" }, { "p", "pe" }, { "np", "po" },
+        { "l", "nge" }, { "ge", "nl" }, { "le", "ng" }, { "g", "nle" },
+    };
+    for (int i = 0; i < 16; i++)
+        for (int j = 0; j < 3 && names[i][j]; j++)
+            if (is(c, names[i][j])) return i;
+    return -1;
+}
+
+/* ---- output ---- */
+
+static uint64_t here(const Asm *a) {
+    return a->obj->sec[a->section].len;
+}
+
+static void byte(Ins *in, int b) {
+    in->b[in->len++] = (uint8_t)b;
+}
+
+static void imm32(Ins *in, int64_t v) {
+    for (int i = 0; i < 4; i++) byte(in, (int)(v >> (8 * i)) & 0xff);
+}
+
+// REX, the opcode bytes, ModRM and whatever follows it for reg and rm
+static bool encode(Ins *in, int size, const uint8_t *op, int op_len, int reg, const Operand *rm) {
+    int rex = size == 64 ? 0x48 : 0;
+    if (reg >= 8) rex |= 0x44;
+    if (rm->kind == OPND_REG) {
+        if (rm->reg >= 8) rex |= 0x41;
+    } else {
+        if (rm->base >= 8 && rm->base != RIP) rex |= 0x41;
+        if (rm->index >= 8) rex |= 0x42;
+    }
+    if (rex) byte(in, rex);
+    for (int i = 0; i < op_len; i++) byte(in, op[i]);
+
+    reg &= 7;
+    if (rm->kind == OPND_REG) {
+        byte(in, 0xc0 | reg << 3 | (rm->reg & 7));
+        return true;
+    }
+    if (rm->kind != OPND_MEM) return false;
+
+    if (rm->base == RIP) {
+        if (!rm->sym.len) return false;
+        byte(in, reg << 3 | 5);
+        in->field = in->len;
+        in->sym = rm->sym;
+        in->addend = rm->imm;
+        imm32(in, 0);
+        return true;
+    }
+    if (rm->imm < INT32_MIN || rm->imm > INT32_MAX) return false;
+
+    // no base: disp32 and an index through the SIB byte
+    if (rm->base < 0) {
+        byte(in, reg << 3 | 4);
+        byte(in, (rm->scale == 8 ? 3 : rm->scale == 4 ? 2 : rm->scale == 2 ? 1 : 0) << 6 | (rm->index & 7) << 3 | 5);
+        imm32(in, rm->imm);
+        return true;
+    }
+
+    int mod = rm->imm == 0 && (rm->base & 7) != 5 ? 0 : fits8(rm->imm) ? 1 : 2;
+    bool sib = rm->index >= 0 || (rm->base & 7) == 4;
+    byte(in, mod << 6 | reg << 3 | (sib ? 4 : rm->base & 7));
+    if (sib) {
+        int ss = rm->scale == 8 ? 3 : rm->scale == 4 ? 2 : rm->scale == 2 ? 1 : 0;
+        int index = rm->index >= 0 ? rm->index & 7 : 4;
+        byte(in, ss << 6 | index << 3 | (rm->base & 7));
+    }
+    if (mod == 1) byte(in, (int)rm->imm & 0xff);
+    if (mod == 2) imm32(in, rm->imm);
+    return true;
+}
+
+static bool encode1(Ins *in, int size, int op, int reg, const Operand *rm) {
+    uint8_t b = (uint8_t)op;
+    return encode(in, size, &b, 1, reg, rm);
+}
+
+static bool encode2(Ins *in, int size, int op1, int op2, int reg, const Operand *rm) {
+    uint8_t b[2] = { (uint8_t)op1, (uint8_t)op2 };
+    return encode(in, size, b, 2, reg, rm);
+}
+
+// the rel32/disp32 to a name holds addend - (end of instruction - field),
+// so the target minus the field's own address is all that is left to add
+static void put(Asm *a, Ins *in) {
+    uint64_t at = here(a);
+    if (in->field >= 0) {
+        int64_t rel = in->addend - (in->len - in->field);
+        for (int i = 0; i < 4; i++) in->b[in->field + i] = (uint8_t)(rel >> (8 * i));
+    }
+    emit_textn(&a->obj->sec[OBJ_TEXT], (const char *)in->b, (size_t)in->len);
+    if (in->field < 0) return;
+
+    if (a->nfix == a->fix_cap) {
+        a->fix_cap = a->fix_cap ? a->fix_cap * 2 : 1024;
+        a->fixups = xrealloc(a->fixups, sizeof(Fixup) * a->fix_cap);
+    }
+    a->fixups[a->nfix++] = (Fixup){ at + (uint64_t)in->field, symbol(a, in->sym) };
+}
+
+// opcode then a rel32 to the label, "1b" resolved on the spot
+static bool branch(Asm *a, Ins *in, const Operand *target) {
+    if (target->kind != OPND_LABEL) return false;
+    Slice t = target->sym;
+    if (isdigit((unsigned char)t.p[0])) {
+        int64_t at = t.p[1] == 'b' ? a->numeric[t.p[0] - '0'] : -1;
+        if (at < 0) return fail(a, "no label before", t.p, t.len);
+        imm32(in, at - (int64_t)(here(a) + (uint64_t)in->len + 4));
+        put(a, in);
+        return true;
+    }
+    in->field = in->len;
+    in->sym = t;
+    in->addend = 0;
+    imm32(in, 0);
+    put(a, in);
+    return true;
+}
+
+/* ---- instructions ---- */
+
+// add, or, and, sub, xor, cmp: ext is the /digit of the immediate form
+static bool alu(Ins *in, int ext, int size, const Operand *src, const Operand *dst) {
+    if (src->kind == OPND_IMM) {
+        if (dst->kind != OPND_REG && dst->kind != OPND_MEM) return false;
+        if (!imm_ok(src->imm, size)) return false;
+        if (size == 8) {
+            if (!encode1(in, size, 0x80, ext, dst)) return false;
+            byte(in, (int)src->imm & 0xff);
+        } else if (fits8((int32_t)src->imm)) {
+            if (!encode1(in, size, 0x83, ext, dst)) return false;
+            byte(in, (int)src->imm & 0xff);
+        } else {
+            if (!encode1(in, size, 0x81, ext, dst)) return false;
+            imm32(in, src->imm);
+        }
+        return true;
+    }
+    int base = ext * 8 + (size == 8 ? 0 : 1);
+    if (src->kind == OPND_REG && (dst->kind == OPND_REG || dst->kind == OPND_MEM))
+        return encode1(in, size, base, src->reg, dst);
+    if (src->kind == OPND_MEM && dst->kind == OPND_REG)
+        return encode1(in, size, base + 2, dst->reg, src);
+    return false;
+}
+
+static bool mov(Ins *in, int size, const Operand *src, const Operand *dst) {
+    if (src->kind == OPND_IMM) {
+        if (!imm_ok(src->imm, size)) return false;
+        if (dst->kind == OPND_REG && size != 64) {
+            if (dst->reg >= 8) byte(in, 0x41);
+            byte(in, (size == 8 ? 0xb0 : 0xb8) + (dst->reg & 7));
+            if (size == 8) byte(in, (int)src->imm & 0xff);
+            else imm32(in, src->imm);
+            return true;
+        }
+        if (dst->kind != OPND_REG && dst->kind != OPND_MEM) return false;
+        if (!encode1(in, size, size == 8 ? 0xc6 : 0xc7, 0, dst)) return false;
+        if (size == 8) byte(in, (int)src->imm & 0xff);
+        else imm32(in, src->imm);
+        return true;
+    }
+    int op = size == 8 ? 0x88 : 0x89;
+    if (src->kind == OPND_REG && (dst->kind == OPND_REG || dst->kind == OPND_MEM))
+        return encode1(in, size, op, src->reg, dst);
+    if (src->kind == OPND_MEM && dst->kind == OPND_REG)
+        return encode1(in, size, op + 2, dst->reg, src);
+    return false;
+}
+
+// "addl" -> "add" and 32, false without a size suffix
+static bool split_suffix(Slice op, Slice *base, int *size) {
+    if (op.len < 2) return false;
+    char c = op.p[op.len - 1];
+    *size = c == 'b' ? 8 : c == 'l' ? 32 : c == 'q' ? 64 : 0;
+    *base = (Slice){ op.p, op.len - 1 };
+    return *size != 0;
+}
+
+// operand sizes that have to agree with the suffix
+static bool sized(const Operand *o, int size) {
+    return o->kind != OPND_REG || o->size == size;
+}
+
+static bool instruction(Asm *a, Slice op, const Operand *ops, int n) {
+    Ins in = { .field = -1 };
+    if (n == 0) {
+        if (is(op, "ret")) byte(&in, 0xc3);
+        else if (is(op, "cltd")) byte(&in, 0x99);
+        else if (is(op, "cqto")) { byte(&in, 0x48); byte(&in, 0x99); }
+        else if (is(op, "syscall")) { byte(&in, 0x0f); byte(&in, 0x05); }
+        else if (is(op, "nop")) byte(&in, 0x90);
+        else return false;
+        put(a, &in);
+        return true;
+    }
+
+    const Operand *src = &ops[0], *dst = &ops[n - 1];
+    if (n == 1 && (is(op, "jmp") || is(op, "call"))) {
+        byte(&in, is(op, "jmp") ? 0xe9 : 0xe8);
+        return branch(a, &in, src);
+    }
+    if (n == 1 && op.p[0] == 'j') {
+        int cc = cond_code((Slice){ op.p + 1, op.len - 1 });
+        if (cc < 0) return false;
+        byte(&in, 0x0f);
+        byte(&in, 0x80 + cc);
+        return branch(a, &in, src);
+    }
+    if (n == 2 && op.len > 4 && memcmp(op.p, "cmov", 4) == 0) {
+        int cc = cond_code((Slice){ op.p + 4, op.len - 4 });
+        if (cc < 0 || dst->kind != OPND_REG || dst->size == 8 || !sized(src, dst->size)) return false;
+        if (src->kind != OPND_REG && src->kind != OPND_MEM) return false;
+        if (!encode2(&in, dst->size, 0x0f, 0x40 + cc, dst->reg, src)) return false;
+        put(a, &in);
+        return true;
+    }
+    if (n == 2 && is(op, "movabsq")) {
+        if (src->kind != OPND_IMM || dst->kind != OPND_REG || dst->size != 64) return false;
+        byte(&in, dst->reg >= 8 ? 0x49 : 0x48);
+        byte(&in, 0xb8 + (dst->reg & 7));
+        imm32(&in, src->imm);
+        imm32(&in, src->imm >> 32);
+        put(a, &in);
+        return true;
+    }
+
+    Slice base;
+    int size;
+    if (!split_suffix(op, &base, &size)) return false;
+    for (int i = 0; i < n; i++)
+        if (!sized(&ops[i], size) || ops[i].kind == OPND_LABEL) return false;
+
+    static const char *const alu_ops[] = { "add", "or", NULL, NULL, "and", "sub", "xor", "cmp" };
+    bool ok = false;
+    if (n == 2) {
+        for (int ext = 0; ext < 8; ext++)
+            if (alu_ops[ext] && is(base, alu_ops[ext])) {
+                if (!alu(&in, ext, size, src, dst)) return false;
+                put(a, &in);
+                return true;
+            }
+    }
+
+    if (is(base, "mov") && n == 2) {
+        ok = mov(&in, size, src, dst);
+    } else if (is(base, "lea") && n == 2) {
+        ok = size != 8 && src->kind == OPND_MEM && dst->kind == OPND_REG &&
+             encode1(&in, size, 0x8d, dst->reg, src);
+    } else if (is(base, "test") && n == 2) {
+        if (src->kind == OPND_IMM) {
+            ok = size != 8 && imm_ok(src->imm, size) && encode1(&in, size, 0xf7, 0, dst);
+            if (ok) imm32(&in, src->imm);
+        } else {
+            ok = src->kind == OPND_REG && encode1(&in, size, size == 8 ? 0x84 : 0x85, src->reg, dst);
+        }
+    } else if (is(base, "imul") && n == 2) {
+        ok = size != 8 && dst->kind == OPND_REG && src->kind != OPND_IMM &&
+             encode2(&in, size, 0x0f, 0xaf, dst->reg, src);
+    } else if (is(base, "imul") && n == 3) {
+        // "imull $k, src, dst"
+        if (size == 8 || src->kind != OPND_IMM || dst->kind != OPND_REG || !imm_ok(src->imm, size)) return false;
+        if (fits8((int32_t)src->imm)) {
+            ok = encode1(&in, size, 0x6b, dst->reg, &ops[1]);
+            if (ok) byte(&in, (int)src->imm & 0xff);
+        } else {
+            ok = encode1(&in, size, 0x69, dst->reg, &ops[1]);
+            if (ok) imm32(&in, src->imm);
+        }
+    } else if (n == 1 && (is(base, "not") || is(base, "neg") || is(base, "mul") || is(base, "div") || is(base, "idiv"))) {
+        int ext = is(base, "not") ? 2 : is(base, "neg") ? 3 : is(base, "mul") ? 4 : is(base, "div") ? 6 : 7;
+        ok = src->kind != OPND_IMM && encode1(&in, size, size == 8 ? 0xf6 : 0xf7, ext, src);
+    } else if (n == 1 && (is(base, "inc") || is(base, "dec"))) {
+        ok = src->kind != OPND_IMM && encode1(&in, size, size == 8 ? 0xfe : 0xff, is(base, "dec"), src);
+    } else if (n == 1 && (is(base, "push") || is(base, "pop")) && size == 64 && src->kind == OPND_REG) {
+        if (src->reg >= 8) byte(&in, 0x41);
+        byte(&in, (is(base, "push") ? 0x50 : 0x58) + (src->reg & 7));
+        ok = true;
+    }
+    if (!ok) return false;
+    put(a, &in);
+    return true;
+}
+
+/* ---- directives ---- */
+
+// the body of a quoted string with GNU as escapes, terminated
+static bool string(Asm *a, Slice s) {
+    Emitter *out = &a->obj->sec[a->section];
+    if (s.len < 2 || s.p[0] != '"' || s.p[s.len - 1] != '"') return false;
+    const char *p = s.p + 1, *end = s.p + s.len - 1;
+    while (p < end) {
+        char c = *p++;
+        if (c == '"') return false;
+        if (c == '\\') {
+            if (p == end) return false;
+            c = *p++;
+            switch (c) {
+                case 'n': c = '\n'; break;
+                case 't': c = '\t'; break;
+                case 'r': c = '\r'; break;
+                case 'b': c = '\b'; break;
+                case 'f': c = '\f'; break;
+                case 'x': {
+                    int v = 0;
+                    while (p < end && isxdigit((unsigned char)*p)) {
+                        v = v * 16 + (isdigit((unsigned char)*p) ? *p - '0' : tolower((unsigned char)*p) - 'a' + 10);
+                        p++;
+                    }
+                    c = (char)v;
+                    break;
+                }
+                default:
+                    if (c >= '0' && c <= '7') {
+                        int v = c - '0';
+                        for (int i = 0; i < 2 && p < end && *p >= '0' && *p <= '7'; i++) v = v * 8 + *p++ - '0';
+                        c = (char)v;
+                    }
+                    // anything else stands for itself: \" \\ \'
+            }
+        }
+        emit_char(out, c);
+    }
+    emit_char(out, '\0');
+    return true;
+}
+
+static void align(Asm *a, int log2) {
+    Emitter *out = &a->obj->sec[a->section];
+    size_t to = (out->len + ((size_t)1 << log2) - 1) & ~(((size_t)1 << log2) - 1);
+    while (out->len < to) emit_char(out, a->section == OBJ_TEXT ? (char)0x90 : 0);
+    if (log2 > a->obj->align[a->section]) a->obj->align[a->section] = log2;
+}
+
+static bool data(Asm *a, const char *p, const char *end, int bytes) {
+    Slice vals[16];
+    int n = split_operands(p, end, vals, 16);
+    if (n < 1) return false;
+    for (int i = 0; i < n; i++) {
+        int64_t v;
+        if (!parse_number(vals[i], &v)) return false;
+        for (int b = 0; b < bytes; b++) emit_char(&a->obj->sec[a->section], (char)(v >> (8 * b)));
+    }
+    return true;
+}
+
+static bool directive(Asm *a, Slice op, const char *p, const char *end) {
+    Slice arg = trim(p, end);
+    int64_t v;
+
+    // .bss is zeros at the end of the data, nothing needs it to be apart
+    if (is(op, ".text") || is(op, ".data") || is(op, ".bss")) {
+        if (arg.len) return false;
+        a->section = op.p[1] == 't' ? OBJ_TEXT : OBJ_DATA;
+        return true;
+    }
+    if (is(op, ".global") || is(op, ".globl")) {
+        if (!is_name(arg)) return false;
+        int i = symbol(a, arg);
+        a->obj->syms[i].global = true;
+        return true;
+    }
+    if (is(op, ".p2align")) {
+        if (!parse_number(arg, &v) || v < 0 || v > 12) return false;
+        align(a, (int)v);
+        return true;
+    }
+    if (is(op, ".align") || is(op, ".balign")) {
+        // a byte count on x86 ELF
+        if (!parse_number(arg, &v) || v < 1 || v > 4096 || (v & (v - 1))) return false;
+        int log2 = 0;
+        while ((1 << log2) < v) log2++;
+        align(a, log2);
+        return true;
+    }
+    if (is(op, ".byte")) return data(a, p, end, 1);
+    if (is(op, ".long")) return data(a, p, end, 4);
+    if (is(op, ".quad")) return data(a, p, end, 8);
+    if (is(op, ".asciz")) return string(a, arg);
+    if (is(op, ".zero") || is(op, ".space")) {
+        if (!parse_number(arg, &v) || v < 0 || v > (1 << 24)) return false;
+        for (int64_t i = 0; i < v; i++) emit_char(&a->obj->sec[a->section], 0);
+        return true;
+    }
+    if (is(op, ".section")) {
+        // only the ELF stack note, which has no contents
+        const char *comma = memchr(p, ',', (size_t)(end - p));
+        Slice name = trim(p, comma ? comma : end);
+        if (!is(name, ".note.GNU-stack")) return false;
+        a->obj->stack_note = true;
+        return true;
+    }
+    return false;
+}
+
+/* ---- lines ---- */
+
+// "name:" starts a symbol, "1:" a numeric label for "1b"
+static bool define_label(Asm *a, Slice name) {
+    if (isdigit((unsigned char)name.p[0])) {
+        if (name.len != 1 || a->section != OBJ_TEXT) return false;
+        a->numeric[name.p[0] - '0'] = (int64_t)here(a);
+        return true;
+    }
+    int i = symbol(a, name);
+    ObjSymbol *s = &a->obj->syms[i];
+    if (s->section >= 0) return fail(a, "symbol defined twice", name.p, name.len);
+    s->section = a->section;
+    s->offset = here(a);
+    return true;
+}
+
+// end of the line without its "#" comment
+static const char *strip_comment(const char *p, const char *end) {
+    bool quoted = false;
+    for (; p < end; p++) {
+        if (*p == '\\' && quoted) p++;
+        else if (*p == '"') quoted = !quoted;
+        else if (!quoted && *p == '#') return p;
+    }
+    return end;
+}
+
+static bool assemble_line(Asm *a, const char *p, const char *end) {
+    end = strip_comment(p, end);
+    p = skip_space(p, end);
+
+    // any labels, then maybe an instruction or directive on the same line
+    for (;;) {
+        const char *q = p;
+        while (q < end && is_ident_char(*q)) q++;
+        if (q == p || q == end || *q != ':') break;
+        if (!define_label(a, (Slice){ p, (int)(q - p) })) return false;
+        p = skip_space(q + 1, end);
+    }
+    if (skip_space(p, end) == end) return true;
+
+    const char *q = p;
+    while (q < end && !isspace((unsigned char)*q)) q++;
+    Slice op = { p, (int)(q - p) };
+    if (op.p[0] == '.') return directive(a, op, q, end);
+
+    Slice text[3];
+    Operand ops[3];
+    int n = split_operands(q, end, text, 3);
+    if (n < 0 || a->section != OBJ_TEXT) return false;
+    for (int i = 0; i < n; i++)
+        if (!parse_operand(text[i], &ops[i])) return fail(a, "bad operand", text[i].p, text[i].len);
+    if (instruction(a, op, ops, n)) return true;
+
+    // an immediate wider than the operation is the one reason worth
+    // telling apart, anything else is not an instruction it knows
+    Slice base;
+    int size;
+    Slice line = trim(p, end);
+    for (int i = 0; i < n; i++)
+        if (ops[i].kind == OPND_IMM && split_suffix(op, &base, &size) && !imm_ok(ops[i].imm, size))
+            return fail(a, "immediate out of range", line.p, line.len);
+    return false;
+}
+
+// rel32 fields to names, now that every label is known: direct within
+// the text, left to whoever places the sections otherwise
+static bool resolve(Asm *a) {
+    Emitter *text = &a->obj->sec[OBJ_TEXT];
+    for (int i = 0; i < a->nfix; i++) {
+        const Fixup *f = &a->fixups[i];
+        const ObjSymbol *s = &a->obj->syms[f->symbol];
+        if (s->section != OBJ_TEXT) {
+            obj_add_reloc(a->obj, OBJ_TEXT, f->offset, RELOC_PC32, f->symbol);
+            continue;
+        }
+        unsigned char *b = (unsigned char *)text->data + f->offset;
+        int64_t v = (int32_t)((uint32_t)b[0] | (uint32_t)b[1] << 8 | (uint32_t)b[2] << 16 | (uint32_t)b[3] << 24);
+        v += (int64_t)s->offset - (int64_t)f->offset;
+        if (v < INT32_MIN || v > INT32_MAX) return fail(a, "branch out of range", s->name, s->len);
+        for (int k = 0; k < 4; k++) b[k] = (unsigned char)(v >> (8 * k));
+    }
+    return true;
+}
+
+bool x86_64_assemble(const char *text, size_t len, ObjFile *o, char *err, size_t err_len) {
+    Asm a = { .obj = o, .section = OBJ_TEXT, .err = err, .err_len = err_len };
+    for (int i = 0; i < 10; i++) a.numeric[i] = -1;
+    err[0] = '\0';
+
+    bool ok = true;
+    const char *p = text, *end = text + len;
+    while (ok && p < end) {
+        const char *eol = memchr(p, '\n', (size_t)(end - p));
+        if (!eol) eol = end;
+        ok = assemble_line(&a, p, eol);
+        if (!ok && !err[0]) {
+            Slice line = trim(p, strip_comment(p, eol));
+            fail(&a, "cannot encode", line.p, line.len);
+        }
+        p = eol + 1;
+    }
+    if (ok) ok = resolve(&a);
+
+    xfree(a.table);
+    xfree(a.fixups);
+    return ok;
+}
@@ -0,0 +1,20 @@
+#ifndef ENCODE_X86_64_H
+#define ENCODE_X86_64_H
+
+#include <stddef.h>
+#include <stdbool.h>
+
+#include "object.h"
+
+// Encodes the x86-64 backend's AT&T assembly into an object, the way
+// arm64_assemble does for arm64. Branches and %rip references within the
+// text are resolved here; everything else is a RELOC_PC32 for whoever
+// places the sections, which for now is only the JIT (jit.c). Branches
+// always take the rel32 form.
+//
+// Returns false on anything it does not know, e.g. a raw line from the
+// source, with why in err: a symbol defined twice, an immediate too wide
+// for its operation, or the line it cannot encode.
+bool x86_64_assemble(const char *text, size_t len, ObjFile *o, char *err, size_t err_len);
+
+#endif // ENCODE_X86_64_H
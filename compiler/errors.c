@@ -1,21 +1,41 @@
+#include <stdarg.h>
+#include <pthread.h>
+
 #include "errors.h"
 
+// Parse workers can hit errors at the same time. The first one in takes
+// the lock for good and exits, so only one message ever comes out.
+static pthread_mutex_t error_lock = PTHREAD_MUTEX_INITIALIZER;
+
 void error_undef(int line_num, const char *varname) {
+    pthread_mutex_lock(&error_lock);
     fprintf(stderr, "[compiler error] variable '%s' not defined! line: %d\n", varname, line_num);
     exit(1);
 }
 
 void error_redef(int line_num, const char *varname) {
+    pthread_mutex_lock(&error_lock);
     fprintf(stderr, "[compiler error] variable '%s' redefined! line: %d\n", varname, line_num);
     exit(1);
 }
 
 void error_func_args(int line_num, const char *funcname) {
+    pthread_mutex_lock(&error_lock);
     fprintf(stderr, "[compiler error] function '%s' called with wrong number of arguments! line: %d\n", funcname, line_num);
     exit(1);
 }
 
 void error_syntax(int line_num, const char *msg) {
+    pthread_mutex_lock(&error_lock);
     fprintf(stderr, "[compiler error] %s line: %d\n", msg, line_num);
     exit(1);
 }
+
+void error_fatal(const char *fmt, ...) {
+    pthread_mutex_lock(&error_lock);
+    va_list ap;
+    va_start(ap, fmt);
+    vfprintf(stderr, fmt, ap);
+    va_end(ap);
+    exit(1);
+}
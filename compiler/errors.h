@@ -9,4 +9,7 @@ void error_redef(int line_num, const char *varname);
 void error_func_args(int line_num, const char *funcname);
 void error_syntax(int line_num, const char *msg);
 
+// printf-style message for errors that do not fit the ones above
+void error_fatal(const char *fmt, ...) __attribute__((format(printf, 1, 2)));
+
 #endif // ERRORS_H
@@ -0,0 +1,204 @@
+#include <stdint.h>
+#include <unistd.h>
+
+#include "interp.h"
+#include "emit.h"
+#include "mem.h"
+
+// print goes through this buffer, written out when it gets this big and
+// at the exit, so a program that never stops still shows its output
+#define OUT_FLUSH (64 * 1024)
+
+// With GCC and clang every handler jumps straight to the next one
+// through a table of label addresses (computed goto), so each opcode
+// gets its own indirect branch. Anything else, or -DINTERP_SWITCH, loops
+// over a switch.
+#if defined(__GNUC__) && !defined(INTERP_SWITCH)
+#define THREADED 1
+#endif
+
+#ifdef THREADED
+#define CASE(op)    lbl_##op
+#define NEXT_OP     goto *dispatch[*pc]
+#define DISPATCH    NEXT_OP;
+#else
+#define CASE(op)    case op
+#define NEXT_OP     continue
+#define DISPATCH    for (;;) switch (*pc)
+#endif
+
+static void print_u32(Emitter *out, uint32_t v) {
+    char buf[21];
+    emit_textn(out, buf, emit_format_int(buf, (long)v));
+    if (out->len >= OUT_FLUSH) {
+        emit_write(out, STDOUT_FILENO);
+        out->len = 0;
+    }
+}
+
+static void print_str(Emitter *out, const Bytecode *bc, uint32_t i) {
+    emit_textn(out, bc->strings.data + bc->str_off[i], bc->str_len[i]);
+    if (out->len >= OUT_FLUSH) {
+        emit_write(out, STDOUT_FILENO);
+        out->len = 0;
+    }
+}
+
+// 32-bit sdiv: x / 0 is 0 and INT_MIN / -1 wraps back to INT_MIN
+static uint32_t sdiv32(uint32_t a, uint32_t b) {
+    int32_t x = (int32_t)a, y = (int32_t)b;
+    if (y == 0) return 0;
+    if (y == -1) return 0u - a;
+    return (uint32_t)(x / y);
+}
+
+int interp_run(const Bytecode *bc, const InterpTier *tier) {
+    uint64_t *r = xmalloc((bc->nslots ? bc->nslots : 1) * sizeof(uint64_t));
+    for (uint32_t i = 0; i < bc->nslots; i++) r[i] = bc->init[i];
+
+    // hits per hot spot, until one reaches the threshold
+    long *hits = xcalloc(bc->nspots ? (size_t)bc->nspots : 1, sizeof(long));
+    long threshold = tier ? tier->threshold : -1;
+
+    const uint32_t *code = bc->code;
+    const uint32_t *pc = code + bc->entry;
+    Emitter out = {0};
+
+#ifdef THREADED
+    static void *const dispatch[BC_OP_COUNT] = {
+        [BC_MOV]    = &&lbl_BC_MOV,
+        [BC_MOV64]  = &&lbl_BC_MOV64,
+        [BC_ADD]    = &&lbl_BC_ADD,
+        [BC_SUB]    = &&lbl_BC_SUB,
+        [BC_MUL]    = &&lbl_BC_MUL,
+        [BC_DIV]    = &&lbl_BC_DIV,
+        [BC_JMP]    = &&lbl_BC_JMP,
+        [BC_JEQ]    = &&lbl_BC_JEQ,
+        [BC_JNE]    = &&lbl_BC_JNE,
+        [BC_JLT]    = &&lbl_BC_JLT,
+        [BC_JGT]    = &&lbl_BC_JGT,
+        [BC_JLE]    = &&lbl_BC_JLE,
+        [BC_JGE]    = &&lbl_BC_JGE,
+        [BC_LOOP]   = &&lbl_BC_LOOP,
+        [BC_NEXT]   = &&lbl_BC_NEXT,
+        [BC_PRINTS] = &&lbl_BC_PRINTS,
+        [BC_PRINTN] = &&lbl_BC_PRINTN,
+        [BC_EXIT]   = &&lbl_BC_EXIT,
+        [BC_HOT]    = &&lbl_BC_HOT,
+    };
+#endif
+
+// operands of the current instruction, wN as the low half of its slot
+#define A       pc[1]
+#define B       pc[2]
+#define W(n)    ((uint32_t)r[pc[n]])
+#define JUMP_IF(cond) \
+        pc = (cond) ? code + pc[3] : pc + 4; \
+        NEXT_OP
+
+    DISPATCH {
+        CASE(BC_MOV):
+            r[A] = W(2);
+            pc += 3;
+            NEXT_OP;
+
+        CASE(BC_MOV64):
+            r[A] = r[B];
+            pc += 3;
+            NEXT_OP;
+
+        CASE(BC_ADD):
+            r[A] = W(2) + W(3);
+            pc += 4;
+            NEXT_OP;
+
+        CASE(BC_SUB):
+            r[A] = W(2) - W(3);
+            pc += 4;
+            NEXT_OP;
+
+        CASE(BC_MUL):
+            r[A] = W(2) * W(3);
+            pc += 4;
+            NEXT_OP;
+
+        CASE(BC_DIV):
+            r[A] = sdiv32(W(2), W(3));
+            pc += 4;
+            NEXT_OP;
+
+        CASE(BC_JMP):
+            pc = code + pc[1];
+            NEXT_OP;
+
+        CASE(BC_JEQ):
+            JUMP_IF((int32_t)W(1) == (int32_t)W(2));
+
+        CASE(BC_JNE):
+            JUMP_IF((int32_t)W(1) != (int32_t)W(2));
+
+        CASE(BC_JLT):
+            JUMP_IF((int32_t)W(1) < (int32_t)W(2));
+
+        CASE(BC_JGT):
+            JUMP_IF((int32_t)W(1) > (int32_t)W(2));
+
+        CASE(BC_JLE):
+            JUMP_IF((int32_t)W(1) <= (int32_t)W(2));
+
+        CASE(BC_JGE):
+            JUMP_IF((int32_t)W(1) >= (int32_t)W(2));
+
+        CASE(BC_LOOP):
+            pc = W(1) == 0 ? code + pc[2] : pc + 3;
+            NEXT_OP;
+
+        CASE(BC_NEXT): {
+            uint32_t left = W(1) - 1;
+            r[A] = left;
+            pc = left ? code + pc[2] : pc + 3;
+            NEXT_OP;
+        }
+
+        CASE(BC_PRINTS):
+            print_str(&out, bc, pc[1]);
+            pc += 2;
+            NEXT_OP;
+
+        CASE(BC_PRINTN):
+            print_u32(&out, W(1));
+            pc += 2;
+            NEXT_OP;
+
+        CASE(BC_EXIT):
+            goto done;
+
+        CASE(BC_HOT):
+            if (++hits[A] == threshold) {
+                // what was printed so far goes out before native code prints
+                emit_write(&out, STDOUT_FILENO);
+                out.len = 0;
+                if (tier->enter(tier->ctx, A, r)) goto done;
+                threshold = -1;
+            }
+            pc += 2;
+            NEXT_OP;
+
+#ifndef THREADED
+        default:
+            goto done;
+#endif
+    }
+
+#undef A
+#undef B
+#undef W
+#undef JUMP_IF
+
+done:
+    emit_write(&out, STDOUT_FILENO);
+    emit_free(&out);
+    xfree(hits);
+    xfree(r);
+    return 0;
+}
@@ -0,0 +1,23 @@
+#ifndef INTERP_H
+#define INTERP_H
+
+#include "bytecode.h"
+
+#include <stdbool.h>
+
+// Tiering up, for bytecode compiled with hot spots: once a hot spot has
+// been passed threshold times, enter() gets the register file and is to
+// carry on from that spot in native code until the exit. It returns
+// false when it cannot, and the interpreter goes on without tiering.
+typedef struct {
+    long threshold;
+    bool (*enter)(void *ctx, uint32_t spot, const uint64_t *slots);
+    void *ctx;
+} InterpTier;
+
+// Run bytecode from its entry to an exit, printing to stdout, or until
+// tier takes over (NULL to only interpret). Returns the process exit
+// status, 0 like the native exit.
+int interp_run(const Bytecode *bc, const InterpTier *tier);
+
+#endif // INTERP_H
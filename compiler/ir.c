@@ -0,0 +1,905 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdbool.h>
+
+#include "ir.h"
+#include "errors.h"
+#include "lexer.h"
+#include "mem.h"
+
+// pointer key -> index, open addressing; keys are interned names
+typedef struct {
+    const void **keys;
+    int *vals;          // index + 1, 0 for an empty entry
+    size_t cap, count;
+} Map;
+
+typedef struct {
+    IrProgram *ir;
+    int cur;            // block being filled, -1 before the first function
+    Map cells, funcs, strings;
+} Builder;
+
+/* ---- maps ---- */
+
+static size_t map_hash(const void *key, size_t cap) {
+    return (size_t)(((uint64_t)(uintptr_t)key * 0x9E3779B97F4A7C15ull) >> 32) & (cap - 1);
+}
+
+static int *map_find(Map *m, const void *key) {
+    if ((m->count + 1) * 2 > m->cap) {
+        Map old = *m;
+        m->cap = m->cap ? m->cap * 2 : 256;
+        m->keys = xcalloc(m->cap, sizeof(void *));
+        m->vals = xcalloc(m->cap, sizeof(int));
+        for (size_t i = 0; i < old.cap; i++) {
+            if (!old.vals[i]) continue;
+            size_t h = map_hash(old.keys[i], m->cap);
+            while (m->vals[h]) h = (h + 1) & (m->cap - 1);
+            m->keys[h] = old.keys[i];
+            m->vals[h] = old.vals[i];
+        }
+        xfree(old.keys);
+        xfree(old.vals);
+    }
+    size_t h = map_hash(key, m->cap);
+    while (m->vals[h] && m->keys[h] != key) h = (h + 1) & (m->cap - 1);
+    m->keys[h] = key;
+    return &m->vals[h];
+}
+
+static void map_free(Map *m) {
+    xfree(m->keys);
+    xfree(m->vals);
+}
+
+/* ---- program pieces ---- */
+
+#define GROW(items, n, cap) \
+    do { \
+        if ((n) == (cap)) { \
+            (cap) = (cap) ? (cap) * 2 : 16; \
+            (items) = xrealloc((items), (size_t)(cap) * sizeof(*(items))); \
+        } \
+    } while (0)
+
+// names are owned by the program, a function's is copied like the rest
+static int new_block(IrProgram *ir, const char *name) {
+    GROW(ir->blocks, ir->nblocks, ir->block_cap);
+    IrBlock *b = &ir->blocks[ir->nblocks];
+    memset(b, 0, sizeof(*b));
+    size_t len = strlen(name);
+    char *copy = xmalloc(len + 1);
+    memcpy(copy, name, len + 1);
+    b->name = copy;
+    return ir->nblocks++;
+}
+
+// kind, number and part: if3.then, loop2.body, or bb.7 for kind "bb"
+static int new_named_block(IrProgram *ir, const char *kind, int seq, const char *part) {
+    char name[64];
+    size_t len = strlen(kind);
+    memcpy(name, kind, len);
+    if (!part) name[len++] = '.';
+    len += emit_format_int(name + len, seq);
+    if (part) {
+        name[len++] = '.';
+        size_t plen = strlen(part);
+        memcpy(name + len, part, plen);
+        len += plen;
+    }
+    name[len] = '\0';
+    return new_block(ir, name);
+}
+
+static void add_pred(IrProgram *ir, int block, int pred) {
+    IrBlock *b = &ir->blocks[block];
+    GROW(b->preds, b->npreds, b->pred_cap);
+    b->preds[b->npreds++] = pred;
+}
+
+int ir_insert(IrProgram *ir, int block, int at, IrInst in) {
+    GROW(ir->insts, ir->ninsts, ir->inst_cap);
+    in.block = block;
+    ir->insts[ir->ninsts] = in;
+
+    IrBlock *b = &ir->blocks[block];
+    GROW(b->insts, b->ninsts, b->inst_cap);
+    if (at < 0 || at > b->ninsts) at = b->ninsts;
+    memmove(&b->insts[at + 1], &b->insts[at], (size_t)(b->ninsts - at) * sizeof(int));
+    b->insts[at] = ir->ninsts;
+    b->ninsts++;
+    return ir->ninsts++;
+}
+
+static int new_cell(IrProgram *ir, const char *label, int reg, IrType type) {
+    GROW(ir->cells, ir->ncells, ir->cell_cap);
+    IrCell *c = &ir->cells[ir->ncells];
+    c->label = label;
+    c->reg = reg;
+    c->type = type;
+    return ir->ncells++;
+}
+
+/* ---- building ---- */
+
+static int add(Builder *b, IrOp op, IrType type, int x, int y) {
+    IrInst in = { .op = op, .type = type, .a = x, .b = y, .cell = -1, .str = -1,
+                  .succ = { -1, -1 } };
+    return ir_insert(b->ir, b->cur, -1, in);
+}
+
+static int constant(Builder *b, IrType type, int64_t imm) {
+    int v = add(b, IR_CONST, type, -1, -1);
+    b->ir->insts[v].imm = imm;
+    return v;
+}
+
+static int load(Builder *b, int cell) {
+    int v = add(b, IR_LOAD, b->ir->cells[cell].type, -1, -1);
+    b->ir->insts[v].cell = cell;
+    return v;
+}
+
+static void store(Builder *b, int cell, int v) {
+    int s = add(b, IR_STORE, IR_VOID, v, -1);
+    b->ir->insts[s].cell = cell;
+}
+
+// end the block being filled
+static void branch(Builder *b, int to) {
+    int t = add(b, IR_BR, IR_VOID, -1, -1);
+    b->ir->insts[t].succ[0] = to;
+    add_pred(b->ir, to, b->cur);
+}
+
+static void cond_branch(Builder *b, int cond, int if_true, int if_false) {
+    int t = add(b, IR_CONDBR, IR_VOID, cond, -1);
+    b->ir->insts[t].succ[0] = if_true;
+    b->ir->insts[t].succ[1] = if_false;
+    add_pred(b->ir, if_true, b->cur);
+    add_pred(b->ir, if_false, b->cur);
+}
+
+// a variable by its resolved label, made on first use
+static int var_cell(Builder *b, const char *label) {
+    int *slot = map_find(&b->cells, label);
+    if (!*slot) {
+        b->cells.count++;
+        *slot = new_cell(b->ir, label, -1, IR_I32) + 1;
+    }
+    return *slot - 1;
+}
+
+// cell of a nevo register, w3 and x3 are both cell 3
+static int reg_cell(const char *name, int line_num) {
+    char *end;
+    long n = strtol(name + 1, &end, 10);
+    if (*end || n < 0 || n >= IR_REGS)
+        error_fatal("Error: unknown register (line %d): %s\n", line_num, name);
+    return (int)n;
+}
+
+static void no_memory(int line_num) {
+    error_fatal("Error: memory operands only work in native code (line %d)\n", line_num);
+}
+
+// a number, register or variable as an i32
+static int operand(Builder *b, const Expr *e, int line_num) {
+    switch (e->kind) {
+        case EXPR_NUMBER:
+            return constant(b, IR_I32, (int32_t)(uint32_t)e->value);
+        case EXPR_REG:
+            return add(b, IR_TRUNC, IR_I32, load(b, reg_cell(e->name, line_num)), -1);
+        case EXPR_VAR:
+            return load(b, var_cell(b, e->label));
+        default:
+            no_memory(line_num);
+    }
+    return -1;
+}
+
+static int expr(Builder *b, const Expr *e, int line_num) {
+    if (e->kind != EXPR_BINARY) return operand(b, e, line_num);
+
+    static const IrOp ops[] = { IR_ADD, IR_SUB, IR_MUL, IR_DIV };
+    int x = operand(b, e->lhs, line_num);
+    int y = operand(b, e->rhs, line_num);
+    return add(b, ops[e->op], IR_I32, x, y);
+}
+
+// dest = value; x registers copied from an x register or set to a number
+// keep 64 bits, everything else is a zero-extended 32-bit result
+static void assign(Builder *b, const Expr *dest, const Expr *value, int line_num) {
+    if (dest->kind == EXPR_MEM || value->kind == EXPR_MEM) no_memory(line_num);
+
+    if (dest->kind != EXPR_REG) {
+        store(b, var_cell(b, dest->label), expr(b, value, line_num));
+        return;
+    }
+
+    int cell = reg_cell(dest->name, line_num);
+    bool wide = dest->name[0] == 'x';
+    if (wide && value->kind == EXPR_REG && value->name[0] == 'x')
+        store(b, cell, load(b, reg_cell(value->name, line_num)));
+    else if (wide && value->kind == EXPR_NUMBER)
+        store(b, cell, constant(b, IR_I64, value->value));
+    else
+        store(b, cell, add(b, IR_ZEXT, IR_I64, expr(b, value, line_num), -1));
+}
+
+static void build_block(Builder *b, const Stmt *s);
+
+// "if a <op> b { ... } else { ... }"
+static void build_if(Builder *b, const Stmt *s) {
+    int x = operand(b, s->lhs, s->line);
+    int y = operand(b, s->rhs, s->line);
+    int c = add(b, IR_CMP, IR_I1, x, y);
+    b->ir->insts[c].cmp = s->cmp;
+
+    int then = new_named_block(b->ir, "if", s->seq, "then");
+    int other = s->else_body ? new_named_block(b->ir, "if", s->seq, "else") : -1;
+    int end = new_named_block(b->ir, "if", s->seq, "end");
+    cond_branch(b, c, then, other >= 0 ? other : end);
+
+    b->cur = then;
+    build_block(b, s->body);
+    branch(b, end);
+    if (other >= 0) {
+        b->cur = other;
+        build_block(b, s->else_body);
+        branch(b, end);
+    }
+    b->cur = end;
+}
+
+// "loop <expr> { ... }": the count goes to the hidden _loop_counter_N,
+// checked for zero once, then decremented and tested at the bottom
+static void build_loop(Builder *b, const Stmt *s) {
+    char label[32];
+    memcpy(label, "_loop_counter_", 14);
+    label[14 + emit_format_int(label + 14, s->seq)] = '\0';
+    int counter = var_cell(b, intern(label, strlen(label)));
+
+    int n = expr(b, s->value, s->line);
+    store(b, counter, n);
+    int zero = add(b, IR_CMP, IR_I1, n, constant(b, IR_I32, 0));
+    b->ir->insts[zero].cmp = CMP_EQ;
+
+    int body = new_named_block(b->ir, "loop", s->seq, "body");
+    int next = new_named_block(b->ir, "loop", s->seq, "next");
+    int end = new_named_block(b->ir, "loop", s->seq, "end");
+    cond_branch(b, zero, end, body);
+
+    b->cur = body;
+    build_block(b, s->body);
+    branch(b, next);
+
+    b->cur = next;
+    int left = add(b, IR_SUB, IR_I32, load(b, counter), constant(b, IR_I32, 1));
+    store(b, counter, left);
+    int more = add(b, IR_CMP, IR_I1, left, constant(b, IR_I32, 0));
+    b->ir->insts[more].cmp = CMP_NE;
+    cond_branch(b, more, body, end);
+
+    b->cur = end;
+}
+
+// nothing comes back from a call or an exit, what follows goes in a
+// fresh block that only a later function's fall-through could reach
+static void after_jump(Builder *b) {
+    b->cur = new_named_block(b->ir, "bb", b->ir->nblocks, NULL);
+}
+
+// "bl func(a, b)": arguments to w0, w1... and a branch to the function
+static void build_call(Builder *b, const Stmt *s) {
+    int reg = 0;
+    for (const Expr *a = s->args; a; a = a->next, reg++) {
+        if (reg == IR_REGS) error_func_args(s->line, s->callee);
+        store(b, reg, add(b, IR_ZEXT, IR_I64, operand(b, a, s->line), -1));
+    }
+    int *target = map_find(&b->funcs, s->callee);
+    if (!*target)
+        error_fatal("Error: call to undefined function (line %d): %s\n", s->line, s->callee);
+    branch(b, *target - 1);
+    after_jump(b);
+}
+
+static int string(Builder *b, const Expr *e) {
+    int *slot = map_find(&b->strings, e->label);
+    if (*slot) return *slot - 1;
+    b->strings.count++;
+
+    IrProgram *ir = b->ir;
+    GROW(ir->strings, ir->nstrings, ir->string_cap);
+    IrString *str = &ir->strings[ir->nstrings];
+    str->label = e->label;
+    str->text = e->name;
+    str->len = e->value;
+    *slot = ir->nstrings + 1;
+    return ir->nstrings++;
+}
+
+static void build_stmt(Builder *b, const Stmt *s) {
+    switch (s->kind) {
+        case STMT_NUM:
+        case STMT_ASSIGN:
+        case STMT_SETR:
+        case STMT_SETM:
+            assign(b, s->dest, s->value, s->line);
+            break;
+
+        case STMT_LOOP:
+            build_loop(b, s);
+            break;
+
+        case STMT_IF:
+            build_if(b, s);
+            break;
+
+        case STMT_PRINT:
+            if (s->value->kind == EXPR_STRING) {
+                int p = add(b, IR_PRINTS, IR_VOID, -1, -1);
+                b->ir->insts[p].str = string(b, s->value);
+            } else {
+                add(b, IR_PRINTN, IR_VOID, operand(b, s->value, s->line), -1);
+            }
+            break;
+
+        case STMT_CALL:
+            build_call(b, s);
+            break;
+
+        case STMT_EXIT:
+            add(b, IR_EXIT, IR_VOID, -1, -1);
+            after_jump(b);
+            break;
+
+        case STMT_RAW:
+            error_fatal("Error: assembly only works in native code (line %d): %.*s\n", s->line, s->len, s->text);
+    }
+}
+
+static void build_block(Builder *b, const Stmt *s) {
+    for (; s; s = s->next)
+        build_stmt(b, s);
+}
+
+void ir_build(const Program *prog, IrProgram *ir) {
+    memset(ir, 0, sizeof(*ir));
+    Builder b = { .ir = ir, .cur = -1 };
+    for (int i = 0; i < IR_REGS; i++) new_cell(ir, NULL, i, IR_I64);
+
+    // every function's block up front, calls can go forward
+    int start = new_block(ir, ".start");
+    for (const Func *f = prog->funcs; f; f = f->next) {
+        int *slot = map_find(&b.funcs, f->name);
+        if (*slot) error_fatal("Error: function defined twice (line %d): %s\n", f->line, f->name);
+        b.funcs.count++;
+        *slot = new_block(ir, f->name) + 1;
+    }
+
+    int entry = prog->funcs ? *map_find(&b.funcs, intern("_main", 5)) : 0;
+    if (prog->funcs && !entry) error_fatal("Error: no _main function\n");
+    b.cur = start;
+    if (entry) branch(&b, entry - 1);
+    else add(&b, IR_EXIT, IR_VOID, -1, -1);
+    b.cur = -1;
+
+    for (const Func *f = prog->funcs; f; f = f->next) {
+        int block = *map_find(&b.funcs, f->name) - 1;
+        if (b.cur >= 0) branch(&b, block);
+        b.cur = block;
+
+        // incoming arguments into the parameters, also on fall-through
+        int reg = 0;
+        for (const Expr *p = f->params; p; p = p->next, reg++) {
+            if (reg == IR_REGS) error_func_args(f->line, f->name);
+            store(&b, var_cell(&b, p->label), add(&b, IR_TRUNC, IR_I32, load(&b, reg), -1));
+        }
+        build_block(&b, f->body);
+    }
+    if (b.cur >= 0) add(&b, IR_EXIT, IR_VOID, -1, -1);
+
+    map_free(&b.cells);
+    map_free(&b.funcs);
+    map_free(&b.strings);
+}
+
+void ir_free(IrProgram *ir) {
+    for (int i = 0; i < ir->ninsts; i++)
+        xfree(ir->insts[i].phi);
+    for (int i = 0; i < ir->nblocks; i++) {
+        xfree((char *)ir->blocks[i].name);
+        xfree(ir->blocks[i].insts);
+        xfree(ir->blocks[i].preds);
+    }
+    xfree(ir->insts);
+    xfree(ir->blocks);
+    xfree(ir->cells);
+    xfree(ir->strings);
+    memset(ir, 0, sizeof(*ir));
+}
+
+void ir_compact(IrProgram *ir) {
+    for (int bi = 0; bi < ir->nblocks; bi++) {
+        IrBlock *b = &ir->blocks[bi];
+        int n = 0;
+        for (int k = 0; k < b->ninsts; k++)
+            if (ir->insts[b->insts[k]].block >= 0) b->insts[n++] = b->insts[k];
+        b->ninsts = n;
+    }
+}
+
+void ir_remove_edge(IrProgram *ir, int pred, int succ) {
+    IrBlock *b = &ir->blocks[succ];
+    int i = 0;
+    while (i < b->npreds && b->preds[i] != pred) i++;
+    if (i == b->npreds) return;
+
+    int tail = b->npreds - i - 1;
+    memmove(&b->preds[i], &b->preds[i + 1], (size_t)tail * sizeof(int));
+    for (int k = 0; k < b->ninsts; k++) {
+        IrInst *in = &ir->insts[b->insts[k]];
+        if (in->op != IR_PHI) break;
+        memmove(&in->phi[i], &in->phi[i + 1], (size_t)tail * sizeof(int));
+    }
+    b->npreds--;
+}
+
+/* ---- verifier ---- */
+
+typedef struct {
+    const IrProgram *ir;
+    char *err;
+    size_t err_len;
+    int *pos;           // instruction -> index in its block
+    int *rpo;           // block -> reverse postorder number, -1 unreachable
+    int *idom;          // block -> immediate dominator, by block number
+} Verifier;
+
+static bool fail(Verifier *v, const char *what, int block, int inst) {
+    const char *name = block >= 0 ? v->ir->blocks[block].name : "?";
+    if (inst >= 0) snprintf(v->err, v->err_len, "%s, in block %s at %%%d", what, name, inst);
+    else snprintf(v->err, v->err_len, "%s, in block %s", what, name);
+    return false;
+}
+
+static int cmp_int(const void *a, const void *b) {
+    int x = *(const int *)a, y = *(const int *)b;
+    return (x > y) - (x < y);
+}
+
+static int count_in(const int *sorted, int n, int key) {
+    int lo = 0, hi = n;
+    while (lo < hi) {
+        int mid = (lo + hi) / 2;
+        if (sorted[mid] < key) lo = mid + 1;
+        else hi = mid;
+    }
+    int c = 0;
+    while (lo + c < n && sorted[lo + c] == key) c++;
+    return c;
+}
+
+// every pred list matches the terminators' edges, as a multiset
+static bool check_edges(Verifier *v) {
+    const IrProgram *ir = v->ir;
+    int **sorted = xcalloc((size_t)ir->nblocks + 1, sizeof(int *));
+    bool ok = true;
+    for (int s = 0; s < ir->nblocks; s++) {
+        const IrBlock *b = &ir->blocks[s];
+        sorted[s] = xmalloc(((size_t)b->npreds + 1) * sizeof(int));
+        if (b->npreds) memcpy(sorted[s], b->preds, (size_t)b->npreds * sizeof(int));
+        qsort(sorted[s], (size_t)b->npreds, sizeof(int), cmp_int);
+        for (int i = 0; ok && i < b->npreds; i++)
+            if (b->preds[i] < 0 || b->preds[i] >= ir->nblocks || ir->blocks[b->preds[i]].ninsts == 0)
+                ok = fail(v, "bad predecessor", s, -1);
+    }
+
+    long edges = 0, listed = 0;
+    for (int p = 0; ok && p < ir->nblocks; p++) {
+        listed += ir->blocks[p].npreds;
+        if (ir->blocks[p].ninsts == 0) continue;
+        const IrInst *t = &ir->insts[ir_terminator(ir, p)];
+        for (int k = 0; ok && k < ir_nsucc(t); k++) {
+            int s = t->succ[k];
+            edges++;
+            int want = 0;
+            for (int j = 0; j < ir_nsucc(t); j++) want += t->succ[j] == s;
+            if (count_in(sorted[s], ir->blocks[s].npreds, p) != want)
+                ok = fail(v, "predecessors do not match the branches", s, -1);
+        }
+    }
+    if (ok && edges != listed) ok = fail(v, "predecessors do not match the branches", -1, -1);
+
+    for (int s = 0; s < ir->nblocks; s++) xfree(sorted[s]);
+    xfree(sorted);
+    return ok;
+}
+
+static bool check_shape(Verifier *v) {
+    const IrProgram *ir = v->ir;
+    if (ir->nblocks == 0 || ir->blocks[0].ninsts == 0) return fail(v, "no start block", -1, -1);
+    if (ir->blocks[0].npreds) return fail(v, "the start block has predecessors", 0, -1);
+
+    for (int i = 0; i < ir->ninsts; i++) v->pos[i] = -1;
+    for (int bi = 0; bi < ir->nblocks; bi++) {
+        const IrBlock *b = &ir->blocks[bi];
+        if (b->ninsts == 0) {
+            if (b->npreds) return fail(v, "a deleted block has predecessors", bi, -1);
+            continue;
+        }
+        bool phis = true;
+        for (int k = 0; k < b->ninsts; k++) {
+            int id = b->insts[k];
+            if (id < 0 || id >= ir->ninsts) return fail(v, "bad instruction number", bi, -1);
+            const IrInst *in = &ir->insts[id];
+            if (in->block != bi || v->pos[id] >= 0) return fail(v, "instruction listed in the wrong block", bi, id);
+            v->pos[id] = k;
+
+            bool term = in->op == IR_BR || in->op == IR_CONDBR || in->op == IR_EXIT;
+            if (term != (k == b->ninsts - 1))
+                return fail(v, term ? "terminator before the end" : "block does not end in a terminator", bi, id);
+            if (in->op == IR_PHI && !phis) return fail(v, "phi after other instructions", bi, id);
+            phis = in->op == IR_PHI;
+            for (int j = 0; j < ir_nsucc(in); j++)
+                if (in->succ[j] < 0 || in->succ[j] >= ir->nblocks || ir->blocks[in->succ[j]].ninsts == 0)
+                    return fail(v, "branch to a missing block", bi, id);
+            for (int j = 0; j < ir_nsucc(in); j++)
+                if (in->succ[j] == 0) return fail(v, "branch to the start block", bi, id);
+        }
+    }
+    for (int i = 0; i < ir->ninsts; i++)
+        if (ir->insts[i].block >= 0 && v->pos[i] < 0)
+            return fail(v, "instruction missing from its block", ir->insts[i].block, i);
+    return true;
+}
+
+/* Cooper, Harvey and Kennedy's "A Simple, Fast Dominance Algorithm":
+   iterate idom over reverse postorder until nothing changes. */
+
+static void number_blocks(Verifier *v, int *order, int *n) {
+    const IrProgram *ir = v->ir;
+    // iterative depth-first search, postorder into order[]
+    int *stack = xmalloc(((size_t)ir->nblocks + 1) * sizeof(int));
+    int *next = xcalloc((size_t)ir->nblocks + 1, sizeof(int));
+    bool *seen = xcalloc((size_t)ir->nblocks + 1, sizeof(bool));
+    int sp = 0;
+    *n = 0;
+    stack[sp++] = 0;
+    seen[0] = true;
+    while (sp) {
+        int b = stack[sp - 1];
+        const IrInst *t = &ir->insts[ir_terminator(ir, b)];
+        if (next[b] < ir_nsucc(t)) {
+            int s = t->succ[next[b]++];
+            if (!seen[s]) {
+                seen[s] = true;
+                stack[sp++] = s;
+            }
+            continue;
+        }
+        order[(*n)++] = b;
+        sp--;
+    }
+    for (int b = 0; b < ir->nblocks; b++) v->rpo[b] = -1;
+    for (int i = 0; i < *n; i++) v->rpo[order[i]] = *n - 1 - i;
+    xfree(stack);
+    xfree(next);
+    xfree(seen);
+}
+
+static int intersect(const Verifier *v, int a, int b) {
+    while (a != b) {
+        while (v->rpo[a] > v->rpo[b]) a = v->idom[a];
+        while (v->rpo[b] > v->rpo[a]) b = v->idom[b];
+    }
+    return a;
+}
+
+static void dominators(Verifier *v) {
+    const IrProgram *ir = v->ir;
+    int *order = xmalloc(((size_t)ir->nblocks + 1) * sizeof(int));
+    int n;
+    number_blocks(v, order, &n);
+    for (int b = 0; b < ir->nblocks; b++) v->idom[b] = -1;
+    v->idom[0] = 0;
+
+    for (bool changed = true; changed;) {
+        changed = false;
+        for (int i = n - 2; i >= 0; i--) {      // reverse postorder, start block skipped
+            int b = order[i];
+            const IrBlock *blk = &ir->blocks[b];
+            int d = -1;
+            for (int k = 0; k < blk->npreds; k++) {
+                int p = blk->preds[k];
+                if (v->idom[p] < 0) continue;
+                d = d < 0 ? p : intersect(v, p, d);
+            }
+            if (d != v->idom[b]) {
+                v->idom[b] = d;
+                changed = true;
+            }
+        }
+    }
+    xfree(order);
+}
+
+static bool dominates(const Verifier *v, int a, int b) {
+    if (v->rpo[a] < 0 || v->rpo[b] < 0) return false;
+    while (v->rpo[b] > v->rpo[a]) b = v->idom[b];
+    return a == b;
+}
+
+// value x is there for instruction id, or at the end of block when id < 0
+static bool check_use(Verifier *v, int x, IrType type, int block, int id) {
+    const IrProgram *ir = v->ir;
+    if (x < 0 || x >= ir->ninsts || ir->insts[x].block < 0)
+        return fail(v, "operand is not a value", block, id);
+    const IrInst *def = &ir->insts[x];
+    if (def->type != type) return fail(v, "operand has the wrong type", block, id);
+
+    if (v->rpo[block] < 0) return true;     // unreachable, anything goes
+    if (def->block == block) {
+        if (id < 0 || v->pos[x] < v->pos[id]) return true;
+        return fail(v, "use before its definition", block, id);
+    }
+    if (!dominates(v, def->block, block))
+        return fail(v, "use not dominated by its definition", block, id);
+    return true;
+}
+
+static bool check_inst(Verifier *v, int id) {
+    const IrProgram *ir = v->ir;
+    const IrInst *in = &ir->insts[id];
+    int bi = in->block;
+    static const IrType want[IR_OP_COUNT] = {
+        [IR_CONST] = IR_VOID, [IR_LOAD] = IR_VOID, [IR_STORE] = IR_VOID,
+        [IR_ADD] = IR_I32, [IR_SUB] = IR_I32, [IR_MUL] = IR_I32, [IR_DIV] = IR_I32,
+        [IR_CMP] = IR_I1, [IR_ZEXT] = IR_I64, [IR_TRUNC] = IR_I32,
+        [IR_PRINTN] = IR_VOID, [IR_PRINTS] = IR_VOID,
+        [IR_BR] = IR_VOID, [IR_CONDBR] = IR_VOID, [IR_EXIT] = IR_VOID,
+    };
+    if ((unsigned)in->op >= IR_OP_COUNT) return fail(v, "unknown instruction", bi, id);
+    if (in->op != IR_CONST && in->op != IR_LOAD && in->op != IR_PHI && in->type != want[in->op])
+        return fail(v, "result has the wrong type", bi, id);
+
+    switch (in->op) {
+        case IR_CONST:
+            if (in->type == IR_VOID) return fail(v, "constant without a type", bi, id);
+            return true;
+        case IR_LOAD:
+        case IR_STORE:
+            if (in->cell < 0 || in->cell >= ir->ncells) return fail(v, "bad cell", bi, id);
+            if (in->op == IR_LOAD)
+                return in->type == ir->cells[in->cell].type || fail(v, "load has the wrong type", bi, id);
+            return check_use(v, in->a, ir->cells[in->cell].type, bi, id);
+        case IR_ADD:
+        case IR_SUB:
+        case IR_MUL:
+        case IR_DIV:
+        case IR_CMP:
+            return check_use(v, in->a, IR_I32, bi, id) && check_use(v, in->b, IR_I32, bi, id);
+        case IR_ZEXT:
+        case IR_PRINTN:
+            return check_use(v, in->a, IR_I32, bi, id);
+        case IR_TRUNC:
+            return check_use(v, in->a, IR_I64, bi, id);
+        case IR_PHI: {
+            if (in->type == IR_VOID) return fail(v, "phi without a type", bi, id);
+            const IrBlock *b = &ir->blocks[bi];
+            if (b->npreds && !in->phi) return fail(v, "phi without operands", bi, id);
+            for (int k = 0; k < b->npreds; k++)
+                if (!check_use(v, in->phi[k], in->type, b->preds[k], -1)) return false;
+            return true;
+        }
+        case IR_PRINTS:
+            return (in->str >= 0 && in->str < ir->nstrings) || fail(v, "bad string", bi, id);
+        case IR_CONDBR:
+            return check_use(v, in->a, IR_I1, bi, id);
+        case IR_BR:
+        case IR_EXIT:
+        case IR_OP_COUNT:
+            break;
+    }
+    return true;
+}
+
+bool ir_verify(const IrProgram *ir, char *err, size_t err_len) {
+    size_t n = (size_t)ir->ninsts + 1, nb = (size_t)ir->nblocks + 1;
+    Verifier v = { ir, err, err_len, xmalloc(n * sizeof(int)), xmalloc(nb * sizeof(int)), xmalloc(nb * sizeof(int)) };
+
+    bool ok = check_shape(&v) && check_edges(&v);
+    if (ok) {
+        dominators(&v);
+        for (int i = 0; ok && i < ir->ninsts; i++)
+            if (ir->insts[i].block >= 0) ok = check_inst(&v, i);
+    }
+    xfree(v.pos);
+    xfree(v.rpo);
+    xfree(v.idom);
+    return ok;
+}
+
+/* ---- dump ----
+   One instruction a line, blocks in the order they were made:
+
+       ; @x i32, @str_0 "hi\n"
+       .start:
+         br _main
+       _main:                          ; preds: .start
+         %3 = load i64 x0
+         %4 = trunc i64 %3 to i32
+         store @x, %4
+         %5 = const i32 10
+         %6 = cmp slt i32 %4, %5
+         condbr %6, if0.then, if0.end
+       ...
+         %9 = phi i32 [ %4, _main ], [ %8, if0.then ]
+
+   Registers are x0..x30, variables and strings @label. */
+
+static const char *const op_names[IR_OP_COUNT] = {
+    "const", "load", "store", "add", "sub", "mul", "div", "cmp",
+    "zext", "trunc", "phi", "printn", "prints", "br", "condbr", "exit"
+};
+
+static const char *const type_names[] = { "void", "i1", "i32", "i64" };
+
+static const char *const cmp_names[] = { "slt", "sgt", "eq", "ne", "sle", "sge" };
+
+static void dump_value(Emitter *out, int v) {
+    emit_char(out, '%');
+    emit_int(out, v);
+}
+
+static void dump_cell(Emitter *out, const IrCell *c) {
+    if (c->label) {
+        emit_char(out, '@');
+        emit_text(out, c->label);
+    } else {
+        emit_char(out, 'x');
+        emit_int(out, c->reg);
+    }
+}
+
+static void dump_inst(Emitter *out, const IrProgram *ir, int id) {
+    const IrInst *in = &ir->insts[id];
+    emit_textn(out, "  ", 2);
+    if (in->type != IR_VOID) {
+        dump_value(out, id);
+        emit_text(out, " = ");
+    }
+    emit_text(out, op_names[in->op]);
+    if (in->op == IR_CMP) {
+        emit_char(out, ' ');
+        emit_text(out, cmp_names[in->cmp]);
+    }
+    if (in->type != IR_VOID) {
+        emit_char(out, ' ');
+        // what it works on: cmp and zext take an i32, trunc an i64
+        IrType t = in->op == IR_CMP || in->op == IR_ZEXT ? IR_I32 : in->op == IR_TRUNC ? IR_I64 : in->type;
+        emit_text(out, type_names[t]);
+    }
+
+    switch (in->op) {
+        case IR_CONST:
+            emit_char(out, ' ');
+            if (in->type == IR_I64) {
+                char buf[21];
+                emit_textn(out, buf, emit_format_int(buf, in->imm));
+            } else {
+                emit_int(out, (int)in->imm);
+            }
+            break;
+        case IR_LOAD:
+            emit_char(out, ' ');
+            dump_cell(out, &ir->cells[in->cell]);
+            break;
+        case IR_STORE:
+            emit_char(out, ' ');
+            dump_cell(out, &ir->cells[in->cell]);
+            emit_textn(out, ", ", 2);
+            dump_value(out, in->a);
+            break;
+        case IR_ADD:
+        case IR_SUB:
+        case IR_MUL:
+        case IR_DIV:
+        case IR_CMP:
+            emit_char(out, ' ');
+            dump_value(out, in->a);
+            emit_textn(out, ", ", 2);
+            dump_value(out, in->b);
+            break;
+        case IR_ZEXT:
+        case IR_TRUNC:
+            emit_char(out, ' ');
+            dump_value(out, in->a);
+            emit_text(out, in->op == IR_ZEXT ? " to i64" : " to i32");
+            break;
+        case IR_PRINTN:
+        case IR_CONDBR:
+            emit_char(out, ' ');
+            dump_value(out, in->a);
+            break;
+        case IR_PHI: {
+            const IrBlock *b = &ir->blocks[in->block];
+            for (int k = 0; k < b->npreds; k++) {
+                emit_text(out, k ? ", [ " : " [ ");
+                dump_value(out, in->phi[k]);
+                emit_textn(out, ", ", 2);
+                emit_text(out, ir->blocks[b->preds[k]].name);
+                emit_text(out, " ]");
+            }
+            break;
+        }
+        case IR_PRINTS:
+            emit_text(out, " @");
+            emit_text(out, ir->strings[in->str].label);
+            break;
+        case IR_BR:
+        case IR_EXIT:
+        case IR_OP_COUNT:
+            break;
+    }
+    for (int k = 0; k < ir_nsucc(in); k++) {
+        emit_text(out, in->op == IR_CONDBR || k ? ", " : " ");
+        emit_text(out, ir->blocks[in->succ[k]].name);
+    }
+    emit_char(out, '\n');
+}
+
+void ir_dump(Emitter *out, const IrProgram *ir) {
+    // what is declared: variables that are still used, then strings
+    bool *used = xcalloc((size_t)ir->ncells + 1, sizeof(bool));
+    for (int i = 0; i < ir->ninsts; i++)
+        if (ir->insts[i].block >= 0 && (ir->insts[i].op == IR_LOAD || ir->insts[i].op == IR_STORE))
+            used[ir->insts[i].cell] = true;
+    const char *sep = "; ";
+    for (int c = 0; c < ir->ncells; c++) {
+        if (!used[c] || !ir->cells[c].label) continue;
+        emit_text(out, sep);
+        dump_cell(out, &ir->cells[c]);
+        emit_text(out, " i32");
+        sep = ", ";
+    }
+    for (int s = 0; s < ir->nstrings; s++) {
+        emit_text(out, sep);
+        emit_char(out, '@');
+        emit_text(out, ir->strings[s].label);
+        emit_text(out, " \"");
+        emit_text(out, ir->strings[s].text);
+        emit_char(out, '"');
+        sep = ", ";
+    }
+    if (sep[0] == ',') emit_char(out, '\n');
+    xfree(used);
+
+    for (int bi = 0; bi < ir->nblocks; bi++) {
+        const IrBlock *b = &ir->blocks[bi];
+        if (b->ninsts == 0) continue;
+        emit_text(out, b->name);
+        emit_char(out, ':');
+        if (b->npreds) {
+            for (size_t col = strlen(b->name) + 1; col < 40; col++) emit_char(out, ' ');
+            emit_text(out, "; preds:");
+            for (int k = 0; k < b->npreds; k++) {
+                emit_text(out, k ? ", " : " ");
+                emit_text(out, ir->blocks[b->preds[k]].name);
+            }
+        }
+        emit_char(out, '\n');
+        for (int k = 0; k < b->ninsts; k++)
+            dump_inst(out, ir, b->insts[k]);
+    }
+}
+
+const Isa isa_ir = {
+    .name = "ir",
+    .align_word = "",
+    .word = "",
+    .lower = ir_dump,
+};
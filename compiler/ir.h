@@ -0,0 +1,168 @@
+#ifndef IR_H
+#define IR_H
+
+#include <stdint.h>
+#include <stdbool.h>
+
+#include "ast.h"
+#include "emit.h"
+#include "target.h"
+
+// Mid-level IR: typed SSA values in basic blocks, built from the
+// resolved program tree. Like the program itself it is one control flow
+// graph: a nevo function is the block named after it, a call stores its
+// arguments to w0, w1... and branches there, and a function's last
+// block falls through into the next function's.
+//
+// Variables (32-bit, 0 at the start) and the registers w0..w30 / x0..x30
+// (64-bit, xN's low half is wN) are memory cells read and written with
+// explicit loads and stores. The mem2reg pass turns them into SSA values
+// and phis; a backend lowers whatever is left of them to memory.
+//
+// Every value is the instruction that computes it, numbered across the
+// program (%N in the dump). A block holds its phis first and ends with
+// exactly one terminator: br, condbr or exit. A block with no
+// instructions has been deleted and is skipped.
+
+typedef enum {
+    IR_VOID,
+    IR_I1,
+    IR_I32,
+    IR_I64
+} IrType;
+
+typedef enum {
+    IR_CONST,       // imm, of type
+    IR_LOAD,        // cell                 i32 variable or i64 register
+    IR_STORE,       // cell, a
+    IR_ADD,         // a, b                 i32, wrapping
+    IR_SUB,
+    IR_MUL,
+    IR_DIV,         // a, b                 arm64 sdiv: x / 0 is 0, INT_MIN / -1 is INT_MIN
+    IR_CMP,         // a, b, cmp            signed i32 compare, an i1
+    IR_ZEXT,        // a                    i32 to i64
+    IR_TRUNC,       // a                    i64 to i32
+    IR_PHI,         // phi[i] from preds[i]
+    IR_PRINTN,      // a                    unsigned decimal
+    IR_PRINTS,      // str
+    IR_BR,          // succ[0]
+    IR_CONDBR,      // a, succ[0] when true, succ[1] when false
+    IR_EXIT,
+    IR_OP_COUNT
+} IrOp;
+
+typedef struct {
+    IrOp op;
+    IrType type;        // of the result, IR_VOID for none
+    int block;          // the block it is in, -1 once deleted
+    int a, b;           // operand values
+    int cell;           // IR_LOAD, IR_STORE
+    int str;            // IR_PRINTS
+    CmpOp cmp;          // IR_CMP
+    int64_t imm;        // IR_CONST
+    int *phi;           // IR_PHI, one value per predecessor
+    int succ[2];        // IR_BR, IR_CONDBR
+} IrInst;
+
+typedef struct {
+    const char *name;   // the function's, or .start, if3.then, loop2.body, bb.7
+    int *insts;
+    int ninsts, inst_cap;
+    int *preds;         // in the order phi operands follow
+    int npreds, pred_cap;
+} IrBlock;
+
+// a memory cell: the registers first, cell N is xN, then the variables
+typedef struct {
+    const char *label;  // the variable's, NULL for a register
+    int reg;            // register number, -1 for a variable
+    IrType type;
+} IrCell;
+
+typedef struct {
+    const char *label;
+    const char *text;   // as written, escapes unresolved
+    long len;           // once resolved
+} IrString;
+
+typedef struct IrProgram {
+    IrInst *insts;
+    int ninsts, inst_cap;
+    IrBlock *blocks;    // block 0, .start, is where the program starts
+    int nblocks, block_cap;
+    IrCell *cells;
+    int ncells, cell_cap;
+    IrString *strings;
+    int nstrings, string_cap;
+} IrProgram;
+
+#define IR_REGS 31
+
+// successors of a terminator, or 0
+static inline int ir_nsucc(const IrInst *in) {
+    return in->op == IR_BR ? 1 : in->op == IR_CONDBR ? 2 : 0;
+}
+
+static inline int ir_terminator(const IrProgram *ir, int block) {
+    const IrBlock *b = &ir->blocks[block];
+    return b->insts[b->ninsts - 1];
+}
+
+// Build from a program after codegen_resolve. What only native code can
+// do, raw assembly lines and memory operands, is reported as an error.
+// Labels point into the resolved tree, so lower before codegen_release.
+void ir_build(const Program *prog, IrProgram *ir);
+void ir_free(IrProgram *ir);
+
+// false with a message in err when something is off: block shape, pred
+// lists, operand types, a use its definition does not dominate
+bool ir_verify(const IrProgram *ir, char *err, size_t err_len);
+
+// the textual form, see ir_dump in ir.c for an example
+void ir_dump(Emitter *out, const IrProgram *ir);
+
+// --emit=ir, lowers to the dump
+extern const Isa isa_ir;
+
+/* ---- passes, ir_pass.c ---- */
+
+// a pass changes the program in place, true when it changed anything
+typedef struct {
+    const char *name;
+    const char *help;
+    bool (*run)(IrProgram *ir);
+} IrPass;
+
+extern const IrPass ir_passes[];
+extern const int ir_pass_count;
+
+// what runs when no pipeline is given
+#define IR_DEFAULT_PIPELINE "mem2reg,simplify,dce"
+
+// called after every pass that ran, e.g. to dump the program
+typedef void (*IrPassHook)(void *ctx, const char *pass, const IrProgram *ir);
+
+// whether every name in a comma-separated list is a pass ("" and "none"
+// are)
+bool ir_pipeline_valid(const char *pipeline);
+
+// Run a comma-separated list of pass names ("" or "none" for none),
+// verifying the program before and after each; a failed verify is an
+// internal error and exits. false, before running any, when a name is
+// not a pass.
+bool ir_run_pipeline(IrProgram *ir, const char *pipeline, IrPassHook hook, void *ctx);
+
+// for passes: add an instruction to block, at index at or at the end
+// when at < 0; returns its number. in.block is filled in
+int ir_insert(IrProgram *ir, int block, int at, IrInst in);
+
+// for passes: drop instructions whose block was set to -1 from the
+// blocks' lists
+void ir_compact(IrProgram *ir);
+
+// for passes: forget that pred branches to succ, dropping pred from
+// succ's preds and its operand from succ's phis (the terminator is the
+// caller's to change)
+void ir_remove_edge(IrProgram *ir, int pred, int succ);
+
+#endif // IR_H
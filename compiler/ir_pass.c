@@ -0,0 +1,625 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdbool.h>
+
+#include "ir.h"
+#include "errors.h"
+#include "mem.h"
+
+// Passes share one way of replacing a value: repl[v] names what v became,
+// and once a pass is done every operand is sent through it and the
+// replaced instructions are deleted. Only blocks reached from the start
+// are looked at: code nothing runs needs no dominating definitions, so a
+// value there can end up its own operand, and folding that would never
+// settle.
+typedef struct {
+    IrProgram *ir;
+    int *repl;          // value -> replacement, -1 for none
+    int cap;
+    bool *reached;      // block -> reached from the start
+} Rewriter;
+
+// blocks a walk along the branches from the start gets to
+static bool *reached_blocks(const IrProgram *ir) {
+    bool *seen = xcalloc((size_t)ir->nblocks + 1, sizeof(bool));
+    int *stack = xmalloc(((size_t)ir->nblocks + 1) * sizeof(int));
+    int sp = 0;
+    stack[sp++] = 0;
+    seen[0] = true;
+    while (sp) {
+        const IrInst *t = &ir->insts[ir_terminator(ir, stack[--sp])];
+        for (int j = 0; j < ir_nsucc(t); j++)
+            if (!seen[t->succ[j]]) {
+                seen[t->succ[j]] = true;
+                stack[sp++] = t->succ[j];
+            }
+    }
+    xfree(stack);
+    return seen;
+}
+
+static void rewriter_init(Rewriter *r, IrProgram *ir) {
+    r->ir = ir;
+    r->cap = ir->ninsts;
+    r->repl = xmalloc(((size_t)r->cap + 1) * sizeof(int));
+    for (int i = 0; i < r->cap; i++) r->repl[i] = -1;
+    r->reached = reached_blocks(ir);
+}
+
+// an instruction still there, in a block that runs
+static bool is_live(const Rewriter *r, int v) {
+    int block = r->ir->insts[v].block;
+    return block >= 0 && r->reached[block];
+}
+
+// values made after init have no replacement; replace never closes a
+// cycle, but if one is there the walk stops inside it, a step per value
+static int resolve(Rewriter *r, int v) {
+    int root = v;
+    for (int steps = 0; root >= 0 && root < r->cap && r->repl[root] >= 0; steps++) {
+        if (steps == r->cap) return root;
+        root = r->repl[root];
+    }
+    while (v >= 0 && v < r->cap && r->repl[v] >= 0) {
+        int next = r->repl[v];
+        r->repl[v] = root;
+        v = next;
+    }
+    return root;
+}
+
+// false, and nothing done, when with already stands for v
+static bool replace(Rewriter *r, int v, int with) {
+    if (resolve(r, with) == v) return false;
+    r->repl[v] = with;
+    r->ir->insts[v].block = -1;
+    return true;
+}
+
+static void rewrite_operands(Rewriter *r) {
+    IrProgram *ir = r->ir;
+    for (int i = 0; i < ir->ninsts; i++) {
+        IrInst *in = &ir->insts[i];
+        if (in->block < 0) continue;
+        if (in->a >= 0) in->a = resolve(r, in->a);
+        if (in->b >= 0) in->b = resolve(r, in->b);
+        if (in->op == IR_PHI)
+            for (int k = 0; k < ir->blocks[in->block].npreds; k++)
+                in->phi[k] = resolve(r, in->phi[k]);
+    }
+}
+
+static void rewriter_free(Rewriter *r) {
+    rewrite_operands(r);
+    ir_compact(r->ir);
+    xfree(r->repl);
+    xfree(r->reached);
+}
+
+static int add_const(IrProgram *ir, int block, int at, IrType type, int64_t imm) {
+    IrInst in = { .op = IR_CONST, .type = type, .imm = imm, .a = -1, .b = -1,
+                  .cell = -1, .str = -1, .succ = { -1, -1 } };
+    return ir_insert(ir, block, at, in);
+}
+
+// A phi whose operands are all one value, or itself, is that value.
+// Replacing it can make others trivial, so go until nothing changes.
+// A phi with no operands other than itself never gets a value: zero.
+static bool remove_trivial_phis(Rewriter *r) {
+    IrProgram *ir = r->ir;
+    bool any = false;
+    for (bool changed = true; changed;) {
+        changed = false;
+        for (int i = 0; i < ir->ninsts && i < r->cap; i++) {
+            IrInst *in = &ir->insts[i];
+            if (!is_live(r, i) || in->op != IR_PHI) continue;
+            int same = -1;
+            bool trivial = true;
+            for (int k = 0; k < ir->blocks[in->block].npreds; k++) {
+                int v = resolve(r, in->phi[k]);
+                if (v == i || v == same) continue;
+                if (same >= 0) {
+                    trivial = false;
+                    break;
+                }
+                same = v;
+            }
+            if (!trivial) continue;
+            if (same < 0) same = add_const(ir, 0, 0, in->type, 0);
+            if (replace(r, i, same)) changed = any = true;
+        }
+    }
+    return any;
+}
+
+/* ---- mem2reg ----
+   SSA construction in one pass over the blocks, after Braun et al.,
+   "Simple and Efficient Construction of Static Single Assignment Form"
+   (CC 2013). A store is the cell's current definition in its block; a
+   load is replaced by the definition reaching it, found by looking
+   backwards through the predecessors. A block whose predecessors are not
+   all filled yet is not sealed: reads there get a placeholder phi that
+   is completed once it is. Nothing takes a cell's address, so every cell
+   goes. */
+
+// (cell, block) -> value, open addressing
+typedef struct {
+    uint64_t *keys;
+    int *vals;          // value + 1, 0 for an empty entry
+    size_t cap, count;
+} DefMap;
+
+// a phi waiting for its block to be sealed
+typedef struct {
+    int cell, phi, next;
+} Pending;
+
+typedef struct {
+    Rewriter r;
+    DefMap defs;
+    bool *sealed;
+    int *unfilled;      // block -> predecessors not filled yet
+    int *pending;       // block -> first Pending, -1 for none
+    Pending *list;
+    int nlist, list_cap;
+    int zero[IR_I64 + 1];
+} Mem2Reg;
+
+static size_t def_hash(uint64_t key, size_t cap) {
+    return (size_t)((key * 0x9E3779B97F4A7C15ull) >> 32) & (cap - 1);
+}
+
+static int *def_find(DefMap *m, int cell, int block) {
+    uint64_t key = (uint64_t)(uint32_t)cell << 32 | (uint32_t)block;
+    if ((m->count + 1) * 2 > m->cap) {
+        DefMap old = *m;
+        m->cap = m->cap ? m->cap * 2 : 1024;
+        m->keys = xcalloc(m->cap, sizeof(uint64_t));
+        m->vals = xcalloc(m->cap, sizeof(int));
+        for (size_t i = 0; i < old.cap; i++) {
+            if (!old.vals[i]) continue;
+            size_t h = def_hash(old.keys[i], m->cap);
+            while (m->vals[h]) h = (h + 1) & (m->cap - 1);
+            m->keys[h] = old.keys[i];
+            m->vals[h] = old.vals[i];
+        }
+        xfree(old.keys);
+        xfree(old.vals);
+    }
+    size_t h = def_hash(key, m->cap);
+    while (m->vals[h] && m->keys[h] != key) h = (h + 1) & (m->cap - 1);
+    if (!m->vals[h]) {
+        m->keys[h] = key;
+        m->count++;
+    }
+    return &m->vals[h];
+}
+
+static void write_def(Mem2Reg *m, int cell, int block, int v) {
+    *def_find(&m->defs, cell, block) = v + 1;
+}
+
+// an empty phi at the top of block
+static int new_phi(Mem2Reg *m, int block, IrType type) {
+    IrProgram *ir = m->r.ir;
+    IrInst in = { .op = IR_PHI, .type = type, .a = -1, .b = -1, .cell = -1, .str = -1,
+                  .succ = { -1, -1 } };
+    int n = ir->blocks[block].npreds;
+    in.phi = xmalloc(((size_t)n + 1) * sizeof(int));
+    for (int k = 0; k < n; k++) in.phi[k] = -1;
+    return ir_insert(ir, block, 0, in);
+}
+
+static int read_def(Mem2Reg *m, int cell, int block);
+
+static void add_phi_operands(Mem2Reg *m, int cell, int phi) {
+    IrProgram *ir = m->r.ir;
+    int block = ir->insts[phi].block;
+    for (int k = 0; k < ir->blocks[block].npreds; k++) {
+        int v = read_def(m, cell, ir->blocks[block].preds[k]);
+        ir->insts[phi].phi[k] = v;
+    }
+}
+
+static int read_def(Mem2Reg *m, int cell, int block) {
+    IrProgram *ir = m->r.ir;
+    int *slot = def_find(&m->defs, cell, block);
+    if (*slot) return resolve(&m->r, *slot - 1);
+
+    int v;
+    IrType type = ir->cells[cell].type;
+    const IrBlock *b = &ir->blocks[block];
+    if (!m->sealed[block]) {
+        v = new_phi(m, block, type);
+        if (m->nlist == m->list_cap) {
+            m->list_cap = m->list_cap ? m->list_cap * 2 : 64;
+            m->list = xrealloc(m->list, (size_t)m->list_cap * sizeof(Pending));
+        }
+        m->list[m->nlist] = (Pending){ cell, v, m->pending[block] };
+        m->pending[block] = m->nlist++;
+    } else if (b->npreds == 0) {
+        v = m->zero[type];
+    } else if (b->npreds == 1) {
+        v = read_def(m, cell, b->preds[0]);
+    } else {
+        // written first so a loop back to here finds the phi
+        v = new_phi(m, block, type);
+        write_def(m, cell, block, v);
+        add_phi_operands(m, cell, v);
+    }
+    write_def(m, cell, block, v);
+    return v;
+}
+
+static void seal(Mem2Reg *m, int block) {
+    m->sealed[block] = true;
+    for (int p = m->pending[block]; p >= 0; p = m->list[p].next)
+        add_phi_operands(m, m->list[p].cell, m->list[p].phi);
+    m->pending[block] = -1;
+}
+
+static void fill(Mem2Reg *m, int block) {
+    IrProgram *ir = m->r.ir;
+    // read_def can put phis at the top of this very block, go by a copy
+    int n = ir->blocks[block].ninsts;
+    int *insts = xmalloc((size_t)n * sizeof(int));
+    if (n) memcpy(insts, ir->blocks[block].insts, (size_t)n * sizeof(int));
+    for (int k = 0; k < n; k++) {
+        IrInst *in = &ir->insts[insts[k]];
+        if (in->op == IR_LOAD) {
+            int v = read_def(m, in->cell, block);
+            replace(&m->r, insts[k], v);
+        } else if (in->op == IR_STORE) {
+            write_def(m, in->cell, block, resolve(&m->r, in->a));
+            in->block = -1;
+        }
+    }
+    xfree(insts);
+
+    const IrInst *t = &ir->insts[ir_terminator(ir, block)];
+    for (int j = 0; j < ir_nsucc(t); j++) {
+        int s = t->succ[j];
+        if (--m->unfilled[s] == 0 && !m->sealed[s]) seal(m, s);
+    }
+}
+
+// blocks in reverse postorder from the start, then the unreachable ones
+static int *block_order(const IrProgram *ir) {
+    int n = ir->nblocks;
+    int *order = xmalloc(((size_t)n + 1) * sizeof(int));
+    int *stack = xmalloc(((size_t)n + 1) * sizeof(int));
+    int *next = xcalloc((size_t)n + 1, sizeof(int));
+    bool *seen = xcalloc((size_t)n + 1, sizeof(bool));
+    int count = n, sp = 0;
+    stack[sp++] = 0;
+    seen[0] = true;
+    while (sp) {
+        int b = stack[sp - 1];
+        const IrInst *t = &ir->insts[ir_terminator(ir, b)];
+        if (next[b] < ir_nsucc(t)) {
+            int s = t->succ[next[b]++];
+            if (!seen[s]) {
+                seen[s] = true;
+                stack[sp++] = s;
+            }
+            continue;
+        }
+        order[--count] = b;
+        sp--;
+    }
+    // the reachable ones sit at the end, reversed: move them up front
+    int reachable = n - count;
+    memmove(order, order + count, (size_t)reachable * sizeof(int));
+    for (int b = 0; b < n; b++)
+        if (!seen[b] && ir->blocks[b].ninsts) order[reachable++] = b;
+    order[reachable] = -1;
+    xfree(stack);
+    xfree(next);
+    xfree(seen);
+    return order;
+}
+
+static bool mem2reg(IrProgram *ir) {
+    bool any = false;
+    for (int i = 0; i < ir->ninsts && !any; i++)
+        any = ir->insts[i].block >= 0 && (ir->insts[i].op == IR_LOAD || ir->insts[i].op == IR_STORE);
+    if (!any) return false;
+
+    Mem2Reg m = { 0 };
+    size_t nb = (size_t)ir->nblocks + 1;
+    m.sealed = xcalloc(nb, sizeof(bool));
+    m.unfilled = xcalloc(nb, sizeof(int));
+    m.pending = xmalloc(nb * sizeof(int));
+    for (int b = 0; b < ir->nblocks; b++) {
+        m.unfilled[b] = ir->blocks[b].npreds;
+        m.pending[b] = -1;
+    }
+    // the zeros cells start out as, made before the rewriter so they stay
+    m.zero[IR_I32] = add_const(ir, 0, 0, IR_I32, 0);
+    m.zero[IR_I64] = add_const(ir, 0, 0, IR_I64, 0);
+    rewriter_init(&m.r, ir);
+
+    int *order = block_order(ir);
+    for (int i = 0; order[i] >= 0; i++) {
+        int b = order[i];
+        if (!m.sealed[b] && m.unfilled[b] == 0) seal(&m, b);
+        fill(&m, b);
+    }
+    for (int b = 0; b < ir->nblocks; b++)
+        if (!m.sealed[b]) seal(&m, b);
+
+    // the placeholders were made after init, give them room in repl
+    int cap = ir->ninsts;
+    m.r.repl = xrealloc(m.r.repl, ((size_t)cap + 1) * sizeof(int));
+    for (int i = m.r.cap; i < cap; i++) m.r.repl[i] = -1;
+    m.r.cap = cap;
+    rewrite_operands(&m.r);
+    remove_trivial_phis(&m.r);
+    rewriter_free(&m.r);
+
+    xfree(order);
+    xfree(m.defs.keys);
+    xfree(m.defs.vals);
+    xfree(m.sealed);
+    xfree(m.unfilled);
+    xfree(m.pending);
+    xfree(m.list);
+    return true;
+}
+
+/* ---- simplify ----
+   Constant folding with the same wrapping 32-bit arithmetic and arm64
+   division the backends use, a few identities, and branches on a
+   constant turned into plain ones. */
+
+static bool is_const(const IrProgram *ir, int v) {
+    return ir->insts[v].op == IR_CONST;
+}
+
+static int32_t fold(IrOp op, int32_t x, int32_t y) {
+    uint32_t a = (uint32_t)x, b = (uint32_t)y;
+    switch (op) {
+        case IR_ADD: return (int32_t)(a + b);
+        case IR_SUB: return (int32_t)(a - b);
+        case IR_MUL: return (int32_t)(a * b);
+        case IR_DIV:
+            if (y == 0) return 0;
+            if (y == -1) return (int32_t)(0u - a);
+            return x / y;
+        default: return 0;
+    }
+}
+
+static bool compare(CmpOp cmp, int32_t x, int32_t y) {
+    switch (cmp) {
+        case CMP_LT: return x < y;
+        case CMP_GT: return x > y;
+        case CMP_EQ: return x == y;
+        case CMP_NE: return x != y;
+        case CMP_LE: return x <= y;
+        case CMP_GE: return x >= y;
+    }
+    return false;
+}
+
+static void make_const(IrInst *in, int64_t imm) {
+    in->op = IR_CONST;
+    in->imm = imm;
+    in->a = in->b = -1;
+}
+
+// one instruction, its operands already resolved; true when it changed
+static bool simplify_inst(Rewriter *r, int id) {
+    IrProgram *ir = r->ir;
+    IrInst *in = &ir->insts[id];
+    int a = in->a, b = in->b;
+    switch (in->op) {
+        case IR_ADD:
+        case IR_SUB:
+        case IR_MUL:
+        case IR_DIV:
+            if (is_const(ir, a) && is_const(ir, b)) {
+                make_const(in, fold(in->op, (int32_t)ir->insts[a].imm, (int32_t)ir->insts[b].imm));
+                return true;
+            }
+            // x + 0, x - 0, x * 1, x / 1
+            if (is_const(ir, b) && ir->insts[b].imm == (in->op == IR_ADD || in->op == IR_SUB ? 0 : 1))
+                return replace(r, id, a);
+            if (in->op == IR_ADD && is_const(ir, a) && ir->insts[a].imm == 0)
+                return replace(r, id, b);
+            return false;
+        case IR_CMP:
+            if (is_const(ir, a) && is_const(ir, b)) {
+                make_const(in, compare(in->cmp, (int32_t)ir->insts[a].imm, (int32_t)ir->insts[b].imm));
+                return true;
+            }
+            return false;
+        case IR_ZEXT:
+            if (is_const(ir, a)) {
+                make_const(in, (int64_t)(uint32_t)ir->insts[a].imm);
+                return true;
+            }
+            return false;
+        case IR_TRUNC:
+            if (is_const(ir, a)) {
+                make_const(in, (int32_t)(uint32_t)ir->insts[a].imm);
+                return true;
+            }
+            if (ir->insts[a].op == IR_ZEXT) return replace(r, id, ir->insts[a].a);
+            return false;
+        case IR_CONDBR: {
+            // known either way, or the same block either way: a br
+            int keep;
+            if (in->succ[0] == in->succ[1]) keep = 0;
+            else if (is_const(ir, a)) keep = ir->insts[a].imm ? 0 : 1;
+            else return false;
+            ir_remove_edge(ir, in->block, in->succ[1 - keep]);
+            in->op = IR_BR;
+            in->succ[0] = in->succ[keep];
+            in->succ[1] = -1;
+            in->a = -1;
+            return true;
+        }
+        default:
+            return false;
+    }
+}
+
+static bool simplify(IrProgram *ir) {
+    Rewriter r;
+    rewriter_init(&r, ir);
+    bool any = false;
+    for (bool changed = true; changed;) {
+        changed = false;
+        for (int i = 0; i < ir->ninsts && i < r.cap; i++) {
+            IrInst *in = &ir->insts[i];
+            if (!is_live(&r, i)) continue;
+            if (in->a >= 0) in->a = resolve(&r, in->a);
+            if (in->b >= 0) in->b = resolve(&r, in->b);
+            if (simplify_inst(&r, i)) changed = true;
+        }
+        if (remove_trivial_phis(&r)) changed = true;
+        any |= changed;
+        // a settled branch can leave blocks behind
+        if (changed) {
+            xfree(r.reached);
+            r.reached = reached_blocks(ir);
+        }
+    }
+    rewriter_free(&r);
+    return any;
+}
+
+/* ---- dce ----
+   Blocks nothing branches to from the start, and instructions with no
+   effect whose value nobody uses. */
+
+static bool has_effect(IrOp op) {
+    switch (op) {
+        case IR_STORE:
+        case IR_PRINTN:
+        case IR_PRINTS:
+        case IR_BR:
+        case IR_CONDBR:
+        case IR_EXIT:
+            return true;
+        default:
+            return false;
+    }
+}
+
+static bool remove_unreachable(IrProgram *ir) {
+    bool *seen = reached_blocks(ir);
+
+    bool any = false;
+    for (int bi = 0; bi < ir->nblocks; bi++) {
+        IrBlock *b = &ir->blocks[bi];
+        if (seen[bi] || b->ninsts == 0) continue;
+        const IrInst *t = &ir->insts[ir_terminator(ir, bi)];
+        for (int j = 0; j < ir_nsucc(t); j++) ir_remove_edge(ir, bi, t->succ[j]);
+        for (int k = 0; k < b->ninsts; k++) ir->insts[b->insts[k]].block = -1;
+        b->ninsts = 0;
+        any = true;
+    }
+    xfree(seen);
+    return any;
+}
+
+static bool dce(IrProgram *ir) {
+    bool any = remove_unreachable(ir);
+    if (any) {
+        // a phi left with one way in is that way's value
+        Rewriter r;
+        rewriter_init(&r, ir);
+        remove_trivial_phis(&r);
+        rewriter_free(&r);
+    }
+
+    // live: what has an effect and everything it uses, cycles of phis
+    // and arithmetic feeding only each other are not
+    size_t n = (size_t)ir->ninsts + 1;
+    bool *live = xcalloc(n, sizeof(bool));
+    int *work = xmalloc(n * sizeof(int));
+    int nwork = 0;
+    for (int i = 0; i < ir->ninsts; i++)
+        if (ir->insts[i].block >= 0 && has_effect(ir->insts[i].op)) {
+            live[i] = true;
+            work[nwork++] = i;
+        }
+    while (nwork) {
+        const IrInst *in = &ir->insts[work[--nwork]];
+        int ops[2] = { in->a, in->b };
+        for (int j = 0; j < 2; j++)
+            if (ops[j] >= 0 && !live[ops[j]]) {
+                live[ops[j]] = true;
+                work[nwork++] = ops[j];
+            }
+        if (in->op != IR_PHI) continue;
+        for (int k = 0; k < ir->blocks[in->block].npreds; k++)
+            if (!live[in->phi[k]]) {
+                live[in->phi[k]] = true;
+                work[nwork++] = in->phi[k];
+            }
+    }
+    for (int i = 0; i < ir->ninsts; i++)
+        if (ir->insts[i].block >= 0 && !live[i]) {
+            ir->insts[i].block = -1;
+            any = true;
+        }
+    ir_compact(ir);
+    xfree(live);
+    xfree(work);
+    return any;
+}
+
+/* ---- pass manager ---- */
+
+const IrPass ir_passes[] = {
+    { "mem2reg", "variables and registers to SSA values and phis", mem2reg },
+    { "simplify", "fold constants, drop identities, settle constant branches", simplify },
+    { "dce", "delete unreachable blocks and unused values", dce },
+};
+const int ir_pass_count = sizeof(ir_passes) / sizeof(ir_passes[0]);
+
+// the pass named by the len characters at name, NULL if there is none
+static const IrPass *find_pass(const char *name, size_t len) {
+    for (int i = 0; i < ir_pass_count; i++)
+        if (strlen(ir_passes[i].name) == len && memcmp(ir_passes[i].name, name, len) == 0)
+            return &ir_passes[i];
+    return NULL;
+}
+
+static void verify_or_die(const IrProgram *ir, const char *after) {
+    char err[256];
+    if (ir_verify(ir, err, sizeof(err))) return;
+    if (after) error_fatal("Error: bad IR after %s: %s\n", after, err);
+    error_fatal("Error: bad IR from the builder: %s\n", err);
+}
+
+bool ir_pipeline_valid(const char *pipeline) {
+    if (strcmp(pipeline, "none") == 0) return true;
+    for (const char *p = pipeline; *p;) {
+        size_t len = strcspn(p, ",");
+        if (!find_pass(p, len)) return false;
+        p += len + (p[len] == ',');
+    }
+    return true;
+}
+
+bool ir_run_pipeline(IrProgram *ir, const char *pipeline, IrPassHook hook, void *ctx) {
+    // all the names first, so a typo runs nothing
+    if (!ir_pipeline_valid(pipeline)) return false;
+    if (strcmp(pipeline, "none") == 0) pipeline = "";
+
+    verify_or_die(ir, NULL);
+    for (const char *p = pipeline; *p;) {
+        size_t len = strcspn(p, ",");
+        const IrPass *pass = find_pass(p, len);
+        pass->run(ir);
+        verify_or_die(ir, pass->name);
+        if (hook) hook(ctx, pass->name, ir);
+        p += len + (p[len] == ',');
+    }
+    return true;
+}
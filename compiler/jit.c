@@ -0,0 +1,341 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+#include <stdbool.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+
+#include "jit.h"
+#include "bytecode.h"
+#include "interp.h"
+#include "codegen.h"
+#include "encode_x86_64.h"
+#include "errors.h"
+#include "emit.h"
+#include "mem.h"
+#include "target.h"
+
+#if defined(__x86_64__) && (defined(__linux__) || defined(__APPLE__))
+#define JIT_HOST 1
+#endif
+
+#ifdef JIT_HOST
+
+/* ---- runtime ----
+   What jitted code calls instead of making syscalls. Output is buffered
+   like the interpreter's and written out at the exit. */
+
+#define OUT_FLUSH (64 * 1024)
+
+static Emitter rt_out;
+
+static void rt_flush(void) {
+    emit_write(&rt_out, STDOUT_FILENO);
+    rt_out.len = 0;
+}
+
+// codegen only ever prints to stdout
+static void nevo_rt_write(int fd, const char *buf, size_t len) {
+    (void)fd;
+    emit_textn(&rt_out, buf, len);
+    if (rt_out.len >= OUT_FLUSH) rt_flush();
+}
+
+static void nevo_rt_print_u32(uint32_t v) {
+    char buf[21];
+    emit_textn(&rt_out, buf, emit_format_int(buf, (long)v));
+    if (rt_out.len >= OUT_FLUSH) rt_flush();
+}
+
+static void nevo_rt_exit(void) {
+    rt_flush();
+}
+
+typedef struct {
+    const char *name;
+    void (*addr)(void);
+} RuntimeRoutine;
+
+static const RuntimeRoutine runtime[] = {
+    { "nevo_rt_write",     (void (*)(void))nevo_rt_write },
+    { "nevo_rt_print_u32", (void (*)(void))nevo_rt_print_u32 },
+    { "nevo_rt_exit",      (void (*)(void))nevo_rt_exit },
+};
+#define RUNTIME_COUNT (int)(sizeof(runtime) / sizeof(runtime[0]))
+
+/* ---- loading ---- */
+
+// "jmp *0(%rip)" and the absolute address after it, for calls out of the
+// mapping that rel32 cannot reach
+#define STUB_SIZE 16
+
+typedef struct {
+    unsigned char *base;
+    size_t size;
+    size_t text_size;       // text and stubs, read/execute once loaded
+    uint64_t data_at;
+} Image;
+
+static size_t page_round(size_t n) {
+    size_t page = (size_t)sysconf(_SC_PAGESIZE);
+    return (n + page - 1) & ~(page - 1);
+}
+
+static const RuntimeRoutine *find_routine(const ObjSymbol *s) {
+    for (int i = 0; i < RUNTIME_COUNT; i++)
+        if ((size_t)s->len == strlen(runtime[i].name) && memcmp(s->name, runtime[i].name, s->len) == 0)
+            return &runtime[i];
+    return NULL;
+}
+
+// text, a stub per undefined symbol, then the data on its own pages
+static void load(const ObjFile *o, Image *img) {
+    const Emitter *text = &o->sec[OBJ_TEXT], *data = &o->sec[OBJ_DATA];
+
+    uint64_t *addr = xcalloc((size_t)o->nsyms + 1, sizeof(uint64_t));
+    size_t stubs_at = (text->len + STUB_SIZE - 1) & ~(size_t)(STUB_SIZE - 1);
+    size_t stubs_end = stubs_at;
+    for (int i = 0; i < o->nsyms; i++) {
+        if (o->syms[i].section >= 0) continue;
+        if (!find_routine(&o->syms[i]))
+            error_fatal("Error: --jit: undefined symbol %.*s\n", o->syms[i].len, o->syms[i].name);
+        addr[i] = stubs_end;
+        stubs_end += STUB_SIZE;
+    }
+
+    img->text_size = page_round(stubs_end ? stubs_end : 1);
+    img->data_at = img->text_size;
+    img->size = img->text_size + page_round(data->len ? data->len : 1);
+    img->base = mmap(NULL, img->size, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+    if (img->base == MAP_FAILED) error_fatal("Error: --jit could not map %zu bytes\n", img->size);
+
+    unsigned char *b = img->base;
+    if (text->len) memcpy(b, text->data, text->len);
+    memset(b + text->len, 0xcc, stubs_at - text->len);
+    if (data->len) memcpy(b + img->data_at, data->data, data->len);
+
+    for (int i = 0; i < o->nsyms; i++) {
+        const ObjSymbol *s = &o->syms[i];
+        if (s->section == OBJ_TEXT) {
+            addr[i] = s->offset;
+        } else if (s->section == OBJ_DATA) {
+            addr[i] = img->data_at + s->offset;
+        } else {
+            uint64_t target = (uint64_t)(uintptr_t)find_routine(s)->addr;
+            unsigned char *stub = b + addr[i];
+            static const unsigned char jmp[6] = { 0xff, 0x25, 0, 0, 0, 0 };
+            memcpy(stub, jmp, sizeof(jmp));
+            memcpy(stub + 6, &target, 8);
+            memset(stub + 14, 0xcc, STUB_SIZE - 14);
+        }
+    }
+
+    // S + A - P, the addend is already in the field
+    for (int i = 0; i < o->nrelocs; i++) {
+        const ObjReloc *r = &o->relocs[i];
+        uint64_t at = (r->section == OBJ_DATA ? img->data_at : 0) + r->offset;
+        int32_t field;
+        memcpy(&field, b + at, 4);
+        int64_t v = (int64_t)addr[r->symbol] + field - (int64_t)at;
+        if (r->kind != RELOC_PC32 || v < INT32_MIN || v > INT32_MAX)
+            error_fatal("Error: --jit cannot place relocation %d\n", i);
+        int32_t out = (int32_t)v;
+        memcpy(b + at, &out, 4);
+    }
+    xfree(addr);
+
+    if (mprotect(b, img->text_size, PROT_READ | PROT_EXEC) != 0)
+        error_fatal("Error: --jit could not make the code executable\n");
+}
+
+/* ---- perf map ----
+   perf looks for /tmp/perf-<pid>.map to name addresses in anonymous
+   executable memory: "start size name" per line, in hex. Functions and
+   the runtime glue are listed, labels inside functions are not. */
+
+static const ObjFile *sort_obj;
+
+static int by_offset(const void *a, const void *b) {
+    const ObjSymbol *x = &sort_obj->syms[*(const int *)a], *y = &sort_obj->syms[*(const int *)b];
+    return x->offset < y->offset ? -1 : x->offset > y->offset;
+}
+
+static void emit_hex(Emitter *out, uint64_t v) {
+    char buf[16];
+    int n = 0;
+    do {
+        buf[n++] = "0123456789abcdef"[v & 15];
+        v >>= 4;
+    } while (v);
+    while (n) emit_char(out, buf[--n]);
+}
+
+static void write_perf_map(const ObjFile *o, const Image *img) {
+    int *order = xmalloc(((size_t)o->nsyms + 1) * sizeof(int));
+    int n = 0;
+    for (int i = 0; i < o->nsyms; i++) {
+        const ObjSymbol *s = &o->syms[i];
+        bool routine = s->len > 7 && memcmp(s->name, ".Lnevo_", 7) == 0;
+        if (s->section == OBJ_TEXT && (s->global || routine)) order[n++] = i;
+    }
+    sort_obj = o;
+    qsort(order, (size_t)n, sizeof(int), by_offset);
+
+    Emitter map = {0};
+    uint64_t text_end = o->sec[OBJ_TEXT].len;
+    for (int i = 0; i < n; i++) {
+        const ObjSymbol *s = &o->syms[order[i]];
+        uint64_t end = i + 1 < n ? o->syms[order[i + 1]].offset : text_end;
+        if (end == s->offset) continue;
+        emit_hex(&map, (uint64_t)(uintptr_t)img->base + s->offset);
+        emit_char(&map, ' ');
+        emit_hex(&map, end - s->offset);
+        emit_char(&map, ' ');
+        emit_textn(&map, s->name, (size_t)s->len);
+        emit_char(&map, '\n');
+    }
+    xfree(order);
+
+    char path[64];
+    snprintf(path, sizeof(path), "/tmp/perf-%d.map", (int)getpid());
+    int fd = open(path, O_WRONLY | O_CREAT | O_TRUNC, 0644);
+    if (fd >= 0) {
+        emit_write(&map, fd);
+        close(fd);
+    }
+    emit_free(&map);
+}
+
+/* ---- building ---- */
+
+typedef struct {
+    Emitter text;
+    ObjFile obj;
+    Image img;
+} Jit;
+
+// the program for target_jit, encoded, loaded and listed for perf
+static void jit_build(Program *prog, int jobs, Jit *j) {
+    memset(j, 0, sizeof(*j));
+    codegen_program(&j->text, prog, jobs, &target_jit);
+    char err[256];
+    if (!x86_64_assemble(j->text.data, j->text.len, &j->obj, err, sizeof(err)))
+        error_fatal("Error: --jit: %s\n", err);
+    load(&j->obj, &j->img);
+    write_perf_map(&j->obj, &j->img);
+}
+
+// where a label of the loaded code is, NULL if it has none
+static unsigned char *jit_symbol(const Jit *j, const char *name) {
+    size_t len = strlen(name);
+    for (int i = 0; i < j->obj.nsyms; i++) {
+        const ObjSymbol *s = &j->obj.syms[i];
+        if ((size_t)s->len != len || memcmp(s->name, name, len) != 0) continue;
+        if (s->section == OBJ_TEXT) return j->img.base + s->offset;
+        if (s->section == OBJ_DATA) return j->img.base + j->img.data_at + s->offset;
+        return NULL;
+    }
+    return NULL;
+}
+
+static void jit_free(Jit *j) {
+    munmap(j->img.base, j->img.size);
+    obj_free(&j->obj);
+    emit_free(&j->text);
+    emit_free(&rt_out);
+}
+
+int jit_run(Program *prog, int jobs) {
+    Jit j;
+    jit_build(prog, jobs, &j);
+
+    // the entry is called like a C function and returns at the exit
+    unsigned char *entry = jit_symbol(&j, "nevo_jit_entry");
+    if (!entry) error_fatal("Error: --jit: no entry point\n");
+    void (*run)(void) = (void (*)(void))(uintptr_t)entry;
+    run();
+
+    jit_free(&j);
+    return 0;
+}
+
+/* ---- tiering up ----
+   The interpreter counts function entries and loop iterations. At the
+   first hot one the whole program is compiled: functions fall through
+   into each other and a bl never comes back, so there is no smaller unit
+   to switch over at. Nothing lives on a stack either, so handing over is
+   copying the register file, variables and loop counters into the native
+   code's memory and jumping to the function or loop body, and it also
+   covers a loop that is still running (on-stack replacement). */
+
+typedef struct {
+    Program *prog;
+    int jobs;
+    const Bytecode *bc;
+} Tier;
+
+static bool tier_enter(void *ctx, uint32_t spot, const uint64_t *slots) {
+    Tier *t = ctx;
+    Jit j;
+    jit_build(t->prog, t->jobs, &j);
+
+    unsigned char *resume = jit_symbol(&j, "nevo_jit_resume");
+    unsigned char *regs = jit_symbol(&j, target_jit.regs->storage);
+    unsigned char *at = jit_symbol(&j, t->bc->spots[spot].label);
+    bool ok = resume && regs && at;
+    for (int i = 0; ok && i < BC_REGS; i++)
+        memcpy(regs + 8 * i, &slots[i], 8);
+    for (int i = 0; ok && i < t->bc->nvars; i++) {
+        const BcVar *v = &t->bc->vars[i];
+        unsigned char *home = jit_symbol(&j, v->label);
+        uint32_t w = (uint32_t)slots[v->slot];
+        if (home) memcpy(home, &w, 4);
+        else ok = false;
+    }
+
+    if (ok) {
+        void (*go)(void *) = (void (*)(void *))(uintptr_t)resume;
+        go(at);
+    }
+    jit_free(&j);
+    return ok;
+}
+
+int jit_run_tiered(Program *prog, int jobs, long threshold) {
+    Bytecode bc;
+    codegen_resolve(prog);
+    bytecode_compile(prog, &bc, true);
+    codegen_release();
+
+    Tier t = { prog, jobs, &bc };
+    InterpTier tier = { threshold, tier_enter, &t };
+    int status = interp_run(&bc, &tier);
+    bytecode_free(&bc);
+    return status;
+}
+
+#else
+
+int jit_run(Program *prog, int jobs) {
+    (void)prog;
+    (void)jobs;
+    error_fatal("Error: --jit needs an x86-64 host\n");
+    return 1;
+}
+
+// nothing to tier up to, so only the interpreter
+int jit_run_tiered(Program *prog, int jobs, long threshold) {
+    (void)jobs;
+    (void)threshold;
+    Bytecode bc;
+    codegen_resolve(prog);
+    bytecode_compile(prog, &bc, false);
+    codegen_release();
+    int status = interp_run(&bc, NULL);
+    bytecode_free(&bc);
+    return status;
+}
+
+#endif
@@ -0,0 +1,23 @@
+#ifndef JIT_H
+#define JIT_H
+
+#include "ast.h"
+
+// `compiler run --jit`: the x86-64 backend's code for target_jit, encoded
+// by x86_64_assemble and loaded into an executable mapping in this
+// process, then called. Print and exit go to the nevo_rt_* routines in
+// jit.c. The functions are listed in /tmp/perf-<pid>.map for perf.
+//
+// Returns the exit status. Needs an x86-64 host; raw assembly lines the
+// encoder does not know are reported as errors.
+int jit_run(Program *prog, int jobs);
+
+// `compiler run --tiered`: the bytecode interpreter until a function
+// entry or loop body has been reached threshold times, then the JIT's
+// code from that point on, a loop already running included. Only the
+// interpreter on hosts without the JIT.
+#define JIT_TIER_THRESHOLD 1000
+
+int jit_run_tiered(Program *prog, int jobs, long threshold);
+
+#endif // JIT_H
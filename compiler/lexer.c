@@ -0,0 +1,285 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <ctype.h>
+#include <pthread.h>
+
+#include "lexer.h"
+#include "errors.h"
+#include "mem.h"
+#include "timing.h"
+
+/* ---- string interning ---- */
+
+// Parse workers intern concurrently, so the table is split into shards
+// by hash, each with its own lock. A name always lands in the same
+// shard, so pointer equality still holds across threads.
+#define INTERN_SHARDS 64
+
+typedef struct {
+    const char *str;
+    int len;
+    unsigned hash;
+    TokenKind kind;     // TOK_IDENT, or the keyword this spelling is
+} InternEntry;
+
+typedef struct {
+    pthread_mutex_t lock;
+    InternEntry *table;
+    unsigned cap;
+    unsigned count;
+
+    // interned text is packed into big blocks, never freed one by one
+    char *block;
+    size_t block_left;
+} InternShard;
+
+static InternShard shards[INTERN_SHARDS];
+static pthread_once_t intern_once = PTHREAD_ONCE_INIT;
+
+static unsigned hash_str(const char *s, int len) {
+    unsigned h = 2166136261u;
+    for (int i = 0; i < len; i++) {
+        h ^= (unsigned char)s[i];
+        h *= 16777619u;
+    }
+    return h;
+}
+
+static char *intern_copy(InternShard *sh, const char *s, int len) {
+    if ((size_t)len + 1 > sh->block_left) {
+        size_t size = 16 * 1024;
+        if ((size_t)len + 1 > size) size = (size_t)len + 1;
+        sh->block = xmalloc(size);
+        sh->block_left = size;
+    }
+    char *p = sh->block;
+    memcpy(p, s, len);
+    p[len] = '\0';
+    sh->block += len + 1;
+    sh->block_left -= len + 1;
+    return p;
+}
+
+static void intern_grow(InternShard *sh) {
+    unsigned new_cap = sh->cap ? sh->cap * 2 : 64;
+    InternEntry *table = xcalloc(new_cap, sizeof(InternEntry));
+    for (unsigned i = 0; i < sh->cap; i++) {
+        if (!sh->table[i].str) continue;
+        unsigned j = sh->table[i].hash & (new_cap - 1);
+        while (table[j].str) j = (j + 1) & (new_cap - 1);
+        table[j] = sh->table[i];
+    }
+    xfree(sh->table);
+    sh->table = table;
+    sh->cap = new_cap;
+}
+
+// the shard's lock must be held, the entry moves when the shard grows
+static InternEntry *intern_entry(InternShard *sh, const char *s, int len, unsigned h) {
+    if ((sh->count + 1) * 2 > sh->cap) intern_grow(sh);
+
+    unsigned i = h & (sh->cap - 1);
+    while (sh->table[i].str) {
+        InternEntry *e = &sh->table[i];
+        if (e->hash == h && e->len == len && memcmp(e->str, s, len) == 0)
+            return e;
+        i = (i + 1) & (sh->cap - 1);
+    }
+
+    InternEntry *e = &sh->table[i];
+    e->str = intern_copy(sh, s, len);
+    e->len = len;
+    e->hash = h;
+    e->kind = TOK_IDENT;
+    sh->count++;
+    return e;
+}
+
+// top bits pick the shard, the low bits are the slot inside it
+static InternShard *shard_for(unsigned h) {
+    return &shards[h >> 26];
+}
+
+static void intern_init(void) {
+    static const struct { const char *word; TokenKind kind; } keywords[] = {
+        { "num",   TOK_KW_NUM },
+        { "loop",  TOK_KW_LOOP },
+        { "if",    TOK_KW_IF },
+        { "else",  TOK_KW_ELSE },
+        { "print", TOK_KW_PRINT },
+        { "exit",  TOK_KW_EXIT },
+        { "setr",  TOK_KW_SETR },
+        { "setm",  TOK_KW_SETM },
+        { "bl",    TOK_KW_BL },
+    };
+    for (int i = 0; i < INTERN_SHARDS; i++)
+        pthread_mutex_init(&shards[i].lock, NULL);
+    for (size_t i = 0; i < sizeof(keywords) / sizeof(keywords[0]); i++) {
+        int len = (int)strlen(keywords[i].word);
+        unsigned h = hash_str(keywords[i].word, len);
+        intern_entry(shard_for(h), keywords[i].word, len, h)->kind = keywords[i].kind;
+    }
+}
+
+// interned spelling of s, and whether it is a keyword
+static const char *intern_kind(const char *s, int len, TokenKind *kind) {
+    pthread_once(&intern_once, intern_init);
+
+    unsigned h = hash_str(s, len);
+    InternShard *sh = shard_for(h);
+    pthread_mutex_lock(&sh->lock);
+    InternEntry *e = intern_entry(sh, s, len, h);
+    const char *str = e->str;
+    *kind = e->kind;
+    pthread_mutex_unlock(&sh->lock);
+    return str;
+}
+
+const char *intern(const char *s, int len) {
+    TokenKind kind;
+    return intern_kind(s, len, &kind);
+}
+
+/* ---- lexer ---- */
+
+static Token *push_token(Lexer *lx, TokenKind kind, int line, int start, int len) {
+    if (lx->count == lx->cap) {
+        lx->cap = lx->cap ? lx->cap * 2 : 64;
+        lx->toks = xrealloc(lx->toks, lx->cap * sizeof(Token));
+    }
+    Token *t = &lx->toks[lx->count++];
+    t->kind = kind;
+    t->line = line;
+    t->start = start;
+    t->len = len;
+    t->text = NULL;
+    return t;
+}
+
+// a '+' or '-' is a sign only where no operand came right before it
+static int prev_is_operand(const Lexer *lx) {
+    if (lx->count == 0) return 0;
+    TokenKind k = lx->toks[lx->count - 1].kind;
+    return k == TOK_IDENT || k == TOK_NUMBER || k == TOK_RPAREN || k == TOK_RBRACKET;
+}
+
+void lex_init(Lexer *lx, const char *src, int len) {
+    lx->src = src;
+    lx->src_len = len;
+    lx->pos = 0;
+    lx->line = 1;
+    lx->toks = NULL;
+    lx->count = 0;
+    lx->cap = 0;
+}
+
+static void lex_tokens(Lexer *lx) {
+    const char *src = lx->src;
+    int len = lx->src_len;
+    int line = lx->line;
+    int i = lx->pos;
+
+    lx->count = 0;
+
+    while (i < len) {
+        char c = src[i];
+        char next = (i + 1 < len) ? src[i + 1] : '\0';
+        int start = i;
+
+        if (c == '\n') {
+            push_token(lx, TOK_NEWLINE, line, i, 1);
+            lx->pos = i + 1;
+            lx->line = line + 1;
+            return;
+        }
+
+        if (c == ' ' || c == '\t' || c == '\r') {
+            i++;
+            continue;
+        }
+
+        // identifiers and keywords
+        if (isalpha((unsigned char)c) || c == '_') {
+            while (i < len && (isalnum((unsigned char)src[i]) || src[i] == '_')) i++;
+            TokenKind kind;
+            const char *text = intern_kind(src + start, i - start, &kind);
+            push_token(lx, kind, line, start, i - start)->text = text;
+            continue;
+        }
+
+        // numbers, with an optional sign when it cannot be a binary operator
+        if (isdigit((unsigned char)c) ||
+            ((c == '-' || c == '+') && isdigit((unsigned char)next) && !prev_is_operand(lx))) {
+            i++;
+            while (i < len && isdigit((unsigned char)src[i])) i++;
+            push_token(lx, TOK_NUMBER, line, start, i - start)->text = intern(src + start, i - start);
+            continue;
+        }
+
+        // string literals
+        if (c == '"') {
+            i++;
+            while (i < len && src[i] != '"' && src[i] != '\n') {
+                if (src[i] == '\\' && i + 1 < len) i++;
+                i++;
+            }
+            if (i >= len || src[i] != '"') error_syntax(line, "Unterminated string literal");
+            i++;
+            push_token(lx, TOK_STRING, line, start, i - start)->text = intern(src + start + 1, i - start - 2);
+            continue;
+        }
+
+        TokenKind kind = TOK_OTHER;
+        int width = 1;
+        switch (c) {
+            case '(': kind = TOK_LPAREN; break;
+            case ')': kind = TOK_RPAREN; break;
+            case '{': kind = TOK_LBRACE; break;
+            case '}': kind = TOK_RBRACE; break;
+            case '[': kind = TOK_LBRACKET; break;
+            case ']': kind = TOK_RBRACKET; break;
+            case ',': kind = TOK_COMMA; break;
+            case '+': kind = TOK_PLUS; break;
+            case '-': kind = TOK_MINUS; break;
+            case '*': kind = TOK_STAR; break;
+            case '/': kind = TOK_SLASH; break;
+            case '<':
+                if (next == '=') { kind = TOK_LE; width = 2; }
+                else kind = TOK_LT;
+                break;
+            case '>':
+                if (next == '=') { kind = TOK_GE; width = 2; }
+                else kind = TOK_GT;
+                break;
+            case '!':
+                if (next == '=') { kind = TOK_NE; width = 2; }
+                break;
+            case '=':
+                if (next == '=') { kind = TOK_EQ; width = 2; }
+                else if (next == '!') { kind = TOK_NE; width = 2; }
+                else if (next == '<') { kind = TOK_LE; width = 2; }
+                else if (next == '>') { kind = TOK_GE; width = 2; }
+                else kind = TOK_ASSIGN;
+                break;
+        }
+        push_token(lx, kind, line, start, width);
+        i += width;
+    }
+
+    // last line without a newline
+    push_token(lx, TOK_EOF, line, len, 0);
+    lx->pos = len;
+}
+
+void lex_line(Lexer *lx) {
+    timing_begin(PHASE_LEX);
+    lex_tokens(lx);
+    timing_end(PHASE_LEX);
+}
+
+void lex_free(Lexer *lx) {
+    xfree(lx->toks);
+    lx->toks = NULL;
+    lx->count = lx->cap = 0;
+}
@@ -0,0 +1,71 @@
+#ifndef LEXER_H
+#define LEXER_H
+
+typedef enum {
+    TOK_EOF,
+    TOK_NEWLINE,
+    TOK_IDENT,
+    TOK_NUMBER,
+    TOK_STRING,      // text is the body between the quotes, escapes kept as written
+
+    // keywords
+    TOK_KW_NUM,
+    TOK_KW_LOOP,
+    TOK_KW_IF,
+    TOK_KW_ELSE,
+    TOK_KW_PRINT,
+    TOK_KW_EXIT,
+    TOK_KW_SETR,
+    TOK_KW_SETM,
+    TOK_KW_BL,
+
+    // punctuation
+    TOK_LPAREN,
+    TOK_RPAREN,
+    TOK_LBRACE,
+    TOK_RBRACE,
+    TOK_LBRACKET,
+    TOK_RBRACKET,
+    TOK_COMMA,
+    TOK_ASSIGN,
+    TOK_PLUS,
+    TOK_MINUS,
+    TOK_STAR,
+    TOK_SLASH,
+    TOK_LT,
+    TOK_GT,
+    TOK_LE,          // <= or =<
+    TOK_GE,          // >= or =>
+    TOK_EQ,          // ==
+    TOK_NE,          // != or =!
+
+    TOK_OTHER        // anything else, only ever seen on raw assembly lines
+} TokenKind;
+
+typedef struct {
+    TokenKind kind;
+    int line;
+    int start;          // offset of the token in the source buffer
+    int len;
+    const char *text;   // interned spelling, NULL for punctuation
+} Token;
+
+// Lexes one line at a time, so only the current line's tokens are in memory.
+typedef struct {
+    const char *src;
+    int src_len;
+    int pos;            // next byte to lex
+    int line;           // line number of the next line
+    Token *toks;        // current line, ends in TOK_NEWLINE or TOK_EOF
+    int count;
+    int cap;
+} Lexer;
+
+void lex_init(Lexer *lx, const char *src, int len);
+void lex_line(Lexer *lx);
+void lex_free(Lexer *lx);
+
+// Interned strings are unique, so equal names compare equal by pointer.
+const char *intern(const char *s, int len);
+
+#endif // LEXER_H
@@ -0,0 +1,67 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdatomic.h>
+
+#include "mem.h"
+
+// every block carries its size in front, padded so the user pointer
+// keeps malloc's alignment
+typedef union {
+    size_t size;
+    max_align_t align;
+} MemHeader;
+
+// parse and codegen workers allocate concurrently
+static _Atomic size_t live = 0;
+static _Atomic size_t peak = 0;
+
+static void *out_of_memory(void) {
+    fprintf(stderr, "Out of memory\n");
+    exit(1);
+}
+
+static void *track(MemHeader *h, size_t size) {
+    if (!h) return out_of_memory();
+    h->size = size;
+    size_t now = atomic_fetch_add(&live, size) + size;
+    size_t old = atomic_load(&peak);
+    while (now > old && !atomic_compare_exchange_weak(&peak, &old, now))
+        ;
+    return h + 1;
+}
+
+void *xmalloc(size_t size) {
+    return track(malloc(sizeof(MemHeader) + size), size);
+}
+
+void *xcalloc(size_t count, size_t size) {
+    if (size && count > ((size_t)-1 - sizeof(MemHeader)) / size) return out_of_memory();
+    return track(calloc(1, sizeof(MemHeader) + count * size), count * size);
+}
+
+void *xrealloc(void *p, size_t size) {
+    if (!p) return xmalloc(size);
+    MemHeader *h = (MemHeader *)p - 1;
+    atomic_fetch_sub(&live, h->size);
+    return track(realloc(h, sizeof(MemHeader) + size), size);
+}
+
+void xfree(void *p) {
+    if (!p) return;
+    MemHeader *h = (MemHeader *)p - 1;
+    atomic_fetch_sub(&live, h->size);
+    free(h);
+}
+
+size_t mem_live(void) {
+    return live;
+}
+
+size_t mem_peak(void) {
+    return peak;
+}
+
+void mem_set_peak(size_t value) {
+    peak = value;
+}
@@ -0,0 +1,19 @@
+#ifndef MEM_H
+#define MEM_H
+
+#include <stddef.h>
+
+// All compiler heap memory goes through these so --time-report can tell
+// how much is live. Running out of memory is fatal.
+void *xmalloc(size_t size);
+void *xcalloc(size_t count, size_t size);
+void *xrealloc(void *p, size_t size);
+void xfree(void *p);
+
+// bytes currently allocated, and the most there has been since the
+// peak was last set
+size_t mem_live(void);
+size_t mem_peak(void);
+void mem_set_peak(size_t peak);
+
+#endif // MEM_H
@@ -0,0 +1,190 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdbool.h>
+#include <stddef.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+#include "nbc.h"
+#include "emit.h"
+#include "mem.h"
+
+#define NBC_BYTE_ORDER 0x01020304u
+
+// sections follow in this order, each at an offset from the start of
+// the file that is a multiple of 8
+typedef struct {
+    char magic[4];          // "NBC\0"
+    uint32_t version;
+    uint32_t byte_order;    // NBC_BYTE_ORDER as the writer stored it
+    uint32_t entry;
+    uint64_t hash;          // of the source text
+    uint64_t size;          // of the whole file
+    uint32_t ncode, nslots, nstr, pad;
+    uint64_t init;          // nslots uint64_t
+    uint64_t code;          // ncode uint32_t
+    uint64_t str_off;       // nstr uint32_t
+    uint64_t str_len;       // nstr uint32_t
+    uint64_t strings;       // strings_len bytes
+    uint64_t strings_len;
+    uint64_t check;         // of everything above it and every section
+} NbcHeader;
+
+#define FNV_BASIS 0xcbf29ce484222325ull
+#define FNV_PRIME 0x100000001b3ull
+
+// FNV-1a
+uint64_t nbc_hash(const char *src, size_t len) {
+    uint64_t h = FNV_BASIS;
+    for (size_t i = 0; i < len; i++) {
+        h ^= (unsigned char)src[i];
+        h *= FNV_PRIME;
+    }
+    return h;
+}
+
+// FNV-1a a word at a time: the sections are mostly 4- and 8-byte items,
+// and a word that changes always changes the result, since xor and a
+// multiply by an odd number both undo
+static uint64_t check_bytes(uint64_t h, const char *p, size_t len) {
+    size_t i = 0;
+    for (; i + 8 <= len; i += 8) {
+        uint64_t w;
+        memcpy(&w, p + i, 8);
+        h = (h ^ w) * FNV_PRIME;
+    }
+    for (; i < len; i++) h = (h ^ (unsigned char)p[i]) * FNV_PRIME;
+    return h;
+}
+
+// the header up to check, then the sections after it
+static uint64_t nbc_check(const char *file, size_t size) {
+    uint64_t h = check_bytes(FNV_BASIS, file, offsetof(NbcHeader, check));
+    return check_bytes(h, file + sizeof(NbcHeader), size - sizeof(NbcHeader));
+}
+
+char *nbc_path(const char *source_path) {
+    size_t n = strlen(source_path);
+    if (n > 2 && strcmp(source_path + n - 2, ".n") == 0) n -= 2;
+    char *path = xmalloc(n + 5);
+    memcpy(path, source_path, n);
+    memcpy(path + n, ".nbc", 5);
+    return path;
+}
+
+/* ---- writing ---- */
+
+// bytes at the next multiple of 8, returns their offset
+static uint64_t put_section(Emitter *out, const void *data, size_t bytes) {
+    static const char zeros[8] = {0};
+    emit_textn(out, zeros, (8 - out->len % 8) % 8);
+    uint64_t at = out->len;
+    if (bytes) emit_textn(out, data, bytes);
+    return at;
+}
+
+bool nbc_save(const Bytecode *bc, uint64_t hash, const char *path) {
+    NbcHeader h = {
+        .magic = "NBC",
+        .version = NBC_VERSION,
+        .byte_order = NBC_BYTE_ORDER,
+        .entry = bc->entry,
+        .hash = hash,
+        .ncode = (uint32_t)bc->len,
+        .nslots = bc->nslots,
+        .nstr = (uint32_t)bc->nstr,
+        .strings_len = bc->strings.len,
+    };
+    Emitter out = {0};
+    emit_textn(&out, (const char *)&h, sizeof(h));
+    h.init = put_section(&out, bc->init, bc->nslots * sizeof(uint64_t));
+    h.code = put_section(&out, bc->code, bc->len * sizeof(uint32_t));
+    h.str_off = put_section(&out, bc->str_off, (size_t)bc->nstr * sizeof(uint32_t));
+    h.str_len = put_section(&out, bc->str_len, (size_t)bc->nstr * sizeof(uint32_t));
+    h.strings = put_section(&out, bc->strings.data, bc->strings.len);
+    h.size = out.len;
+    memcpy(out.data, &h, sizeof(h));
+    // over the header as it is in the file, so it goes in last
+    h.check = nbc_check(out.data, out.len);
+    memcpy(out.data, &h, sizeof(h));
+
+    // written beside it and renamed over, so a reader never maps half a file
+    size_t n = strlen(path);
+    char *tmp = xmalloc(n + 32);
+    snprintf(tmp, n + 32, "%s.%ld.tmp", path, (long)getpid());
+    int fd = open(tmp, O_WRONLY | O_CREAT | O_TRUNC, 0644);
+    bool ok = fd >= 0;
+    if (ok) {
+        ok = emit_write(&out, fd) == 0;
+        ok = close(fd) == 0 && ok;
+        ok = ok && rename(tmp, path) == 0;
+        if (!ok) unlink(tmp);
+    }
+    xfree(tmp);
+    emit_free(&out);
+    return ok;
+}
+
+/* ---- mapping ---- */
+
+static bool section_fits(uint64_t at, uint64_t count, size_t item, uint64_t size) {
+    return at % 8 == 0 && at >= sizeof(NbcHeader) && at <= size && count <= (size - at) / item;
+}
+
+static bool header_ok(const NbcHeader *h, uint64_t hash, uint64_t size) {
+    if (memcmp(h->magic, "NBC", 4) != 0 || h->version != NBC_VERSION || h->byte_order != NBC_BYTE_ORDER)
+        return false;
+    if (h->hash != hash || h->size != size || h->entry >= h->ncode) return false;
+    if (h->check != nbc_check((const char *)h, size)) return false;
+    return section_fits(h->init, h->nslots, sizeof(uint64_t), size)
+        && section_fits(h->code, h->ncode, sizeof(uint32_t), size)
+        && section_fits(h->str_off, h->nstr, sizeof(uint32_t), size)
+        && section_fits(h->str_len, h->nstr, sizeof(uint32_t), size)
+        && section_fits(h->strings, h->strings_len, 1, size);
+}
+
+bool nbc_load(const char *path, uint64_t hash, Bytecode *bc) {
+    int fd = open(path, O_RDONLY);
+    if (fd < 0) return false;
+    struct stat st;
+    void *p = MAP_FAILED;
+    if (fstat(fd, &st) == 0 && S_ISREG(st.st_mode) && (size_t)st.st_size >= sizeof(NbcHeader))
+        p = mmap(NULL, (size_t)st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+    close(fd);
+    if (p == MAP_FAILED) return false;
+
+    size_t size = (size_t)st.st_size;
+    const NbcHeader *h = p;
+    const char *base = p;
+    if (!header_ok(h, hash, size)) {
+        munmap(p, size);
+        return false;
+    }
+    const uint32_t *str_off = (const uint32_t *)(base + h->str_off);
+    const uint32_t *str_len = (const uint32_t *)(base + h->str_len);
+    for (uint32_t i = 0; i < h->nstr; i++) {
+        if (str_off[i] > h->strings_len || str_len[i] > h->strings_len - str_off[i]) {
+            munmap(p, size);
+            return false;
+        }
+    }
+
+    // read-only from here on: the interpreter never writes these
+    memset(bc, 0, sizeof(*bc));
+    bc->code = (uint32_t *)(base + h->code);
+    bc->len = h->ncode;
+    bc->entry = h->entry;
+    bc->init = (uint64_t *)(base + h->init);
+    bc->nslots = h->nslots;
+    bc->strings.data = (char *)(base + h->strings);
+    bc->strings.len = h->strings_len;
+    bc->str_off = (uint32_t *)str_off;
+    bc->str_len = (uint32_t *)str_len;
+    bc->nstr = (int)h->nstr;
+    bc->map = p;
+    bc->map_len = size;
+    return true;
+}
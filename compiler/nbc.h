@@ -0,0 +1,37 @@
+#ifndef NBC_H
+#define NBC_H
+
+#include <stdint.h>
+#include <stddef.h>
+#include <stdbool.h>
+
+#include "bytecode.h"
+
+// .nbc files: `compiler run file.n` keeps the bytecode in file.nbc and
+// skips lexing, parsing and lowering the next time the source is the
+// same. The file is the Bytecode's own arrays behind a header, at 8-byte
+// aligned offsets and with nothing but offsets inside, so it is mapped
+// and run in place: the register file's initial values (the constants),
+// the code with its jump targets and the strings are never decoded.
+//
+// The header holds a hash of the source text, a format version and the
+// writer's byte order; a file that does not match all three is ignored
+// and written again. So is one whose layout does not fit its size or
+// whose checksum, over the header and every section, has changed: the
+// interpreter runs the code as it finds it, so a damaged file must never
+// reach it.
+#define NBC_VERSION 2
+
+uint64_t nbc_hash(const char *src, size_t len);
+
+// file.n -> file.nbc, anything else gets .nbc added; free with xfree
+char *nbc_path(const char *source_path);
+
+// false when the file cannot be written, which leaves no file behind
+bool nbc_save(const Bytecode *bc, uint64_t hash, const char *path);
+
+// bc points into the mapped file until bytecode_free; false when there is
+// no file, it is for another source, version or byte order, or damaged
+bool nbc_load(const char *path, uint64_t hash, Bytecode *bc);
+
+#endif // NBC_H
@@ -0,0 +1,432 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "object.h"
+#include "mem.h"
+
+int obj_add_symbol(ObjFile *o, const char *name, int len) {
+    if (o->nsyms == o->sym_cap) {
+        o->sym_cap = o->sym_cap ? o->sym_cap * 2 : 256;
+        o->syms = xrealloc(o->syms, sizeof(ObjSymbol) * o->sym_cap);
+    }
+    ObjSymbol *s = &o->syms[o->nsyms];
+    s->name = name;
+    s->len = len;
+    s->section = -1;
+    s->offset = 0;
+    s->global = false;
+    return o->nsyms++;
+}
+
+void obj_add_reloc(ObjFile *o, int section, uint64_t offset, RelocKind kind, int symbol) {
+    if (o->nrelocs == o->reloc_cap) {
+        o->reloc_cap = o->reloc_cap ? o->reloc_cap * 2 : 1024;
+        o->relocs = xrealloc(o->relocs, sizeof(ObjReloc) * o->reloc_cap);
+    }
+    o->relocs[o->nrelocs++] = (ObjReloc){ section, offset, kind, symbol };
+}
+
+void obj_free(ObjFile *o) {
+    for (int i = 0; i < OBJ_SECTION_COUNT; i++) emit_free(&o->sec[i]);
+    xfree(o->syms);
+    xfree(o->relocs);
+    memset(o, 0, sizeof(*o));
+}
+
+/* ---- little-endian fields ---- */
+
+static void put_le(Emitter *e, uint64_t v, int bytes) {
+    char b[8];
+    for (int i = 0; i < bytes; i++) b[i] = (char)(v >> (8 * i));
+    emit_textn(e, b, bytes);
+}
+
+static void put8(Emitter *e, uint8_t v) {
+    emit_char(e, (char)v);
+}
+
+static void put16(Emitter *e, uint16_t v) {
+    put_le(e, v, 2);
+}
+
+static void put32(Emitter *e, uint32_t v) {
+    put_le(e, v, 4);
+}
+
+static void put64(Emitter *e, uint64_t v) {
+    put_le(e, v, 8);
+}
+
+// fixed-size name field, zero padded
+static void put_name(Emitter *e, const char *name, size_t size) {
+    size_t n = strlen(name);
+    emit_textn(e, name, n);
+    for (; n < size; n++) put8(e, 0);
+}
+
+static void pad_to(Emitter *e, size_t offset) {
+    while (e->len < offset) put8(e, 0);
+}
+
+static uint64_t align_up(uint64_t v, uint64_t align) {
+    return (v + align - 1) & ~(align - 1);
+}
+
+// adds a terminated name to a string table, returns its offset
+static uint32_t add_string(Emitter *table, const char *name, int len) {
+    uint32_t at = (uint32_t)table->len;
+    emit_textn(table, name, len);
+    put8(table, 0);
+    return at;
+}
+
+static bool is_local(const ObjSymbol *s) {
+    return s->section >= 0 && !s->global;
+}
+
+/* ---- ELF ---- */
+
+#define EM_AARCH64 183
+#define SHT_PROGBITS 1
+#define SHT_SYMTAB 2
+#define SHT_STRTAB 3
+#define SHT_RELA 4
+#define SHF_WRITE 0x1
+#define SHF_ALLOC 0x2
+#define SHF_EXECINSTR 0x4
+#define SHF_INFO_LINK 0x40
+
+static uint32_t elf_reloc_type(RelocKind kind) {
+    switch (kind) {
+        case RELOC_JUMP26: return 282;          // R_AARCH64_JUMP26
+        case RELOC_CALL26: return 283;          // R_AARCH64_CALL26
+        case RELOC_PAGE21: return 275;          // R_AARCH64_ADR_PREL_PG_HI21
+        case RELOC_LO12_ADD: return 277;        // R_AARCH64_ADD_ABS_LO12_NC
+        case RELOC_LO12_LDST8: return 278;      // R_AARCH64_LDST8_ABS_LO12_NC
+        case RELOC_LO12_LDST32: return 285;     // R_AARCH64_LDST32_ABS_LO12_NC
+        case RELOC_LO12_LDST64: return 286;     // R_AARCH64_LDST64_ABS_LO12_NC
+        case RELOC_PC32: break;
+    }
+    return 0;
+}
+
+typedef struct {
+    uint32_t name, type;
+    uint64_t flags;
+    const Emitter *body;
+    uint64_t offset;
+    uint32_t link, info;
+    uint64_t align, entsize;
+} ElfSection;
+
+void obj_write_elf(const ObjFile *o, Emitter *out) {
+    static const char *const names[OBJ_SECTION_COUNT] = { ".text", ".data" };
+    static const char *const rela_names[OBJ_SECTION_COUNT] = { ".rela.text", ".rela.data" };
+    static const uint64_t flags[OBJ_SECTION_COUNT] = {
+        SHF_ALLOC | SHF_EXECINSTR, SHF_ALLOC | SHF_WRITE
+    };
+
+    Emitter shstrtab = {0}, strtab = {0}, symtab = {0};
+    Emitter rela[OBJ_SECTION_COUNT] = {{0}};
+    Emitter empty = {0};
+    put8(&shstrtab, 0);
+    put8(&strtab, 0);
+
+    // the sections: contents first, so their indices are 1 and 2
+    ElfSection sh[16];
+    int nsh = 1;
+    memset(&sh[0], 0, sizeof(sh[0]));
+    for (int s = 0; s < OBJ_SECTION_COUNT; s++) {
+        sh[nsh++] = (ElfSection){
+            add_string(&shstrtab, names[s], (int)strlen(names[s])), SHT_PROGBITS, flags[s],
+            &o->sec[s], 0, 0, 0, 1u << o->align[s], 0
+        };
+    }
+
+    // ELF wants the local symbols ahead of the globals
+    int *index = xmalloc(sizeof(int) * (o->nsyms + 1));
+    int nelf = 1;
+    for (int i = 0; i < 24; i++) put8(&symtab, 0);
+    for (int pass = 0; pass < 2; pass++) {
+        for (int i = 0; i < o->nsyms; i++) {
+            const ObjSymbol *s = &o->syms[i];
+            if (is_local(s) != (pass == 0)) continue;
+            index[i] = nelf++;
+            put32(&symtab, add_string(&strtab, s->name, s->len));
+            put8(&symtab, (s->global || s->section < 0) ? 0x10 : 0x00);    // STB_GLOBAL/LOCAL, STT_NOTYPE
+            put8(&symtab, 0);
+            put16(&symtab, s->section < 0 ? 0 : (uint16_t)(s->section + 1));
+            put64(&symtab, s->offset);
+            put64(&symtab, 0);
+        }
+    }
+    uint32_t first_global = 1;
+    for (int i = 0; i < o->nsyms; i++)
+        if (is_local(&o->syms[i])) first_global++;
+
+    int symtab_index = nsh + OBJ_SECTION_COUNT;
+    for (int i = 0; i < o->nrelocs; i++) {
+        const ObjReloc *r = &o->relocs[i];
+        put64(&rela[r->section], r->offset);
+        put64(&rela[r->section], ((uint64_t)index[r->symbol] << 32) | elf_reloc_type(r->kind));
+        put64(&rela[r->section], 0);
+    }
+    xfree(index);
+    for (int s = 0; s < OBJ_SECTION_COUNT; s++) {
+        // always present so the table indices stay fixed, empty ones are harmless
+        sh[nsh++] = (ElfSection){
+            add_string(&shstrtab, rela_names[s], (int)strlen(rela_names[s])), SHT_RELA, SHF_INFO_LINK,
+            &rela[s], 0, (uint32_t)symtab_index, (uint32_t)(s + 1), 8, 24
+        };
+    }
+    sh[nsh] = (ElfSection){
+        add_string(&shstrtab, ".symtab", 7), SHT_SYMTAB, 0,
+        &symtab, 0, (uint32_t)(nsh + 1), first_global, 8, 24
+    };
+    nsh++;
+    sh[nsh] = (ElfSection){ add_string(&shstrtab, ".strtab", 7), SHT_STRTAB, 0, &strtab, 0, 0, 0, 1, 0 };
+    nsh++;
+    if (o->stack_note) {
+        sh[nsh++] = (ElfSection){
+            add_string(&shstrtab, ".note.GNU-stack", 15), SHT_PROGBITS, 0, &empty, 0, 0, 0, 1, 0
+        };
+    }
+    int shstrndx = nsh;
+    sh[nsh++] = (ElfSection){ add_string(&shstrtab, ".shstrtab", 9), SHT_STRTAB, 0, &shstrtab, 0, 0, 0, 1, 0 };
+
+    // lay out the section bodies after the header, then the section table
+    uint64_t offset = 64;
+    for (int i = 1; i < nsh; i++) {
+        offset = align_up(offset, sh[i].align);
+        sh[i].offset = offset;
+        offset += sh[i].body->len;
+    }
+    uint64_t shoff = align_up(offset, 8);
+
+    size_t base = out->len;
+    emit_reserve(out, shoff + 64 * (size_t)nsh);
+    emit_textn(out, "\177ELF", 4);
+    put8(out, 2);       // ELFCLASS64
+    put8(out, 1);       // ELFDATA2LSB
+    put8(out, 1);       // EV_CURRENT
+    pad_to(out, base + 16);
+    put16(out, 1);      // ET_REL
+    put16(out, EM_AARCH64);
+    put32(out, 1);
+    put64(out, 0);      // entry
+    put64(out, 0);      // program headers
+    put64(out, shoff);
+    put32(out, 0);      // flags
+    put16(out, 64);     // header size
+    put16(out, 0);
+    put16(out, 0);
+    put16(out, 64);     // section header size
+    put16(out, (uint16_t)nsh);
+    put16(out, (uint16_t)shstrndx);
+
+    for (int i = 1; i < nsh; i++) {
+        pad_to(out, base + sh[i].offset);
+        if (sh[i].body->len) emit_textn(out, sh[i].body->data, sh[i].body->len);
+    }
+    pad_to(out, base + shoff);
+    for (int i = 0; i < nsh; i++) {
+        put32(out, sh[i].name);
+        put32(out, sh[i].type);
+        put64(out, sh[i].flags);
+        put64(out, 0);  // address
+        put64(out, sh[i].offset);
+        put64(out, sh[i].body ? sh[i].body->len : 0);
+        put32(out, sh[i].link);
+        put32(out, sh[i].info);
+        put64(out, sh[i].align);
+        put64(out, sh[i].entsize);
+    }
+
+    emit_free(&shstrtab);
+    emit_free(&strtab);
+    emit_free(&symtab);
+    for (int s = 0; s < OBJ_SECTION_COUNT; s++) emit_free(&rela[s]);
+}
+
+/* ---- Mach-O ---- */
+
+#define MH_MAGIC_64 0xfeedfacf
+#define CPU_TYPE_ARM64 0x0100000c
+#define MH_OBJECT 1
+#define LC_SEGMENT_64 0x19
+#define LC_SYMTAB 0x2
+#define LC_DYSYMTAB 0xb
+#define LC_BUILD_VERSION 0x32
+#define PLATFORM_MACOS 1
+#define N_EXT 0x01
+#define N_SECT 0x0e
+
+static uint32_t macho_reloc_type(RelocKind kind) {
+    switch (kind) {
+        case RELOC_JUMP26:
+        case RELOC_CALL26: return 2;            // ARM64_RELOC_BRANCH26
+        case RELOC_PAGE21: return 3;            // ARM64_RELOC_PAGE21
+        case RELOC_LO12_ADD:
+        case RELOC_LO12_LDST8:
+        case RELOC_LO12_LDST32:
+        case RELOC_LO12_LDST64: return 4;       // ARM64_RELOC_PAGEOFF12
+        case RELOC_PC32: break;
+    }
+    return 0;
+}
+
+void obj_write_macho(const ObjFile *o, Emitter *out) {
+    static const char *const sect_names[OBJ_SECTION_COUNT][2] = {
+        { "__text", "__TEXT" }, { "__data", "__DATA" }
+    };
+    // S_REGULAR, plus S_ATTR_PURE_INSTRUCTIONS | S_ATTR_SOME_INSTRUCTIONS for code
+    static const uint32_t sect_flags[OBJ_SECTION_COUNT] = { 0x80000400, 0 };
+
+    // symbols go locals, then defined globals, then undefined ones
+    int *index = xmalloc(sizeof(int) * (o->nsyms + 1));
+    int *order = xmalloc(sizeof(int) * (o->nsyms + 1));
+    int counts[3] = {0};
+    int n = 0;
+    for (int kind = 0; kind < 3; kind++) {
+        for (int i = 0; i < o->nsyms; i++) {
+            const ObjSymbol *s = &o->syms[i];
+            int k = s->section < 0 ? 2 : s->global ? 1 : 0;
+            if (k != kind) continue;
+            index[i] = n;
+            order[n++] = i;
+            counts[kind]++;
+        }
+    }
+
+    // section addresses in the one segment, file offsets follow them
+    uint32_t cmds_size = (72 + 80 * OBJ_SECTION_COUNT) + 24 + 24 + 80;
+    uint64_t addr[OBJ_SECTION_COUNT];
+    uint64_t vmsize = 0;
+    for (int s = 0; s < OBJ_SECTION_COUNT; s++) {
+        addr[s] = align_up(vmsize, 1u << o->align[s]);
+        vmsize = addr[s] + o->sec[s].len;
+    }
+    uint64_t seg_off = align_up(32 + cmds_size, 16);
+
+    int nrel[OBJ_SECTION_COUNT] = {0};
+    for (int i = 0; i < o->nrelocs; i++) nrel[o->relocs[i].section]++;
+    uint64_t rel_off[OBJ_SECTION_COUNT];
+    uint64_t offset = align_up(seg_off + vmsize, 8);
+    for (int s = 0; s < OBJ_SECTION_COUNT; s++) {
+        rel_off[s] = offset;
+        offset += 8 * (uint64_t)nrel[s];
+    }
+    uint64_t sym_off = align_up(offset, 8);
+
+    Emitter strtab = {0};
+    put8(&strtab, ' ');
+    put8(&strtab, 0);
+    uint32_t *strx = xmalloc(sizeof(uint32_t) * (o->nsyms + 1));
+    for (int i = 0; i < n; i++)
+        strx[i] = add_string(&strtab, o->syms[order[i]].name, o->syms[order[i]].len);
+    pad_to(&strtab, align_up(strtab.len, 8));
+    uint64_t str_off = sym_off + 16 * (uint64_t)n;
+
+    size_t base = out->len;
+    emit_reserve(out, str_off + strtab.len);
+    put32(out, MH_MAGIC_64);
+    put32(out, CPU_TYPE_ARM64);
+    put32(out, 0);      // CPU_SUBTYPE_ARM64_ALL
+    put32(out, MH_OBJECT);
+    put32(out, 4);      // load commands
+    put32(out, cmds_size);
+    put32(out, 0);      // flags
+    put32(out, 0);
+
+    put32(out, LC_SEGMENT_64);
+    put32(out, 72 + 80 * OBJ_SECTION_COUNT);
+    put_name(out, "", 16);
+    put64(out, 0);
+    put64(out, vmsize);
+    put64(out, seg_off);
+    put64(out, vmsize);
+    put32(out, 7);      // rwx, objects leave it to the linker
+    put32(out, 7);
+    put32(out, OBJ_SECTION_COUNT);
+    put32(out, 0);
+    for (int s = 0; s < OBJ_SECTION_COUNT; s++) {
+        put_name(out, sect_names[s][0], 16);
+        put_name(out, sect_names[s][1], 16);
+        put64(out, addr[s]);
+        put64(out, o->sec[s].len);
+        put32(out, (uint32_t)(seg_off + addr[s]));
+        put32(out, (uint32_t)o->align[s]);
+        put32(out, nrel[s] ? (uint32_t)rel_off[s] : 0);
+        put32(out, (uint32_t)nrel[s]);
+        put32(out, sect_flags[s]);
+        put32(out, 0);
+        put32(out, 0);
+        put32(out, 0);
+    }
+
+    put32(out, LC_BUILD_VERSION);
+    put32(out, 24);
+    put32(out, PLATFORM_MACOS);
+    put32(out, 11 << 16);   // minimum macOS 11.0, the first on arm64
+    put32(out, 0);
+    put32(out, 0);
+
+    put32(out, LC_SYMTAB);
+    put32(out, 24);
+    put32(out, (uint32_t)sym_off);
+    put32(out, (uint32_t)n);
+    put32(out, (uint32_t)str_off);
+    put32(out, (uint32_t)strtab.len);
+
+    put32(out, LC_DYSYMTAB);
+    put32(out, 80);
+    put32(out, 0);
+    put32(out, (uint32_t)counts[0]);
+    put32(out, (uint32_t)counts[0]);
+    put32(out, (uint32_t)counts[1]);
+    put32(out, (uint32_t)(counts[0] + counts[1]));
+    put32(out, (uint32_t)counts[2]);
+    for (int i = 0; i < 12; i++) put32(out, 0);
+
+    for (int s = 0; s < OBJ_SECTION_COUNT; s++) {
+        pad_to(out, base + seg_off + addr[s]);
+        if (o->sec[s].len) emit_textn(out, o->sec[s].data, o->sec[s].len);
+    }
+
+    for (int s = 0; s < OBJ_SECTION_COUNT; s++) {
+        pad_to(out, base + rel_off[s]);
+        for (int i = 0; i < o->nrelocs; i++) {
+            const ObjReloc *r = &o->relocs[i];
+            if (r->section != s) continue;
+            uint32_t type = macho_reloc_type(r->kind);
+            bool pcrel = type != 4;
+            put32(out, (uint32_t)r->offset);
+            // symbolnum:24 pcrel:1 length:2 extern:1 type:4
+            put32(out, (uint32_t)index[r->symbol] | (uint32_t)pcrel << 24 | 2u << 25 | 1u << 27 | type << 28);
+        }
+    }
+
+    pad_to(out, base + sym_off);
+    for (int i = 0; i < n; i++) {
+        const ObjSymbol *s = &o->syms[order[i]];
+        put32(out, strx[i]);
+        if (s->section < 0) {
+            put8(out, N_EXT);
+            put8(out, 0);
+            put16(out, 0);
+            put64(out, 0);
+        } else {
+            put8(out, N_SECT | (s->global ? N_EXT : 0));
+            put8(out, (uint8_t)(s->section + 1));
+            put16(out, 0);
+            put64(out, addr[s->section] + s->offset);
+        }
+    }
+    emit_textn(out, strtab.data, strtab.len);
+
+    emit_free(&strtab);
+    xfree(strx);
+    xfree(order);
+    xfree(index);
+}
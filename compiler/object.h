@@ -0,0 +1,69 @@
+#ifndef OBJECT_H
+#define OBJECT_H
+
+#include <stdint.h>
+#include <stdbool.h>
+
+#include "emit.h"
+
+// A relocatable object as the integrated assembler builds it: section
+// contents, symbols and the relocations the linker still has to apply.
+// The writers for each object format (ELF, Mach-O) lay it out on disk.
+
+typedef enum {
+    OBJ_TEXT,
+    OBJ_DATA,
+    OBJ_SECTION_COUNT
+} ObjSection;
+
+// what the linker patches, named after the instruction field; each
+// writer maps them to its own relocation types
+typedef enum {
+    RELOC_JUMP26,       // b
+    RELOC_CALL26,       // bl
+    RELOC_PAGE21,       // adrp
+    RELOC_LO12_ADD,     // add with the low 12 bits of an address
+    RELOC_LO12_LDST8,   // ldr/str, the low 12 bits scaled by the access size
+    RELOC_LO12_LDST32,
+    RELOC_LO12_LDST64,
+    RELOC_PC32,         // x86-64 rel32 or %rip displacement, the addend
+                        // already in the field; only the JIT loads these
+} RelocKind;
+
+typedef struct {
+    const char *name;   // not terminated, points into the assembly text
+    int len;
+    int section;        // ObjSection, or -1 while undefined
+    uint64_t offset;    // within the section
+    bool global;
+} ObjSymbol;
+
+typedef struct {
+    int section;
+    uint64_t offset;
+    RelocKind kind;
+    int symbol;         // index into syms
+} ObjReloc;
+
+typedef struct {
+    Emitter sec[OBJ_SECTION_COUNT];
+    int align[OBJ_SECTION_COUNT];   // log2 of the largest .align seen
+
+    ObjSymbol *syms;
+    int nsyms, sym_cap;
+
+    ObjReloc *relocs;
+    int nrelocs, reloc_cap;
+
+    bool stack_note;    // ELF: mark the stack non-executable
+} ObjFile;
+
+int obj_add_symbol(ObjFile *o, const char *name, int len);
+void obj_add_reloc(ObjFile *o, int section, uint64_t offset, RelocKind kind, int symbol);
+void obj_free(ObjFile *o);
+
+// lay out an aarch64 object file into out
+void obj_write_elf(const ObjFile *o, Emitter *out);
+void obj_write_macho(const ObjFile *o, Emitter *out);
+
+#endif // OBJECT_H
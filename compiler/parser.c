@@ -0,0 +1,440 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdbool.h>
+#include <ctype.h>
+
+#include "parser.h"
+#include "errors.h"
+#include "mem.h"
+#include "pool.h"
+#include "timing.h"
+
+typedef struct {
+    Lexer *lx;
+    Arena *arena;
+    bool at_else;       // last block ended on a "} else" line, left unconsumed
+} Parser;
+
+// current line: t[0..n-1], t[n] is the newline (or EOF)
+static int cur_line(Parser *p, const Token **t) {
+    *t = p->lx->toks;
+    return p->lx->count - 1;
+}
+
+// the next line overwrites the current line's tokens
+static void next_line(Parser *p) {
+    lex_line(p->lx);
+}
+
+// skip blank lines and lone "{" lines, returns false at end of input
+static bool skip_blank(Parser *p) {
+    for (;;) {
+        const Token *t;
+        int n = cur_line(p, &t);
+        if (n == 0 && t[0].kind == TOK_EOF) return false;
+        if (n == 0 || (n == 1 && t[0].kind == TOK_LBRACE)) {
+            next_line(p);
+            continue;
+        }
+        return true;
+    }
+}
+
+static bool is_register(const char *s) {
+    return (s[0] == 'w' || s[0] == 'x') && isdigit((unsigned char)s[1]);
+}
+
+static Expr *new_expr(Parser *p, ExprKind kind) {
+    Expr *e = ARENA_NEW(p->arena, Expr);
+    e->kind = kind;
+    return e;
+}
+
+static Stmt *new_stmt(Parser *p, StmtKind kind, int line) {
+    Stmt *s = ARENA_NEW(p->arena, Stmt);
+    s->kind = kind;
+    s->line = line;
+    return s;
+}
+
+// a single number, register or variable
+static Expr *parse_operand(Parser *p, const Token *t, int line) {
+    Expr *e;
+    switch (t->kind) {
+        case TOK_NUMBER:
+            e = new_expr(p, EXPR_NUMBER);
+            e->name = t->text;
+            e->value = strtol(t->text, NULL, 10);
+            return e;
+        case TOK_IDENT:
+            e = new_expr(p, is_register(t->text) ? EXPR_REG : EXPR_VAR);
+            e->name = t->text;
+            return e;
+        default:
+            error_syntax(line, "Expected a number, register or variable");
+            return NULL;
+    }
+}
+
+// "a" or "a <op> b"
+static Expr *parse_expr(Parser *p, const Token *t, int n, int line) {
+    if (n == 1) return parse_operand(p, t, line);
+    if (n != 3) error_syntax(line, "Unsupported expression");
+
+    Expr *e = new_expr(p, EXPR_BINARY);
+    switch (t[1].kind) {
+        case TOK_PLUS:  e->op = OP_ADD; break;
+        case TOK_MINUS: e->op = OP_SUB; break;
+        case TOK_STAR:  e->op = OP_MUL; break;
+        case TOK_SLASH: e->op = OP_DIV; break;
+        default: error_syntax(line, "Unsupported operator");
+    }
+    e->lhs = parse_operand(p, &t[0], line);
+    e->rhs = parse_operand(p, &t[2], line);
+    return e;
+}
+
+// comma separated operands up to the closing ')', returns a linked list
+static Expr *parse_list(Parser *p, const Token *t, int n, int line, bool names_only) {
+    Expr *head = NULL, **tail = &head;
+    for (int i = 0; i < n; i++) {
+        if (t[i].kind == TOK_COMMA) continue;
+        if (names_only && t[i].kind != TOK_IDENT) error_syntax(line, "Malformed function parameters");
+        Expr *e = parse_operand(p, &t[i], line);
+        if (names_only) e->kind = EXPR_VAR;
+        *tail = e;
+        tail = &e->next;
+        if (i + 1 < n && t[i + 1].kind != TOK_COMMA) error_syntax(line, "Expected ','");
+    }
+    return head;
+}
+
+// operand of setr/setm: one token or a whole [memory] group
+static Expr *parse_set_operand(Parser *p, const Token *t, int n, int line, int *used) {
+    if (n <= 0) error_syntax(line, "Missing operand in setr/setm function call");
+    if (t[0].kind != TOK_LBRACKET) {
+        *used = 1;
+        return parse_operand(p, t, line);
+    }
+    for (int i = 1; i < n; i++) {
+        if (t[i].kind == TOK_RBRACKET) {
+            Expr *e = new_expr(p, EXPR_MEM);
+            e->text = p->lx->src + t[0].start;
+            e->len = t[i].start + t[i].len - t[0].start;
+            *used = i + 1;
+            return e;
+        }
+    }
+    error_syntax(line, "Missing ']' in memory operand");
+    return NULL;
+}
+
+static Stmt *parse_block(Parser *p, int open_line, bool allow_else);
+
+// "loop <expr> {"
+static Stmt *parse_loop(Parser *p, const Token *t, int n, int line) {
+    if (t[n - 1].kind == TOK_LBRACE) n--;
+    if (n < 2) error_syntax(line, "Missing loop count");
+
+    Stmt *s = new_stmt(p, STMT_LOOP, line);
+    s->value = parse_expr(p, t + 1, n - 1, line);
+    next_line(p);
+    s->body = parse_block(p, line, false);
+    return s;
+}
+
+// "if a <op> b {" ... "} else {" ... "}"
+static Stmt *parse_if(Parser *p, const Token *t, int n, int line) {
+    if (t[n - 1].kind == TOK_LBRACE) n--;
+    if (n != 4) error_syntax(line, "Malformed if condition");
+
+    Stmt *s = new_stmt(p, STMT_IF, line);
+    s->lhs = parse_operand(p, &t[1], line);
+    s->rhs = parse_operand(p, &t[3], line);
+    switch (t[2].kind) {
+        case TOK_LT: s->cmp = CMP_LT; break;
+        case TOK_GT: s->cmp = CMP_GT; break;
+        case TOK_EQ: s->cmp = CMP_EQ; break;
+        case TOK_NE: s->cmp = CMP_NE; break;
+        case TOK_LE: s->cmp = CMP_LE; break;
+        case TOK_GE: s->cmp = CMP_GE; break;
+        default: error_syntax(line, "Unsupported operator in if");
+    }
+    next_line(p);
+
+    const Token *close;
+    s->body = parse_block(p, line, true);
+
+    // only our own closing line counts, a "} else" after a plain "}"
+    // belongs to an enclosing if
+    bool own_else = p->at_else;
+    p->at_else = false;
+    cur_line(p, &close);
+    if (own_else ||
+        // "}" then "else {" on its own line
+        (skip_blank(p) && cur_line(p, &close) >= 1 && close[0].kind == TOK_KW_ELSE)) {
+        int else_line = close[0].line;
+        next_line(p);
+        s->else_body = parse_block(p, else_line, false);
+    }
+    return s;
+}
+
+static Stmt *parse_statement(Parser *p, const Token *t, int n) {
+    int line = t[0].line;
+    Stmt *s;
+
+    switch (t[0].kind) {
+        case TOK_KW_LOOP:
+            return parse_loop(p, t, n, line);
+
+        case TOK_KW_IF:
+            return parse_if(p, t, n, line);
+
+        case TOK_KW_ELSE:
+            error_syntax(line, "Unexpected else without matching if");
+            return NULL;
+
+        case TOK_KW_NUM:
+            // num <var> = <expr>
+            if (n < 4 || t[1].kind != TOK_IDENT || t[2].kind != TOK_ASSIGN)
+                error_syntax(line, "Unsupported decleration syntax in num type decleration");
+            s = new_stmt(p, STMT_NUM, line);
+            s->dest = new_expr(p, EXPR_VAR);
+            s->dest->name = t[1].text;
+            s->value = parse_expr(p, t + 3, n - 3, line);
+            next_line(p);
+            return s;
+
+        case TOK_KW_PRINT:
+            if (n < 3 || t[1].kind != TOK_LPAREN || t[n - 1].kind != TOK_RPAREN) break;
+            if (n == 3) error_syntax(line, "too few arguments in print call");
+            if (n > 4) error_syntax(line, "Too many arguments in print()");
+            s = new_stmt(p, STMT_PRINT, line);
+            if (t[2].kind == TOK_STRING) {
+                s->value = new_expr(p, EXPR_STRING);
+                s->value->name = t[2].text;
+            } else {
+                s->value = parse_operand(p, &t[2], line);
+            }
+            next_line(p);
+            return s;
+
+        case TOK_KW_EXIT:
+            if (n < 3 || t[1].kind != TOK_LPAREN || t[n - 1].kind != TOK_RPAREN) break;
+            s = new_stmt(p, STMT_EXIT, line);
+            next_line(p);
+            return s;
+
+        case TOK_KW_BL:
+            // function call: bl func(a,b,c), or plain bl func from "jump _func"
+            if (n < 2 || t[1].kind != TOK_IDENT) break;
+            if (n > 2 && (n < 4 || t[2].kind != TOK_LPAREN || t[n - 1].kind != TOK_RPAREN)) break;
+            s = new_stmt(p, STMT_CALL, line);
+            s->callee = t[1].text;
+            if (n > 2) s->args = parse_list(p, t + 3, n - 4, line, false);
+            next_line(p);
+            return s;
+
+        case TOK_KW_SETR:
+        case TOK_KW_SETM: {
+            // setr dest, src  /  setm dest = src
+            s = new_stmt(p, t[0].kind == TOK_KW_SETR ? STMT_SETR : STMT_SETM, line);
+            int lw, rw;
+            s->dest = parse_set_operand(p, t + 1, n - 1, line, &lw);
+            int sep = 1 + lw;
+            if (sep >= n || (t[sep].kind != TOK_COMMA && t[sep].kind != TOK_ASSIGN))
+                error_syntax(line, "Expected ',' or '=' in setr/setm function call");
+            s->value = parse_set_operand(p, t + sep + 1, n - sep - 1, line, &rw);
+            if (sep + 1 + rw != n) error_syntax(line, "Too many arguments in setr/setm function call");
+
+            if (s->kind == STMT_SETR && s->dest->kind != EXPR_REG) {
+                error_fatal("Error: setr destination must be a register (line %d): %.*s\n",
+                            line, t[1].len, p->lx->src + t[1].start);
+            }
+            if (s->kind == STMT_SETM && s->dest->kind != EXPR_MEM && s->dest->kind != EXPR_VAR) {
+                error_fatal("Error: setm destination must be memory (line %d): %.*s\n",
+                            line, t[1].len, p->lx->src + t[1].start);
+            }
+            if (s->kind == STMT_SETM && s->value->kind == EXPR_MEM)
+                error_syntax(line, "setm source must be a number, register or variable");
+            next_line(p);
+            return s;
+        }
+
+        case TOK_IDENT:
+            // dest = a <op> b  /  dest = value
+            if (n >= 3 && t[1].kind == TOK_ASSIGN) {
+                s = new_stmt(p, STMT_ASSIGN, line);
+                s->dest = parse_operand(p, &t[0], line);
+                s->value = parse_expr(p, t + 2, n - 2, line);
+                next_line(p);
+                return s;
+            }
+            if (n >= 4 && t[1].kind == TOK_LPAREN && t[n - 1].kind == TOK_LBRACE)
+                error_syntax(line, "Functions cannot be defined inside of a function");
+            break;
+
+        default:
+            break;
+    }
+
+    // fallback: raw assembly line
+    s = new_stmt(p, STMT_RAW, line);
+    s->text = p->lx->src + t[0].start;
+    s->len = t[n - 1].start + t[n - 1].len - t[0].start;
+    next_line(p);
+    return s;
+}
+
+// statements up to the closing "}" line; a "} else {" line is left for the caller
+static Stmt *parse_block(Parser *p, int open_line, bool allow_else) {
+    Stmt *head = NULL, **tail = &head;
+
+    for (;;) {
+        if (!skip_blank(p)) error_syntax(open_line, "Missing '}'");
+
+        const Token *t;
+        int n = cur_line(p, &t);
+
+        if (t[0].kind == TOK_RBRACE) {
+            if (n == 1) next_line(p);
+            else if (t[1].kind != TOK_KW_ELSE) error_syntax(t[0].line, "Unexpected tokens after '}'");
+            else if (!allow_else) error_syntax(t[0].line, "Unexpected else without matching if");
+            else p->at_else = true;
+            return head;
+        }
+
+        Stmt *s = parse_statement(p, t, n);
+        *tail = s;
+        tail = &s->next;
+    }
+}
+
+Program *parse_program(Lexer *lx, Arena *arena) {
+    Parser parser = { lx, arena, false };
+    Parser *p = &parser;
+
+    lex_line(lx);
+
+    Program *prog = ARENA_NEW(arena, Program);
+    Func **tail = &prog->funcs;
+
+    while (skip_blank(p)) {
+        const Token *t;
+        int n = cur_line(p, &t);
+        int line = t[0].line;
+
+        // optional "func" in front of the name
+        if (n >= 2 && t[0].kind == TOK_IDENT && strcmp(t[0].text, "func") == 0 && t[1].kind == TOK_IDENT) {
+            t++;
+            n--;
+        }
+
+        // function definition: name(params) {
+        if (n < 4 || t[0].kind != TOK_IDENT || t[1].kind != TOK_LPAREN ||
+            t[n - 2].kind != TOK_RPAREN || t[n - 1].kind != TOK_LBRACE)
+            error_syntax(line, "Everything must be inside of a function");
+
+        Func *f = ARENA_NEW(arena, Func);
+        f->name = t[0].text;
+        f->line = line;
+        f->params = parse_list(p, t + 2, n - 4, line, true);
+        next_line(p);
+        f->body = parse_block(p, line, false);
+
+        *tail = f;
+        tail = &f->next;
+    }
+
+    return prog;
+}
+
+/* ---- parallel parse ---- */
+
+typedef struct {
+    const char *src;
+    int len;
+    int line;           // line number of the chunk's first line
+    Program *prog;
+} Chunk;
+
+typedef struct {
+    Chunk *chunks;
+    Arena *arenas;
+} ParseJob;
+
+static void parse_chunk(void *ctx, int task, int worker) {
+    ParseJob *job = ctx;
+    Chunk *c = &job->chunks[task];
+
+    // on a worker, the lex time inside is counted there and handed over
+    timing_begin(PHASE_PARSE);
+    Lexer lx;
+    lex_init(&lx, c->src, c->len);
+    lx.line = c->line;  // numbering carries on from the whole file
+    c->prog = parse_program(&lx, &job->arenas[worker]);
+    lex_free(&lx);
+    timing_end(PHASE_PARSE);
+}
+
+// Cut the source between top-level functions into pieces of at least
+// target bytes. A line starting with '}' closes a block and one ending
+// in '{' opens one, the same way the parser sees them.
+static Chunk *split_chunks(const char *src, size_t len, size_t target, int *count) {
+    int cap = 16, n = 0;
+    Chunk *chunks = xmalloc(cap * sizeof(Chunk));
+
+    const char *p = src, *end = src + len, *start = src;
+    int depth = 0, line = 1, start_line = 1;
+
+    while (p < end) {
+        const char *nl = memchr(p, '\n', end - p);
+        const char *e = nl ? nl : end;
+
+        const char *first = p, *last = e;
+        while (first < e && (*first == ' ' || *first == '\t' || *first == '\r')) first++;
+        while (last > first && (last[-1] == ' ' || last[-1] == '\t' || last[-1] == '\r')) last--;
+        if (first < e && *first == '}' && depth > 0) depth--;
+        if (last > first && last[-1] == '{') depth++;
+
+        p = nl ? nl + 1 : end;
+        line++;
+
+        if (depth == 0 && (size_t)(p - start) >= target && p < end) {
+            if (n == cap) chunks = xrealloc(chunks, (cap *= 2) * sizeof(Chunk));
+            chunks[n++] = (Chunk){ start, (int)(p - start), start_line, NULL };
+            start = p;
+            start_line = line;
+        }
+    }
+
+    if (n == cap) chunks = xrealloc(chunks, (cap + 1) * sizeof(Chunk));
+    chunks[n++] = (Chunk){ start, (int)(end - start), start_line, NULL };
+    *count = n;
+    return chunks;
+}
+
+Program *parse_source(const char *src, size_t len, int jobs, Arena *arenas) {
+    // a few pieces per worker keeps them busy when functions differ in size
+    size_t target = jobs > 1 ? len / ((size_t)jobs * 4) : len;
+    if (target < 16 * 1024) target = 16 * 1024;
+
+    int count;
+    Chunk *chunks = split_chunks(src, len, target, &count);
+
+    ParseJob job = { chunks, arenas };
+    pool_run(jobs, count, parse_chunk, &job);
+
+    // join the function lists back up in source order
+    Program *prog = chunks[0].prog;
+    Func **tail = &prog->funcs;
+    for (int i = 0; i < count; i++) {
+        if (i > 0) *tail = chunks[i].prog->funcs;
+        while (*tail) tail = &(*tail)->next;
+    }
+
+    xfree(chunks);
+    return prog;
+}
@@ -0,0 +1,19 @@
+#ifndef PARSER_H
+#define PARSER_H
+
+#include <stddef.h>
+
+#include "arena.h"
+#include "ast.h"
+#include "lexer.h"
+
+// Build the program tree, pulling lines from lx as it goes.
+// All nodes are allocated from arena.
+Program *parse_program(Lexer *lx, Arena *arena);
+
+// Parse a whole source buffer, split between top-level functions and
+// spread over jobs threads. Worker i allocates from arenas[i], so the
+// caller passes jobs zeroed arenas and frees them when done with the tree.
+Program *parse_source(const char *src, size_t len, int jobs, Arena *arenas);
+
+#endif // PARSER_H
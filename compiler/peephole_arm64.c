@@ -0,0 +1,664 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+#include <stdbool.h>
+#include <ctype.h>
+
+#include "peephole_arm64.h"
+#include "mem.h"
+
+typedef struct {
+    const char *p;
+    int len;
+} Slice;
+
+typedef enum {
+    LINE_NOTE,      // blank, comment or directive: no effect on anything
+    LINE_LABEL,
+    LINE_OPAQUE,    // not understood: reads every register, may do anything
+    LINE_INSN
+} LineKind;
+
+// the instructions codegen_arm64.c writes, in the forms it writes them
+typedef enum {
+    INS_ADRP,       // adrp xd, sym
+    INS_LDR,        // ldr wd, [xa, sym]         sym is the lo12 operand
+    INS_STR,        // str wb, [xa, sym]
+    INS_MOV,        // mov wd, wa / mov xd, xa
+    INS_MOVI,       // mov wd, #imm / mov xd, #imm
+    INS_ARITH,      // add|sub|mul|sdiv wd, wa, wb|#imm
+    INS_SUBS,       // subs wd, wa, wb|#imm, flags as well
+    INS_CMP,        // cmp wa, wb|#imm
+    INS_B,          // b sym
+    INS_BCOND,      // b.cc sym
+    INS_CBZ,        // cbz|cbnz wa, sym
+    INS_BL          // bl sym
+} InsKind;
+
+typedef struct {
+    LineKind kind;
+    Slice text;         // as written, without the newline
+    InsKind ins;
+    Slice op;
+    bool wide;          // x registers
+    int d, a, b;        // register numbers, -1 for none
+    bool has_imm;       // b is the immediate instead
+    int64_t imm;
+    Slice sym;
+    int target;         // branches: the label's line, -1 outside the function
+    bool changed;       // written back out from the fields
+    bool deleted;
+} Line;
+
+#define ALL_REGS 0x7fffffffu
+
+/* ---- parsing ---- */
+
+static Slice trim(const char *p, const char *end) {
+    while (p < end && isspace((unsigned char)*p)) p++;
+    while (end > p && isspace((unsigned char)end[-1])) end--;
+    Slice s = { p, (int)(end - p) };
+    return s;
+}
+
+static bool is(Slice s, const char *word) {
+    return (size_t)s.len == strlen(word) && memcmp(s.p, word, s.len) == 0;
+}
+
+static bool same(Slice a, Slice b) {
+    return a.len == b.len && memcmp(a.p, b.p, a.len) == 0;
+}
+
+// w0..w30 / x0..x30; sp and the zero registers are not tracked
+static bool parse_reg(Slice s, int *num, bool *wide) {
+    if (s.len < 2 || s.len > 3 || (s.p[0] != 'w' && s.p[0] != 'x')) return false;
+    int n = 0;
+    for (int i = 1; i < s.len; i++) {
+        if (!isdigit((unsigned char)s.p[i])) return false;
+        n = n * 10 + (s.p[i] - '0');
+    }
+    if (n > 30 || (s.len == 3 && s.p[1] == '0')) return false;
+    *num = n;
+    *wide = s.p[0] == 'x';
+    return true;
+}
+
+// "#-12" or "12", decimal
+static bool parse_imm(Slice s, int64_t *v) {
+    const char *p = s.p, *end = s.p + s.len;
+    if (p < end && *p == '#') p++;
+    bool neg = p < end && *p == '-';
+    if (neg) p++;
+    if (p == end || end - p > 12) return false;
+    int64_t n = 0;
+    for (; p < end; p++) {
+        if (!isdigit((unsigned char)*p)) return false;
+        n = n * 10 + (*p - '0');
+    }
+    *v = neg ? -n : n;
+    return true;
+}
+
+// "[xa, sym]" with a symbolic offset, :lo12:sym or sym@PAGEOFF, or
+// "[xa, #off]" into the variable block
+static bool parse_address(Slice s, int *base, Slice *sym) {
+    bool wide;
+    if (s.len < 5 || s.p[0] != '[' || s.p[s.len - 1] != ']') return false;
+    const char *comma = memchr(s.p, ',', s.len);
+    if (!comma) return false;
+    Slice reg = trim(s.p + 1, comma);
+    *sym = trim(comma + 1, s.p + s.len - 1);
+    if (!parse_reg(reg, base, &wide) || !wide || sym->len == 0) return false;
+    int64_t off;
+    if (sym->p[0] == '#') return parse_imm(*sym, &off) && off >= 0;
+    return sym->p[0] == ':' || isalpha((unsigned char)sym->p[0]) || sym->p[0] == '_';
+}
+
+// up to three comma-separated operands, a [...] counting as one
+static int split_operands(Slice s, Slice *ops) {
+    int n = 0;
+    const char *p = s.p, *end = s.p + s.len;
+    while (p < end && n < 3) {
+        const char *q = p;
+        int depth = 0;
+        while (q < end && (depth || *q != ',')) {
+            if (*q == '[') depth++;
+            if (*q == ']') depth--;
+            q++;
+        }
+        ops[n++] = trim(p, q);
+        p = q < end ? q + 1 : q;
+    }
+    return p < end ? -1 : n;
+}
+
+// w register operand of a 32-bit instruction
+static bool wreg(Slice s, int *num) {
+    bool wide;
+    return parse_reg(s, num, &wide) && !wide;
+}
+
+// a branch target in this function's text or another's; "1b" / "3f"
+// go to the print routine's numbered labels, which are not followed
+static bool branch_target(Slice s) {
+    return s.len > 0 && !isdigit((unsigned char)s.p[0]);
+}
+
+static bool parse_insn(Line *l, Slice op, Slice rest) {
+    Slice ops[3];
+    int n = split_operands(rest, ops);
+    bool wide;
+    l->op = op;
+    l->d = l->a = l->b = -1;
+
+    if (is(op, "adrp") && n == 2) {
+        l->ins = INS_ADRP;
+        l->sym = ops[1];
+        return parse_reg(ops[0], &l->d, &wide) && wide;
+    }
+    if ((is(op, "ldr") || is(op, "str")) && n == 2) {
+        bool load = op.p[0] == 'l';
+        l->ins = load ? INS_LDR : INS_STR;
+        if (!wreg(ops[0], load ? &l->d : &l->b)) return false;
+        return parse_address(ops[1], &l->a, &l->sym);
+    }
+    if (is(op, "mov") && n == 2) {
+        if (!parse_reg(ops[0], &l->d, &l->wide)) return false;
+        bool src_wide;
+        if (parse_reg(ops[1], &l->a, &src_wide)) {
+            l->ins = INS_MOV;
+            return src_wide == l->wide;
+        }
+        l->ins = INS_MOVI;
+        l->has_imm = true;
+        return parse_imm(ops[1], &l->imm);
+    }
+    if ((is(op, "add") || is(op, "sub") || is(op, "subs") || is(op, "mul") || is(op, "sdiv")) && n == 3) {
+        l->ins = is(op, "subs") ? INS_SUBS : INS_ARITH;
+        if (!wreg(ops[0], &l->d) || !wreg(ops[1], &l->a)) return false;
+        if (wreg(ops[2], &l->b)) return true;
+        l->has_imm = true;
+        return (is(op, "add") || is(op, "sub") || is(op, "subs")) && parse_imm(ops[2], &l->imm)
+               && l->imm >= 0 && l->imm <= 4095;
+    }
+    if (is(op, "cmp") && n == 2) {
+        l->ins = INS_CMP;
+        if (!wreg(ops[0], &l->a)) return false;
+        if (wreg(ops[1], &l->b)) return true;
+        l->has_imm = true;
+        return parse_imm(ops[1], &l->imm) && l->imm >= 0 && l->imm <= 4095;
+    }
+    if (is(op, "b") && n == 1) {
+        l->ins = INS_B;
+        l->sym = ops[0];
+        return branch_target(l->sym);
+    }
+    if (op.len > 2 && op.p[0] == 'b' && op.p[1] == '.' && n == 1) {
+        l->ins = INS_BCOND;
+        l->sym = ops[0];
+        return branch_target(l->sym);
+    }
+    if ((is(op, "cbz") || is(op, "cbnz")) && n == 2) {
+        l->ins = INS_CBZ;
+        l->sym = ops[1];
+        return parse_reg(ops[0], &l->a, &wide) && branch_target(l->sym);
+    }
+    if (is(op, "bl") && n == 1) {
+        l->ins = INS_BL;
+        l->sym = ops[0];
+        return true;
+    }
+    return false;
+}
+
+static void parse_line(Line *l, const char *p, const char *end) {
+    memset(l, 0, sizeof(*l));
+    l->target = -1;
+    if (p < end && *p == PEEPHOLE_OPAQUE) {
+        l->kind = LINE_OPAQUE;
+        l->text.p = p + 1;
+        l->text.len = (int)(end - p - 1);
+        return;
+    }
+    l->text.p = p;
+    l->text.len = (int)(end - p);
+
+    Slice s = trim(p, end);
+    if (s.len == 0 || s.p[0] == '.' || (s.len >= 2 && s.p[0] == '/' && s.p[1] == '/')) {
+        l->kind = LINE_NOTE;
+        return;
+    }
+
+    const char *q = s.p, *send = s.p + s.len;
+    while (q < send && !isspace((unsigned char)*q)) q++;
+    Slice word = { s.p, (int)(q - s.p) };
+    if (word.p[word.len - 1] == ':') {
+        // "name:" alone is a label, "1: udiv ..." is more than we follow
+        l->kind = q == send ? LINE_LABEL : LINE_OPAQUE;
+        l->sym.p = word.p;
+        l->sym.len = word.len - 1;
+        return;
+    }
+    l->kind = parse_insn(l, word, trim(q, send)) ? LINE_INSN : LINE_OPAQUE;
+}
+
+/* ---- labels ---- */
+
+typedef struct {
+    int *slots;         // line + 1, open addressing
+    size_t cap;
+} LabelTable;
+
+static uint32_t hash(Slice s) {
+    uint32_t h = 2166136261u;
+    for (int i = 0; i < s.len; i++) h = (h ^ (unsigned char)s.p[i]) * 16777619u;
+    return h;
+}
+
+static void labels_build(LabelTable *t, const Line *lines, int n) {
+    int count = 0;
+    for (int i = 0; i < n; i++) count += lines[i].kind == LINE_LABEL;
+    t->cap = 16;
+    while (t->cap < (size_t)count * 2 + 1) t->cap *= 2;
+    t->slots = xcalloc(t->cap, sizeof(int));
+    for (int i = 0; i < n; i++) {
+        if (lines[i].kind != LINE_LABEL) continue;
+        size_t h = hash(lines[i].sym) & (t->cap - 1);
+        while (t->slots[h]) h = (h + 1) & (t->cap - 1);
+        t->slots[h] = i + 1;
+    }
+}
+
+static int labels_find(const LabelTable *t, const Line *lines, Slice name) {
+    size_t h = hash(name) & (t->cap - 1);
+    for (; t->slots[h]; h = (h + 1) & (t->cap - 1))
+        if (same(lines[t->slots[h] - 1].sym, name)) return t->slots[h] - 1;
+    return -1;
+}
+
+/* ---- forward: what each register holds ----
+   Within a straight run of instructions: the page an adrp put in a
+   register, the constant a mov put in a w register, and which register
+   holds a variable's value since it was last stored or loaded. Labels
+   and lines it does not follow end the run. A variable is its lo12
+   operand, which names it whatever page x9 holds, or its offset from
+   the block's base while that register stays put. */
+
+#define MAX_KNOWN 16
+
+typedef struct {
+    Slice page[31];     // len 0: unknown
+    bool has_const[31];
+    uint32_t value[31];
+    Slice var[MAX_KNOWN];
+    int var_base[MAX_KNOWN];    // register an offset is from, -1 for a symbol
+    int var_reg[MAX_KNOWN];
+    int nvars;
+} Known;
+
+static void forget_all(Known *k) {
+    memset(k, 0, sizeof(*k));
+}
+
+// register r is about to be written
+static void clobber(Known *k, int r) {
+    k->page[r].len = 0;
+    k->has_const[r] = false;
+    for (int i = 0; i < k->nvars; i++)
+        if (k->var_reg[i] == r || k->var_base[i] == r) {
+            k->nvars--;
+            k->var[i] = k->var[k->nvars];
+            k->var_base[i] = k->var_base[k->nvars];
+            k->var_reg[i] = k->var_reg[k->nvars];
+            i--;
+        }
+}
+
+// the register an ldr/str's offset is from, -1 when it is a symbol
+static int address_base(const Line *l) {
+    return l->sym.p[0] == '#' ? l->a : -1;
+}
+
+static int var_find(const Known *k, const Line *l) {
+    for (int i = 0; i < k->nvars; i++)
+        if (same(k->var[i], l->sym) && k->var_base[i] == address_base(l)) return i;
+    return -1;
+}
+
+static void var_set(Known *k, const Line *l, int r) {
+    int i = var_find(k, l);
+    if (i < 0) {
+        if (k->nvars == MAX_KNOWN) {
+            // the oldest goes
+            memmove(&k->var[0], &k->var[1], (MAX_KNOWN - 1) * sizeof(Slice));
+            memmove(&k->var_base[0], &k->var_base[1], (MAX_KNOWN - 1) * sizeof(int));
+            memmove(&k->var_reg[0], &k->var_reg[1], (MAX_KNOWN - 1) * sizeof(int));
+            k->nvars--;
+        }
+        i = k->nvars++;
+        k->var[i] = l->sym;
+        k->var_base[i] = address_base(l);
+    }
+    k->var_reg[i] = r;
+}
+
+// a mov of v to a w register the integrated assembler can encode
+// (movz or movn, one 16-bit half)
+static bool mov_encodable(uint32_t v) {
+    return !(v & 0xffff0000u) || !(v & 0xffffu) || !(~v & 0xffff0000u) || !(~v & 0xffffu);
+}
+
+// wrapping 32-bit arithmetic, sdiv as arm64 does it: x / 0 is 0,
+// INT_MIN / -1 is INT_MIN
+static uint32_t fold(Slice op, uint32_t a, uint32_t b) {
+    if (is(op, "add")) return a + b;
+    if (is(op, "sub")) return a - b;
+    if (is(op, "mul")) return a * b;
+    if (b == 0) return 0;
+    if (b == 0xffffffffu) return 0u - a;
+    return (uint32_t)((int32_t)a / (int32_t)b);
+}
+
+// l sets its w register to v, which is known: it becomes "mov wd, #v",
+// or goes when the register holds v already
+static void becomes_const(Known *k, Line *l, uint32_t v) {
+    if (k->has_const[l->d] && k->value[l->d] == v) {
+        l->deleted = true;
+        return;
+    }
+    l->ins = INS_MOVI;
+    l->op = (Slice){ "mov", 3 };
+    l->wide = false;
+    l->has_imm = true;
+    l->imm = (int32_t)v;
+    l->a = l->b = -1;
+    l->changed = true;
+    clobber(k, l->d);
+    k->has_const[l->d] = true;
+    k->value[l->d] = v;
+}
+
+static void forward(Line *lines, int n) {
+    Known k;
+    forget_all(&k);
+    for (int i = 0; i < n; i++) {
+        Line *l = &lines[i];
+        if (l->kind == LINE_NOTE) continue;
+        if (l->kind != LINE_INSN) {
+            forget_all(&k);
+            continue;
+        }
+
+        switch (l->ins) {
+            case INS_ADRP:
+                if (same(k.page[l->d], l->sym)) {
+                    l->deleted = true;
+                    break;
+                }
+                clobber(&k, l->d);
+                k.page[l->d] = l->sym;
+                break;
+
+            case INS_LDR: {
+                int v = var_find(&k, l);
+                if (v < 0) {
+                    clobber(&k, l->d);
+                    var_set(&k, l, l->d);
+                    break;
+                }
+                int src = k.var_reg[v];
+                if (src == l->d) {
+                    l->deleted = true;
+                    break;
+                }
+                if (k.has_const[src]) {
+                    becomes_const(&k, l, k.value[src]);
+                    break;
+                }
+                // the value is in src already
+                l->ins = INS_MOV;
+                l->op = (Slice){ "mov", 3 };
+                l->a = src;
+                l->changed = true;
+                clobber(&k, l->d);
+                break;
+            }
+
+            case INS_STR:
+                var_set(&k, l, l->b);
+                break;
+
+            case INS_MOVI: {
+                bool fits = !l->wide && l->imm >= INT32_MIN && l->imm <= (int64_t)UINT32_MAX;
+                if (fits && k.has_const[l->d] && k.value[l->d] == (uint32_t)l->imm) {
+                    // it holds that already
+                    l->deleted = true;
+                    break;
+                }
+                clobber(&k, l->d);
+                if (fits) {
+                    k.has_const[l->d] = true;
+                    k.value[l->d] = (uint32_t)l->imm;
+                }
+                break;
+            }
+
+            case INS_MOV:
+                if (!l->wide && k.has_const[l->a]) {
+                    // mov w0, #5 / mov w3, w0: the constant goes to w3 itself
+                    becomes_const(&k, l, k.value[l->a]);
+                    break;
+                }
+                clobber(&k, l->d);
+                break;
+
+            case INS_ARITH: {
+                bool ca = k.has_const[l->a];
+                bool cb = l->has_imm || k.has_const[l->b];
+                uint32_t va = k.value[l->a], vb = l->has_imm ? (uint32_t)l->imm : k.value[l->b];
+                if (ca && cb && mov_encodable(fold(l->op, va, vb))) {
+                    becomes_const(&k, l, fold(l->op, va, vb));
+                    break;
+                }
+                bool add_sub = is(l->op, "add") || is(l->op, "sub");
+                if (add_sub && !l->has_imm && cb && vb <= 4095) {
+                    l->has_imm = true;
+                    l->imm = vb;
+                    l->b = -1;
+                    l->changed = true;
+                } else if (is(l->op, "add") && !l->has_imm && ca && va <= 4095) {
+                    l->a = l->b;
+                    l->has_imm = true;
+                    l->imm = va;
+                    l->b = -1;
+                    l->changed = true;
+                }
+                clobber(&k, l->d);
+                break;
+            }
+
+            case INS_CMP:
+                if (!l->has_imm && k.has_const[l->b] && k.value[l->b] <= 4095) {
+                    l->has_imm = true;
+                    l->imm = k.value[l->b];
+                    l->b = -1;
+                    l->changed = true;
+                }
+                break;
+
+            case INS_SUBS:
+                clobber(&k, l->d);
+                break;
+
+            case INS_CBZ:
+                if (k.has_const[l->a]) {
+                    // a loop's zero-trip test on a constant count
+                    if ((k.value[l->a] == 0) != is(l->op, "cbz")) {
+                        l->deleted = true;
+                        break;
+                    }
+                    l->ins = INS_B;
+                    l->op = (Slice){ "b", 1 };
+                    l->a = -1;
+                    l->changed = true;
+                    forget_all(&k);
+                }
+                break;
+
+            case INS_BCOND:
+                break;
+
+            case INS_B:
+            case INS_BL:
+                forget_all(&k);
+                break;
+        }
+    }
+}
+
+/* ---- backward: dead results ----
+   Liveness over the function's own control flow: fall-through, and
+   branches to labels in the function. A bl, a branch out of it and the
+   end (falling into the next function) need exit_live; a line it does not
+   follow needs everything. An instruction that only sets a register
+   nothing reads afterwards goes. */
+
+static uint32_t bit(int r) {
+    return r >= 0 ? 1u << r : 0;
+}
+
+static uint32_t uses(const Line *l) {
+    switch (l->ins) {
+        case INS_LDR: return bit(l->a);
+        case INS_STR: return bit(l->a) | bit(l->b);
+        case INS_MOV: return bit(l->a);
+        case INS_ARITH:
+        case INS_SUBS:
+        case INS_CMP: return bit(l->a) | (l->has_imm ? 0 : bit(l->b));
+        case INS_CBZ: return bit(l->a);
+        default: return 0;
+    }
+}
+
+// no effect but the register it sets
+static bool pure(const Line *l) {
+    return l->kind == LINE_INSN && (l->ins == INS_ADRP || l->ins == INS_LDR || l->ins == INS_MOV
+                                    || l->ins == INS_MOVI || l->ins == INS_ARITH);
+}
+
+static bool falls_through(const Line *l) {
+    return !(l->kind == LINE_INSN && !l->deleted && (l->ins == INS_B || l->ins == INS_BL));
+}
+
+// one round: liveness to a fixed point, then delete what is dead;
+// true when something was
+static bool sweep(Line *lines, int n, uint32_t exit_live, uint32_t *live_in) {
+    for (int i = 0; i < n; i++) live_in[i] = 0;
+    for (bool changed = true; changed;) {
+        changed = false;
+        for (int i = n - 1; i >= 0; i--) {
+            const Line *l = &lines[i];
+            uint32_t in;
+            if (l->kind == LINE_OPAQUE) {
+                in = ALL_REGS;
+            } else {
+                uint32_t out = 0;
+                if (falls_through(l)) out |= i + 1 < n ? live_in[i + 1] : exit_live;
+                if (l->kind == LINE_INSN && !l->deleted) {
+                    if (l->ins == INS_B || l->ins == INS_BCOND || l->ins == INS_CBZ)
+                        out |= l->target >= 0 ? live_in[l->target] : exit_live;
+                    if (l->ins == INS_BL) out = exit_live;
+                }
+                in = out;
+                if (l->kind == LINE_INSN && !l->deleted) {
+                    in &= ~bit(l->d);
+                    in |= uses(l);
+                }
+            }
+            if (in != live_in[i]) {
+                live_in[i] = in;
+                changed = true;
+            }
+        }
+    }
+
+    bool any = false;
+    for (int i = 0; i < n; i++) {
+        Line *l = &lines[i];
+        if (l->deleted || !pure(l)) continue;
+        uint32_t out = i + 1 < n ? live_in[i + 1] : exit_live;
+        if (!(out & bit(l->d))) {
+            l->deleted = true;
+            any = true;
+        }
+    }
+    return any;
+}
+
+/* ---- output ---- */
+
+static void emit_reg(Emitter *out, bool wide, int r) {
+    emit_char(out, wide ? 'x' : 'w');
+    emit_int(out, r);
+}
+
+static void emit_line(Emitter *out, const Line *l) {
+    if (!l->changed) {
+        emit_textn(out, l->text.p, l->text.len);
+        emit_char(out, '\n');
+        return;
+    }
+    emit_textn(out, "    ", 4);
+    emit_textn(out, l->op.p, l->op.len);
+    emit_char(out, ' ');
+    if (l->ins == INS_B) {
+        emit_textn(out, l->sym.p, l->sym.len);
+        emit_char(out, '\n');
+        return;
+    }
+    if (l->d >= 0) {
+        emit_reg(out, l->wide, l->d);
+        emit_textn(out, ", ", 2);
+    }
+    if (l->a >= 0) {
+        emit_reg(out, l->wide, l->a);
+        if (l->b >= 0 || (l->has_imm && l->ins != INS_MOVI)) emit_textn(out, ", ", 2);
+    }
+    if (l->b >= 0) emit_reg(out, l->wide, l->b);
+    else if (l->has_imm) emit_imm(out, l->imm);
+    emit_char(out, '\n');
+}
+
+void peephole_arm64(const char *text, size_t len, uint32_t exit_live, Emitter *out) {
+    int n = 0, cap = 256;
+    Line *lines = xmalloc((size_t)cap * sizeof(Line));
+    for (const char *p = text, *end = text + len; p < end;) {
+        const char *nl = memchr(p, '\n', (size_t)(end - p));
+        if (!nl) nl = end;
+        if (n == cap) {
+            cap *= 2;
+            lines = xrealloc(lines, (size_t)cap * sizeof(Line));
+        }
+        parse_line(&lines[n++], p, nl);
+        p = nl + 1;
+    }
+
+    LabelTable labels;
+    labels_build(&labels, lines, n);
+    for (int i = 0; i < n; i++) {
+        Line *l = &lines[i];
+        if (l->kind == LINE_INSN && (l->ins == INS_B || l->ins == INS_BCOND || l->ins == INS_CBZ))
+            l->target = labels_find(&labels, lines, l->sym);
+    }
+    xfree(labels.slots);
+
+    forward(lines, n);
+    uint32_t *live_in = xmalloc(((size_t)n + 1) * sizeof(uint32_t));
+    while (sweep(lines, n, exit_live, live_in)) {}
+    xfree(live_in);
+
+    for (int i = 0; i < n; i++)
+        if (!lines[i].deleted) emit_line(out, &lines[i]);
+    xfree(lines);
+}
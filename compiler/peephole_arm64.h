@@ -0,0 +1,30 @@
+#ifndef PEEPHOLE_ARM64_H
+#define PEEPHOLE_ARM64_H
+
+#include <stddef.h>
+#include <stdint.h>
+#include <stdbool.h>
+
+#include "emit.h"
+
+// The arm64 backend writes each statement on its own, so its text
+// reloads what the statement before just stored, repeats adrp for a page
+// x9 already holds and moves constants through w0/w1. This pass goes
+// over one function's text and:
+//   - drops an adrp of the page the register still holds
+//   - forwards a stored or loaded variable to the next load of it
+//   - folds constants into moves, add/sub/cmp immediates and arithmetic
+//   - settles a cbz/cbnz on a known constant, a loop's zero-trip test
+//   - deletes instructions whose result nothing reads
+// What is known is forgotten at every label and at any line it does not
+// recognize, and such a line is assumed to read every register. A line
+// starting with PEEPHOLE_OPAQUE (a raw line from the source) is treated
+// that way whatever it says, and copied out without the marker.
+//
+// exit_live: the registers (bit n for wn/xn) code after the function may
+// read, at a bl or falling through into the next one.
+#define PEEPHOLE_OPAQUE '\001'
+
+void peephole_arm64(const char *text, size_t len, uint32_t exit_live, Emitter *out);
+
+#endif // PEEPHOLE_ARM64_H
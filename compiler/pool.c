@@ -0,0 +1,64 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdatomic.h>
+#include <pthread.h>
+#include <unistd.h>
+
+#include "pool.h"
+#include "mem.h"
+
+typedef struct {
+    PoolFn fn;
+    void *ctx;
+    int count;
+    atomic_int next;    // next task to hand out
+} Pool;
+
+typedef struct {
+    Pool *pool;
+    int id;
+} Worker;
+
+static void *worker_main(void *arg) {
+    Worker *w = arg;
+    Pool *pool = w->pool;
+    for (;;) {
+        int task = atomic_fetch_add(&pool->next, 1);
+        if (task >= pool->count) break;
+        pool->fn(pool->ctx, task, w->id);
+    }
+    return NULL;
+}
+
+void pool_run(int jobs, int count, PoolFn fn, void *ctx) {
+    if (jobs > count) jobs = count;
+
+    // nothing to share out, stay on this thread
+    if (jobs <= 1) {
+        for (int i = 0; i < count; i++) fn(ctx, i, 0);
+        return;
+    }
+
+    Pool pool = { fn, ctx, count, 0 };
+    Worker *workers = xmalloc(jobs * sizeof(Worker));
+    pthread_t *threads = xmalloc(jobs * sizeof(pthread_t));
+
+    for (int i = 0; i < jobs; i++) {
+        workers[i].pool = &pool;
+        workers[i].id = i;
+        if (pthread_create(&threads[i], NULL, worker_main, &workers[i]) != 0) {
+            fprintf(stderr, "Could not start worker thread\n");
+            exit(1);
+        }
+    }
+    for (int i = 0; i < jobs; i++)
+        pthread_join(threads[i], NULL);
+
+    xfree(threads);
+    xfree(workers);
+}
+
+int pool_default_jobs(void) {
+    long n = sysconf(_SC_NPROCESSORS_ONLN);
+    return n > 0 ? (int)n : 1;
+}
@@ -0,0 +1,14 @@
+#ifndef POOL_H
+#define POOL_H
+
+// Runs fn(ctx, task, worker) for every task in 0..count-1 on up to jobs
+// threads and returns when all of them are done. Tasks are handed out
+// in order; worker is 0..jobs-1 and says whose buffers to use.
+typedef void (*PoolFn)(void *ctx, int task, int worker);
+
+void pool_run(int jobs, int count, PoolFn fn, void *ctx);
+
+// how many workers to use when the user does not say (-j)
+int pool_default_jobs(void);
+
+#endif // POOL_H
@@ -1,5 +1,5 @@
-clang compiler.c errors.c -o compiler
-clang transpiler.c -o transpiler
+clang compiler.c source.c lexer.c parser.c codegen.c codegen_arm64.c codegen_x86_64.c codegen_c.c codegen_llvm.c ir.c ir_pass.c peephole_arm64.c encode_arm64.c encode_x86_64.c object.c bytecode.c nbc.c interp.c jit.c target.c emit.c symtab.c arena.c transpiler.c errors.c mem.c timing.c pool.c -o compiler
+clang -DTRANSPILER_STANDALONE transpiler.c source.c emit.c mem.c -o transpiler
 ./compiler test.n out.s
 clang out.s -o test
-./test
\ No newline at end of file
+./test
@@ -0,0 +1,64 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+#include "source.h"
+#include "mem.h"
+
+// read everything from fd, for pipes and anything else we cannot map
+static bool read_all(int fd, SourceFile *out) {
+    size_t cap = 64 * 1024, len = 0;
+    char *buf = xmalloc(cap);
+
+    for (;;) {
+        if (len == cap) {
+            cap *= 2;
+            buf = xrealloc(buf, cap);
+        }
+        ssize_t n = read(fd, buf + len, cap - len);
+        if (n < 0) {
+            xfree(buf);
+            return false;
+        }
+        if (n == 0) break;
+        len += (size_t)n;
+    }
+
+    out->data = buf;
+    out->len = len;
+    out->mapped = false;
+    return true;
+}
+
+bool load_source(const char *path, SourceFile *out) {
+    int fd = strcmp(path, "-") == 0 ? STDIN_FILENO : open(path, O_RDONLY);
+    if (fd < 0) return false;
+
+    struct stat st;
+    bool ok;
+    if (fstat(fd, &st) == 0 && S_ISREG(st.st_mode) && st.st_size > 0) {
+        void *p = mmap(NULL, (size_t)st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+        ok = p != MAP_FAILED;
+        if (ok) {
+            out->data = p;
+            out->len = (size_t)st.st_size;
+            out->mapped = true;
+        }
+    } else {
+        ok = read_all(fd, out);
+    }
+
+    if (fd != STDIN_FILENO) close(fd);
+    return ok;
+}
+
+void free_source(SourceFile *src) {
+    if (src->mapped) munmap((void *)src->data, src->len);
+    else xfree((void *)src->data);
+    src->data = NULL;
+    src->len = 0;
+}
@@ -0,0 +1,19 @@
+#ifndef SOURCE_H
+#define SOURCE_H
+
+#include <stddef.h>
+#include <stdbool.h>
+
+// A whole input file in memory. Regular files are mmapped read-only,
+// pipes and other streams are read in one go. Never NUL-terminated.
+typedef struct {
+    const char *data;
+    size_t len;
+    bool mapped;
+} SourceFile;
+
+// path "-" reads stdin
+bool load_source(const char *path, SourceFile *out);
+void free_source(SourceFile *src);
+
+#endif // SOURCE_H
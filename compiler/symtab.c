@@ -0,0 +1,60 @@
+#include <stdint.h>
+#include <stdlib.h>
+
+#include "symtab.h"
+
+static unsigned hash_ptr(const char *name, unsigned cap) {
+    uint64_t h = (uint64_t)(uintptr_t)name * 0x9E3779B97F4A7C15ull;
+    return (unsigned)(h >> 32) & (cap - 1);
+}
+
+Scope *scope_push(Arena *a, Scope *parent) {
+    Scope *s = ARENA_NEW(a, Scope);
+    s->parent = parent;
+    s->cap = 16;
+    s->slots = arena_alloc(a, s->cap * sizeof(ScopeSlot));
+    return s;
+}
+
+Symbol *scope_find_local(const Scope *s, const char *name) {
+    unsigned i = hash_ptr(name, s->cap);
+    while (s->slots[i].name) {
+        if (s->slots[i].name == name) return s->slots[i].sym;
+        i = (i + 1) & (s->cap - 1);
+    }
+    return NULL;
+}
+
+Symbol *scope_find(const Scope *s, const char *name) {
+    for (; s; s = s->parent) {
+        Symbol *sym = scope_find_local(s, name);
+        if (sym) return sym;
+    }
+    return NULL;
+}
+
+static void insert_slot(ScopeSlot *slots, unsigned cap, Symbol *sym) {
+    unsigned i = hash_ptr(sym->name, cap);
+    while (slots[i].name) i = (i + 1) & (cap - 1);
+    slots[i].name = sym->name;
+    slots[i].sym = sym;
+}
+
+Symbol *scope_add(Arena *a, Scope *s, const char *name) {
+    // keep the load factor under 1/2
+    if ((s->count + 1) * 2 > s->cap) {
+        unsigned cap = s->cap * 2;
+        ScopeSlot *slots = arena_alloc(a, cap * sizeof(ScopeSlot));
+        for (unsigned i = 0; i < s->cap; i++)
+            if (s->slots[i].name) insert_slot(slots, cap, s->slots[i].sym);
+        s->slots = slots;
+        s->cap = cap;
+    }
+
+    Symbol *sym = ARENA_NEW(a, Symbol);
+    sym->name = name;
+    sym->label = name;
+    insert_slot(s->slots, s->cap, sym);
+    s->count++;
+    return sym;
+}
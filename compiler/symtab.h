@@ -0,0 +1,38 @@
+#ifndef SYMTAB_H
+#define SYMTAB_H
+
+#include "arena.h"
+
+// Names are interned (see intern() in lexer.h), so lookups compare pointers.
+
+typedef struct Symbol Symbol;
+struct Symbol {
+    const char *name;
+    const char *label;  // assembly label the value lives at
+    Symbol *next;       // definition order, used when emitting .data
+};
+
+// the name sits next to the pointer so a probe never has to touch the Symbol
+typedef struct {
+    const char *name;
+    Symbol *sym;
+} ScopeSlot;
+
+typedef struct Scope Scope;
+struct Scope {
+    Scope *parent;
+    ScopeSlot *slots;   // open addressing, power of two size
+    unsigned cap;
+    unsigned count;
+};
+
+Scope *scope_push(Arena *a, Scope *parent);
+
+// look in this scope only / in this scope and then its parents
+Symbol *scope_find_local(const Scope *s, const char *name);
+Symbol *scope_find(const Scope *s, const char *name);
+
+// add a new symbol, the caller makes sure it is not there yet
+Symbol *scope_add(Arena *a, Scope *s, const char *name);
+
+#endif // SYMTAB_H
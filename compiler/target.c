@@ -0,0 +1,148 @@
+#include <string.h>
+
+#include "target.h"
+#include "codegen_arm64.h"
+#include "codegen_x86_64.h"
+#include "codegen_c.h"
+#include "codegen_llvm.h"
+#include "ir.h"
+
+/* ---- register files ---- */
+
+static const RegisterFile regs_arm64 = {
+    .count = 31,
+    .storage = NULL,
+    .acc = "w0",
+    .tmp = "w1",
+    .addr = "x9",
+    .arg_prefix = "w",
+};
+
+// no w0..w30 on x86, they get 8-byte slots in .bss with wN the low half
+static const RegisterFile regs_x86_64 = {
+    .count = 31,
+    .storage = ".Lnevo_regs",
+    .acc = "%eax",
+    .tmp = "%ecx",
+    .addr = "%rcx",
+    .arg_prefix = "w",
+};
+
+/* ---- object formats ---- */
+
+static const ObjectFormat macho = {
+    .name = "mach-o",
+    .text = ".text\n",
+    .data = ".data\n",
+    .page_prefix = "",
+    .page_suffix = "@PAGE",
+    .lo12_prefix = "",
+    .lo12_suffix = "@PAGEOFF",
+    .stack_note = "",
+    .write_object = obj_write_macho,
+};
+
+static const ObjectFormat elf = {
+    .name = "elf",
+    .text = ".text\n",
+    .data = ".data\n",
+    .page_prefix = "",
+    .page_suffix = "",
+    .lo12_prefix = ":lo12:",
+    .lo12_suffix = "",
+    .stack_note = ".section .note.GNU-stack,\"\",@progbits\n",
+    .write_object = obj_write_elf,
+};
+
+// C or LLVM IR has no sections or relocations, its compiler lays it out
+static const ObjectFormat source = {
+    .name = "source",
+    .text = "",
+    .data = "",
+    .page_prefix = "",
+    .page_suffix = "",
+    .lo12_prefix = "",
+    .lo12_suffix = "",
+    .stack_note = "",
+    .write_object = NULL,
+};
+
+/* ---- OS ABIs ---- */
+
+// the program brings its own entry point and makes syscalls directly
+static const char *const static_no_crt[] = { "-nostdlib", "-static", NULL };
+static const char *const no_flags[] = { NULL };
+
+static const OsAbi darwin_arm64 = {
+    .name = "darwin",
+    .sys_reg = "x16",
+    .sys_write = 0x2000004,
+    .sys_exit = 0x2000001,
+    .entry = NULL,
+    .link_flags = no_flags,
+};
+
+static const OsAbi linux_arm64 = {
+    .name = "linux",
+    .sys_reg = "x8",
+    .sys_write = 64,
+    .sys_exit = 93,
+    .entry = "_start",
+    .link_flags = static_no_crt,
+};
+
+static const OsAbi linux_x86_64 = {
+    .name = "linux",
+    .sys_reg = "%eax",
+    .sys_write = 1,
+    .sys_exit = 60,
+    .entry = "_start",
+    .link_flags = static_no_crt,
+};
+
+// machine code for this process, see jit.c
+static const OsAbi jit_x86_64 = {
+    .name = "jit",
+    .sys_reg = "%eax",
+    .sys_write = 1,
+    .sys_exit = 60,
+    .entry = "nevo_jit_entry",
+    .link_flags = no_flags,
+    .in_process = true,
+};
+
+// stdio from the C library, main() is the entry
+static const OsAbi hosted = {
+    .name = "hosted",
+    .sys_reg = NULL,
+    .sys_write = 0,
+    .sys_exit = 0,
+    .entry = NULL,
+    .link_flags = no_flags,
+};
+
+/* ---- targets ---- */
+
+const Target targets[] = {
+    { "arm64-macos",   &isa_arm64,  &regs_arm64,  &macho, &darwin_arm64 },
+    { "aarch64-linux", &isa_arm64,  &regs_arm64,  &elf,   &linux_arm64 },
+    { "x86_64-linux",  &isa_x86_64, &regs_x86_64, &elf,   &linux_x86_64 },
+};
+const int target_count = sizeof(targets) / sizeof(targets[0]);
+
+const Target target_jit = { "x86_64-jit", &isa_x86_64, &regs_x86_64, &elf, &jit_x86_64 };
+
+// registers are r[] or allocas in main, like the x86 .bss slots
+const Target target_c = { "c", &isa_c, &regs_x86_64, &source, &hosted };
+const Target target_llvm = { "llvm", &isa_llvm, &regs_x86_64, &source, &hosted };
+const Target target_ir = { "ir", &isa_ir, &regs_x86_64, &source, &hosted };
+
+const Target *target_find(const char *name) {
+    for (int i = 0; i < target_count; i++)
+        if (strcmp(targets[i].name, name) == 0) return &targets[i];
+    return NULL;
+}
+
+const Target *target_default(void) {
+    return &targets[0];
+}
@@ -0,0 +1,127 @@
+#ifndef TARGET_H
+#define TARGET_H
+
+#include <stdbool.h>
+
+#include "ast.h"
+#include "emit.h"
+#include "object.h"
+
+// A target is put together from four parts: the instruction selection
+// for an ISA, its register file, the object format's relocation and
+// section syntax, and the OS's syscall/runtime ABI. Backends only
+// implement instruction selection and read the rest from here, so a new
+// OS or object format for an ISA we already have is a table entry.
+
+typedef struct Target Target;
+struct IrProgram;
+
+// instruction selection, one per ISA (codegen_arm64.c, codegen_x86_64.c),
+// or a source language (codegen_c.c, codegen_llvm.c)
+typedef struct {
+    const char *name;
+    const char *align_word;     // before each 4-byte variable, ".align 2\n"
+    const char *word;           // after its label, ": .word 0\n"
+    const char *var_block;      // label of one block holding every variable,
+                                // in definition order from a cache line
+                                // boundary; NULL to place them one by one
+    // true for a variable the code only ever keeps in a register, which
+    // gets no word; asked after end, NULL when every variable has one
+    bool (*in_register)(const char *label);
+
+    // main thread, before any function: remembers t, writes the header;
+    // the program is resolved, for anything the backend works out up front
+    void (*start)(Emitter *out, const Target *t, const Program *prog);
+    // one function, called from several threads at once
+    void (*func)(Emitter *out, const Func *f);
+    // after the last function: exit, runtime routines
+    void (*end)(Emitter *out);
+
+    // integrated assembler for the text above, NULL to always use the
+    // system one; false when the text has something it cannot encode
+    bool (*assemble)(const char *text, size_t len, ObjFile *o);
+
+    // backends that write source rather than assembly (C, LLVM IR):
+    // variables and strings are declared by these, NULL for the assembler
+    // forms. They follow the code unless declare_first puts them right
+    // after start, where C needs its locals of main
+    void (*variable)(Emitter *out, const char *label);
+    void (*string)(Emitter *out, const char *label, const char *text);
+    bool declare_first;
+
+    // backends that lower from the IR (ir.h) set this instead of start,
+    // func and end: the program after the passes, written out in one go
+    void (*lower)(Emitter *out, const struct IrProgram *ir);
+} Isa;
+
+// the registers generated code works with
+typedef struct {
+    int count;                  // w0..w(count-1) / x0.. that nevo code can name
+    const char *storage;        // symbol they live at when the ISA has no such
+                                // registers, NULL for real machine registers
+    const char *acc;            // expression results
+    const char *tmp;            // second operand
+    const char *addr;           // address of a variable or memory operand
+    const char *arg_prefix;     // arguments go in arg_prefix0, arg_prefix1, ...
+} RegisterFile;
+
+// how the assembler spells sections and symbol addresses
+typedef struct {
+    const char *name;
+    const char *text;           // section directives
+    const char *data;
+    const char *page_prefix;    // page of a symbol for adrp: prefix label suffix
+    const char *page_suffix;
+    const char *lo12_prefix;    // low 12 bits of its address
+    const char *lo12_suffix;
+    const char *stack_note;     // after the code, "" when the format has none
+
+    // lays out what the integrated assembler built
+    void (*write_object)(const ObjFile *o, Emitter *out);
+} ObjectFormat;
+
+// syscalls and process startup
+typedef struct {
+    const char *name;
+    const char *sys_reg;        // syscall number goes here
+    long sys_write;
+    long sys_exit;
+    const char *entry;          // defined to jump to _main, NULL when crt calls it
+    const char *const *link_flags;  // for the final link, NULL terminated
+
+    // code for the compiler's own process (the JIT): entry is called like
+    // a C function and returns at the exit, print and exit call the
+    // nevo_rt_* routines instead of making syscalls; x86-64 only
+    bool in_process;
+} OsAbi;
+
+struct Target {
+    const char *name;
+    const Isa *isa;
+    const RegisterFile *regs;
+    const ObjectFormat *format;
+    const OsAbi *abi;
+};
+
+extern const Target targets[];
+extern const int target_count;
+
+// what `compiler run --jit` builds, not one of the targets above
+extern const Target target_jit;
+
+// --emit=c: portable C for the host's compiler
+extern const Target target_c;
+
+// --emit=llvm: textual LLVM IR for opt and llc
+extern const Target target_llvm;
+
+// --emit=ir: the IR after the passes, as text
+extern const Target target_ir;
+
+// by name, e.g. "aarch64-linux", NULL if unknown
+const Target *target_find(const char *name);
+
+// arm64-macos, what the compiler has always built for
+const Target *target_default(void);
+
+#endif // TARGET_H
@@ -0,0 +1,94 @@
+// build latency with the integrated assembler against the system one:
+// generated programs through -S (text only), straight to a .o, and to a
+// .o by way of $CC -c wherever an assembler for the target is around
+// clang -O2 run.c ../bench/gen.c -o run && ./run [--runs N]
+#include <sys/stat.h>
+
+#include "../bench/gen.h"
+
+#define WORK_DIR "/tmp/nevo-assemble"
+#include "../common.h"
+
+typedef struct {
+    const char *name;
+    const char *cc;     // assembler driver for it, NULL to use $CC on the host
+} TargetInfo;
+
+// the targets that have an integrated assembler
+static const TargetInfo targets[] = {
+    { "arm64-macos",   NULL },
+    { "aarch64-linux", "aarch64-linux-gnu-gcc" },
+};
+#define TARGET_COUNT (int)(sizeof(targets) / sizeof(targets[0]))
+
+static const size_t sizes[] = { 100u << 10, 1u << 20, 10u << 20 };
+#define SIZE_COUNT (int)(sizeof(sizes) / sizeof(sizes[0]))
+
+static long file_size(const char *path) {
+    struct stat st;
+    return stat(path, &st) == 0 ? (long)st.st_size : -1;
+}
+
+static void print_ms(double s) {
+    if (s < 0) printf(" %12s", "-");
+    else printf(" %12.1f", s * 1e3);
+}
+
+int main(int argc, char **argv) {
+    int runs = 3;
+    if (argc == 3 && strcmp(argv[1], "--runs") == 0) {
+        runs = atoi(argv[2]);
+    } else if (argc != 1) {
+        runs = 0;
+    }
+    if (runs < 1) {
+        fprintf(stderr, "Usage: %s [--runs N]\n", argv[0]);
+        return 1;
+    }
+
+    build_compiler(WORK_DIR);
+
+    printf("%-14s %9s %12s %12s %12s %12s\n", "target", "source", "-S ms", "integrated", "$CC -c ms", "object");
+    for (int s = 0; s < SIZE_COUNT; s++) {
+        char src[64];
+        snprintf(src, sizeof(src), WORK_DIR "/prog%d.n", s);
+        FILE *f = fopen(src, "w");
+        if (!f) {
+            fprintf(stderr, "Could not open %s\n", src);
+            return 1;
+        }
+        GenParams p = { 64, 16, 3, 10, GEN_ALL & ~GEN_SCOPED, sizes[s], 1 };
+        gen_program(f, &p);
+        fclose(f);
+
+        for (int t = 0; t < TARGET_COUNT; t++) {
+            const TargetInfo *ti = &targets[t];
+            char flag[64];
+            snprintf(flag, sizeof(flag), "--target=%s", ti->name);
+
+            char *text[] = { WORK_DIR "/compiler", flag, src, WORK_DIR "/out.s", NULL };
+            char *integrated[] = { WORK_DIR "/compiler", flag, src, WORK_DIR "/out.o", NULL };
+            char *external[] = { WORK_DIR "/compiler", "-fno-integrated-as", flag, src, WORK_DIR "/ext.o", NULL };
+
+            printf("%-14s %8zuK", ti->name, sizes[s] >> 10);
+            print_ms(best_of(text, "/dev/null", runs));
+            print_ms(best_of(integrated, "/dev/null", runs));
+
+            // the system assembler only when one for this target is around
+            bool native = strcmp(ti->name, HOST_TARGET) == 0;
+            double ext = -1;
+            if (native || (ti->cc && in_path(ti->cc))) {
+                char *host_cc = getenv("CC") ? strdup(getenv("CC")) : NULL;
+                if (!native) setenv("CC", ti->cc, 1);
+                ext = best_of(external, "/dev/null", runs);
+                if (host_cc) setenv("CC", host_cc, 1);
+                else unsetenv("CC");
+                free(host_cc);
+            }
+            print_ms(ext);
+            printf(" %12ld\n", file_size(WORK_DIR "/out.o"));
+            fflush(stdout);
+        }
+    }
+    return 0;
+}
@@ -0,0 +1,209 @@
+// synthetic Nevo programs for the compile-time benchmarks
+// standalone: clang -O2 -DGEN_STANDALONE gen.c -o gen
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdarg.h>
+
+#include "gen.h"
+
+typedef struct {
+    const GenParams *p;
+    FILE *out;
+    size_t bytes;
+    long lines;
+    unsigned rng;
+    int func;           // index of the function being written
+} Gen;
+
+static unsigned next_rand(Gen *g) {
+    g->rng = g->rng * 1103515245u + 12345u;
+    return (g->rng >> 16) & 0x7fff;
+}
+
+static int pick(Gen *g, int n) {
+    return (int)(next_rand(g) % (unsigned)n);
+}
+
+static void line(Gen *g, int indent, const char *fmt, ...) {
+    va_list ap;
+    int n = fprintf(g->out, "%*s", indent * 4, "");
+    va_start(ap, fmt);
+    n += vfprintf(g->out, fmt, ap);
+    va_end(ap);
+    fputc('\n', g->out);
+    g->bytes += (size_t)n + 1;
+    g->lines++;
+}
+
+static const char *func_name(int f, char *buf) {
+    if (f == 0) return "_main";
+    sprintf(buf, "_f%d", f);
+    return buf;
+}
+
+// name of one of the current function's variables
+static const char *var(Gen *g, char *buf) {
+    if ((g->p->features & GEN_SCOPED) && pick(g, 4) == 0)
+        return "$s";
+    sprintf(buf, "f%d_v%d", g->func, pick(g, g->p->vars));
+    return buf;
+}
+
+static void block(Gen *g, int indent, int depth);
+
+static void statement(Gen *g, int indent, int depth) {
+    const GenParams *p = g->p;
+    char a[32], b[32], c[32];
+
+    if (pick(g, 100) < p->print_density) {
+        int kind = pick(g, 3);
+        if (kind == 0 && (p->features & GEN_PRINT_VARS)) line(g, indent, "print(%s)", var(g, a));
+        else if (kind == 1) line(g, indent, "print(\"\\n\")");
+        else line(g, indent, "print(\"value %d\")", pick(g, 1000));
+        return;
+    }
+
+    // nested blocks and calls now and then, assignments otherwise, and a
+    // string print when the feature set has neither
+    int choice = pick(g, 10);
+    if (depth < p->depth && choice == 0 && (p->features & GEN_LOOP)) {
+        if (pick(g, 2)) line(g, indent, "loop %d {", 1 + pick(g, 9));
+        else line(g, indent, "loop %s {", var(g, a));
+        block(g, indent + 1, depth + 1);
+        line(g, indent, "}");
+    } else if (depth < p->depth && choice == 1 && (p->features & GEN_IF)) {
+        static const char *const cmps[] = { "<", ">", "==", "!=", "<=", ">=" };
+        line(g, indent, "if %s %s %s {", var(g, a), cmps[pick(g, 6)], var(g, b));
+        block(g, indent + 1, depth + 1);
+        if (pick(g, 2)) {
+            line(g, indent, "} else {");
+            block(g, indent + 1, depth + 1);
+        }
+        line(g, indent, "}");
+    } else if (choice == 2 && (p->features & GEN_CALL) && p->funcs > 1) {
+        int callee = 1 + pick(g, p->funcs - 1);
+        line(g, indent, "bl %s(%s, %d)", func_name(callee, c), var(g, a), pick(g, 100));
+    } else if (p->features & GEN_ASSIGN) {
+        static const char ops[] = { '+', '-', '*' };
+        // a scoped var can be read but the assignment target stays plain
+        sprintf(c, "f%d_v%d", g->func, pick(g, p->vars));
+        line(g, indent, "%s = %s %c %d", c, var(g, a), ops[pick(g, 3)], 1 + pick(g, 50));
+    } else {
+        line(g, indent, "print(\"value %d\")", pick(g, 1000));
+    }
+}
+
+static void block(Gen *g, int indent, int depth) {
+    int n = 1 + pick(g, 4);
+    for (int i = 0; i < n; i++)
+        statement(g, indent, depth);
+}
+
+long gen_program(FILE *out, const GenParams *p) {
+    Gen g = { p, out, 0, 0, p->seed ? p->seed : 1, 0 };
+    int funcs = p->funcs > 0 ? p->funcs : 1;
+    size_t per_func = p->target_bytes / (size_t)funcs;
+
+    for (int f = 0; f < funcs; f++) {
+        char name[32];
+        g.func = f;
+        size_t start = g.bytes;
+
+        if (f > 0 && (p->features & GEN_CALL)) line(&g, 0, "%s(f%d_p0, f%d_p1) {", func_name(f, name), f, f);
+        else line(&g, 0, "%s() {", func_name(f, name));
+
+        for (int v = 0; v < p->vars; v++)
+            line(&g, 1, "num f%d_v%d = %d", f, v, pick(&g, 100));
+        if (p->features & GEN_SCOPED)
+            line(&g, 1, "scoped num s = %d", pick(&g, 100));
+
+        // always at least one statement, then fill this function's share
+        do {
+            statement(&g, 1, 0);
+        } while (g.bytes - start < per_func);
+
+        line(&g, 0, "}");
+    }
+    return g.lines;
+}
+
+unsigned gen_parse_features(const char *s) {
+    static const struct { const char *name; unsigned bit; } names[] = {
+        { "print-vars", GEN_PRINT_VARS },
+        { "assign",     GEN_ASSIGN },
+        { "if",         GEN_IF },
+        { "loop",       GEN_LOOP },
+        { "call",       GEN_CALL },
+        { "scoped",     GEN_SCOPED },
+        { "all",        GEN_ALL },
+        { "none",       0 },
+    };
+    unsigned bits = 0;
+    while (*s) {
+        size_t len = strcspn(s, ",");
+        size_t i;
+        for (i = 0; i < sizeof(names) / sizeof(names[0]); i++) {
+            if (strlen(names[i].name) == len && strncmp(names[i].name, s, len) == 0) {
+                bits |= names[i].bit;
+                break;
+            }
+        }
+        if (i == sizeof(names) / sizeof(names[0])) {
+            fprintf(stderr, "Unknown feature: %.*s\n", (int)len, s);
+            exit(1);
+        }
+        s += len;
+        if (*s == ',') s++;
+    }
+    return bits;
+}
+
+#ifdef GEN_STANDALONE
+static void usage(const char *prog) {
+    fprintf(stderr,
+            "Usage: %s [options] <output.n>\n"
+            "  --size BYTES        approximate program size (default 1048576)\n"
+            "  --funcs N           functions, _main included (default 8)\n"
+            "  --vars N            variables per function (default 8)\n"
+            "  --depth N           deepest loop/if nesting (default 3)\n"
+            "  --print-density P   percent of statements that print (default 20)\n"
+            "  --features LIST     print-vars,assign,if,loop,call,scoped (default all)\n"
+            "  --seed N\n", prog);
+}
+
+int main(int argc, char **argv) {
+    GenParams p = { 8, 8, 3, 20, GEN_ALL, 1 << 20, 1 };
+    const char *path = NULL;
+
+    for (int i = 1; i < argc; i++) {
+        const char *arg = argv[i];
+        const char *val = i + 1 < argc ? argv[i + 1] : NULL;
+        if (arg[0] != '-') { path = arg; continue; }
+        if (!val) { usage(argv[0]); return 1; }
+        if (strcmp(arg, "--size") == 0) p.target_bytes = strtoull(val, NULL, 10);
+        else if (strcmp(arg, "--funcs") == 0) p.funcs = atoi(val);
+        else if (strcmp(arg, "--vars") == 0) p.vars = atoi(val);
+        else if (strcmp(arg, "--depth") == 0) p.depth = atoi(val);
+        else if (strcmp(arg, "--print-density") == 0) p.print_density = atoi(val);
+        else if (strcmp(arg, "--features") == 0) p.features = gen_parse_features(val);
+        else if (strcmp(arg, "--seed") == 0) p.seed = (unsigned)strtoul(val, NULL, 10);
+        else { usage(argv[0]); return 1; }
+        i++;
+    }
+    if (!path || p.vars < 1) {
+        usage(argv[0]);
+        return 1;
+    }
+
+    FILE *out = fopen(path, "w");
+    if (!out) {
+        fprintf(stderr, "Could not open %s\n", path);
+        return 1;
+    }
+    long lines = gen_program(out, &p);
+    fclose(out);
+    printf("%s: %ld lines\n", path, lines);
+    return 0;
+}
+#endif
@@ -0,0 +1,35 @@
+#ifndef GEN_H
+#define GEN_H
+
+#include <stdio.h>
+#include <stddef.h>
+
+// language features a generated program may use, older compilers
+// only understand some of them
+enum {
+    GEN_PRINT_VARS = 1 << 0,   // print(var), not just string literals
+    GEN_ASSIGN     = 1 << 1,   // x = a + b on declared vars
+    GEN_IF         = 1 << 2,
+    GEN_LOOP       = 1 << 3,
+    GEN_CALL       = 1 << 4,   // functions with params and bl calls
+    GEN_SCOPED     = 1 << 5,   // scoped num / $var (transpiler)
+    GEN_ALL        = (1 << 6) - 1
+};
+
+typedef struct {
+    int funcs;              // number of functions, _main included
+    int vars;               // variables declared per function
+    int depth;              // deepest loop/if nesting
+    int print_density;      // percent of statements that print
+    unsigned features;      // GEN_* bits
+    size_t target_bytes;    // stop once the program is about this big
+    unsigned seed;
+} GenParams;
+
+// Write a Nevo program to out, returns the number of lines written.
+long gen_program(FILE *out, const GenParams *p);
+
+// comma separated feature names ("print-vars,if,loop"), "all" or "none"
+unsigned gen_parse_features(const char *s);
+
+#endif // GEN_H
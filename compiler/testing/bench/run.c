@@ -0,0 +1,265 @@
+// compile-time scaling: generated programs from 1KB to 100MB through the
+// current compiler and the historical beta v1..v7 / release v1 compilers
+// clang -O2 run.c gen.c -o run && ./run [--max-size BYTES] [--timeout SECONDS] [--no-history]
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdbool.h>
+#include <time.h>
+#include <fcntl.h>
+#include <signal.h>
+#include <unistd.h>
+#include <sys/stat.h>
+#include <sys/wait.h>
+#include <sys/resource.h>
+
+#include "gen.h"
+
+#define WORK_DIR "/tmp/nevo-bench"
+
+// every compiler is run from its own directory, since release v1 writes
+// out.n next to itself and calls ./transpiler
+typedef struct {
+    const char *name;
+    const char *dir;        // sources, relative to this directory
+    bool errors_c;          // has errors.c next to compiler.c
+    bool transpiler;        // needs ./transpiler built next to it
+    unsigned features;      // what its parser understands
+} Version;
+
+static const Version history[] = {
+    { "beta v1",    "../../beta v1",    false, false, GEN_ASSIGN },
+    { "beta v2",    "../../beta v2",    false, false, GEN_ASSIGN },
+    { "beta v3",    "../../beta v3",    false, false, GEN_ASSIGN | GEN_PRINT_VARS },
+    { "beta v4",    "../../beta v4",    true,  false, GEN_ASSIGN | GEN_PRINT_VARS },
+    { "beta v5",    "../../beta v5",    true,  false, GEN_ASSIGN | GEN_PRINT_VARS | GEN_IF | GEN_CALL },
+    { "beta v6",    "../../beta v6",    true,  false, GEN_ASSIGN | GEN_PRINT_VARS | GEN_IF | GEN_CALL | GEN_LOOP },
+    { "beta v7",    "../../beta v7",    true,  true,  GEN_ASSIGN | GEN_PRINT_VARS | GEN_IF | GEN_CALL | GEN_LOOP },
+    { "release v1", "../../release v1", true,  true,  GEN_ASSIGN | GEN_PRINT_VARS | GEN_IF | GEN_CALL | GEN_LOOP },
+};
+
+typedef struct {
+    bool ok;
+    double wall;
+    double cpu;
+    size_t maxrss;      // bytes
+    size_t heap;        // peak heap from --time-report, current compiler only
+} RunResult;
+
+static double now(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+static double tv_seconds(struct timeval tv) {
+    return tv.tv_sec + tv.tv_usec / 1e6;
+}
+
+static void shell(const char *cmd) {
+    if (system(cmd) != 0) {
+        fprintf(stderr, "Failed: %s\n", cmd);
+        exit(1);
+    }
+}
+
+// run argv from dir with stdout going to out_path, killed after timeout seconds
+static RunResult run(const char *dir, char *const argv[], const char *out_path, int timeout) {
+    RunResult r = {0};
+    double start = now();
+
+    pid_t pid = fork();
+    if (pid < 0) return r;
+    if (pid == 0) {
+        int out = open(out_path, O_WRONLY | O_CREAT | O_TRUNC, 0644);
+        int null = open("/dev/null", O_WRONLY);
+        if (chdir(dir) != 0 || out < 0 || null < 0) _exit(127);
+        dup2(out, STDOUT_FILENO);
+        dup2(null, STDERR_FILENO);
+        alarm(timeout);     // survives exec, SIGALRM kills the compiler
+        execv(argv[0], argv);
+        _exit(127);
+    }
+
+    int status;
+    struct rusage ru;
+    if (wait4(pid, &status, 0, &ru) < 0) return r;
+
+    r.wall = now() - start;
+    r.cpu = tv_seconds(ru.ru_utime) + tv_seconds(ru.ru_stime);
+#ifdef __APPLE__
+    r.maxrss = (size_t)ru.ru_maxrss;
+#else
+    r.maxrss = (size_t)ru.ru_maxrss * 1024;
+#endif
+    r.ok = WIFEXITED(status) && WEXITSTATUS(status) == 0;
+    return r;
+}
+
+// total peak_bytes from the current compiler's --time-report=json
+static size_t report_heap(const char *path) {
+    FILE *f = fopen(path, "r");
+    if (!f) return 0;
+    char buf[4096];
+    size_t n = fread(buf, 1, sizeof(buf) - 1, f);
+    fclose(f);
+    buf[n] = '\0';
+
+    const char *total = strstr(buf, "\"total\"");
+    const char *peak = total ? strstr(total, "\"peak_bytes\":") : NULL;
+    return peak ? strtoull(peak + 13, NULL, 10) : 0;
+}
+
+static const char *human(size_t bytes, char *buf) {
+    if (bytes >= 1 << 20) sprintf(buf, "%zuMB", bytes >> 20);
+    else if (bytes >= 1 << 10) sprintf(buf, "%zuKB", bytes >> 10);
+    else sprintf(buf, "%zuB", bytes);
+    return buf;
+}
+
+static void print_header(void) {
+    printf("%-14s %8s %10s %10s %10s %12s %10s %12s %12s\n",
+           "compiler", "size", "lines", "wall s", "cpu s", "lines/s", "MB/s", "peak heap", "max rss");
+}
+
+static void print_row(const char *name, size_t size, long lines, const RunResult *r) {
+    char a[32], b[32], c[32];
+    if (!r->ok) {
+        printf("%-14s %8s %10ld %10s\n", name, human(size, a), lines, "failed");
+        return;
+    }
+    printf("%-14s %8s %10ld %10.3f %10.3f %12.0f %10.1f %12s %12s\n",
+           name, human(size, a), lines, r->wall, r->cpu,
+           lines / r->wall, size / r->wall / 1e6,
+           r->heap ? human(r->heap, b) : "-", human(r->maxrss, c));
+}
+
+static long generate(const char *path, size_t size, unsigned features, int print_density, int funcs, int vars) {
+    GenParams p = { funcs, vars, 3, print_density, features, size, 1 };
+    FILE *f = fopen(path, "w");
+    if (!f) {
+        fprintf(stderr, "Could not open %s\n", path);
+        exit(1);
+    }
+    long lines = gen_program(f, &p);
+    fclose(f);
+    return lines;
+}
+
+int main(int argc, char **argv) {
+    size_t max_size = 100u << 20;
+    int timeout = 120;
+    bool with_history = true;
+
+    for (int i = 1; i < argc; i++) {
+        if (strcmp(argv[i], "--max-size") == 0 && i + 1 < argc) max_size = strtoull(argv[++i], NULL, 10);
+        else if (strcmp(argv[i], "--timeout") == 0 && i + 1 < argc) timeout = atoi(argv[++i]);
+        else if (strcmp(argv[i], "--no-history") == 0) with_history = false;
+        else {
+            fprintf(stderr, "Usage: %s [--max-size BYTES] [--timeout SECONDS] [--no-history]\n", argv[0]);
+            return 1;
+        }
+    }
+
+    // build everything fresh, with the same flags
+    shell("rm -rf " WORK_DIR " && mkdir -p " WORK_DIR "/current");
+    shell("cc -O2 -w -pthread ../../*.c -o " WORK_DIR "/current/compiler");
+
+    int nhist = with_history ? (int)(sizeof(history) / sizeof(history[0])) : 0;
+    for (int v = 0; v < nhist; v++) {
+        const Version *h = &history[v];
+        char cmd[1024];
+        snprintf(cmd, sizeof(cmd), "mkdir -p '" WORK_DIR "/%d' && cc -O2 -w '%s/compiler.c' %s%s%s -o '" WORK_DIR "/%d/compiler'",
+                 v, h->dir, h->errors_c ? "'" : "", h->errors_c ? h->dir : "", h->errors_c ? "/errors.c'" : "", v);
+        shell(cmd);
+        if (h->transpiler) {
+            snprintf(cmd, sizeof(cmd), "cc -O2 -w '%s/transpiler.c' -o '" WORK_DIR "/%d/transpiler'", h->dir, v);
+            shell(cmd);
+        }
+    }
+
+    // 1KB, 10KB, ... up to max_size, always ending on max_size itself
+    size_t sizes[16];
+    int nsizes = 0;
+    for (size_t s = 1024; s < max_size && nsizes < 15; s *= 10)
+        sizes[nsizes++] = s;
+    sizes[nsizes++] = max_size;
+
+    printf("current compiler, all features\n");
+    print_header();
+    for (int i = 0; i < nsizes; i++) {
+        long lines = generate(WORK_DIR "/in.n", sizes[i], GEN_ALL, 20, 16, 8);
+        char *args[] = { WORK_DIR "/current/compiler", "--time-report=json",
+                         WORK_DIR "/in.n", WORK_DIR "/out.s", NULL };
+        RunResult r = run(WORK_DIR "/current", args, WORK_DIR "/report.json", timeout);
+        r.heap = report_heap(WORK_DIR "/report.json");
+        print_row("current", sizes[i], lines, &r);
+        fflush(stdout);
+    }
+
+    // thread scaling on the biggest program, many functions to share out
+    printf("\ncurrent compiler, -j scaling\n");
+    print_header();
+    long lines = generate(WORK_DIR "/in.n", max_size, GEN_ALL, 20, 512, 8);
+    long ncpu = sysconf(_SC_NPROCESSORS_ONLN);
+    for (long j = 1; j <= ncpu; j *= 2) {
+        char flag[32], name[32];
+        snprintf(flag, sizeof(flag), "-j%ld", j);
+        snprintf(name, sizeof(name), "current -j%ld", j);
+        char *args[] = { WORK_DIR "/current/compiler", flag, "--time-report=json",
+                         WORK_DIR "/in.n", WORK_DIR "/out.s", NULL };
+        RunResult r = run(WORK_DIR "/current", args, WORK_DIR "/report.json", timeout);
+        r.heap = report_heap(WORK_DIR "/report.json");
+        print_row(name, max_size, lines, &r);
+        fflush(stdout);
+        if (j < ncpu && j * 2 > ncpu) j = ncpu / 2;     // always end on all cores
+    }
+
+    if (!nhist) return 0;
+
+    // The same program for every version, using only what beta v1
+    // understands. beta v1 keeps variables in w1-w30 and the old compilers
+    // stop at 256 strings, so few variables and no string prints.
+    printf("\nall versions, common subset (num, assignment)\n");
+    print_header();
+    for (int i = 0; i < nsizes; i++) {
+        long lines = generate(WORK_DIR "/in.n", sizes[i], history[0].features, 0, 4, 6);
+        for (int v = 0; v <= nhist; v++) {
+            char dir[256], exe[300];
+            RunResult r;
+            if (v < nhist) {
+                snprintf(dir, sizeof(dir), WORK_DIR "/%d", v);
+                snprintf(exe, sizeof(exe), "%s/compiler", dir);
+                char *args[] = { exe, WORK_DIR "/in.n", WORK_DIR "/out.s", NULL };
+                r = run(dir, args, "/dev/null", timeout);
+            } else {
+                snprintf(dir, sizeof(dir), WORK_DIR "/current");
+                snprintf(exe, sizeof(exe), "%s/compiler", dir);
+                char *args[] = { exe, "--time-report=json", WORK_DIR "/in.n", WORK_DIR "/out.s", NULL };
+                r = run(dir, args, WORK_DIR "/report.json", timeout);
+                r.heap = report_heap(WORK_DIR "/report.json");
+            }
+            print_row(v < nhist ? history[v].name : "current", sizes[i], lines, &r);
+            fflush(stdout);
+        }
+    }
+
+    // each version on the richest program it can parse
+    printf("\nall versions, own feature set\n");
+    print_header();
+    for (int i = 0; i < nsizes; i++) {
+        for (int v = 0; v < nhist; v++) {
+            long lines = generate(WORK_DIR "/in.n", sizes[i], history[v].features, 20, 4, 6);
+            char dir[256], exe[300];
+            snprintf(dir, sizeof(dir), WORK_DIR "/%d", v);
+            snprintf(exe, sizeof(exe), "%s/compiler", dir);
+
+            char *args[] = { exe, WORK_DIR "/in.n", WORK_DIR "/out.s", NULL };
+            RunResult r = run(dir, args, "/dev/null", timeout);
+            print_row(history[v].name, sizes[i], lines, &r);
+            fflush(stdout);
+        }
+    }
+    printf("\nfailed: compile error, crash, or over the %ds timeout\n", timeout);
+    return 0;
+}
@@ -0,0 +1,206 @@
+#ifndef TESTING_COMMON_H
+#define TESTING_COMMON_H
+
+// What every harness in testing/ needs around the compiler: a clock,
+// running a command with its output in a file, comparing outputs,
+// counting instructions and writing programs out, plus the kernel the
+// backends are all timed on.
+// Header only, so each harness still builds from its one run.c:
+// #include "../common.h" and clang -O2 run.c -o run.
+//
+// A harness may define RUN_TIME_LIMIT (seconds) before including this,
+// to have run() give up on anything that takes longer.
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdbool.h>
+#include <ctype.h>
+#include <time.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/wait.h>
+
+#ifndef RUN_TIME_LIMIT
+#define RUN_TIME_LIMIT 0    // none
+#endif
+
+#if defined(__x86_64__) && defined(__linux__)
+#define HOST_TARGET "x86_64-linux"
+#elif defined(__aarch64__) && defined(__APPLE__)
+#define HOST_TARGET "arm64-macos"
+#elif defined(__aarch64__) && defined(__linux__)
+#define HOST_TARGET "aarch64-linux"
+#else
+#define HOST_TARGET ""
+#endif
+
+// arithmetic, division and a data-dependent if in a hot nested loop
+static const char kernel[] =
+    "_main() {\n"
+    "    num total = 0\n"
+    "    num i = 0\n"
+    "    loop 2000 {\n"
+    "        loop 10000 {\n"
+    "            i = i + 1\n"
+    "            num t = i * 3\n"
+    "            t = t / 7\n"
+    "            if t > 1000 {\n"
+    "                total = total + 1\n"
+    "            } else {\n"
+    "                total = total - t\n"
+    "            }\n"
+    "        }\n"
+    "    }\n"
+    "    print(total)\n"
+    "    print(\"\\n\")\n"
+    "}\n";
+
+static inline double now(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+static inline void shell(const char *cmd) {
+    if (system(cmd) != 0) {
+        fprintf(stderr, "Failed: %s\n", cmd);
+        exit(1);
+    }
+}
+
+// an empty work_dir with the compiler built from ../../*.c in it
+static inline void build_compiler(const char *work_dir) {
+    char cmd[512];
+    snprintf(cmd, sizeof(cmd), "rm -rf %s && mkdir -p %s", work_dir, work_dir);
+    shell(cmd);
+    snprintf(cmd, sizeof(cmd), "cc -O2 -w -pthread ../../*.c -o %s/compiler", work_dir);
+    shell(cmd);
+}
+
+static inline bool in_path(const char *cmd) {
+    char buf[256];
+    snprintf(buf, sizeof(buf), "command -v %s >/dev/null 2>&1", cmd);
+    return system(buf) == 0;
+}
+
+// run argv with stdout going to out_path and stderr to err_path, returns
+// wall seconds, or -1 when it failed, was killed or ran out of time
+static inline double run_with_stderr(char *const argv[], const char *out_path, const char *err_path) {
+    double start = now();
+    pid_t pid = fork();
+    if (pid < 0) return -1;
+    if (pid == 0) {
+        int out = open(out_path, O_WRONLY | O_CREAT | O_TRUNC, 0644);
+        int err = open(err_path, O_WRONLY | O_CREAT | O_TRUNC, 0644);
+        if (out < 0 || err < 0) _exit(127);
+        dup2(out, STDOUT_FILENO);
+        dup2(err, STDERR_FILENO);
+        alarm(RUN_TIME_LIMIT);
+        execvp(argv[0], argv);
+        _exit(127);
+    }
+    int status;
+    if (waitpid(pid, &status, 0) < 0) return -1;
+    if (!WIFEXITED(status) || WEXITSTATUS(status) != 0) return -1;
+    return now() - start;
+}
+
+// the same with stderr thrown away
+static inline double run(char *const argv[], const char *out_path) {
+    return run_with_stderr(argv, out_path, "/dev/null");
+}
+
+// the fastest of runs runs, -1 as soon as one fails
+static inline double best_of(char *const argv[], const char *out_path, int runs) {
+    double best = -1;
+    for (int r = 0; r < runs; r++) {
+        double w = run(argv, out_path);
+        if (w < 0) return -1;
+        if (best < 0 || w < best) best = w;
+    }
+    return best;
+}
+
+// the whole file, NUL-terminated; NULL and a length of 0 when it cannot
+// be opened
+static inline char *read_file(const char *path, size_t *len) {
+    *len = 0;
+    FILE *f = fopen(path, "rb");
+    if (!f) return NULL;
+    fseek(f, 0, SEEK_END);
+    *len = (size_t)ftell(f);
+    fseek(f, 0, SEEK_SET);
+    char *buf = malloc(*len + 1);
+    if (fread(buf, 1, *len, f) != *len) *len = 0;
+    buf[*len] = '\0';
+    fclose(f);
+    return buf;
+}
+
+static inline bool same_file(const char *a, const char *b) {
+    size_t la, lb;
+    char *x = read_file(a, &la), *y = read_file(b, &lb);
+    bool same = x && y && la == lb && memcmp(x, y, la) == 0;
+    free(x);
+    free(y);
+    return same;
+}
+
+// whether the file at path has text in it anywhere
+static inline bool file_has(const char *path, const char *text) {
+    size_t len;
+    char *data = read_file(path, &len);
+    bool found = data && strstr(data, text);
+    free(data);
+    return found;
+}
+
+static inline void write_program(const char *path, const char *text) {
+    FILE *f = fopen(path, "w");
+    if (!f) {
+        fprintf(stderr, "Could not open %s\n", path);
+        exit(1);
+    }
+    fputs(text, f);
+    fclose(f);
+}
+
+// lines that assemble to an instruction: no labels, directives or comments
+static inline long count_instructions(const char *s, size_t len) {
+    long n = 0;
+    const char *end = s + len;
+    while (s < end) {
+        const char *eol = memchr(s, '\n', (size_t)(end - s));
+        if (!eol) eol = end;
+
+        const char *p = s;
+        while (p < eol && isspace((unsigned char)*p)) p++;
+        const char *q = p;
+        while (q < eol && (isalnum((unsigned char)*q) || *q == '_' || *q == '.')) q++;
+        if (q < eol && *q == ':') {
+            p = q + 1;
+            while (p < eol && isspace((unsigned char)*p)) p++;
+        }
+        if (p < eol && *p != '.' && *p != '#' && *p != '/') n++;
+        s = eol + 1;
+    }
+    return n;
+}
+
+// [--runs N] [program.n ...]: the index of the first program (argc when
+// there are none), or -1 after printing the usage
+static inline int parse_runs(int argc, char **argv, int *runs) {
+    int first = 1;
+    *runs = 5;
+    if (argc > 2 && strcmp(argv[1], "--runs") == 0) {
+        *runs = atoi(argv[2]);
+        first = 3;
+    }
+    if (*runs < 1 || (first < argc && argv[first][0] == '-')) {
+        fprintf(stderr, "Usage: %s [--runs N] [program.n ...]\n", argv[0]);
+        return -1;
+    }
+    return first;
+}
+
+#endif // TESTING_COMMON_H
@@ -0,0 +1,90 @@
+// assembly output cost: buffered emitter vs fprintf
+// clang -O2 run.c ../../emit.c ../../mem.c -o run
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <fcntl.h>
+#include <unistd.h>
+
+#include "../../emit.h"
+
+// each round is the code for "num x = x + 1" followed by a loop header
+#define ROUNDS 2000000
+
+static double now(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+// what codegen used to do
+static void run_fprintf(FILE *f) {
+    for (int i = 0; i < ROUNDS; i++) {
+        char label[32];
+        snprintf(label, sizeof(label), "_loop_%d", i);
+        fprintf(f, "    adrp x9, %s@PAGE\n", "x");
+        fprintf(f, "    ldr  w0, [x9, %s@PAGEOFF]\n", "x");
+        fprintf(f, "    mov w1, #%d\n", 1);
+        fprintf(f, "    %s w0, w0, w1\n", "add");
+        fprintf(f, "    adrp x9, %s@PAGE\n", "x");
+        fprintf(f, "    str  %s, [x9, %s@PAGEOFF]\n", "w0", "x");
+        fprintf(f, "%s:\n", label);
+        fprintf(f, "    cbz w0, %s\n", label);
+    }
+}
+
+static void run_emitter(Emitter *e) {
+    for (int i = 0; i < ROUNDS; i++) {
+        char label[32];
+        memcpy(label, "_loop_", 6);
+        emit_format_int(label + 6, i);
+        emit_text(e, "    adrp x9, x@PAGE\n");
+        emit_op(e, "ldr");
+        emit_text(e, "w0, [x9, x@PAGEOFF]\n");
+        emit_op(e, "mov");
+        emit_text(e, "w1, ");
+        emit_imm(e, 1);
+        emit_char(e, '\n');
+        emit_ins(e, "add", "w0", "w0", "w1");
+        emit_text(e, "    adrp x9, x@PAGE\n");
+        emit_op(e, "str");
+        emit_text(e, "w0, [x9, x@PAGEOFF]\n");
+        emit_label(e, label);
+        emit_ins(e, "cbz", "w0", label, NULL);
+    }
+}
+
+int main() {
+    const char *path = "/tmp/nevo_emit_bench.s";
+
+    double t0 = now();
+    FILE *f = fopen(path, "w");
+    if (!f) {
+        fprintf(stderr, "Could not open %s\n", path);
+        return 1;
+    }
+    run_fprintf(f);
+    long bytes = ftell(f);
+    fclose(f);
+    double t_fprintf = now() - t0;
+
+    t0 = now();
+    Emitter e = {0};
+    run_emitter(&e);
+    int fd = open(path, O_WRONLY | O_CREAT | O_TRUNC, 0644);
+    if (fd < 0 || emit_write(&e, fd) != 0) {
+        fprintf(stderr, "Could not write %s\n", path);
+        return 1;
+    }
+    close(fd);
+    double t_emit = now() - t0;
+
+    printf("%10s %10s %12s\n", "method", "seconds", "MB/s");
+    printf("%10s %10.3f %12.1f\n", "fprintf", t_fprintf, bytes / t_fprintf / 1e6);
+    printf("%10s %10.3f %12.1f\n", "emitter", t_emit, e.len / t_emit / 1e6);
+
+    emit_free(&e);
+    unlink(path);
+    return 0;
+}
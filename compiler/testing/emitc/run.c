@@ -0,0 +1,208 @@
+// --emit=c against the hand-written backends: each program compiled to C
+// with -std=c99 -Wall -Wextra -Werror (so any warning fails the row) at
+// -O2 and -O3, and run next to the arm64 codegen's executable. On an
+// arm64 host both run directly; elsewhere the C is cross-compiled with
+// the same toolchain and both run under qemu-user
+// (aarch64-linux-gnu-gcc + qemu-aarch64), and the host's own backend and
+// C build are timed as well. Outputs are checked against the first row.
+// Then programs with an undefined callee, a function defined twice and
+// no _main must each get the other backends' error and no C. The exit
+// status is 1 when a row fails or differs.
+// clang -O2 run.c -o run && ./run [--runs N] [program.n ...]
+#define WORK_DIR "/tmp/nevo-emitc"
+#include "../common.h"
+
+#define C_FLAGS "-std=c99 -Wall -Wextra -Werror"
+
+#if defined(__aarch64__) && defined(__APPLE__)
+#define ARM64_TARGET "arm64-macos"
+#define ARM64_HOST 1
+#elif defined(__aarch64__) && defined(__linux__)
+#define ARM64_TARGET "aarch64-linux"
+#define ARM64_HOST 1
+#else
+#define ARM64_TARGET "aarch64-linux"
+#define ARM64_HOST 0
+#endif
+
+#define CROSS_CC "aarch64-linux-gnu-gcc"
+#define EMULATOR "qemu-aarch64"
+
+// a call in every iteration, the arguments going through w0
+static const char calls[] =
+    "_main() {\n"
+    "    num n = 0\n"
+    "    num sum = 0\n"
+    "    bl _step(1)\n"
+    "}\n"
+    "_step(k) {\n"
+    "    n = n + 1\n"
+    "    num m = k * n\n"
+    "    sum = sum + m\n"
+    "    if n < 20000000 {\n"
+    "        bl _step(n)\n"
+    "    }\n"
+    "    print(sum)\n"
+    "    print(\"\\n\")\n"
+    "    exit(0)\n"
+    "}\n";
+
+// _f reads y before _g, where it is declared, has ever run: the C has
+// to start it at 0 like the other backends, and build without warnings
+static const char later[] =
+    "_main() {\n"
+    "    bl _f()\n"
+    "}\n"
+    "_g() {\n"
+    "    num y = 5\n"
+    "}\n"
+    "_f() {\n"
+    "    print(y)\n"
+    "    print(\"\\n\")\n"
+    "    exit(0)\n"
+    "}\n";
+
+// programs the C compiler would choke on, which --emit=c has to refuse
+// with the same error as the other backends and no output
+static const struct {
+    const char *name;
+    const char *program;
+    const char *error;
+} bad[] = {
+    { "undefined callee",
+      "_main() {\n    bl _nope(1)\n}\n",
+      "Error: call to undefined function (line 2): _nope" },
+    { "defined twice",
+      "_main() {\n    print(1)\n}\n_main() {\n    exit(0)\n}\n",
+      "Error: function defined twice (line 4): _main" },
+    { "no _main",
+      "_f() {\n    print(1)\n}\n",
+      "Error: no _main function" },
+};
+
+static bool failed = false;
+
+// times an executable built by the caller, emulated or not, and prints
+// its row; the first row that runs is what the rest must print
+static void time_row(const char *name, bool built, const char *exe, bool emulated, int runs, const char **reference) {
+    if (!built) {
+        printf("  %-18s %12s\n", name, "failed");
+        failed = true;
+        return;
+    }
+    char out_path[256];
+    snprintf(out_path, sizeof(out_path), "%s.out", exe);
+    char *native_prog[] = { (char *)exe, NULL };
+    char *emulated_prog[] = { EMULATOR, (char *)exe, NULL };
+    double best = best_of(emulated ? emulated_prog : native_prog, out_path, runs);
+    if (best < 0) {
+        printf("  %-18s %12s\n", name, "failed");
+        failed = true;
+        return;
+    }
+    printf("  %-18s %12.2f", name, best * 1e3);
+    if (*reference && !same_file(*reference, out_path)) {
+        printf("  output differs from %s", *reference);
+        failed = true;
+    }
+    printf("\n");
+    if (!*reference) *reference = strdup(out_path);
+}
+
+// nevo straight to an executable through one of the compiler's backends
+static void backend_row(const char *path, const char *target, const char *cc, bool emulated, int runs, const char **reference) {
+    char flag[64], exe[256], name[64];
+    snprintf(flag, sizeof(flag), "--target=%s", target);
+    snprintf(exe, sizeof(exe), WORK_DIR "/%s", target);
+    snprintf(name, sizeof(name), "%s asm", target);
+
+    char *host_cc = getenv("CC") ? strdup(getenv("CC")) : NULL;
+    if (cc) setenv("CC", cc, 1);
+    char *build[] = { WORK_DIR "/compiler", flag, (char *)path, exe, NULL };
+    bool built = run(build, "/dev/null") >= 0;
+    if (host_cc) setenv("CC", host_cc, 1);
+    else unsetenv("CC");
+    free(host_cc);
+    time_row(name, built, exe, emulated, runs, reference);
+}
+
+// the --emit=c output through a C compiler; warnings are errors
+static void c_row(const char *cc, const char *opt, const char *tag, bool emulated, int runs, const char **reference) {
+    char cmd[512], exe[256], name[64];
+    snprintf(exe, sizeof(exe), WORK_DIR "/c-%s%s", tag, opt);
+    snprintf(name, sizeof(name), "c %s %s", tag, opt);
+    snprintf(cmd, sizeof(cmd), "%s %s %s %s " WORK_DIR "/prog.c -o %s",
+             cc, C_FLAGS, opt, emulated ? "-static" : "", exe);
+    time_row(name, system(cmd) == 0, exe, emulated, runs, reference);
+}
+
+static void bench(const char *path, int runs) {
+    printf("%s\n", path);
+    printf("  %-18s %12s\n", "", "run ms");
+
+    char *emit[] = { WORK_DIR "/compiler", "--emit=c", (char *)path, WORK_DIR "/prog.c", NULL };
+    if (run(emit, "/dev/null") < 0) {
+        printf("  --emit=c failed\n");
+        failed = true;
+        return;
+    }
+
+    // arm64: the hand-written codegen against C from the same toolchain
+    const char *reference = NULL;
+    bool cross = !ARM64_HOST && in_path(CROSS_CC) && in_path(EMULATOR);
+    if (ARM64_HOST || cross) {
+        const char *cc = ARM64_HOST ? "cc" : CROSS_CC;
+        backend_row(path, ARM64_TARGET, ARM64_HOST ? NULL : CROSS_CC, cross, runs, &reference);
+        c_row(cc, "-O2", "arm64", cross, runs, &reference);
+        c_row(cc, "-O3", "arm64", cross, runs, &reference);
+    } else {
+        printf("  %-18s %12s  (needs an arm64 host or " CROSS_CC " and " EMULATOR ")\n", ARM64_TARGET " asm", "-");
+    }
+
+    // and the host's own backend when it is not arm64
+    if (HOST_TARGET[0] && !ARM64_HOST) {
+        backend_row(path, HOST_TARGET, NULL, false, runs, &reference);
+        c_row("cc", "-O2", "host", false, runs, &reference);
+        c_row("cc", "-O3", "host", false, runs, &reference);
+    }
+    fflush(stdout);
+}
+
+static void check_errors(void) {
+    printf("errors\n");
+    for (size_t i = 0; i < sizeof(bad) / sizeof(bad[0]); i++) {
+        write_program(WORK_DIR "/bad.n", bad[i].program);
+        shell("rm -f " WORK_DIR "/bad.c");
+        char *emit[] = { WORK_DIR "/compiler", "--emit=c", WORK_DIR "/bad.n", WORK_DIR "/bad.c", NULL };
+        bool refused = run_with_stderr(emit, "/dev/null", WORK_DIR "/bad.err") < 0;
+        bool said = file_has(WORK_DIR "/bad.err", bad[i].error);
+        bool written = access(WORK_DIR "/bad.c", F_OK) == 0;
+        printf("  %-18s %s\n", bad[i].name,
+               !refused ? "accepted" : !said ? "wrong error" : written ? "wrote output" : "ok");
+        if (!refused || !said || written) failed = true;
+    }
+    fflush(stdout);
+}
+
+int main(int argc, char **argv) {
+    int runs;
+    int first = parse_runs(argc, argv, &runs);
+    if (first < 0) return 1;
+
+    build_compiler(WORK_DIR);
+
+    if (first < argc) {
+        for (int i = first; i < argc; i++) bench(argv[i], runs);
+        return failed;
+    }
+
+    write_program(WORK_DIR "/kernel.n", kernel);
+    write_program(WORK_DIR "/calls.n", calls);
+    write_program(WORK_DIR "/later.n", later);
+    bench("../../test.n", runs);
+    bench(WORK_DIR "/kernel.n", runs);
+    bench(WORK_DIR "/calls.n", runs);
+    bench(WORK_DIR "/later.n", runs);
+    check_errors();
+    return failed;
+}
@@ -0,0 +1,128 @@
+// the bytecode interpreter and the JIT against native code: each program
+// built for the host and run, then run with `compiler run` threaded
+// (computed goto), with the plain switch, with --jit and --tiered,
+// checking that they all print the same. Then programs the JIT cannot
+// build, each of which has to stop it with the reason. The exit status
+// is 1 when a row fails or differs.
+// clang -O2 run.c -o run && ./run [--runs N] [program.n ...]
+#define WORK_DIR "/tmp/nevo-interp"
+#include "../common.h"
+
+// a call in every iteration, and a lot of printing
+static const char calls[] =
+    "_main() {\n"
+    "    num n = 0\n"
+    "    num sum = 0\n"
+    "    bl _step(1)\n"
+    "}\n"
+    "_step(k) {\n"
+    "    n = n + 1\n"
+    "    num m = k * n\n"
+    "    sum = sum + m\n"
+    "    if n < 3000000 {\n"
+    "        bl _step(n)\n"
+    "    }\n"
+    "    loop 200000 {\n"
+    "        print(sum)\n"
+    "        print(\" \")\n"
+    "    }\n"
+    "    exit(0)\n"
+    "}\n";
+
+// what --jit has to say about programs its encoder refuses
+static const struct {
+    const char *name;
+    const char *program;
+    const char *error;
+} bad[] = {
+    { "defined twice",
+      "_main() {\n    print(1)\n}\n_main() {\n    exit(0)\n}\n",
+      "Error: --jit: symbol defined twice: _main" },
+    { "undefined callee",
+      "_main() {\n    bl _nope(1)\n}\n",
+      "Error: --jit: undefined symbol _nope" },
+    { "wide literal",
+      "_main() {\n    num a = 99999999999999999999\n    print(a)\n}\n",
+      "Error: --jit: immediate out of range: movl $" },
+    { "raw line",
+      "_main() {\n    mov x0, x1\n}\n",
+      "Error: --jit: cannot encode: mov x0, x1" },
+};
+
+static bool failed = false;
+
+static void print_row(const char *name, double s, double native, const char *out, const char *reference) {
+    if (s < 0) {
+        printf("  %-10s %12s\n", name, "failed");
+        failed = true;
+        return;
+    }
+    printf("  %-10s %12.2f", name, s * 1e3);
+    if (native > 0) printf(" %11.1fx", s / native);
+    if (reference && !same_file(reference, out)) {
+        printf("  output differs from native");
+        failed = true;
+    }
+    printf("\n");
+}
+
+static void bench(const char *path, int runs) {
+    printf("%s\n", path);
+    printf("  %-10s %12s %12s\n", "", "run ms", "vs native");
+
+    // native code for the host, when the compiler has a backend for it
+    double native = -1;
+    const char *reference = NULL;
+    if (HOST_TARGET[0]) {
+        char *build[] = { WORK_DIR "/compiler", "--target=" HOST_TARGET, (char *)path, WORK_DIR "/native", NULL };
+        char *prog[] = { WORK_DIR "/native", NULL };
+        if (run(build, "/dev/null") >= 0) native = best_of(prog, WORK_DIR "/native.out", runs);
+        if (native > 0) reference = WORK_DIR "/native.out";
+        print_row("native", native, -1, NULL, NULL);
+    }
+
+    char *threaded[] = { WORK_DIR "/compiler", "run", (char *)path, NULL };
+    char *switched[] = { WORK_DIR "/compiler-switch", "run", (char *)path, NULL };
+    char *jit[] = { WORK_DIR "/compiler", "run", "--jit", (char *)path, NULL };
+    char *tiered[] = { WORK_DIR "/compiler", "run", "--tiered", (char *)path, NULL };
+    print_row("threaded", best_of(threaded, WORK_DIR "/threaded.out", runs), native, WORK_DIR "/threaded.out", reference);
+    print_row("switch", best_of(switched, WORK_DIR "/switch.out", runs), native, WORK_DIR "/switch.out", reference);
+    print_row("jit", best_of(jit, WORK_DIR "/jit.out", runs), native, WORK_DIR "/jit.out", reference);
+    print_row("tiered", best_of(tiered, WORK_DIR "/tiered.out", runs), native, WORK_DIR "/tiered.out", reference);
+    fflush(stdout);
+}
+
+static void check_jit_errors(void) {
+    printf("jit errors\n");
+    for (size_t i = 0; i < sizeof(bad) / sizeof(bad[0]); i++) {
+        write_program(WORK_DIR "/bad.n", bad[i].program);
+        char *jit[] = { WORK_DIR "/compiler", "run", "--jit", "--no-cache", WORK_DIR "/bad.n", NULL };
+        bool refused = run_with_stderr(jit, "/dev/null", WORK_DIR "/bad.err") < 0;
+        bool said = file_has(WORK_DIR "/bad.err", bad[i].error);
+        printf("  %-18s %s\n", bad[i].name, !refused ? "accepted" : !said ? "wrong error" : "ok");
+        if (!refused || !said) failed = true;
+    }
+    fflush(stdout);
+}
+
+int main(int argc, char **argv) {
+    int runs;
+    int first = parse_runs(argc, argv, &runs);
+    if (first < 0) return 1;
+
+    build_compiler(WORK_DIR);
+    shell("cc -O2 -w -pthread -DINTERP_SWITCH ../../*.c -o " WORK_DIR "/compiler-switch");
+
+    if (first < argc) {
+        for (int i = first; i < argc; i++) bench(argv[i], runs);
+        return failed;
+    }
+
+    write_program(WORK_DIR "/kernel.n", kernel);
+    write_program(WORK_DIR "/calls.n", calls);
+    bench("../../test.n", runs);
+    bench(WORK_DIR "/kernel.n", runs);
+    bench(WORK_DIR "/calls.n", runs);
+    if (strcmp(HOST_TARGET, "x86_64-linux") == 0) check_jit_errors();
+    return failed;
+}
@@ -0,0 +1,127 @@
+// the IR passes on programs that once sent them into a loop: each one
+// through --emit=ir with every pipeline, and through --emit=llvm, under
+// a time limit. A `loop 0` leaves its body unreachable once simplify
+// settles the entry branch, and in code nothing runs a value can end up
+// its own operand (%17 = trunc %34, %34 -> %18 = zext %17). Last, an
+// unknown pass has to be refused without leaving a temp object.
+// clang -O2 run.c -o run && ./run [program.n ...]
+#include <glob.h>
+
+#define WORK_DIR "/tmp/nevo-ir"
+#define RUN_TIME_LIMIT 10   // seconds per compile
+#include "../common.h"
+
+// a variable set in an if inside a loop that never runs
+static const char loop_zero[] =
+    "_main() {\n"
+    "    num a = 1\n"
+    "    loop 0 {\n"
+    "        if a < 3 {\n"
+    "            a = 2\n"
+    "        }\n"
+    "    }\n"
+    "    print(a)\n"
+    "}\n";
+
+// the same with a register read and written back: trunc and zext
+static const char loop_zero_reg[] =
+    "_main() {\n"
+    "    num a = 1\n"
+    "    loop 0 {\n"
+    "        num c = w1\n"
+    "        if a < 3 {\n"
+    "            setr w1, c\n"
+    "        }\n"
+    "    }\n"
+    "    print(a)\n"
+    "}\n";
+
+static const char *const pipelines[] = {
+    "none", "mem2reg", "simplify", "dce", "mem2reg,simplify", "simplify,mem2reg",
+    "mem2reg,simplify,dce", "mem2reg,dce,simplify,dce",
+};
+
+// one compile, one row, passes NULL for the default pipeline; false
+// when it did not finish cleanly
+static bool check(const char *path, const char *emit, const char *passes) {
+    char emit_flag[32], passes_flag[96];
+    snprintf(emit_flag, sizeof(emit_flag), "--emit=%s", emit);
+    char *argv[6];
+    int argc = 0;
+    argv[argc++] = WORK_DIR "/compiler";
+    argv[argc++] = emit_flag;
+    if (passes) {
+        snprintf(passes_flag, sizeof(passes_flag), "--passes=%s", passes);
+        argv[argc++] = passes_flag;
+    }
+    argv[argc++] = (char *)path;
+    argv[argc++] = WORK_DIR "/out";
+    argv[argc] = NULL;
+
+    double start = now();
+    bool ok = run(argv, "/dev/null") >= 0;
+    bool timed_out = !ok && now() - start >= RUN_TIME_LIMIT;
+    printf("  %-6s %-26s %s\n", emit, passes ? passes : "(default)",
+           ok ? "ok" : timed_out ? "timed out" : "failed");
+    return ok;
+}
+
+static bool check_program(const char *path) {
+    printf("%s\n", path);
+    bool ok = true;
+    for (size_t i = 0; i < sizeof(pipelines) / sizeof(pipelines[0]); i++)
+        ok &= check(path, "ir", pipelines[i]);
+    ok &= check(path, "llvm", NULL);
+    fflush(stdout);
+    return ok;
+}
+
+// the compiler's temp objects in /tmp right now
+static size_t temp_objects(void) {
+    glob_t g;
+    size_t n = glob("/tmp/nevo-*.o", 0, NULL, &g) == 0 ? g.gl_pathc : 0;
+    globfree(&g);
+    return n;
+}
+
+// a name that is not a pass is refused before anything is built, for
+// a native build as well, and leaves no temp object behind
+static bool check_unknown_pass(void) {
+    char *argv[6];
+    int argc = 0;
+    argv[argc++] = WORK_DIR "/compiler";
+    if (HOST_TARGET[0]) argv[argc++] = "--target=" HOST_TARGET;
+    argv[argc++] = "--passes=mem2reg,bogus";
+    argv[argc++] = "../../test.n";
+    argv[argc++] = WORK_DIR "/prog";
+    argv[argc] = NULL;
+
+    size_t before = temp_objects();
+    bool refused = run(argv, "/dev/null") < 0;
+    bool left = temp_objects() > before;
+    printf("unknown pass\n  %s\n", !refused ? "accepted" : left ? "left a temp object" : "ok");
+    return refused && !left;
+}
+
+int main(int argc, char **argv) {
+    if (argc > 1 && argv[1][0] == '-') {
+        fprintf(stderr, "Usage: %s [program.n ...]\n", argv[0]);
+        return 1;
+    }
+
+    build_compiler(WORK_DIR);
+
+    bool ok = true;
+    if (argc > 1) {
+        for (int i = 1; i < argc; i++) ok &= check_program(argv[i]);
+        return ok ? 0 : 1;
+    }
+
+    write_program(WORK_DIR "/loop_zero.n", loop_zero);
+    write_program(WORK_DIR "/loop_zero_reg.n", loop_zero_reg);
+    ok &= check_program(WORK_DIR "/loop_zero.n");
+    ok &= check_program(WORK_DIR "/loop_zero_reg.n");
+    ok &= check_program("../../test.n");
+    ok &= check_unknown_pass();
+    return ok ? 0 : 1;
+}
@@ -0,0 +1,131 @@
+// --emit=llvm against the host's own backend, which writes assembly one
+// statement at a time: each program lowered to LLVM IR, run through
+// `opt -O3` (or straight to llc for the unoptimized row) and llc, and
+// timed next to the native build. Outputs are checked against native.
+// LLVM 14 tools get -opaque-pointers, set LLVM_FLAGS="" for newer ones.
+// Every command gets a time limit, and the exit status says whether any
+// row failed or differed.
+// clang -O2 run.c -o run && ./run [--runs N] [program.n ...]
+#define WORK_DIR "/tmp/nevo-llvm"
+#define RUN_TIME_LIMIT 120  // seconds per command
+#include "../common.h"
+
+// a plain reduction, what the vectorizer is for
+static const char sum[] =
+    "_main() {\n"
+    "    num s = 0\n"
+    "    num k = 0\n"
+    "    loop 20000 {\n"
+    "        k = 0\n"
+    "        loop 50000 {\n"
+    "            k = k + 1\n"
+    "            num m = k * 3\n"
+    "            s = s + m\n"
+    "        }\n"
+    "    }\n"
+    "    print(s)\n"
+    "    print(\"\\n\")\n"
+    "}\n";
+
+// a loop that never runs around an if that sets a register: the body is
+// unreachable once the entry branch is settled, which once hung simplify
+static const char loop_zero[] =
+    "_main() {\n"
+    "    num a = 1\n"
+    "    loop 0 {\n"
+    "        num c = w1\n"
+    "        if a < 3 {\n"
+    "            a = 2\n"
+    "            setr w1, c\n"
+    "        }\n"
+    "    }\n"
+    "    print(a)\n"
+    "    print(\"\\n\")\n"
+    "}\n";
+
+static bool failed = false;
+
+static void print_row(const char *name, double s, double native, const char *out, const char *reference) {
+    if (s < 0) {
+        printf("  %-10s %12s\n", name, "failed");
+        failed = true;
+        return;
+    }
+    printf("  %-10s %12.2f", name, s * 1e3);
+    if (native > 0) printf(" %11.2fx", s / native);
+    if (reference && !same_file(reference, out)) {
+        printf("  output differs from native");
+        failed = true;
+    }
+    printf("\n");
+}
+
+// IR to an executable: opt at level (none for -O0), llc, the C driver
+static bool build_llvm(const char *level, const char *exe) {
+    const char *flags = getenv("LLVM_FLAGS") ? getenv("LLVM_FLAGS") : "-opaque-pointers";
+    char cmd[1024];
+    if (strcmp(level, "-O0") == 0) {
+        snprintf(cmd, sizeof(cmd), "llc %s -O0 -relocation-model=pic -filetype=obj " WORK_DIR "/prog.ll -o %s.o", flags, exe);
+    } else {
+        snprintf(cmd, sizeof(cmd), "opt %s %s " WORK_DIR "/prog.ll -o %s.bc && llc %s %s -relocation-model=pic -filetype=obj %s.bc -o %s.o",
+                 flags, level, exe, flags, level, exe, exe);
+    }
+    if (system(cmd) != 0) return false;
+    snprintf(cmd, sizeof(cmd), "cc %s.o -o %s", exe, exe);
+    return system(cmd) == 0;
+}
+
+static void bench(const char *path, int runs) {
+    printf("%s\n", path);
+    printf("  %-10s %12s %12s\n", "", "run ms", "vs native");
+
+    double native = -1;
+    const char *reference = NULL;
+    if (HOST_TARGET[0]) {
+        char *build[] = { WORK_DIR "/compiler", "--target=" HOST_TARGET, (char *)path, WORK_DIR "/native", NULL };
+        char *prog[] = { WORK_DIR "/native", NULL };
+        if (run(build, "/dev/null") >= 0) native = best_of(prog, WORK_DIR "/native.out", runs);
+        if (native > 0) reference = WORK_DIR "/native.out";
+        print_row("native", native, -1, NULL, NULL);
+    }
+
+    char *emit[] = { WORK_DIR "/compiler", "--emit=llvm", (char *)path, WORK_DIR "/prog.ll", NULL };
+    if (run(emit, "/dev/null") < 0) {
+        printf("  --emit=llvm failed\n");
+        failed = true;
+        return;
+    }
+    static const char *const levels[] = { "-O0", "-O2", "-O3" };
+    for (int i = 0; i < 3; i++) {
+        char exe[64], out[80], name[16];
+        snprintf(exe, sizeof(exe), WORK_DIR "/llvm%s", levels[i]);
+        snprintf(out, sizeof(out), "%s.out", exe);
+        snprintf(name, sizeof(name), "llvm %s", levels[i]);
+        char *prog[] = { exe, NULL };
+        double s = build_llvm(levels[i], exe) ? best_of(prog, out, runs) : -1;
+        print_row(name, s, native, out, reference);
+    }
+    fflush(stdout);
+}
+
+int main(int argc, char **argv) {
+    int runs;
+    int first = parse_runs(argc, argv, &runs);
+    if (first < 0) return 1;
+
+    build_compiler(WORK_DIR);
+
+    if (first < argc) {
+        for (int i = first; i < argc; i++) bench(argv[i], runs);
+        return failed;
+    }
+
+    write_program(WORK_DIR "/kernel.n", kernel);
+    write_program(WORK_DIR "/sum.n", sum);
+    write_program(WORK_DIR "/loop_zero.n", loop_zero);
+    bench("../../test.n", runs);
+    bench(WORK_DIR "/kernel.n", runs);
+    bench(WORK_DIR "/sum.n", runs);
+    bench(WORK_DIR "/loop_zero.n", runs);
+    return failed;
+}
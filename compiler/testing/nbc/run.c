@@ -0,0 +1,180 @@
+// start-up of `compiler run` with and without the .nbc cache: a long
+// script that does little, so the time is lexing, parsing and lowering
+// against mapping file.nbc. Rows are --no-cache, the first run (which
+// also writes the cache) and the runs after it, all checked to print
+// the same. Then damaged caches: a stale source hash, another version,
+// a truncated file and one overwritten code word must each be thrown
+// away, the program run correctly and the file written again. The exit
+// status is 1 when any of it fails.
+// clang -O2 run.c -o run && ./run [--runs N] [--funcs N]
+#include <stdint.h>
+
+#define WORK_DIR "/tmp/nevo-nbc"
+#define RUN_TIME_LIMIT 60   // seconds per run, a damaged file could loop
+#include "../common.h"
+
+// where nbc.c's header keeps what the damage goes after
+#define NBC_AT_VERSION 4    // uint32_t
+#define NBC_AT_HASH 16      // uint64_t, of the source
+#define NBC_AT_NCODE 32     // uint32_t
+#define NBC_AT_CODE 56      // uint64_t, offset of the code
+
+static bool failed = false;
+
+// funcs functions falling through into each other, each with a little
+// arithmetic, a branch, a loop and a string
+static void write_funcs(const char *path, int funcs) {
+    FILE *f = fopen(path, "w");
+    if (!f) {
+        fprintf(stderr, "Could not open %s\n", path);
+        exit(1);
+    }
+    fprintf(f, "_main() {\n    num total = 0\n}\n");
+    for (int i = 0; i < funcs; i++) {
+        fprintf(f, "_f%d() {\n", i);
+        fprintf(f, "    num a%d = %d\n", i, i);
+        fprintf(f, "    a%d = a%d * 3\n", i, i);
+        fprintf(f, "    a%d = a%d + 7\n", i, i);
+        fprintf(f, "    if a%d > %d {\n        total = total + a%d\n    } else {\n        total = total - 1\n    }\n", i, i * 2, i);
+        fprintf(f, "    loop 2 {\n        total = total + 1\n    }\n");
+        fprintf(f, "    print(\"f%d \")\n", i);
+        fprintf(f, "}\n");
+    }
+    fprintf(f, "_done() {\n    print(total)\n    print(\"\\n\")\n    exit(0)\n}\n");
+    fclose(f);
+}
+
+static void print_row(const char *name, double s, double base, const char *out, const char *reference) {
+    if (s < 0) {
+        printf("  %-12s %12s\n", name, "failed");
+        failed = true;
+        return;
+    }
+    printf("  %-12s %12.2f", name, s * 1e3);
+    if (base > 0) printf(" %11.2fx", base / s);
+    if (reference && !same_file(reference, out)) {
+        printf("  output differs");
+        failed = true;
+    }
+    printf("\n");
+}
+
+/* ---- damaged caches ---- */
+
+static void write_file(const char *path, const char *data, size_t len) {
+    FILE *f = fopen(path, "wb");
+    if (!f || fwrite(data, 1, len, f) != len) {
+        fprintf(stderr, "Could not write %s\n", path);
+        exit(1);
+    }
+    fclose(f);
+}
+
+static void stale_hash(char *file, size_t *len) {
+    (void)len;
+    file[NBC_AT_HASH] ^= 1;
+}
+
+static void wrong_version(char *file, size_t *len) {
+    (void)len;
+    uint32_t version;
+    memcpy(&version, file + NBC_AT_VERSION, 4);
+    version++;
+    memcpy(file + NBC_AT_VERSION, &version, 4);
+}
+
+static void truncated(char *file, size_t *len) {
+    (void)file;
+    *len /= 2;
+}
+
+// the middle word of the code, header and sizes left as they are
+static void code_word(char *file, size_t *len) {
+    (void)len;
+    uint32_t ncode, word = 0xffffffffu;
+    uint64_t code;
+    memcpy(&ncode, file + NBC_AT_NCODE, 4);
+    memcpy(&code, file + NBC_AT_CODE, 8);
+    memcpy(file + code + ncode / 2 * 4, &word, 4);
+}
+
+// good is the cache as `compiler run` writes it: damaged, it must run
+// the same as without a cache and leave the good file behind again
+static void check_damage(const char *name, void (*damage)(char *, size_t *), const char *good) {
+    char *cached[] = { WORK_DIR "/compiler", "run", WORK_DIR "/small.n", NULL };
+    size_t len;
+    char *file = read_file(good, &len);
+    damage(file, &len);
+    write_file(WORK_DIR "/small.nbc", file, len);
+    free(file);
+
+    bool ran = run(cached, WORK_DIR "/damaged.out") >= 0;
+    bool same = ran && same_file(WORK_DIR "/small.out", WORK_DIR "/damaged.out");
+    bool rebuilt = same_file(good, WORK_DIR "/small.nbc");
+    printf("  %-16s %s\n", name,
+           !ran ? "failed" : !same ? "output differs" : !rebuilt ? "not written again" : "ok");
+    if (!ran || !same || !rebuilt) failed = true;
+}
+
+static void damaged_caches(void) {
+    char *uncached[] = { WORK_DIR "/compiler", "run", "--no-cache", WORK_DIR "/small.n", NULL };
+    char *cached[] = { WORK_DIR "/compiler", "run", WORK_DIR "/small.n", NULL };
+    write_funcs(WORK_DIR "/small.n", 8);
+    shell("rm -f " WORK_DIR "/small.nbc");
+    if (run(uncached, WORK_DIR "/small.out") < 0 || run(cached, WORK_DIR "/first.out") < 0) {
+        printf("damaged caches: could not run the program\n");
+        failed = true;
+        return;
+    }
+    shell("cp " WORK_DIR "/small.nbc " WORK_DIR "/good.nbc");
+
+    printf("damaged caches\n");
+    check_damage("stale hash", stale_hash, WORK_DIR "/good.nbc");
+    check_damage("wrong version", wrong_version, WORK_DIR "/good.nbc");
+    check_damage("truncated", truncated, WORK_DIR "/good.nbc");
+    check_damage("code word", code_word, WORK_DIR "/good.nbc");
+}
+
+int main(int argc, char **argv) {
+    int runs = 5, funcs = 20000;
+    for (int i = 1; i < argc; i++) {
+        if (strcmp(argv[i], "--runs") == 0 && i + 1 < argc) {
+            runs = atoi(argv[++i]);
+        } else if (strcmp(argv[i], "--funcs") == 0 && i + 1 < argc) {
+            funcs = atoi(argv[++i]);
+        } else {
+            runs = 0;
+            break;
+        }
+    }
+    if (runs < 1 || funcs < 1) {
+        fprintf(stderr, "Usage: %s [--runs N] [--funcs N]\n", argv[0]);
+        return 1;
+    }
+
+    build_compiler(WORK_DIR);
+    write_funcs(WORK_DIR "/prog.n", funcs);
+
+    printf("%d functions\n", funcs);
+    printf("  %-12s %12s %12s\n", "", "run ms", "speedup");
+
+    char *uncached[] = { WORK_DIR "/compiler", "run", "--no-cache", "-j", "1", WORK_DIR "/prog.n", NULL };
+    char *cached[] = { WORK_DIR "/compiler", "run", "-j", "1", WORK_DIR "/prog.n", NULL };
+    const char *reference = WORK_DIR "/uncached.out";
+
+    double base = -1;
+    for (int r = 0; r < runs; r++) {
+        double s = run(uncached, reference);
+        if (s >= 0 && (base < 0 || s < base)) base = s;
+    }
+    print_row("--no-cache", base, -1, NULL, NULL);
+
+    double first = run(cached, WORK_DIR "/first.out");
+    print_row("first run", first, base, WORK_DIR "/first.out", reference);
+
+    double best = best_of(cached, WORK_DIR "/cached.out", runs);
+    print_row("cached", best, base, WORK_DIR "/cached.out", reference);
+
+    damaged_caches();
+    return failed;
+}
@@ -0,0 +1,118 @@
+// what the arm64 peephole pass saves: instructions in the aarch64-linux
+// assembly with and without -fno-peephole, for test.n and generated
+// programs of each feature mix, and both builds' output compared under
+// qemu-user wherever a cross toolchain is around
+// (aarch64-linux-gnu-gcc + qemu-aarch64)
+// clang -O2 run.c ../bench/gen.c -o run && ./run [program.n ...]
+#include "../bench/gen.h"
+
+#define WORK_DIR "/tmp/nevo-peephole"
+#include "../common.h"
+
+// the instructions in an assembly file, -1 when there is none
+static long count_file(const char *path) {
+    size_t len;
+    char *text = read_file(path, &len);
+    if (!text) return -1;
+    long n = count_instructions(text, len);
+    free(text);
+    return n;
+}
+
+static long total_before, total_after;
+
+// the compiler's command line, with -fno-peephole for the "before" build
+static void compile_args(char **argv, bool peephole, bool asm_only, const char *in, const char *out) {
+    int n = 0;
+    argv[n++] = WORK_DIR "/compiler";
+    argv[n++] = "--target=aarch64-linux";
+    if (asm_only) argv[n++] = "-S";
+    if (!peephole) argv[n++] = "-fno-peephole";
+    argv[n++] = (char *)in;
+    argv[n++] = (char *)out;
+    argv[n] = NULL;
+}
+
+// one program both ways: the instruction counts, and whether the two
+// builds print the same when they can be run
+static void bench(const char *name, const char *path, bool emulate) {
+    long ins[2];
+    char *argv[8];
+    for (int i = 0; i < 2; i++) {
+        char asm_path[256];
+        snprintf(asm_path, sizeof(asm_path), WORK_DIR "/out%d.s", i);
+        compile_args(argv, i, true, path, asm_path);
+        ins[i] = run(argv, "/dev/null") >= 0 ? count_file(asm_path) : -1;
+    }
+    if (ins[0] < 0 || ins[1] < 0) {
+        printf("  %-24s %12s\n", name, "failed");
+        return;
+    }
+    total_before += ins[0];
+    total_after += ins[1];
+    printf("  %-24s %12ld %12ld %+9.1f%%", name, ins[0], ins[1], 100.0 * (ins[1] - ins[0]) / ins[0]);
+
+    if (emulate) {
+        bool ok = true;
+        for (int i = 0; i < 2 && ok; i++) {
+            char exe_path[256], out_path[256];
+            snprintf(exe_path, sizeof(exe_path), WORK_DIR "/prog%d", i);
+            snprintf(out_path, sizeof(out_path), WORK_DIR "/prog%d.out", i);
+            char *prog[] = { "qemu-aarch64", exe_path, NULL };
+            compile_args(argv, i, false, path, exe_path);
+            ok = run(argv, "/dev/null") >= 0 && run(prog, out_path) >= 0;
+        }
+        printf("  %s", !ok ? "run failed" : same_file(WORK_DIR "/prog0.out", WORK_DIR "/prog1.out")
+                                            ? "same output" : "OUTPUT DIFFERS");
+    }
+    printf("\n");
+    fflush(stdout);
+}
+
+int main(int argc, char **argv) {
+    if (argc > 1 && argv[1][0] == '-') {
+        fprintf(stderr, "Usage: %s [program.n ...]\n", argv[0]);
+        return 1;
+    }
+
+    build_compiler(WORK_DIR);
+
+    bool emulate = in_path("aarch64-linux-gnu-gcc") && in_path("qemu-aarch64");
+    if (emulate) setenv("CC", "aarch64-linux-gnu-gcc", 1);
+
+    printf("  %-24s %12s %12s %10s\n", "program", "no peephole", "peephole", "change");
+    if (argc > 1) {
+        for (int i = 1; i < argc; i++) bench(argv[i], argv[i], emulate);
+    } else {
+        // few variables per function all get registers, many leave most
+        // of them in memory, which is where the pass has the most to do
+        static const struct {
+            const char *name;
+            unsigned features;
+            int vars;
+        } mixes[] = {
+            { "straight-line",     GEN_PRINT_VARS | GEN_ASSIGN, 6 },
+            { "straight, 40 vars", GEN_PRINT_VARS | GEN_ASSIGN, 40 },
+            { "if+loop",           GEN_PRINT_VARS | GEN_ASSIGN | GEN_IF | GEN_LOOP, 8 },
+            { "if+loop, 40 vars", GEN_PRINT_VARS | GEN_ASSIGN | GEN_IF | GEN_LOOP, 40 },
+            { "all",               GEN_ALL & ~GEN_SCOPED, 16 },
+        };
+        bench("test.n", "../../test.n", emulate);
+        for (size_t m = 0; m < sizeof(mixes) / sizeof(mixes[0]); m++) {
+            const char *src = WORK_DIR "/gen.n";
+            FILE *f = fopen(src, "w");
+            if (!f) {
+                fprintf(stderr, "Could not open %s\n", src);
+                return 1;
+            }
+            GenParams p = { 16, mixes[m].vars, 3, 10, mixes[m].features, 64 * 1024, 1 };
+            gen_program(f, &p);
+            fclose(f);
+            bench(mixes[m].name, src, emulate);
+        }
+    }
+    if (total_before > 0)
+        printf("  %-24s %12ld %12ld %+9.1f%%\n", "total", total_before, total_after,
+               100.0 * (total_after - total_before) / total_before);
+    return 0;
+}
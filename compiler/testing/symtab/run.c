@@ -0,0 +1,84 @@
+// symbol lookup cost vs number of variables
+// clang -O2 run.c ../../symtab.c ../../arena.c ../../lexer.c ../../errors.c ../../mem.c ../../timing.c -o run
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#include "../../lexer.h"
+#include "../../symtab.h"
+
+#define LOOKUPS 10000000
+
+static double now(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+// what get_var_label() used to do
+static int linear_find(const char **names, int count, const char *name) {
+    for (int i = 0; i < count; i++)
+        if (strcmp(names[i], name) == 0) return i;
+    return -1;
+}
+
+int main() {
+    static const int sizes[] = { 10, 100, 1000, 10000, 100000, 1000000 };
+    unsigned seed = 12345;
+
+    printf("%10s %14s %14s\n", "vars", "hash ns/op", "linear ns/op");
+
+    for (size_t k = 0; k < sizeof(sizes) / sizeof(sizes[0]); k++) {
+        int count = sizes[k];
+        Arena arena = {0};
+
+        // globals plus one function scope on top, like codegen does
+        Scope *globals = scope_push(&arena, NULL);
+        Scope *func = scope_push(&arena, globals);
+        const char **names = malloc(count * sizeof(char *));
+
+        for (int i = 0; i < count; i++) {
+            char buf[64];
+            int len = snprintf(buf, sizeof(buf), "main_var_v%d", i);
+            names[i] = intern(buf, len);
+            scope_add(&arena, globals, names[i]);
+        }
+
+        // random order so we do not just walk the table
+        int *order = malloc(LOOKUPS * sizeof(int));
+        for (int i = 0; i < LOOKUPS; i++) {
+            seed = seed * 1103515245u + 12345u;
+            order[i] = (seed >> 8) % count;
+        }
+
+        double t0 = now();
+        long found = 0;
+        for (int i = 0; i < LOOKUPS; i++)
+            found += scope_find(func, names[order[i]]) != NULL;
+        double hash_ns = (now() - t0) * 1e9 / LOOKUPS;
+
+        if (found != LOOKUPS) {
+            fprintf(stderr, "lookup failed\n");
+            return 1;
+        }
+
+        // the old scan gets too slow past 10k, only time a slice of it
+        char linear[32] = "-";
+        if (count <= 10000) {
+            int n = LOOKUPS / count;
+            volatile long sink = 0;
+            t0 = now();
+            for (int i = 0; i < n; i++)
+                sink += linear_find(names, count, names[order[i]]);
+            snprintf(linear, sizeof(linear), "%.1f", (now() - t0) * 1e9 / n);
+        }
+
+        printf("%10d %14.1f %14s\n", count, hash_ns, linear);
+
+        free(order);
+        free(names);
+        arena_free(&arena);
+    }
+    return 0;
+}
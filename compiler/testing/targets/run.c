@@ -0,0 +1,93 @@
+// the same programs through every backend: compile time, code size, and
+// run time wherever the host can execute the result, natively or under
+// qemu-user with a cross toolchain (aarch64-linux-gnu-gcc + qemu-aarch64)
+// clang -O2 run.c -o run && ./run [--runs N] [program.n ...]
+#define WORK_DIR "/tmp/nevo-targets"
+#include "../common.h"
+
+typedef struct {
+    const char *name;
+    const char *cross_cc;   // assembler/linker driver when not on the host
+    const char *emulator;   // runs it when not on the host
+} TargetInfo;
+
+static const TargetInfo targets[] = {
+    { "arm64-macos",   NULL,                    NULL },
+    { "aarch64-linux", "aarch64-linux-gnu-gcc", "qemu-aarch64" },
+    { "x86_64-linux",  "x86_64-linux-gnu-gcc",  "qemu-x86_64" },
+};
+#define TARGET_COUNT (int)(sizeof(targets) / sizeof(targets[0]))
+
+static void bench(const char *path, int runs) {
+    printf("%s\n", path);
+    printf("  %-14s %12s %12s %12s %12s\n", "target", "compile ms", "asm bytes", "instructions", "run ms");
+
+    const char *reference = NULL;
+    for (int t = 0; t < TARGET_COUNT; t++) {
+        const TargetInfo *ti = &targets[t];
+        char flag[64], asm_path[256], exe_path[256], out_path[256];
+        snprintf(flag, sizeof(flag), "--target=%s", ti->name);
+        snprintf(asm_path, sizeof(asm_path), WORK_DIR "/%s.s", ti->name);
+        snprintf(exe_path, sizeof(exe_path), WORK_DIR "/%s", ti->name);
+        snprintf(out_path, sizeof(out_path), WORK_DIR "/%s.out", ti->name);
+
+        char *compile[] = { WORK_DIR "/compiler", flag, (char *)path, asm_path, NULL };
+        double best = best_of(compile, "/dev/null", runs);
+        if (best < 0) {
+            printf("  %-14s %12s\n", ti->name, "failed");
+            continue;
+        }
+
+        size_t len;
+        char *text = read_file(asm_path, &len);
+        long ins = text ? count_instructions(text, len) : 0;
+        free(text);
+        printf("  %-14s %12.2f %12zu %12ld", ti->name, best * 1e3, len, ins);
+
+        // the host's own target runs directly, others need a cross
+        // toolchain and an emulator
+        bool native = strcmp(ti->name, HOST_TARGET) == 0;
+        if (!native && !(ti->cross_cc && in_path(ti->cross_cc) && in_path(ti->emulator))) {
+            printf(" %12s\n", "-");
+            continue;
+        }
+        char *build[] = { WORK_DIR "/compiler", flag, (char *)path, exe_path, NULL };
+        char *native_prog[] = { exe_path, NULL };
+        char *emulated_prog[] = { (char *)ti->emulator, exe_path, NULL };
+        char **prog = native ? native_prog : emulated_prog;
+        char *host_cc = getenv("CC") ? strdup(getenv("CC")) : NULL;
+        if (!native) setenv("CC", ti->cross_cc, 1);
+        bool built = run(build, "/dev/null") >= 0;
+        if (host_cc) setenv("CC", host_cc, 1);
+        else unsetenv("CC");
+        free(host_cc);
+        double run_best = built ? best_of(prog, out_path, runs) : -1;
+        if (run_best < 0) {
+            printf(" %12s\n", "failed");
+            continue;
+        }
+        printf(" %12.2f", run_best * 1e3);
+        if (reference && !same_file(reference, out_path)) printf("  output differs from %s", reference);
+        printf("\n");
+        if (!reference) reference = strdup(out_path);
+    }
+    fflush(stdout);
+}
+
+int main(int argc, char **argv) {
+    int runs;
+    int first = parse_runs(argc, argv, &runs);
+    if (first < 0) return 1;
+
+    build_compiler(WORK_DIR);
+
+    if (first < argc) {
+        for (int i = first; i < argc; i++) bench(argv[i], runs);
+        return 0;
+    }
+
+    write_program(WORK_DIR "/kernel.n", kernel);
+    bench("../../test.n", runs);
+    bench(WORK_DIR "/kernel.n", runs);
+    return 0;
+}
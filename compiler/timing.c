@@ -0,0 +1,250 @@
+#include <stdio.h>
+#include <string.h>
+#include <time.h>
+#include <pthread.h>
+
+#include "timing.h"
+#include "mem.h"
+
+_Thread_local bool timing_enabled = false;
+
+typedef struct {
+    bool ran;
+    double wall;        // seconds
+    double cpu;         // seconds
+    size_t peak;        // bytes
+} PhaseStats;
+
+static const char *const phase_names[PHASE_COUNT] = {
+    "transpile", "lex", "parse", "codegen", "emit", "assemble", "link",
+};
+
+static PhaseStats stats[PHASE_COUNT];
+static double run_start;
+
+// open phases, innermost last
+static struct {
+    Phase phase;
+    double since;       // when this phase last got the clock back
+    size_t outer_peak;  // enclosing peak, restored when the phase ends
+} stack[PHASE_COUNT];
+static int depth = 0;
+
+// Reading the CPU clock is a syscall, far too slow to do per line, so it
+// is only read around the outermost phase. Its CPU time is then shared
+// out between that phase and the ones nested in it by wall time.
+static double span_wall[PHASE_COUNT];
+static double span_start;
+static double span_cpu_start;
+
+// Workers keep the same books for themselves, on their own CPU clock,
+// and add them to worker_cpu when their outermost phase ends. Nothing
+// there is more than two deep (lex inside parse).
+static bool workers_timed = false;
+static _Thread_local int thread_depth;
+static _Thread_local Phase thread_outer;
+static _Thread_local double thread_since;
+static _Thread_local double thread_wall[PHASE_COUNT];
+static _Thread_local double thread_start;
+static _Thread_local double thread_cpu_start;
+static double worker_cpu[PHASE_COUNT];
+static pthread_mutex_t worker_lock = PTHREAD_MUTEX_INITIALIZER;
+
+double timing_now(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+static double cpu_now(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_PROCESS_CPUTIME_ID, &ts);
+    return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+static double thread_cpu_now(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_THREAD_CPUTIME_ID, &ts);
+    return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+void timing_start(void) {
+    timing_enabled = true;
+    workers_timed = true;
+    run_start = timing_now();
+}
+
+static void worker_begin(Phase p) {
+    double now = timing_now();
+    if (thread_depth++ > 0) {
+        thread_wall[thread_outer] += now - thread_since;
+    } else {
+        memset(thread_wall, 0, sizeof(thread_wall));
+        thread_outer = p;
+        thread_start = now;
+        thread_cpu_start = thread_cpu_now();
+    }
+    thread_since = now;
+}
+
+static void worker_end(Phase p) {
+    double now = timing_now();
+    thread_wall[p] += now - thread_since;
+    thread_since = now;
+    if (--thread_depth > 0) return;
+
+    double wall = now - thread_start;
+    double cpu = thread_cpu_now() - thread_cpu_start;
+    pthread_mutex_lock(&worker_lock);
+    for (int i = 0; i < PHASE_COUNT; i++)
+        if (thread_wall[i] > 0 && wall > 0) worker_cpu[i] += cpu * thread_wall[i] / wall;
+    pthread_mutex_unlock(&worker_lock);
+}
+
+void timing_begin(Phase p) {
+    if (!timing_enabled) {
+        if (workers_timed) worker_begin(p);
+        return;
+    }
+
+    double now = timing_now();
+    if (depth > 0) {
+        // pause the enclosing phase
+        span_wall[stack[depth - 1].phase] += now - stack[depth - 1].since;
+    } else {
+        memset(span_wall, 0, sizeof(span_wall));
+        span_start = now;
+        span_cpu_start = cpu_now();
+    }
+
+    stack[depth].phase = p;
+    stack[depth].since = now;
+    stack[depth].outer_peak = mem_peak();
+    depth++;
+
+    mem_set_peak(mem_live());
+    stats[p].ran = true;
+}
+
+void timing_end(Phase p) {
+    if (!timing_enabled) {
+        if (workers_timed) worker_end(p);
+        return;
+    }
+
+    double now = timing_now();
+    depth--;
+    span_wall[p] += now - stack[depth].since;
+
+    size_t peak = mem_peak();
+    if (peak > stats[p].peak) stats[p].peak = peak;
+    mem_set_peak(peak > stack[depth].outer_peak ? peak : stack[depth].outer_peak);
+
+    if (depth > 0) {
+        // resume the enclosing phase
+        stack[depth - 1].since = now;
+        return;
+    }
+
+    double wall = now - span_start;
+    double cpu = cpu_now() - span_cpu_start;
+    for (int i = 0; i < PHASE_COUNT; i++) {
+        if (span_wall[i] == 0) continue;
+        stats[i].wall += span_wall[i];
+        stats[i].cpu += wall > 0 ? cpu * span_wall[i] / wall : 0;
+    }
+
+    // The workers ran inside p. Their CPU time is part of what the
+    // process clock just gave p; the phases other than p take theirs,
+    // and a share of p's wall time in the same proportion.
+    double given = wall > 0 ? cpu * span_wall[p] / wall : 0;
+    for (int i = 0; i < PHASE_COUNT; i++) {
+        double t = worker_cpu[i];
+        worker_cpu[i] = 0;
+        if (i == (int)p || t == 0 || given <= 0) continue;
+        if (t > stats[p].cpu) t = stats[p].cpu;
+        double share = span_wall[p] * t / given;
+        stats[i].ran = true;
+        stats[i].cpu += t;
+        stats[i].wall += share;
+        stats[p].cpu -= t;
+        stats[p].wall -= share;
+    }
+}
+
+static double tv_seconds(struct timeval tv) {
+    return tv.tv_sec + tv.tv_usec / 1e6;
+}
+
+// ru_maxrss is in kilobytes on Linux and bytes on macOS
+static size_t maxrss_bytes(const struct rusage *ru) {
+#ifdef __APPLE__
+    return (size_t)ru->ru_maxrss;
+#else
+    return (size_t)ru->ru_maxrss * 1024;
+#endif
+}
+
+void timing_add_child(Phase p, double wall, const struct rusage *ru) {
+    if (!timing_enabled) return;
+
+    stats[p].ran = true;
+    stats[p].wall += wall;
+    stats[p].cpu += tv_seconds(ru->ru_utime) + tv_seconds(ru->ru_stime);
+    size_t peak = maxrss_bytes(ru);
+    if (peak > stats[p].peak) stats[p].peak = peak;
+}
+
+static void json_string(FILE *out, const char *s) {
+    fputc('"', out);
+    for (; *s; s++) {
+        unsigned char c = (unsigned char)*s;
+        if (c == '"' || c == '\\') fprintf(out, "\\%c", c);
+        else if (c < 0x20) fprintf(out, "\\u%04x", c);
+        else fputc(c, out);
+    }
+    fputc('"', out);
+}
+
+void timing_report(FILE *out, const char *input, bool json) {
+    struct rusage self, children;
+    getrusage(RUSAGE_SELF, &self);
+    getrusage(RUSAGE_CHILDREN, &children);
+
+    double total_wall = timing_now() - run_start;
+    double total_cpu = tv_seconds(self.ru_utime) + tv_seconds(self.ru_stime) +
+                       tv_seconds(children.ru_utime) + tv_seconds(children.ru_stime);
+    size_t total_peak = mem_peak();
+
+    if (json) {
+        fprintf(out, "{\n  \"input\": ");
+        json_string(out, input);
+        fprintf(out, ",\n  \"phases\": [\n");
+        for (int i = 0; i < PHASE_COUNT; i++) {
+            const PhaseStats *s = &stats[i];
+            fprintf(out, "    {\"name\": \"%s\", \"ran\": %s, \"wall_ms\": %.3f, "
+                         "\"cpu_ms\": %.3f, \"peak_bytes\": %zu}%s\n",
+                    phase_names[i], s->ran ? "true" : "false",
+                    s->wall * 1e3, s->cpu * 1e3, s->peak,
+                    i + 1 < PHASE_COUNT ? "," : "");
+        }
+        fprintf(out, "  ],\n  \"total\": {\"wall_ms\": %.3f, \"cpu_ms\": %.3f, "
+                     "\"peak_bytes\": %zu}\n}\n",
+                total_wall * 1e3, total_cpu * 1e3, total_peak);
+        return;
+    }
+
+    fprintf(out, "===== time report: %s =====\n", input);
+    fprintf(out, "%-10s %12s %12s %14s\n", "phase", "wall ms", "cpu ms", "peak bytes");
+    for (int i = 0; i < PHASE_COUNT; i++) {
+        const PhaseStats *s = &stats[i];
+        if (!s->ran) {
+            fprintf(out, "%-10s %12s %12s %14s\n", phase_names[i], "-", "-", "-");
+            continue;
+        }
+        fprintf(out, "%-10s %12.3f %12.3f %14zu\n",
+                phase_names[i], s->wall * 1e3, s->cpu * 1e3, s->peak);
+    }
+    fprintf(out, "%-10s %12.3f %12.3f %14zu\n", "total", total_wall * 1e3, total_cpu * 1e3, total_peak);
+    fprintf(out, "peak bytes are live compiler heap, or max RSS for assemble and link\n");
+}
@@ -0,0 +1,42 @@
+#ifndef TIMING_H
+#define TIMING_H
+
+#include <stdio.h>
+#include <stdbool.h>
+#include <sys/resource.h>
+
+// Per-phase wall time, CPU time and peak heap bytes for --time-report.
+typedef enum {
+    PHASE_TRANSPILE,
+    PHASE_LEX,
+    PHASE_PARSE,
+    PHASE_CODEGEN,
+    PHASE_EMIT,
+    PHASE_ASSEMBLE,
+    PHASE_LINK,
+    PHASE_COUNT
+} Phase;
+
+// The thread that called timing_start records every phase. With more
+// than one job, lexing runs on the parse workers instead: each times its
+// own, inside a parse of its share, and the totals are taken out of the
+// main thread's parse when that ends.
+extern _Thread_local bool timing_enabled;
+
+// Start the clock for the whole run, turns timing on for this thread.
+void timing_start(void);
+
+// Phases nest: lex runs one line at a time from inside parse, and its
+// time is taken out of parse's. Both are no-ops unless timing is on.
+void timing_begin(Phase p);
+void timing_end(Phase p);
+
+// assemble and link run as child processes, their usage comes from wait4
+void timing_add_child(Phase p, double wall, const struct rusage *ru);
+
+// wall clock in seconds
+double timing_now(void);
+
+void timing_report(FILE *out, const char *input, bool json);
+
+#endif // TIMING_H
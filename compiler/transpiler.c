@@ -3,196 +3,254 @@
 #include <stdlib.h>
 #include <ctype.h>
 
-#define LINE_MAX_LEN 1024
+#include "transpiler.h"
+#include "mem.h"
 
-char current_func[64] = "";
+/* Lines are handled as [line, end) slices of the source buffer,
+   nothing is copied or modified in place. */
+
+static char *current_func = NULL;    // grows to fit the longest function name
+static size_t current_func_cap = 0;
+static int depth = 0;                // brace depth inside the current function
+
+static void set_current_func(const char *name, size_t len)
+{
+    if (len + 1 > current_func_cap)
+    {
+        current_func_cap = len + 1 > 64 ? len + 1 : 64;
+        current_func = xrealloc(current_func, current_func_cap);
+    }
+    memcpy(current_func, name, len);
+    current_func[len] = '\0';
+}
 
 /* Trim leading whitespace */
-char *ltrim(char *s)
+static const char *ltrim(const char *s, const char *end)
 {
-    while (isspace(*s))
+    while (s < end && isspace((unsigned char)*s))
         s++;
     return s;
 }
 
 /* Check if line starts with keyword */
-int starts_with(const char *line, const char *kw)
+static int starts_with(const char *line, const char *end, const char *kw)
 {
-    return strncmp(line, kw, strlen(kw)) == 0;
+    size_t n = strlen(kw);
+    return (size_t)(end - line) >= n && strncmp(line, kw, n) == 0;
+}
+
+/* Check if line (ignoring trailing whitespace) ends with c */
+static int ends_with(const char *line, const char *end, char c)
+{
+    while (end > line && isspace((unsigned char)end[-1]))
+        end--;
+    return end > line && end[-1] == c;
 }
 
 /* Extract function name from a line like:
    name(params) {
    or func name(params) {
 */
-void parse_func_name(char *line)
+static void parse_func_name(const char *line, const char *end)
 {
-    char *p = ltrim(line);
+    const char *p = ltrim(line, end);
 
     // If starts with 'func ', skip it
-    if (starts_with(p, "func "))
+    if (starts_with(p, end, "func "))
     {
         p += 5; // skip 'func '
     }
 
     // Extract function name until '(' or whitespace
-    int i = 0;
-    while (*p && *p != '(' && !isspace(*p) && i < 63)
-    {
-        current_func[i++] = *p++;
-    }
-    current_func[i] = '\0';
+    size_t len = 0;
+    while (p + len < end && p[len] != '(' && !isspace((unsigned char)p[len]))
+        len++;
+    set_current_func(p, len);
 }
 
 /* Detect function definitions even without 'func' */
-int is_func_def(char *line)
+static int is_func_def(const char *line, const char *end)
 {
-    char *t = ltrim(line);
+    const char *t = ltrim(line, end);
 
     // Skip empty lines or lines starting with non-letters/underscore
-    if (!isalpha(t[0]) && t[0] != '_')
+    if (t == end || (!isalpha((unsigned char)t[0]) && t[0] != '_'))
         return 0;
 
     // Look for '(' in the line
-    char *paren = strchr(t, '(');
-    if (!paren)
+    if (!memchr(t, '(', end - t))
         return 0;
 
     // Check that there is a '{' after ')'
-    char *brace = strchr(t, '{');
-    if (!brace)
+    if (!memchr(t, '{', end - t))
         return 0;
 
     return 1;
 }
 
 /* Replace $x with func_var_x or x */
-void replace_var_refs(char *line, FILE *out)
+static void replace_var_refs(const char *s, const char *end, Emitter *out)
 {
-    for (int i = 0; line[i]; i++)
+    while (s < end)
     {
-        if (line[i] == '$')
+        const char *dollar = memchr(s, '$', end - s);
+        if (!dollar)
         {
-            i++;
-            char var[64];
-            int j = 0;
-
-            while (isalnum(line[i]) || line[i] == '_')
-            {
-                var[j++] = line[i++];
-            }
-            var[j] = '\0';
-            i--;
-
-            if (current_func[0])
-            {
-                fprintf(out, "%s_var_%s", current_func, var);
-            }
-            else
-            {
-                fprintf(out, "%s", var);
-            }
+            emit_textn(out, s, end - s);
+            return;
         }
-        else
+
+        // everything before the '$' goes out as-is
+        emit_textn(out, s, dollar - s);
+
+        const char *name = dollar + 1;
+        s = name;
+        while (s < end && (isalnum((unsigned char)*s) || *s == '_'))
+            s++;
+
+        if (current_func[0])
         {
-            fputc(line[i], out);
+            emit_text(out, current_func);
+            emit_text(out, "_var_");
         }
+        emit_textn(out, name, s - name);
     }
 }
 
 /* Handle scoped var while preserving indentation */
-void transpile_line(char *line, FILE *out)
+static void transpile_line(const char *line, const char *end, Emitter *out)
 {
     // Count leading spaces/tabs
-    int indent_len = 0;
-    while (line[indent_len] == ' ' || line[indent_len] == '\t')
-        indent_len++;
+    const char *t = line;
+    while (t < end && (*t == ' ' || *t == '\t'))
+        t++;
 
-    char *t = line + indent_len;
+    // Print original indentation
+    emit_textn(out, line, t - line);
 
-    if (starts_with(t, "scoped num "))
+    if (starts_with(t, end, "scoped num "))
     {
-        char *rest = t + 11; // after "scoped num "
-
-        // Print original indentation
-        for (int i = 0; i < indent_len; i++)
-            fputc(line[i], out);
+        const char *rest = t + 11; // after "scoped num "
 
         if (current_func[0])
         {
-            fprintf(out, "num %s_var_", current_func);
-            replace_var_refs(rest, out);
+            emit_text(out, "num ");
+            emit_text(out, current_func);
+            emit_text(out, "_var_");
         }
         else
         {
-            fprintf(out, "num ");
-            replace_var_refs(rest, out);
+            emit_text(out, "num ");
         }
-        fputc('\n', out);
+        replace_var_refs(rest, end, out);
         return;
     }
-    if (starts_with(t, "jump "))
+    if (starts_with(t, end, "jump "))
     {
-        char *rest = t + 5; // skip "bl "
+        const char *rest = t + 5; // skip "jump "
 
-        // preserve indentation
-        for (int i = 0; i < indent_len; i++)
-            fputc(line[i], out);
-
-        fprintf(out, "bl ");
-        replace_var_refs(rest, out);
-        fputc('\n', out);
+        emit_text(out, "bl ");
+        replace_var_refs(rest, end, out);
         return;
     }
 
-    // Print line with $ replaced (with indentation preserved)
-    for (int i = 0; i < indent_len; i++)
-        fputc(line[i], out);
-    replace_var_refs(line + indent_len, out);
+    // Print line with $ replaced
+    replace_var_refs(t, end, out);
 }
 
-int main(int argc, char **argv)
+/* Does the source use anything the transpiler rewrites?
+   Plain nevo can go straight to the compiler without a copy. */
+int transpile_needed(const char *src, size_t len)
 {
-    if (argc != 3)
-    {
-        printf("Usage: %s <input> <output>\n", argv[0]);
+    if (memchr(src, '$', len))
         return 1;
-    }
-
-    FILE *in = fopen(argv[1], "r");
-    FILE *out = fopen(argv[2], "w");
 
-    if (!in || !out)
+    static const char *const words[] = { "scoped num ", "jump " };
+    for (size_t w = 0; w < sizeof(words) / sizeof(words[0]); w++)
     {
-        printf("File error\n");
-        return 1;
+        size_t n = strlen(words[w]);
+        for (const char *p = src; (p = memchr(p, words[w][0], len - (p - src))) != NULL; p++)
+        {
+            if ((size_t)(src + len - p) >= n && memcmp(p, words[w], n) == 0)
+                return 1;
+        }
     }
+    return 0;
+}
+
+/* Run the whole transpile stage over a source buffer.
+   The compiler calls this directly and lexes the result straight
+   out of memory, so there is no temp file and no child process. */
+void transpile_buffer(const char *src, size_t len, Emitter *out)
+{
+    const char *p = src;
+    const char *src_end = src + len;
 
-    char line[LINE_MAX_LEN];
+    set_current_func("", 0);
+    depth = 0;
 
-    while (fgets(line, sizeof(line), in))
+    while (p < src_end)
     {
-        char *t = ltrim(line);
+        // one line, including its newline
+        const char *nl = memchr(p, '\n', src_end - p);
+        const char *end = nl ? nl + 1 : src_end;
+        const char *t = ltrim(p, end);
 
         // Detect function definition (with or without 'func')
-        if (starts_with(t, "func ") || is_func_def(t))
+        if (depth == 0 && (starts_with(t, end, "func ") || is_func_def(t, end)))
         {
-            parse_func_name(t);
-            fputs(line, out);
+            parse_func_name(t, end);
+            depth = 1;
+            emit_textn(out, p, end - p);
+            p = end;
             continue;
         }
 
-        if (starts_with(t, "}"))
-        {
-            current_func[0] = '\0';
-            fputs(line, out);
-            continue;
-        }
+        // only the '}' that closes the function ends its scope
+        if (starts_with(t, end, "}") && depth > 0 && --depth == 0)
+            set_current_func("", 0);
+        if (current_func[0] && ends_with(t, end, '{'))
+            depth++;
+
+        transpile_line(p, end, out);
+        p = end;
+    }
+}
+
+#ifdef TRANSPILER_STANDALONE
+#include <fcntl.h>
+#include <unistd.h>
+
+#include "source.h"
+
+int main(int argc, char **argv)
+{
+    if (argc != 3)
+    {
+        printf("Usage: %s <input> <output>\n", argv[0]);
+        return 1;
+    }
+
+    SourceFile in;
+    int out = open(argv[2], O_WRONLY | O_CREAT | O_TRUNC, 0644);
+
+    if (!load_source(argv[1], &in) || out < 0)
+    {
+        printf("File error\n");
+        return 1;
+    }
 
-        transpile_line(line, out);
+    Emitter buf = {0};
+    transpile_buffer(in.data, in.len, &buf);
+    if (emit_write(&buf, out) != 0)
+    {
+        printf("File error\n");
+        return 1;
     }
 
-    fclose(in);
-    fclose(out);
+    emit_free(&buf);
+    free_source(&in);
+    close(out);
     return 0;
 }
+#endif
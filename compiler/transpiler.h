@@ -0,0 +1,12 @@
+#ifndef TRANSPILER_H
+#define TRANSPILER_H
+
+#include <stddef.h>
+
+#include "emit.h"
+
+// advanced nevo (scoped num, $var, jump) -> simpler nevo for the compiler
+int transpile_needed(const char *src, size_t len);
+void transpile_buffer(const char *src, size_t len, Emitter *out);
+
+#endif // TRANSPILER_H